@@ -421,6 +421,10 @@ SOURCE=.\memcache\apr_memcache.c
 
 SOURCE=.\memory\unix\apr_pools.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\memory\unix\apr_slab.c
+# End Source File
 # End Group
 # Begin Group "misc"
 
@@ -652,10 +656,26 @@ SOURCE=.\strmatch\apr_strmatch.c
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=.\tables\apr_bloom.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_btree.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_chash.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\tables\apr_hash.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\tables\apr_ohash.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\tables\apr_tables.c
 # End Source File
 # Begin Source File
@@ -742,6 +762,10 @@ SOURCE=.\util-misc\apr_rmm.c
 
 SOURCE=.\util-misc\apr_thread_pool.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\util-misc\apr_timer_wheel.c
+# End Source File
 # End Group
 # Begin Group "xlate"
 
@@ -882,6 +906,18 @@ SOURCE=.\include\apr_atomic.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_bloom.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_btree.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_chash.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_dso.h
 # End Source File
 # Begin Source File
@@ -938,6 +974,10 @@ SOURCE=.\include\apr_network_io.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_ohash.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_poll.h
 # End Source File
 # Begin Source File
@@ -974,6 +1014,10 @@ SOURCE=.\include\apr_skiplist.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_slab.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_strings.h
 # End Source File
 # Begin Source File
@@ -1006,6 +1050,10 @@ SOURCE=.\include\apr_time.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_timer_wheel.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_user.h
 # End Source File
 # Begin Source File
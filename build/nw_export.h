@@ -14,6 +14,9 @@
 #include "apr_anylock.h"
 #include "apr_atomic.h"
 #include "apr_base64.h"
+#include "apr_bloom.h"
+#include "apr_btree.h"
+#include "apr_chash.h"
 #include "apr_buckets.h"
 #include "apr_date.h"
 #include "apr_dbd.h"
@@ -38,6 +41,7 @@
 #include "apr_memcache.h"
 #include "apr_mmap.h"
 #include "apr_network_io.h"
+#include "apr_ohash.h"
 #include "apr_optional.h"
 #include "apr_optional_hooks.h"
 #include "apr_poll.h"
@@ -54,6 +58,7 @@
 #include "apr_shm.h"
 #include "apr_signal.h"
 #include "apr_skiplist.h"
+#include "apr_slab.h"
 #include "apr_strings.h"
 #include "apr_strmatch.h"
 #include "apr_support.h"
@@ -64,6 +69,7 @@
 #include "apr_thread_proc.h"
 #include "apr_thread_rwlock.h"
 #include "apr_time.h"
+#include "apr_timer_wheel.h"
 #include "apr_uri.h"
 #include "apr_user.h"
 #include "apr_uuid.h"
@@ -42,6 +42,12 @@ typedef struct apr_allocator_t apr_allocator_t;
 /** the structure which holds information about the allocation */
 typedef struct apr_memnode_t apr_memnode_t;
 
+#ifndef APR_INTERVAL_TIME_T_DEFINED
+#define APR_INTERVAL_TIME_T_DEFINED
+/** intervals in microseconds, as in apr_time.h which includes this file */
+typedef apr_int64_t apr_interval_time_t;
+#endif
+
 /** basic memory node structure
  * @note The next, ref and first_avail fields are available for use by the
  *       caller of apr_allocator_alloc(), the remaining fields are read-only.
@@ -66,6 +72,31 @@ struct apr_memnode_t {
 /** Symbolic constants */
 #define APR_ALLOCATOR_MAX_FREE_UNLIMITED 0
 
+/**
+ * @defgroup apr_allocator_flags Allocator creation flags
+ * @{
+ */
+/**
+ * Put a per-thread cache of recently freed nodes in front of the shared
+ * free lists, so that most allocations and frees by a thread do not take
+ * the allocator mutex.  Only useful for allocators shared by several
+ * threads; ignored when APR is built without thread support.
+ */
+#define APR_ALLOCATOR_THREAD_CACHE  0x01
+/**
+ * Carve the nodes out of 2MB regions backed by huge pages (MAP_HUGETLB
+ * when pages are reserved, transparent huge pages otherwise), to reduce
+ * TLB misses for long-lived pools.  Nodes larger than a quarter region
+ * get a mapping of their own, rounded up to the region size only when
+ * backed by reserved huge pages.  Carved nodes are never unmapped before
+ * the allocator is destroyed; the memory of those above
+ * apr_allocator_max_free_set() is handed back to the system with madvise()
+ * instead, in whole huge pages for reserved ones.  Ignored where mmap() is
+ * not available.
+ */
+#define APR_ALLOCATOR_HUGE_PAGES    0x02
+/** @} */
+
 /**
  * Create a new allocator
  * @param allocator The allocator we have just created.
@@ -74,6 +105,57 @@ struct apr_memnode_t {
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
                           __attribute__((nonnull(1)));
 
+/**
+ * Create a new allocator with the given behaviour
+ * @param allocator The allocator we have just created.
+ * @param flags A bitwise OR of the @ref apr_allocator_flags, or 0 to get
+ *        the same allocator as apr_allocator_create().
+ * @remark The thread caches hold at most a few hundred KB each in addition
+ *         to the limit set with apr_allocator_max_free_set().
+ */
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags)
+                          __attribute__((nonnull(1)));
+
+/** Bind to the NUMA node the calling thread is running on */
+#define APR_ALLOCATOR_NUMA_CURRENT (-1)
+/** Allocate from whichever NUMA node the calling thread is running on */
+#define APR_ALLOCATOR_NUMA_LOCAL   (-2)
+
+/**
+ * Create a new allocator whose memory is bound to a NUMA node
+ * @param allocator The allocator we have just created.
+ * @param numa_node The node to bind to, APR_ALLOCATOR_NUMA_CURRENT, or
+ *        APR_ALLOCATOR_NUMA_LOCAL.
+ * @param flags A bitwise OR of the @ref apr_allocator_flags.
+ * @return APR_EINVAL if the node does not exist or has no memory,
+ *         APR_ENOTIMPL where NUMA binding is not supported.
+ * @remark The nodes are carved out of regions (see APR_ALLOCATOR_HUGE_PAGES)
+ *         which prefer the given node, falling back to other nodes when it
+ *         runs out of memory.
+ * @remark With APR_ALLOCATOR_NUMA_LOCAL, the allocator keeps separate free
+ *         lists and regions per node, and serves each allocation from the
+ *         node the calling thread is running on.  Nodes given back go to
+ *         the lists of the node they were carved for, whichever thread
+ *         frees them; the nodes too large to be carved (over 512KB) are
+ *         given back to the system rather than kept.
+ * @remark Pools created with this allocator, and their subpools created
+ *         with apr_pool_create() or with a NULL allocator, allocate from
+ *         the bound node (or the local one).
+ */
+APR_DECLARE(apr_status_t) apr_allocator_create_numa(apr_allocator_t **allocator,
+                                                    int numa_node,
+                                                    apr_uint32_t flags)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Get the NUMA node the calling thread is currently running on
+ * @param numa_node The node number
+ * @return APR_ENOTIMPL where this cannot be determined.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_numa_node_current(int *numa_node)
+                          __attribute__((nonnull(1)));
+
 /**
  * Destroy an allocator
  * @param allocator The allocator to be destroyed
@@ -128,6 +210,15 @@ APR_DECLARE(void) apr_allocator_owner_set(apr_allocator_t *allocator,
 APR_DECLARE(apr_pool_t *) apr_allocator_owner_get(apr_allocator_t *allocator)
                           __attribute__((nonnull(1)));
 
+/**
+ * Get the NUMA node the allocator is bound to
+ * @param allocator The allocator
+ * @return The node, APR_ALLOCATOR_NUMA_LOCAL, or -1 if the allocator was
+ *         not created with apr_allocator_create_numa().
+ */
+APR_DECLARE(int) apr_allocator_numa_node_get(apr_allocator_t *allocator)
+                 __attribute__((nonnull(1)));
+
 /**
  * Set the current threshold at which the allocator should start
  * giving blocks back to the system.
@@ -138,6 +229,99 @@ APR_DECLARE(void) apr_allocator_max_free_set(apr_allocator_t *allocator,
                                              apr_size_t size)
                   __attribute__((nonnull(1)));
 
+/**
+ * @defgroup apr_allocator_decay_flags Decay trimming flags
+ * @{
+ */
+/**
+ * Trim the allocator from a background thread, every decay interval.
+ * The allocator must have a mutex, @see apr_allocator_mutex_set().
+ */
+#define APR_ALLOCATOR_DECAY_THREAD  0x01
+/** @} */
+
+/**
+ * Set the time after which unused free nodes may be given back to the
+ * system by apr_allocator_trim()
+ * @param allocator The allocator
+ * @param decay The idle time in microseconds, or 0 to have
+ *        apr_allocator_trim() give back all the free nodes (the default).
+ * @param flags A bitwise OR of the @ref apr_allocator_decay_flags, or 0
+ *        to leave the trimming to the caller.
+ * @return APR_EINVAL if a background thread is asked for an allocator
+ *         without a mutex, APR_ENOTIMPL if APR is built without thread
+ *         support, or the error of the thread creation.
+ * @remark Unlike apr_allocator_max_free_set(), which bounds the memory
+ *         kept at any time, this lets a burst of allocations be served
+ *         from the free lists while it lasts, and gives the memory back
+ *         once it is over.  Both can be used together.
+ * @remark Setting the decay again (with or without the flag) stops or
+ *         restarts the background thread as needed.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_decay_set(apr_allocator_t *allocator,
+                                                  apr_interval_time_t decay,
+                                                  apr_uint32_t flags)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Give back to the system the free nodes which were not used for at least
+ * the decay interval, @see apr_allocator_decay_set()
+ * @param allocator The allocator
+ * @return The number of bytes given back
+ * @remark The free lists are LIFO, so the nodes which stayed at their
+ *         bottom since the previous trim were not used meanwhile: those
+ *         are given back, unless the decay interval did not elapse since
+ *         then, in which case nothing is.
+ * @remark Nodes carved out of regions (@see APR_ALLOCATOR_HUGE_PAGES)
+ *         stay on the free lists, their pages are given back with
+ *         madvise().  The nodes held by the thread caches, which are
+ *         bounded, are not trimmed.
+ */
+APR_DECLARE(apr_size_t) apr_allocator_trim(apr_allocator_t *allocator)
+                        __attribute__((nonnull(1)));
+
+/** Allocator statistics, @see apr_allocator_stats_get() */
+typedef struct apr_allocator_stats_t {
+    /** Number of nodes taken from the system (malloc()ed or mapped) */
+    apr_uint64_t fresh_count;
+    /** Number of bytes taken from the system */
+    apr_uint64_t fresh_bytes;
+    /** Number of nodes recycled from the free lists or thread caches */
+    apr_uint64_t reuse_count;
+    /** Number of nodes given back to the allocator */
+    apr_uint64_t free_count;
+    /** Number of nodes handed back to the system, because of the
+     *  apr_allocator_max_free_set() limit or by apr_allocator_trim()
+     *  (including the nodes of regions whose pages were purged) */
+    apr_uint64_t release_count;
+    /** Number of bytes handed back to the system */
+    apr_uint64_t release_bytes;
+    /** Bytes currently held in the free lists and thread caches */
+    apr_size_t   free_bytes;
+    /** High-water mark of the bytes held in the free lists (not
+     *  counting the thread caches) */
+    apr_size_t   free_bytes_max;
+    /** Number of oversized nodes currently in the sink free list */
+    apr_size_t   sink_count;
+    /** Bytes currently held in the sink free list */
+    apr_size_t   sink_bytes;
+    /** Number of nodes of destroyed pools kept aside to hold new pools,
+     *  counted in free_bytes too */
+    apr_size_t   pool_cache_count;
+} apr_allocator_stats_t;
+
+/**
+ * Get the statistics of an allocator
+ * @param allocator The allocator
+ * @param stats Filled with the counters since the allocator was created
+ * @remark The counters are maintained under the allocator's mutex when
+ *         it is held anyway, in the thread caches, or with relaxed atomic
+ *         increments, so keeping them costs next to nothing.
+ */
+APR_DECLARE(void) apr_allocator_stats_get(apr_allocator_t *allocator,
+                                          apr_allocator_stats_t *stats)
+                  __attribute__((nonnull(1,2)));
+
 #include "apr_thread_mutex.h"
 
 #if APR_HAS_THREADS
@@ -0,0 +1,200 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_BLOOM_H
+#define APR_BLOOM_H
+
+/**
+ * @file apr_bloom.h
+ * @brief APR Bloom Filters
+ */
+
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_bloom Bloom Filters
+ * @ingroup APR
+ * A set of keys which can tell for sure that a key was never added, but
+ * only that it probably was otherwise, e.g. to skip looking up a cache or
+ * a database for keys known to be missing.  It takes a few bits per key
+ * (about 10 for a 1% false positive rate), whatever their length, and is
+ * sized once for an expected number of keys: adding more keys than that
+ * makes the false positives more frequent.  Keys cannot be removed.
+ *
+ * The filter is made of a single block of memory, without pointers, so
+ * it can be shared by processes in an apr_shm_t segment: one creates it
+ * with apr_bloom_make() in the segment, the others use it with
+ * apr_bloom_attach().  Adding and checking keys is then safe from any
+ * number of processes or threads at once, without locking.
+ * @{
+ */
+
+/**
+ * Abstract type for Bloom filters.
+ */
+typedef struct apr_bloom_t apr_bloom_t;
+
+/**
+ * Get the size of the memory for a Bloom filter.
+ * @param nelts The number of keys expected
+ * @param fp_rate The false positive rate wanted, between 0 and 1
+ *        exclusive (e.g. 0.01)
+ * @return The size in bytes, or 0 if the arguments are invalid or the
+ *         filter would have more than 2^32 bits
+ */
+APR_DECLARE(apr_size_t) apr_bloom_size(apr_size_t nelts, double fp_rate);
+
+/**
+ * Create a Bloom filter, allocated from a pool.
+ * @param bloom The new Bloom filter
+ * @param nelts The number of keys expected
+ * @param fp_rate The false positive rate wanted
+ * @param pool The pool to allocate the filter out of
+ * @return APR_SUCCESS, or APR_EINVAL, see apr_bloom_size()
+ */
+APR_DECLARE(apr_status_t) apr_bloom_create(apr_bloom_t **bloom,
+                                           apr_size_t nelts, double fp_rate,
+                                           apr_pool_t *pool)
+                          __attribute__((nonnull(1,4)));
+
+/**
+ * Create a Bloom filter in a given block of memory, e.g. that of an
+ * apr_shm_t.
+ * @param bloom The new Bloom filter
+ * @param mem The memory, aligned on 8 bytes
+ * @param size The size of @a mem
+ * @param nelts The number of keys expected
+ * @param fp_rate The false positive rate wanted
+ * @param pool The pool to allocate the filter's handle out of
+ * @return APR_SUCCESS, APR_EINVAL, see apr_bloom_size(), or APR_ENOSPC if
+ *         @a size is too small
+ */
+APR_DECLARE(apr_status_t) apr_bloom_make(apr_bloom_t **bloom, void *mem,
+                                         apr_size_t size, apr_size_t nelts,
+                                         double fp_rate, apr_pool_t *pool)
+                          __attribute__((nonnull(1,2,6)));
+
+/**
+ * Use a Bloom filter created by apr_bloom_make(), e.g. by another process.
+ * @param bloom The Bloom filter
+ * @param mem The memory it was made in (possibly mapped at another
+ *        address)
+ * @param pool The pool to allocate the filter's handle out of
+ * @return APR_SUCCESS, or APR_EINVAL if @a mem holds no Bloom filter
+ */
+APR_DECLARE(apr_status_t) apr_bloom_attach(apr_bloom_t **bloom, void *mem,
+                                           apr_pool_t *pool)
+                          __attribute__((nonnull(1,2,3)));
+
+/**
+ * Add a key to a Bloom filter.
+ * @param bloom The Bloom filter
+ * @param key The key
+ * @param klen The length of the key, or APR_HASH_KEY_STRING
+ * @return Non-zero if the key was new, zero if it was probably added
+ *         already
+ */
+APR_DECLARE(int) apr_bloom_add(apr_bloom_t *bloom, const void *key,
+                               apr_ssize_t klen)
+                 __attribute__((nonnull(1,2)));
+
+/**
+ * Check whether a key was added to a Bloom filter.
+ * @param bloom The Bloom filter
+ * @param key The key
+ * @param klen The length of the key, or APR_HASH_KEY_STRING
+ * @return Zero if the key was never added, non-zero if it probably was
+ */
+APR_DECLARE(int) apr_bloom_check(const apr_bloom_t *bloom, const void *key,
+                                 apr_ssize_t klen)
+                 __attribute__((nonnull(1,2)));
+
+/**
+ * Add keys to a Bloom filter.
+ * @param bloom The Bloom filter
+ * @param keys The keys
+ * @param klens The lengths of the keys, or NULL if they are all strings
+ * @param n The number of keys
+ * @remark This is faster than adding the keys one at a time, the memory
+ *         of several keys being fetched at once.
+ */
+APR_DECLARE(void) apr_bloom_add_batch(apr_bloom_t *bloom,
+                                      const void *const *keys,
+                                      const apr_ssize_t *klens, apr_size_t n)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Check whether keys were added to a Bloom filter.
+ * @param bloom The Bloom filter
+ * @param keys The keys
+ * @param klens The lengths of the keys, or NULL if they are all strings
+ * @param n The number of keys
+ * @param found Set to zero for each key never added, non-zero for those
+ *        probably added
+ * @return The number of keys probably added
+ * @remark This is faster than checking the keys one at a time, the memory
+ *         of several keys being fetched at once.
+ */
+APR_DECLARE(apr_size_t) apr_bloom_check_batch(const apr_bloom_t *bloom,
+                                              const void *const *keys,
+                                              const apr_ssize_t *klens,
+                                              apr_size_t n, char *found)
+                        __attribute__((nonnull(1,2,5)));
+
+/**
+ * Remove all the keys from a Bloom filter.
+ * @param bloom The Bloom filter
+ * @remark This is not atomic: the keys added meanwhile by other threads or
+ *         processes may be kept or not.
+ */
+APR_DECLARE(void) apr_bloom_clear(apr_bloom_t *bloom)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Get the number of keys added to a Bloom filter.
+ * @param bloom The Bloom filter
+ * @return The number of keys for which apr_bloom_add() returned non-zero,
+ *         which may be a little less than the number of distinct keys
+ */
+APR_DECLARE(apr_size_t) apr_bloom_count(const apr_bloom_t *bloom)
+                        __attribute__((nonnull(1)));
+
+/**
+ * Estimate the current false positive rate of a Bloom filter.
+ * @param bloom The Bloom filter
+ * @return The rate, from the number of keys and the size of the filter
+ */
+APR_DECLARE(double) apr_bloom_fp_rate(const apr_bloom_t *bloom)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Get a pointer to the pool which the Bloom filter's handle was created in
+ */
+APR_POOL_DECLARE_ACCESSOR(bloom);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_BLOOM_H */
@@ -0,0 +1,193 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_BTREE_H
+#define APR_BTREE_H
+
+/**
+ * @file apr_btree.h
+ * @brief APR B+trees
+ */
+
+#include "apr_pools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_btree B+trees
+ * @ingroup APR
+ * An ordered set of elements, as with @ref apr_skiplist: the elements are
+ * referenced (not copied) and ordered by a compare function, and there can
+ * be only one element comparing equal to a given one.  The elements are
+ * stored in wide leaves, chained in order, under wide internal nodes; all
+ * of them are a few cache lines long and come from a slab, so that a
+ * search takes few cache misses (besides those of the compare function)
+ * and an element costs little more than its pointer.
+ * @{
+ */
+
+/**
+ * Abstract type for B+trees.
+ */
+typedef struct apr_btree_t apr_btree_t;
+
+/**
+ * Abstract type for scanning B+trees.
+ */
+typedef struct apr_btree_index_t apr_btree_index_t;
+
+/**
+ * Function comparing two elements of a B+tree, or a key to an element.
+ * @param a The first element (the key when looking up)
+ * @param b The second element
+ * @return A negative value, zero or a positive value when a is less
+ *         than, equal to or greater than b.
+ */
+typedef int (apr_btree_compare_fn_t)(const void *a, const void *b);
+
+/**
+ * Create a B+tree.
+ * @param bt The new B+tree
+ * @param compare The compare function
+ * @param pool The pool to allocate the B+tree and its nodes out of
+ * @return APR_SUCCESS, or an error creating the slab of nodes
+ */
+APR_DECLARE(apr_status_t) apr_btree_create(apr_btree_t **bt,
+                                           apr_btree_compare_fn_t *compare,
+                                           apr_pool_t *pool)
+                          __attribute__((nonnull(1,2,3)));
+
+/**
+ * Find the element equal to a key.
+ * @param bt The B+tree
+ * @param key The key, passed as the first argument of the compare function
+ * @return The element, or NULL if none compares equal to @a key
+ */
+APR_DECLARE(void *) apr_btree_find(const apr_btree_t *bt, const void *key)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Find the first element not less than a key.
+ * @param bt The B+tree
+ * @param key The key, passed as the first argument of the compare function
+ * @return The element, or NULL if all are less than @a key
+ */
+APR_DECLARE(void *) apr_btree_lower_bound(const apr_btree_t *bt,
+                                          const void *key)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Insert an element in a B+tree.
+ * @param bt The B+tree
+ * @param elem The element
+ * @return @a elem, the element already in the tree comparing equal to
+ *         it (which is left in place), or NULL if out of memory
+ */
+APR_DECLARE(void *) apr_btree_insert(apr_btree_t *bt, void *elem)
+                    __attribute__((nonnull(1,2)));
+
+/**
+ * Remove the element equal to a key from a B+tree.
+ * @param bt The B+tree
+ * @param key The key, passed as the first argument of the compare function
+ * @return The element removed, or NULL if none compares equal to @a key
+ */
+APR_DECLARE(void *) apr_btree_remove(apr_btree_t *bt, const void *key)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Remove the least element of a B+tree.
+ * @param bt The B+tree
+ * @return The element removed, or NULL if the tree is empty
+ */
+APR_DECLARE(void *) apr_btree_pop_min(apr_btree_t *bt)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Start iterating over the elements of a B+tree, in order.
+ * @param p The pool to allocate the apr_btree_index_t iterator. If this
+ *          pool is NULL, then an internal, non-thread-safe iterator is used.
+ * @param bt The B+tree
+ * @return The iteration state, or NULL if the tree is empty
+ * @remark Inserting or removing elements invalidates the iterators.
+ */
+APR_DECLARE(apr_btree_index_t *) apr_btree_first(apr_pool_t *p,
+                                                 apr_btree_t *bt)
+                                 __attribute__((nonnull(2)));
+
+/**
+ * Start iterating over the elements of a B+tree, in order, from the first
+ * one not less than a key.
+ * @param p The pool to allocate the apr_btree_index_t iterator. If this
+ *          pool is NULL, then an internal, non-thread-safe iterator is used.
+ * @param bt The B+tree
+ * @param key The key, passed as the first argument of the compare function
+ * @return The iteration state, or NULL if all the elements are less than
+ *         @a key
+ * @remark To iterate over a range, stop at the first element not less
+ *         than its end.
+ */
+APR_DECLARE(apr_btree_index_t *) apr_btree_seek(apr_pool_t *p,
+                                                apr_btree_t *bt,
+                                                const void *key)
+                                 __attribute__((nonnull(2)));
+
+/**
+ * Continue iterating over the elements of a B+tree.
+ * @param bi The iteration state
+ * @return a pointer to the updated iteration state.  NULL if there are no more
+ *         elements.
+ */
+APR_DECLARE(apr_btree_index_t *) apr_btree_next(apr_btree_index_t *bi)
+                                 __attribute__((nonnull(1)));
+
+/**
+ * Get the current element from the iteration state.
+ * @param bi The iteration state
+ * @return The element
+ */
+APR_DECLARE(void *) apr_btree_this(apr_btree_index_t *bi)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Get the number of elements in a B+tree.
+ * @param bt The B+tree
+ * @return The number of elements
+ */
+APR_DECLARE(apr_size_t) apr_btree_count(const apr_btree_t *bt)
+                        __attribute__((nonnull(1)));
+
+/**
+ * Remove all the elements of a B+tree.
+ * @param bt The B+tree
+ */
+APR_DECLARE(void) apr_btree_clear(apr_btree_t *bt)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Get a pointer to the pool which the B+tree was created in
+ */
+APR_POOL_DECLARE_ACCESSOR(btree);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_BTREE_H */
@@ -0,0 +1,202 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_CHASH_H
+#define APR_CHASH_H
+
+/**
+ * @file apr_chash.h
+ * @brief APR Concurrent Hash Tables
+ */
+
+#include "apr_pools.h"
+#include "apr_hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_chash Concurrent Hash Tables
+ * @ingroup APR
+ * A hash table which several threads can use at once, e.g. for a process
+ * wide cache.  The entries are spread by their hash over stripes, each of
+ * them a small chained hash table behind its own read/write lock, so that
+ * threads working on different keys seldom meet on a lock (or on a cache
+ * line), and a stripe growing only stalls the users of that stripe.
+ *
+ * The entries come from a slab and the bucket arrays from an allocator,
+ * both private to the table, so that the memory of removed entries is
+ * reused and the table's pool does not grow with its churn.
+ *
+ * Keys and values are referenced, not copied, and the keys are compared
+ * with memcmp() as for apr_hash_t; APR_HASH_KEY_STRING may be passed as
+ * the key length.
+ * @{
+ */
+
+/**
+ * Abstract type for concurrent hash tables.
+ */
+typedef struct apr_chash_t apr_chash_t;
+
+/**
+ * Callback creating the value of a missing key, @see apr_chash_get_or_make()
+ * @param baton The baton passed to apr_chash_get_or_make()
+ * @param key Pointer to the key, which may be changed to point to a copy
+ *            living as long as the entry (the key passed to
+ *            apr_chash_get_or_make() may be a temporary)
+ * @param klen Length of the key
+ * @param val Return pointer for the value, the entry is not added if NULL
+ * @return APR_SUCCESS, or an error which apr_chash_get_or_make() returns
+ *         without adding the entry
+ */
+typedef apr_status_t (apr_chash_make_fn_t)(void *baton, const void **key,
+                                           apr_ssize_t klen, void **val);
+
+/**
+ * Create a concurrent hash table.
+ * @param ht The new hash table
+ * @param stripes The number of stripes, rounded up to a power of two (up
+ *        to 65536), or 0 for the default (64)
+ * @param hash_func A custom hash function, or NULL for the default one
+ * @param pool The pool to allocate the hash table out of
+ * @return APR_SUCCESS, or an error creating the locks or the allocator
+ * @remark There should be a few times more stripes than threads using the
+ *         table at once.  A stripe costs a lock, a cache line and, once it
+ *         holds more than a few entries, a memory node for its buckets.
+ */
+APR_DECLARE(apr_status_t) apr_chash_create(apr_chash_t **ht,
+                                           unsigned int stripes,
+                                           apr_hashfunc_t hash_func,
+                                           apr_pool_t *pool)
+                          __attribute__((nonnull(1,4)));
+
+/**
+ * Destroy a concurrent hash table before its pool is, giving its memory
+ * back.
+ * @param ht The hash table
+ */
+APR_DECLARE(void) apr_chash_destroy(apr_chash_t *ht)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Look up the value associated with a key in a hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @return Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_chash_get(apr_chash_t *ht, const void *key,
+                                  apr_ssize_t klen)
+                    __attribute__((nonnull(1,2)));
+
+/**
+ * Associate a value with a key in a hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @param val Value to associate with the key
+ * @param old_val Return pointer for the value previously associated with
+ *        the key (NULL if none), or NULL if not interesting
+ * @return APR_SUCCESS, APR_ENOMEM if the entry could not be allocated, or
+ *         APR_EINVAL if the key is longer than 4GB
+ * @remark If the value is NULL the hash entry is deleted.
+ */
+APR_DECLARE(apr_status_t) apr_chash_set(apr_chash_t *ht, const void *key,
+                                        apr_ssize_t klen, const void *val,
+                                        void **old_val)
+                          __attribute__((nonnull(1,2)));
+
+/**
+ * Remove a key from a hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @return The value that was associated with the key, or NULL if the key
+ *         was not present
+ */
+APR_DECLARE(void *) apr_chash_remove(apr_chash_t *ht, const void *key,
+                                     apr_ssize_t klen)
+                    __attribute__((nonnull(1,2)));
+
+/**
+ * Look up the value associated with a key in a hash table, creating it
+ * atomically if the key is not present.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @param make The function creating the value
+ * @param baton The first argument of @a make
+ * @param val Return pointer for the value, found or made
+ * @return APR_SUCCESS, the error returned by @a make, or APR_ENOMEM or
+ *         APR_EINVAL as for apr_chash_set()
+ * @remark @a make is called at most once, when the key is missing, with
+ *         the key's stripe locked: it must not use the hash table, and
+ *         should be quick since it blocks the other users of the stripe.
+ */
+APR_DECLARE(apr_status_t) apr_chash_get_or_make(apr_chash_t *ht,
+                                                const void *key,
+                                                apr_ssize_t klen,
+                                                apr_chash_make_fn_t *make,
+                                                void *baton, void **val)
+                          __attribute__((nonnull(1,2,4,6)));
+
+/**
+ * Iterate over a hash table running the provided function once for every
+ * element in the hash table.
+ * @param comp The function to run
+ * @param rec The data to pass as the first argument to the function
+ * @param ht The hash table to iterate over
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @see apr_hash_do_callback_fn_t
+ * @remark The stripes are read locked one at a time, each one being
+ *         consistent but the entries of the others may change meanwhile.
+ *         @a comp must not modify the hash table.
+ */
+APR_DECLARE(int) apr_chash_do(apr_hash_do_callback_fn_t *comp,
+                              void *rec, apr_chash_t *ht)
+                 __attribute__((nonnull(1,3)));
+
+/**
+ * Get the number of key/value pairs in the hash table.
+ * @param ht The hash table
+ * @return The number of key/value pairs in the hash table, as counted
+ *         stripe by stripe.
+ */
+APR_DECLARE(unsigned int) apr_chash_count(apr_chash_t *ht)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Clear any key/value pairs in the hash table.
+ * @param ht The hash table
+ */
+APR_DECLARE(void) apr_chash_clear(apr_chash_t *ht)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Get a pointer to the pool which the hash table was created in
+ */
+APR_POOL_DECLARE_ACCESSOR(chash);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_CHASH_H */
@@ -66,10 +66,34 @@ typedef unsigned int (*apr_hashfunc_t)(const char *key, apr_ssize_t *klen);
 
 /**
  * The default hash function.
+ * @remark This is the historical times 33 hash, reading the key a byte at
+ *         a time, which the hash tables no longer use by default (their
+ *         seeded variant of apr_hashfunc_fast() is).  It is kept for the
+ *         callers depending on its values.
  */
 APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *key,
                                                       apr_ssize_t *klen);
 
+/**
+ * A fast hash function, reading the key 8 or 16 bytes at a time and
+ * mixing all of its bits into the result, for long or binary keys.
+ * @remark The values are the same on all platforms.
+ */
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_fast(const char *key,
+                                                   apr_ssize_t *klen);
+
+/**
+ * Seeded version of apr_hashfunc_fast().
+ * @param key The key.
+ * @param klen The length of the key, or APR_HASH_KEY_STRING to use the string
+ *             length. If APR_HASH_KEY_STRING then returns the actual key length.
+ * @param seed The seed, a random one makes the values hard to predict,
+ *             hence collisions hard to provoke.
+ */
+APR_DECLARE(unsigned int) apr_hashfunc_fast_seeded(const char *key,
+                                                   apr_ssize_t *klen,
+                                                   unsigned int seed);
+
 /**
  * Create a hash table.
  * @param pool The pool to allocate the hash table out of
@@ -86,6 +110,30 @@ APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool);
 APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool, 
                                                apr_hashfunc_t hash_func);
 
+/**
+ * Grow the hash table a few buckets at a time rather than all at once,
+ * see apr_hash_make_ex().
+ */
+#define APR_HASH_INCREMENTAL 0x01
+
+/**
+ * Create a hash table with a custom hash function and options
+ * @param pool The pool to allocate the hash table out of
+ * @param hash_func A custom hash function, or NULL for the default one
+ * @param flags Zero or APR_HASH_INCREMENTAL
+ * @return The hash table just created
+ * @remark A hash table doubles its array whenever it holds more entries
+ *         than buckets, moving all of them at once.  With
+ *         APR_HASH_INCREMENTAL, the entries are moved to the new array
+ *         over the following additions instead, a few buckets each, which
+ *         bounds the time taken by apr_hash_set() for large tables.  Only
+ *         additions do so, hence lookups, replacements and deletions
+ *         during an iteration are as safe as with other tables.
+ */
+APR_DECLARE(apr_hash_t *) apr_hash_make_ex(apr_pool_t *pool,
+                                           apr_hashfunc_t hash_func,
+                                           unsigned int flags);
+
 /**
  * Make a copy of a hash table
  * @param pool The pool from which to allocate the new hash table
@@ -0,0 +1,214 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_OHASH_H
+#define APR_OHASH_H
+
+/**
+ * @file apr_ohash.h
+ * @brief APR Open Addressing Hash Tables
+ */
+
+#include "apr_pools.h"
+#include "apr_hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_ohash Open Addressing Hash Tables
+ * @ingroup APR
+ * A drop-in alternative to @ref apr_hash for large or hot maps.  The
+ * entries are stored inline in one array, next to an array of one byte
+ * per entry holding a few bits of its hash, which lookups scan a group
+ * of 8 or 16 entries at a time (with SSE2 when available).  A lookup
+ * thus mostly touches two cache lines, and an entry costs the key, its
+ * length and the value, plus a byte.
+ *
+ * Keys and values are referenced, not copied, and the keys are compared
+ * with memcmp() as for apr_hash_t; APR_HASH_KEY_STRING may be passed as
+ * the key length.
+ * @{
+ */
+
+/**
+ * Abstract type for open addressing hash tables.
+ */
+typedef struct apr_ohash_t apr_ohash_t;
+
+/**
+ * Abstract type for scanning open addressing hash tables.
+ */
+typedef struct apr_ohash_index_t apr_ohash_index_t;
+
+/**
+ * Create an open addressing hash table.
+ * @param pool The pool to allocate the hash table out of
+ * @return The hash table just created
+ */
+APR_DECLARE(apr_ohash_t *) apr_ohash_make(apr_pool_t *pool)
+                           __attribute__((nonnull(1)));
+
+/**
+ * Create an open addressing hash table with a custom hash function
+ * @param pool The pool to allocate the hash table out of
+ * @param hash_func A custom hash function.
+ * @return The hash table just created
+ * @remark The hash values are mixed before use, so that the function
+ *         need not spread its bits evenly, but it must not map too many
+ *         keys to the same value.
+ */
+APR_DECLARE(apr_ohash_t *) apr_ohash_make_custom(apr_pool_t *pool,
+                                                 apr_hashfunc_t hash_func)
+                           __attribute__((nonnull(1)));
+
+/**
+ * Make room in a hash table for a number of entries, so that adding them
+ * will not resize it.
+ * @param ht The hash table
+ * @param count The number of entries (including the present ones)
+ * @remark Every resize allocates a new array from the table's pool and
+ *         leaves the previous one there, reserving early saves that.
+ */
+APR_DECLARE(void) apr_ohash_reserve(apr_ohash_t *ht, unsigned int count)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Associate a value with a key in a hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @param val Value to associate with the key
+ * @remark If the value is NULL the hash entry is deleted.
+ */
+APR_DECLARE(void) apr_ohash_set(apr_ohash_t *ht, const void *key,
+                                apr_ssize_t klen, const void *val)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Look up the value associated with a key in a hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @return Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_ohash_get(const apr_ohash_t *ht, const void *key,
+                                  apr_ssize_t klen)
+                    __attribute__((nonnull(1,2)));
+
+/**
+ * Start iterating over the entries in a hash table.
+ * @param p The pool to allocate the apr_ohash_index_t iterator. If this
+ *          pool is NULL, then an internal, non-thread-safe iterator is used.
+ * @param ht The hash table
+ * @return The iteration state, or NULL if the table is empty
+ * @remark Deleting entries during an iteration is fine, but adding some
+ *         may move the others around, after which the iteration must be
+ *         restarted.
+ */
+APR_DECLARE(apr_ohash_index_t *) apr_ohash_first(apr_pool_t *p,
+                                                 apr_ohash_t *ht)
+                                 __attribute__((nonnull(2)));
+
+/**
+ * Continue iterating over the entries in a hash table.
+ * @param hi The iteration state
+ * @return a pointer to the updated iteration state.  NULL if there are no more
+ *         entries.
+ */
+APR_DECLARE(apr_ohash_index_t *) apr_ohash_next(apr_ohash_index_t *hi)
+                                 __attribute__((nonnull(1)));
+
+/**
+ * Get the current entry's details from the iteration state.
+ * @param hi The iteration state
+ * @param key Return pointer for the pointer to the key.
+ * @param klen Return pointer for the key length.
+ * @param val Return pointer for the associated value.
+ * @remark The return pointers should point to a variable that will be set to the
+ *         corresponding data, or they may be NULL if the data isn't interesting.
+ */
+APR_DECLARE(void) apr_ohash_this(apr_ohash_index_t *hi, const void **key,
+                                 apr_ssize_t *klen, void **val)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Get the current entry's key from the iteration state.
+ * @param hi The iteration state
+ * @return The pointer to the key
+ */
+APR_DECLARE(const void *) apr_ohash_this_key(apr_ohash_index_t *hi)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Get the current entry's key length from the iteration state.
+ * @param hi The iteration state
+ * @return The key length
+ */
+APR_DECLARE(apr_ssize_t) apr_ohash_this_key_len(apr_ohash_index_t *hi)
+                         __attribute__((nonnull(1)));
+
+/**
+ * Get the current entry's value from the iteration state.
+ * @param hi The iteration state
+ * @return The pointer to the value
+ */
+APR_DECLARE(void *) apr_ohash_this_val(apr_ohash_index_t *hi)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Iterate over a hash table running the provided function once for every
+ * element in the hash table.
+ * @param comp The function to run
+ * @param rec The data to pass as the first argument to the function
+ * @param ht The hash table to iterate over
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @see apr_hash_do_callback_fn_t
+ */
+APR_DECLARE(int) apr_ohash_do(apr_hash_do_callback_fn_t *comp,
+                              void *rec, const apr_ohash_t *ht)
+                 __attribute__((nonnull(1,3)));
+
+/**
+ * Get the number of key/value pairs in the hash table.
+ * @param ht The hash table
+ * @return The number of key/value pairs in the hash table.
+ */
+APR_DECLARE(unsigned int) apr_ohash_count(const apr_ohash_t *ht)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Clear any key/value pairs in the hash table.
+ * @param ht The hash table
+ * @remark The table keeps its size.
+ */
+APR_DECLARE(void) apr_ohash_clear(apr_ohash_t *ht)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Get a pointer to the pool which the hash table was created in
+ */
+APR_POOL_DECLARE_ACCESSOR(ohash);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_OHASH_H */
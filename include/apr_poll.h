@@ -267,6 +267,8 @@ APR_DECLARE(apr_status_t) apr_pollset_remove(apr_pollset_t *pollset,
  * @remark Multiple signalled conditions for the same descriptor may be reported
  *         in one or more returned apr_pollfd_t structures, depending on the
  *         implementation.
+ * @remark To wait for the descriptors and some timers, see
+ *         apr_timer_wheel_timeout().
  */
 APR_DECLARE(apr_status_t) apr_pollset_poll(apr_pollset_t *pollset,
                                            apr_interval_time_t timeout,
@@ -416,6 +418,8 @@ typedef apr_status_t (*apr_pollcb_cb_t)(void *baton, apr_pollfd_t *descriptor);
  * @remark APR_EINTR will be returned if the pollset has been created with
  *         APR_POLLSET_WAKEABLE and apr_pollcb_wakeup() has been called while
  *         waiting for activity.
+ * @remark To wait for the descriptors and some timers, see
+ *         apr_timer_wheel_timeout().
  */
 APR_DECLARE(apr_status_t) apr_pollcb_poll(apr_pollcb_t *pollcb,
                                           apr_interval_time_t timeout,
@@ -142,6 +142,18 @@ typedef struct apr_pool_t apr_pool_t;
 /** the place in the code where the particular function was called */
 #define APR_POOL__FILE_LINE__ __FILE__ ":" APR_STRINGIFY(__LINE__)
 
+#ifdef DOXYGEN
+/**
+ * Define this before including the APR headers to have apr_palloc(),
+ * apr_pcalloc(), apr_palloc_aligned(), apr_pcalloc_aligned(),
+ * apr_pvsprintf() and apr_psprintf() pass their caller's
+ * APR_POOL__FILE_LINE__ to the allocation profiler, see
+ * apr_pool_profile_start().  The debug versions of the functions are
+ * called instead.  Has no effect when #APR_POOL_DEBUG is set.
+ */
+#define APR_POOL_PROFILE
+#endif
+
 
 
 /** A function that is called when allocation fails. */
@@ -320,6 +332,84 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged(apr_pool_t **newpool);
 #endif
 #endif
 
+/**
+ * Create a new pool which several threads can allocate from at once.
+ * @param newpool The pool we have just created.
+ * @param parent The parent pool, @see apr_pool_create_ex.
+ * @param abort_fn A function to use if the pool cannot allocate more memory.
+ * @param allocator The allocator to use with the new pool.  If NULL the
+ *        allocator of the parent pool will be used.
+ * @remark apr_palloc(), apr_palloc_aligned(), apr_psprintf() and the
+ *         functions built on them (apr_pcalloc(), apr_pstrdup()...) can be
+ *         called by several threads without locking: allocations claim
+ *         their memory with an atomic compare-and-swap, and only take a
+ *         lock when a new memory node is needed.  This is what several
+ *         threads building their results into one pool want, rather than
+ *         apr_pool_mutex_set() which serializes every allocation.
+ * @remark Every other operation on the pool (registering cleanups, user
+ *         data, apr_pool_mark(), clearing or destroying it...) keeps the
+ *         single thread contract and must not overlap with allocations.
+ * @remark The allocator must have a mutex if it is shared with pools used
+ *         by other threads, as usual.  Without thread support this is the
+ *         same as apr_pool_create_ex().
+ */
+APR_DECLARE(apr_status_t) apr_pool_create_concurrent(apr_pool_t **newpool,
+                                                     apr_pool_t *parent,
+                                                     apr_abortfunc_t abort_fn,
+                                                     apr_allocator_t *allocator)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Create a new pool whose allocations are packed into one contiguous,
+ * page aligned block of memory, for long-lived data which is read often,
+ * such as a configuration.  Deep copying data structures into the arena
+ * (e.g. with apr_table_clone(), apr_hash_copy() or apr_array_copy(),
+ * then their contents) puts them on as few cache lines and pages as
+ * possible, where the pool they were built in would have them scattered
+ * over many nodes.  Once done, see apr_pool_freeze().
+ * @param newpool The pool we have just created.
+ * @param parent The parent pool, @see apr_pool_create_ex.
+ * @param size The size of the arena, rounded up to whole pages.  It may
+ *        be taken from the used_bytes of apr_pool_stats_get() on the pool
+ *        the data comes from.
+ * @remark What does not fit in the arena is allocated as from any pool.
+ * @remark When #APR_POOL_DEBUG is set this is the same as
+ *         apr_pool_create_ex(), every allocation being separate anyway.
+ */
+APR_DECLARE(apr_status_t) apr_pool_create_arena(apr_pool_t **newpool,
+                                                apr_pool_t *parent,
+                                                apr_size_t size)
+                          __attribute__((nonnull(1)));
+
+/**
+ * @defgroup apr_pool_freeze_flags Pool freezing flags
+ * @{
+ */
+/** Make the pages of the arena read-only, so that any write to the
+ *  frozen data faults */
+#define APR_POOL_FREEZE_READONLY   0x01
+/** @} */
+
+/**
+ * Stop allocating from the arena of a pool, possibly making it read-only
+ * @param pool The pool, created by apr_pool_create_arena()
+ * @param flags A bitwise OR of the @ref apr_pool_freeze_flags, or 0
+ * @return APR_EINVAL if the pool has no arena, APR_ENOTIMPL if the arena
+ *         can't be made read-only on this platform (or at all when
+ *         #APR_POOL_DEBUG is set), or the error of mprotect()
+ * @remark Further allocations from the pool come from other nodes.  The
+ *         arena is made writable again, before any cleanup runs, and given
+ *         back when the pool is cleared or destroyed.  The records of the
+ *         cleanups registered with the pool are kept out of the arena.
+ * @remark The end of the arena which does not fill a whole page stays
+ *         writable, since the page is shared with other memory.
+ * @warning Rewinding the pool to a mark taken before it was frozen
+ *          (see apr_pool_rewind()) is not supported.
+ */
+APR_DECLARE(apr_status_t) apr_pool_freeze(apr_pool_t *pool,
+                                          apr_uint32_t flags)
+                          __attribute__((nonnull(1)));
+
 /**
  * Find the pool's allocator
  * @param pool The pool to get the allocator from.
@@ -327,6 +417,31 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged(apr_pool_t **newpool);
 APR_DECLARE(apr_allocator_t *) apr_pool_allocator_get(apr_pool_t *pool)
                                __attribute__((nonnull(1)));
 
+/** Pool statistics, @see apr_pool_stats_get() */
+typedef struct apr_pool_stats_t {
+    /** Number of memory nodes currently held by the pool */
+    apr_size_t   node_count;
+    /** Total size of those nodes */
+    apr_size_t   node_bytes;
+    /** High-water mark of node_bytes since the pool was created */
+    apr_size_t   node_bytes_max;
+    /** Bytes allocated from those nodes, including the pool itself */
+    apr_size_t   used_bytes;
+    /** Number of times the pool was cleared */
+    apr_uint32_t clear_count;
+} apr_pool_stats_t;
+
+/**
+ * Get the memory statistics of a pool, not including its subpools
+ * @param pool The pool
+ * @param stats Filled with the statistics
+ * @remark For the recycling of the nodes behind the pools, see
+ *         apr_allocator_stats_get().
+ */
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_t *pool,
+                                     apr_pool_stats_t *stats)
+                  __attribute__((nonnull(1,2)));
+
 /**
  * Clear all memory in the pool and run all the cleanups. This also destroys all
  * subpools.
@@ -389,6 +504,55 @@ APR_DECLARE(void) apr_pool_destroy_debug(apr_pool_t *p,
     apr_pool_destroy_debug(p, APR_POOL__FILE_LINE__)
 #endif
 
+/**
+ * A savepoint in a pool, @see apr_pool_mark()
+ * @remark The fields are private, the structure is only public so that
+ *         marks can live on the stack.
+ */
+typedef struct apr_pool_mark_t {
+    /** The node active at the time of the mark */
+    void       *node;
+    /** Its first free byte at that time */
+    char       *avail;
+    /** The node before it, after which later nodes are linked */
+    void       *tail;
+    /** The number of cleanups registered until then */
+    apr_uint64_t cleanups;
+    /** The number of subpools created until then */
+    apr_uint64_t children;
+} apr_pool_mark_t;
+
+/**
+ * Take a savepoint in a pool, to later release with apr_pool_rewind()
+ * everything allocated after it at once.
+ * @param p The pool
+ * @param mark Where to save the state of the pool
+ * @remark Marks nest like a stack: rewinding to a mark invalidates the
+ *         marks taken after it.  Clearing or destroying the pool
+ *         invalidates them all.
+ * @remark Taking a mark is cheap, it only records the current position
+ *         in the pool.  From then on until the pool is cleared, the free
+ *         space left in nodes which are no longer current is not reused.
+ */
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *p, apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Release all the memory allocated from a pool since a savepoint
+ * @param p The pool the mark was taken on
+ * @param mark The mark
+ * @remark The subpools created since the mark are destroyed, the nodes
+ *         added to the pool since the mark are given back to its
+ *         allocator, and the cleanups registered since the mark and
+ *         not killed meanwhile are run.
+ * @remark User data and subprocesses registered after the mark are not
+ *         rewound, and so can't use memory allocated after the mark.
+ * @remark The mark stays valid, so it can be rewound to repeatedly, e.g.
+ *         once per iteration of a loop.
+ */
+APR_DECLARE(void) apr_pool_rewind(apr_pool_t *p, const apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
 
 /*
  * Memory allocation
@@ -421,7 +585,7 @@ APR_DECLARE(void *) apr_palloc_debug(apr_pool_t *p, apr_size_t size,
 #endif
                     __attribute__((nonnull(1)));
 
-#if APR_POOL_DEBUG
+#if APR_POOL_DEBUG || defined(APR_POOL_PROFILE)
 #define apr_palloc(p, size) \
     apr_palloc_debug(p, size, APR_POOL__FILE_LINE__)
 #endif
@@ -455,6 +619,90 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *p, apr_size_t size,
     apr_pcalloc_debug(p, size, APR_POOL__FILE_LINE__)
 #endif
 
+/**
+ * Allocate a block of memory from a pool, aligned on a given boundary
+ * @param p The pool to allocate from
+ * @param size The amount of memory to allocate
+ * @param alignment The alignment, a power of two (e.g. 64 for a cache
+ *        line, or 4096 for a page)
+ * @return The allocated memory, or NULL if alignment is not a power of two
+ * @remark The memory skipped to align the block is taken from the space
+ *         left in the pool's nodes, so aligning costs at most alignment
+ *         bytes and usually much less.  An alignment up to APR_ALIGN_DEFAULT
+ *         is the same as apr_palloc().
+ */
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *p, apr_size_t size,
+                                       apr_size_t alignment)
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4))
+                    __attribute__((alloc_size(2)))
+#endif
+                    __attribute__((nonnull(1)));
+
+/**
+ * Allocate a block of memory from a pool, aligned on a given boundary,
+ * and set all of the memory to 0
+ * @param p The pool to allocate from
+ * @param size The amount of memory to allocate
+ * @param alignment The alignment, a power of two
+ * @return The allocated memory, or NULL if alignment is not a power of two
+ */
+APR_DECLARE(void *) apr_pcalloc_aligned(apr_pool_t *p, apr_size_t size,
+                                        apr_size_t alignment)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Debug version of apr_palloc_aligned
+ * @param p See: apr_palloc_aligned
+ * @param size See: apr_palloc_aligned
+ * @param alignment See: apr_palloc_aligned
+ * @param file_line Where the function is called from.
+ *        This is usually APR_POOL__FILE_LINE__.
+ * @return See: apr_palloc_aligned
+ */
+APR_DECLARE(void *) apr_palloc_aligned_debug(apr_pool_t *p, apr_size_t size,
+                                             apr_size_t alignment,
+                                             const char *file_line)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Debug version of apr_pcalloc_aligned
+ * @param p See: apr_pcalloc_aligned
+ * @param size See: apr_pcalloc_aligned
+ * @param alignment See: apr_pcalloc_aligned
+ * @param file_line Where the function is called from.
+ *        This is usually APR_POOL__FILE_LINE__.
+ * @return See: apr_pcalloc_aligned
+ */
+APR_DECLARE(void *) apr_pcalloc_aligned_debug(apr_pool_t *p, apr_size_t size,
+                                              apr_size_t alignment,
+                                              const char *file_line)
+                    __attribute__((nonnull(1)));
+
+#if APR_POOL_DEBUG || defined(APR_POOL_PROFILE)
+#define apr_palloc_aligned(p, size, alignment) \
+    apr_palloc_aligned_debug(p, size, alignment, APR_POOL__FILE_LINE__)
+#define apr_pcalloc_aligned(p, size, alignment) \
+    apr_pcalloc_aligned_debug(p, size, alignment, APR_POOL__FILE_LINE__)
+#endif
+
+/**
+ * Grow (or shrink) a block of memory in place, if it is the last one
+ * allocated from the pool.
+ * @param p The pool the block was allocated from
+ * @param mem The block
+ * @param size The size it was allocated (or last grown) with
+ * @param new_size The size it should have
+ * @return Non-zero if the block now has @a new_size bytes, zero if it was
+ *         left as is and a new block is to be allocated
+ * @remark This never allocates, it only succeeds when @a mem ends where
+ *         the space left in the pool's active node starts and there is
+ *         enough of it.  It always fails for pools created with
+ *         apr_pool_create_concurrent(), and with APR_POOL_DEBUG.
+ */
+APR_DECLARE(int) apr_palloc_grow(apr_pool_t *p, void *mem, apr_size_t size,
+                                 apr_size_t new_size)
+                 __attribute__((nonnull(1,2)));
+
 
 /*
  * Pool Properties
@@ -680,6 +928,64 @@ APR_DECLARE(apr_status_t) apr_pool_cleanup_run(apr_pool_t *p, void *data,
                                                apr_status_t (*cleanup)(void *))
                           __attribute__((nonnull(3)));
 
+/**
+ * The handle of a registered cleanup, @see apr_pool_cleanup_register_ex()
+ * @remark The fields are private, the structure is only public so that
+ *         handles can be kept by value.
+ */
+typedef struct apr_pool_cleanup_t {
+    /** The entry of the cleanup in the pool */
+    void        *entry;
+    /** The generation of the entry when the cleanup was registered */
+    apr_uint32_t gen;
+} apr_pool_cleanup_t;
+
+/**
+ * Register a function to be called when a pool is cleared or destroyed,
+ * and return a handle to kill or run it in constant time.
+ * @param cleanup Where to store the handle of the cleanup, whose entry
+ *                is NULL if @a p is NULL
+ * @param p The pool to register the cleanup with
+ * @param data The data to pass to the cleanup function.
+ * @param plain_cleanup The function to call when the pool is cleared
+ *                      or destroyed
+ * @param child_cleanup The function to call when a child process is about
+ *                      to exec - this function is called in the child, obviously!
+ * @remark Once the cleanup is killed or run, the handle is stale and
+ *         using it is a noop, even if the pool reused the entry for
+ *         another cleanup.  The handle must not be used after the pool
+ *         is cleared or destroyed, nor rewound to a mark taken before
+ *         the registration.  The cleanup can still be killed with
+ *         apr_pool_cleanup_kill().
+ */
+APR_DECLARE(void) apr_pool_cleanup_register_ex(apr_pool_cleanup_t *cleanup,
+                            apr_pool_t *p, const void *data,
+                            apr_status_t (*plain_cleanup)(void *),
+                            apr_status_t (*child_cleanup)(void *))
+                  __attribute__((nonnull(1,4,5)));
+
+/**
+ * Remove a cleanup registered with apr_pool_cleanup_register_ex()
+ * @param p The pool the cleanup was registered with
+ * @param cleanup The handle of the cleanup
+ */
+APR_DECLARE(void) apr_pool_cleanup_kill_ex(apr_pool_t *p,
+                                           const apr_pool_cleanup_t *cleanup)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Unregister a cleanup registered with apr_pool_cleanup_register_ex(),
+ * and run its plain cleanup function immediately.
+ * @param p The pool the cleanup was registered with
+ * @param cleanup The handle of the cleanup
+ * @return The value returned by the cleanup function, or APR_SUCCESS if
+ *         the handle is stale, including when the cleanup is being run
+ *         by the pool.
+ */
+APR_DECLARE(apr_status_t) apr_pool_cleanup_run_ex(apr_pool_t *p,
+                                      const apr_pool_cleanup_t *cleanup)
+                          __attribute__((nonnull(1,2)));
+
 /**
  * An empty cleanup function.
  * 
@@ -699,6 +1005,101 @@ APR_DECLARE(void) apr_pool_cleanup_for_exec(void);
 
 /** @} */
 
+/**
+ * @defgroup PoolProfile Pool Allocation Profiling
+ *
+ * A sampling profiler, cheap enough to be left running in production
+ * builds.  About one in every rate allocations from the pools, and one in
+ * every rate memory nodes taken by the pools from their allocators, is
+ * recorded along with the tag of the pool (see apr_pool_tag()) and the
+ * caller: its file and line if it is built with #APR_POOL_PROFILE, its
+ * address otherwise.  The samples are aggregated per site, a site being
+ * a tag and a caller.
+ *
+ * Not available when #APR_POOL_DEBUG is set, whose verbose modes log
+ * every allocation.
+ * @{
+ */
+
+/** An allocation site, @see apr_pool_profile_walk() */
+typedef struct apr_pool_profile_site_t {
+    /** The tag of the pools, possibly truncated, or NULL if untagged */
+    const char   *tag;
+    /** The return address of the allocation function, or NULL if the
+     *  compiler can't tell it */
+    const void   *caller;
+    /** Where the allocation function was called from, when the caller
+     *  was built with #APR_POOL_PROFILE, or NULL */
+    const char   *file_line;
+    /** Number of samples taken */
+    apr_uint64_t  samples;
+    /** Estimated bytes allocated from the pools, that is the sampled
+     *  bytes times the sampling rate */
+    apr_uint64_t  alloc_bytes;
+    /** Estimated bytes of the nodes taken from the allocators */
+    apr_uint64_t  node_bytes;
+} apr_pool_profile_site_t;
+
+/**
+ * Callback for apr_pool_profile_walk()
+ * @param baton The baton given to apr_pool_profile_walk()
+ * @param site The site, valid for the duration of the call only
+ * @return Non-zero to stop the walk
+ */
+typedef int (apr_pool_profile_fn_t)(void *baton,
+                                    const apr_pool_profile_site_t *site);
+
+/**
+ * Start (or change the rate of) the sampling of pool allocations
+ * @param rate About one in rate allocations is sampled
+ * @return APR_EINVAL if rate is 0, APR_ENOTIMPL when #APR_POOL_DEBUG is set
+ * @remark The caller recorded is the one of apr_palloc(), apr_pcalloc(),
+ *         apr_palloc_aligned(), apr_pvsprintf() or apr_psprintf(), so the
+ *         allocations made by other APR functions (e.g. apr_pstrdup()) are
+ *         attributed to those.
+ */
+APR_DECLARE(apr_status_t) apr_pool_profile_start(apr_uint32_t rate);
+
+/**
+ * Stop sampling pool allocations, keeping the samples taken so far
+ */
+APR_DECLARE(void) apr_pool_profile_stop(void);
+
+/**
+ * Forget all the samples taken so far
+ */
+APR_DECLARE(void) apr_pool_profile_reset(void);
+
+/**
+ * Iterate over the allocation sites sampled so far, in no particular order
+ * @param fn The function called for each site
+ * @param baton Passed to fn
+ * @return The non-zero value returned by fn, if any, or 0
+ * @remark The number of sites is bounded, the samples of the sites which
+ *         find no room are dropped.
+ */
+APR_DECLARE(int) apr_pool_profile_walk(apr_pool_profile_fn_t *fn,
+                                       void *baton)
+                 __attribute__((nonnull(1)));
+
+/* apr_file_io.h depends on this header */
+struct apr_file_t;
+
+/**
+ * Write a report of the sampled allocations, aggregated per tag and per
+ * site, followed by the sizes of the pools of a tree
+ * @param file The file to write to
+ * @param pool The root of the pool tree, or NULL for the global pool
+ * @remark The sizes of the pools are their high-water marks (see
+ *         apr_pool_stats_t), which are kept up to date as the pools grow
+ *         and can be read while other threads use them.
+ */
+APR_DECLARE(apr_status_t) apr_pool_profile_dump(struct apr_file_t *file,
+                                                apr_pool_t *pool)
+                          __attribute__((nonnull(1)));
+
+/** @} */
+
 /**
  * @defgroup PoolDebug Pool Debugging functions.
  *
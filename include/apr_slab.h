@@ -0,0 +1,144 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_SLAB_H
+#define APR_SLAB_H
+
+/**
+ * @file apr_slab.h
+ * @brief APR Fixed Size Object Cache
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_slab Fixed Size Object Cache
+ * @ingroup APR
+ * Objects of one size are carved out of memory nodes taken from the
+ * pool's allocator and recycled through free lists, so that allocating
+ * and freeing them is a matter of a few pointer updates.  The nodes are
+ * given back to the allocator when the slab (or its pool) is destroyed.
+ * @{
+ */
+
+/** Opaque object cache */
+typedef struct apr_slab_t apr_slab_t;
+
+/**
+ * @defgroup apr_slab_flags Slab creation flags
+ * @{
+ */
+/**
+ * The slab is shared by several threads: protect it with a mutex, and put
+ * a per-thread cache of free objects in front of it so that most
+ * allocations and frees don't take the mutex.  Ignored when APR is built
+ * without thread support.
+ */
+#define APR_SLAB_THREADS    0x01
+/** @} */
+
+/** Slab statistics, @see apr_slab_stats_get() */
+typedef struct apr_slab_stats_t {
+    /** The size of the objects, as rounded up by the slab */
+    apr_size_t   object_size;
+    /** Number of objects carved so far, i.e. the high-water mark of the
+     *  objects in use give or take those held by the thread caches */
+    apr_size_t   object_count;
+    /** Number of objects currently free */
+    apr_size_t   free_count;
+    /** Number of memory nodes taken from the allocator */
+    apr_size_t   node_count;
+    /** Total size of those nodes */
+    apr_size_t   node_bytes;
+    /** Number of calls to apr_slab_alloc() and apr_slab_calloc() */
+    apr_uint64_t alloc_calls;
+    /** Number of calls to apr_slab_free() */
+    apr_uint64_t free_calls;
+} apr_slab_stats_t;
+
+/**
+ * Create an object cache
+ * @param slab The new slab
+ * @param size The size of the objects
+ * @param flags A bitwise OR of the @ref apr_slab_flags, or 0
+ * @param pool The pool whose allocator provides the memory, and whose
+ *        lifetime bounds the slab's
+ * @return APR_EINVAL if size is 0
+ * @remark The objects are aligned on a cache line when at least that big,
+ *         smaller ones get a power of two size and never straddle two
+ *         cache lines.
+ */
+APR_DECLARE(apr_status_t) apr_slab_create(apr_slab_t **slab,
+                                          apr_size_t size,
+                                          apr_uint32_t flags,
+                                          apr_pool_t *pool)
+                          __attribute__((nonnull(1,4)));
+
+/**
+ * Destroy an object cache before its pool is, giving its memory back
+ * @param slab The slab
+ * @remark All the objects allocated from the slab become invalid.
+ */
+APR_DECLARE(void) apr_slab_destroy(apr_slab_t *slab)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Allocate an object
+ * @param slab The slab
+ * @return The object, or NULL if memory is exhausted (once the pool's
+ *         abort function, if any, was called)
+ */
+APR_DECLARE(void *) apr_slab_alloc(apr_slab_t *slab)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Allocate an object and set it to zero
+ * @param slab The slab
+ * @return The object, or NULL if memory is exhausted
+ */
+APR_DECLARE(void *) apr_slab_calloc(apr_slab_t *slab)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Give an object back to its slab
+ * @param slab The slab the object was allocated from
+ * @param obj The object
+ */
+APR_DECLARE(void) apr_slab_free(apr_slab_t *slab, void *obj)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Get the statistics of an object cache
+ * @param slab The slab
+ * @param stats Filled with the statistics
+ */
+APR_DECLARE(void) apr_slab_stats_get(apr_slab_t *slab,
+                                     apr_slab_stats_t *stats)
+                  __attribute__((nonnull(1,2)));
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !APR_SLAB_H */
@@ -182,6 +182,42 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *p, const char *fmt, va_list ap);
 APR_DECLARE_NONSTD(char *) apr_psprintf(apr_pool_t *p, const char *fmt, ...)
         __attribute__((format(printf,2,3)));
 
+/**
+ * Debug version of apr_pvsprintf
+ * @param p See: apr_pvsprintf
+ * @param file_line Where the function is called from.
+ *        This is usually APR_POOL__FILE_LINE__.
+ * @param fmt See: apr_pvsprintf
+ * @param ap See: apr_pvsprintf
+ * @return See: apr_pvsprintf
+ */
+APR_DECLARE(char *) apr_pvsprintf_debug(apr_pool_t *p, const char *file_line,
+                                        const char *fmt, va_list ap);
+
+/**
+ * Debug version of apr_psprintf
+ * @param p See: apr_psprintf
+ * @param file_line Where the function is called from.
+ *        This is usually APR_POOL__FILE_LINE__.
+ * @param fmt See: apr_psprintf
+ * @param ... See: apr_psprintf
+ * @return See: apr_psprintf
+ */
+APR_DECLARE_NONSTD(char *) apr_psprintf_debug(apr_pool_t *p,
+                                              const char *file_line,
+                                              const char *fmt, ...)
+        __attribute__((format(printf,3,4)));
+
+#if defined(APR_POOL_PROFILE) && !APR_POOL_DEBUG
+#define apr_pvsprintf(p, fmt, ap) \
+    apr_pvsprintf_debug(p, APR_POOL__FILE_LINE__, fmt, ap)
+#if (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L) \
+    || (defined(__cplusplus) && __cplusplus >= 201103L) || defined(__GNUC__)
+#define apr_psprintf(p, ...) \
+    apr_psprintf_debug(p, APR_POOL__FILE_LINE__, __VA_ARGS__)
+#endif
+#endif
+
 /**
  * Copy up to dst_size characters from src to dst; does not copy
  * past a NUL terminator in src, but always terminates dst with a NUL
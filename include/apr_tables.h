@@ -126,7 +126,9 @@ APR_DECLARE(apr_array_header_t *) apr_array_make(apr_pool_t *p,
  * @param arr The array to add an element to.
  * @return Location for the new element in the array.
  * @remark If there are no free spots in the array, then this function will
- *         allocate new space for the new element.
+ *         allocate new space for the new element, or grow the array in
+ *         place when its elements are the last allocation of its pool
+ *         (see apr_palloc_grow()).
  */
 APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr);
 
@@ -165,6 +167,15 @@ APR_DECLARE(void *) apr_array_pop(apr_array_header_t *arr);
  */
 APR_DECLARE(void) apr_array_clear(apr_array_header_t *arr);
 
+/**
+ * Make room in an array for a number of elements, so that pushing up to
+ * that many does not allocate.
+ * @param arr The array
+ * @param nelts The number of elements, counting those in the array
+ * @remark The new room is cleared, as with apr_array_push().
+ */
+APR_DECLARE(void) apr_array_reserve(apr_array_header_t *arr, int nelts);
+
 /**
  * Concatenate two arrays together.
  * @param dst The destination array, and the one to go first in the combined 
@@ -222,6 +233,67 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
 				      const apr_array_header_t *arr,
 				      const char sep);
 
+/**
+ * Function comparing two elements of an array, as for qsort().
+ * @param a The first element
+ * @param b The second element
+ * @return Negative if @a a goes before @a b, positive if after, 0 if they
+ *         are equal
+ */
+typedef int (apr_array_compare_fn_t)(const void *a, const void *b);
+
+/**
+ * Sort the elements of an array.
+ * @param arr The array
+ * @param cmp The function comparing two elements
+ * @remark The sort is not stable, and takes O(n log n) time in the worst
+ *         case.
+ */
+APR_DECLARE(void) apr_array_sort(apr_array_header_t *arr,
+                                 apr_array_compare_fn_t *cmp);
+
+/**
+ * Sort the elements of an array by an integer key, faster than
+ * apr_array_sort() for large arrays.
+ * @param arr The array
+ * @param key_offset The offset of the key in the elements, e.g. 0 for an
+ *        array of integers, or APR_OFFSETOF() of a structure member
+ * @param key_size The size of the key: 1, 2, 4 or 8 bytes
+ * @param is_signed Whether the key is a signed integer
+ * @return APR_SUCCESS, APR_EINVAL if the key is not within the elements or
+ *         has another size, or APR_ENOMEM
+ * @remark The sort is stable, and takes O(n) time, with a temporary copy
+ *         of the elements out of the heap.
+ */
+APR_DECLARE(apr_status_t) apr_array_sort_key(apr_array_header_t *arr,
+                                             apr_size_t key_offset,
+                                             apr_size_t key_size,
+                                             int is_signed);
+
+/**
+ * Search a sorted array for an element.
+ * @param arr The array, sorted as by @a cmp
+ * @param key The element to search for
+ * @param cmp The function comparing two elements, which is given an element
+ *        of the array first and @a key second
+ * @param index If not NULL, set to the index of the first element equal to
+ *        @a key, or else where to insert it to keep the array sorted
+ * @return The first element equal to @a key, or NULL
+ */
+APR_DECLARE(void *) apr_array_bsearch(const apr_array_header_t *arr,
+                                      const void *key,
+                                      apr_array_compare_fn_t *cmp,
+                                      int *index);
+
+/**
+ * Sort the elements of an array and remove the duplicates.
+ * @param arr The array
+ * @param cmp The function comparing two elements
+ * @remark Of the equal elements, which one is kept is unspecified.
+ */
+APR_DECLARE(void) apr_array_sort_unique(apr_array_header_t *arr,
+                                        apr_array_compare_fn_t *cmp);
+
 /**
  * Make a new table.
  * @param p The pool to allocate the pool out of
@@ -52,8 +52,11 @@ typedef apr_int64_t apr_time_t;
 /** mechanism to properly print apr_time_t values */
 #define APR_TIME_T_FMT APR_INT64_T_FMT
 
+#ifndef APR_INTERVAL_TIME_T_DEFINED
+#define APR_INTERVAL_TIME_T_DEFINED
 /** intervals for I/O timeouts, in microseconds */
 typedef apr_int64_t apr_interval_time_t;
+#endif
 /** short interval for I/O timeouts, in microseconds */
 typedef apr_int32_t apr_short_interval_time_t;
 
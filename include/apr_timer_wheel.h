@@ -0,0 +1,198 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_TIMER_WHEEL_H
+#define APR_TIMER_WHEEL_H
+
+/**
+ * @file apr_timer_wheel.h
+ * @brief APR Timer Wheels
+ */
+
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_time.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_timer_wheel Timer Wheels
+ * @ingroup APR
+ * A hierarchical timing wheel, for many timeouts (e.g. those of the
+ * connections of a server) which are mostly rescheduled or cancelled
+ * before they expire.  Setting, rescheduling and cancelling a timer take
+ * constant time and allocate nothing; the expired timers are run tick by
+ * tick, those of a tick at once, and the time left until the next one is
+ * cheap to get as the timeout of apr_pollset_poll() or apr_pollcb_poll().
+ *
+ * The time is counted in ticks, whose length is given at creation: a
+ * timer never runs before its expiry time, but may run up to a tick (plus
+ * the lateness of apr_timer_wheel_expire()) after it.
+ * @{
+ */
+
+/**
+ * Abstract type for timer wheels.
+ */
+typedef struct apr_timer_wheel_t apr_timer_wheel_t;
+
+/**
+ * Abstract type for timers.
+ */
+typedef struct apr_timer_t apr_timer_t;
+
+/**
+ * Function called when a timer expires.
+ * @param timer The timer, no longer pending: it may be set again, or
+ *              cancelled if it was set again meanwhile (by another thread)
+ * @param baton The baton given to apr_timer_create()
+ */
+typedef void (apr_timer_callback_t)(apr_timer_t *timer, void *baton);
+
+/**
+ * Setting, cancelling and expiring the timers is thread safe.
+ */
+#define APR_TIMER_WHEEL_THREADSAFE 0x01
+
+/**
+ * Create a timer wheel.
+ * @param tw The new timer wheel
+ * @param tick The length of a tick, or 0 for the default (one millisecond)
+ * @param flags 0, or APR_TIMER_WHEEL_THREADSAFE
+ * @param pool The pool to allocate the timer wheel out of
+ * @return APR_SUCCESS, APR_ENOTIMPL if APR_TIMER_WHEEL_THREADSAFE is asked
+ *         without threads, or an error creating the mutex
+ * @remark Without APR_TIMER_WHEEL_THREADSAFE, the timer wheel and its
+ *         timers must be used by one thread at a time, which saves a mutex.
+ * @remark The timers can be set up to 2^32 ticks ahead (about 49 days for
+ *         the default tick); those set further are kept, though rescheduled
+ *         on the wheel every 2^32 ticks.
+ */
+APR_DECLARE(apr_status_t) apr_timer_wheel_create(apr_timer_wheel_t **tw,
+                                                 apr_interval_time_t tick,
+                                                 apr_uint32_t flags,
+                                                 apr_pool_t *pool)
+                          __attribute__((nonnull(1,4)));
+
+/**
+ * Create a timer, not pending.
+ * @param timer The new timer
+ * @param tw The timer wheel of the timer
+ * @param callback The function to call when the timer expires
+ * @param baton The second argument of @a callback
+ * @param pool The pool to allocate the timer out of, which must not live
+ *             longer than the timer wheel's; the timer is cancelled when
+ *             it is cleared or destroyed
+ * @return APR_SUCCESS
+ * @remark A timer is meant to be created once (e.g. with a connection) and
+ *         set as many times as needed.
+ */
+APR_DECLARE(apr_status_t) apr_timer_create(apr_timer_t **timer,
+                                           apr_timer_wheel_t *tw,
+                                           apr_timer_callback_t *callback,
+                                           void *baton, apr_pool_t *pool)
+                          __attribute__((nonnull(1,2,3,5)));
+
+/**
+ * Set a timer to expire at a given time, rescheduling it if it is pending
+ * already.
+ * @param timer The timer
+ * @param when The expiry time, which may be passed already
+ * @remark When another thread waits for events with a timeout given by
+ *         apr_timer_wheel_timeout(), and the timer may expire before it,
+ *         the waiting thread should be woken up (e.g. with
+ *         apr_pollset_wakeup()).
+ */
+APR_DECLARE(void) apr_timer_set(apr_timer_t *timer, apr_time_t when)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Cancel a timer.
+ * @param timer The timer
+ * @return Whether the timer was pending
+ */
+APR_DECLARE(int) apr_timer_cancel(apr_timer_t *timer)
+                 __attribute__((nonnull(1)));
+
+/**
+ * Tell whether a timer is pending, i.e. set and not yet expired.
+ * @param timer The timer
+ */
+APR_DECLARE(int) apr_timer_is_pending(apr_timer_t *timer)
+                 __attribute__((nonnull(1)));
+
+/**
+ * Get the expiry time a timer was last set to.
+ * @param timer The timer
+ */
+APR_DECLARE(apr_time_t) apr_timer_expiry(apr_timer_t *timer)
+                        __attribute__((nonnull(1)));
+
+/**
+ * Run the callbacks of the timers expired at a given time.
+ * @param tw The timer wheel
+ * @param now The current time, usually apr_time_now()
+ * @return The number of callbacks run
+ * @remark The timers are run tick after tick.  With
+ *         APR_TIMER_WHEEL_THREADSAFE, the callbacks are run without
+ *         holding the wheel's mutex.
+ */
+APR_DECLARE(unsigned int) apr_timer_wheel_expire(apr_timer_wheel_t *tw,
+                                                 apr_time_t now)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Get the time left until a timer may expire, as a timeout to wait for
+ * events, e.g. with apr_pollset_poll() or apr_pollcb_poll().
+ * @param tw The timer wheel
+ * @param now The current time, usually apr_time_now()
+ * @param max The timeout to return if it is shorter, or a negative value
+ *            for none
+ * @return The timeout, 0 if some timers expired already, or @a max if
+ *         none is pending (negative means none)
+ * @remark This takes a constant time: the wheel is not searched for the
+ *         exact next expiry time but for the next tick some timers are
+ *         due or moved closer on the wheel, which may be before.  Waking
+ *         up then is cheap, apr_timer_wheel_expire() only moving them.
+ */
+APR_DECLARE(apr_interval_time_t) apr_timer_wheel_timeout(
+                                        apr_timer_wheel_t *tw,
+                                        apr_time_t now,
+                                        apr_interval_time_t max)
+                                 __attribute__((nonnull(1)));
+
+/**
+ * Get the number of pending timers, including the expired ones whose
+ * callback is not run yet.
+ * @param tw The timer wheel
+ */
+APR_DECLARE(apr_size_t) apr_timer_wheel_count(apr_timer_wheel_t *tw)
+                        __attribute__((nonnull(1)));
+
+/**
+ * Get a pointer to the pool which the timer wheel was created in
+ */
+APR_POOL_DECLARE_ACCESSOR(timer_wheel);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_TIMER_WHEEL_H */
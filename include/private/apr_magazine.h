@@ -0,0 +1,112 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_MAGAZINE_H
+#define APR_MAGAZINE_H
+
+/**
+ * @file apr_magazine.h
+ * @brief Per-thread cache slots, for the allocator and the slabs
+ */
+
+#include "apr.h"
+#include "apr_atomic.h"
+#include "apr_portable.h"
+#include "apr_thread_proc.h"
+
+#if APR_HAS_THREADS
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_magazine Internal per-thread cache slots
+ * @ingroup APR
+ * A thread is mapped onto one of APR_MAGAZINE_COUNT slots by hashing its
+ * id.  The slots are laid out in an array, each of them some multiple of
+ * a cache line big, and start with a volatile apr_uint32_t which is
+ * non-zero while a thread is using the slot.
+ * @{
+ */
+
+#define APR_MAGAZINE_SHIFT  5
+#define APR_MAGAZINE_COUNT  (1 << APR_MAGAZINE_SHIFT)
+
+/** The slot number n of the array */
+#define apr_magazine_slot(slots, slot_size, n) \
+    ((void *)((char *)(slots) + (apr_size_t)(n) * (slot_size)))
+
+/**
+ * Take the slot of the calling thread
+ * @param slots The array of slots
+ * @param slot_size The size of each slot
+ * @return The slot, or NULL if another thread hashing to the same slot
+ *         is using it, in which case the caller should rather take its
+ *         shared path than wait.
+ */
+static APR_INLINE void *apr_magazine_acquire(char *slots,
+                                             apr_size_t slot_size)
+{
+    apr_uintptr_t tid = (apr_uintptr_t)apr_os_thread_current();
+    apr_uint32_t hash;
+    void *slot;
+
+    /* Thread ids are usually aligned addresses, fold and mix them */
+    hash = (apr_uint32_t)tid ^ (apr_uint32_t)(tid >> 12)
+                             ^ (apr_uint32_t)(tid >> 24);
+    hash *= 0x9E3779B1;
+    slot = apr_magazine_slot(slots, slot_size,
+                             hash >> (32 - APR_MAGAZINE_SHIFT));
+
+    if (apr_atomic_cas32((volatile apr_uint32_t *)slot, 1, 0) != 0)
+        return NULL;
+
+    return slot;
+}
+
+/**
+ * Take a slot, waiting for the thread using it if any, e.g. to walk
+ * all the slots
+ * @param slot The slot
+ */
+static APR_INLINE void apr_magazine_lock(void *slot)
+{
+    /* Slots are only ever held for a few instructions, their holders
+     * release them before waiting for any lock.
+     */
+    while (apr_atomic_cas32((volatile apr_uint32_t *)slot, 1, 0) != 0)
+        apr_thread_yield();
+}
+
+/**
+ * Give a slot back
+ * @param slot The slot
+ */
+static APR_INLINE void apr_magazine_release(void *slot)
+{
+    apr_atomic_cas32((volatile apr_uint32_t *)slot, 0, 1);
+}
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APR_HAS_THREADS */
+
+#endif /* ! APR_MAGAZINE_H */
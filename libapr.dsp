@@ -456,6 +456,10 @@ SOURCE=.\memcache\apr_memcache.c
 
 SOURCE=.\memory\unix\apr_pools.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\memory\unix\apr_slab.c
+# End Source File
 # End Group
 # Begin Group "misc"
 
@@ -687,7 +691,24 @@ SOURCE=.\strmatch\apr_strmatch.c
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=.\tables\apr_bloom.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_btree.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_chash.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\tables\apr_hash.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_ohash.c
+# End Source File
 # Begin Source File
 
 SOURCE=.\tables\apr_tables.c
@@ -776,6 +797,10 @@ SOURCE=.\util-misc\apr_rmm.c
 
 SOURCE=.\util-misc\apr_thread_pool.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\util-misc\apr_timer_wheel.c
+# End Source File
 # End Group
 # Begin Group "xlate"
 
@@ -916,6 +941,18 @@ SOURCE=.\include\apr_atomic.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_bloom.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_btree.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_chash.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_dso.h
 # End Source File
 # Begin Source File
@@ -972,6 +1009,10 @@ SOURCE=.\include\apr_network_io.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_ohash.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_poll.h
 # End Source File
 # Begin Source File
@@ -1008,6 +1049,10 @@ SOURCE=.\include\apr_skiplist.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_slab.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_strings.h
 # End Source File
 # Begin Source File
@@ -1040,6 +1085,10 @@ SOURCE=.\include\apr_time.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_timer_wheel.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_user.h
 # End Source File
 # Begin Source File
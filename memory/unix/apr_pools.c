@@ -14,6 +14,9 @@
  * limitations under the License.
  */
 
+/* The functions are defined here, not the macros of APR_POOL_PROFILE */
+#undef APR_POOL_PROFILE
+
 #include "apr.h"
 #include "apr_private.h"
 
@@ -25,9 +28,11 @@
 #include "apr_allocator.h"
 #include "apr_lib.h"
 #include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
 #include "apr_hash.h"
 #include "apr_time.h"
 #include "apr_support.h"
+#include "apr_magazine.h"
 #define APR_WANT_MEMFUNC
 #include "apr_want.h"
 #include "apr_env.h"
@@ -44,10 +49,35 @@
 #define APR_ALLOCATOR_USES_MMAP   1
 #endif
 
-#if APR_ALLOCATOR_USES_MMAP
+#if APR_ALLOCATOR_USES_MMAP || HAVE_SYS_MMAN_H
 #include <sys/mman.h>
 #endif
 
+/* Huge page regions (APR_ALLOCATOR_HUGE_PAGES) need anonymous mappings,
+ * and can't work with a guard page around every node.
+ */
+#if HAVE_MMAP && HAVE_MUNMAP && defined(MAP_ANON) \
+    && !APR_ALLOCATOR_GUARD_PAGES
+#define ALLOCATOR_HAS_REGIONS 1
+#else
+#define ALLOCATOR_HAS_REGIONS 0
+#endif
+
+/* NUMA binding (apr_allocator_create_numa) applies to regions, and is
+ * done with the raw syscalls so as not to depend on libnuma.
+ */
+#if ALLOCATOR_HAS_REGIONS && defined(__linux__) && HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+#if ALLOCATOR_HAS_REGIONS && defined(SYS_mbind) && defined(SYS_getcpu)
+#define ALLOCATOR_HAS_NUMA 1
+#define NUMA_MPOL_PREFERRED 1
+#define NUMA_MAX_NODES 1024
+#define NUMA_MASK_BITS (8 * sizeof(unsigned long))
+#else
+#define ALLOCATOR_HAS_NUMA 0
+#endif
+
 #if HAVE_VALGRIND
 #define REDZONE APR_ALIGN_DEFAULT(8)
 int apr_running_on_valgrind = 0;
@@ -64,8 +94,8 @@ int apr_running_on_valgrind = 0;
 
 /*
  * XXX: This is not optimal when using --enable-allocator-uses-mmap on
- * XXX: machines with large pagesize, but currently the sink is assumed
- * XXX: to be index 0, so MIN_ALLOC must be at least two pages.
+ * XXX: machines with large pagesize, but currently free[0] is assumed
+ * XXX: to be unused, so MIN_ALLOC must be at least two pages.
  */
 #define MIN_ALLOC (2 * BOUNDARY_SIZE)
 #define MAX_INDEX   20
@@ -90,6 +120,31 @@ static unsigned int boundary_size;
 #define GUARDPAGE_SIZE 0
 #endif /* APR_ALLOCATOR_GUARD_PAGES */
 
+/*
+ * Thread caches (APR_ALLOCATOR_THREAD_CACHE): a thread is mapped onto one
+ * of APR_MAGAZINE_COUNT slots (see apr_magazine.h), each slot caching up
+ * to MAGAZINE_DEPTH nodes per index and MAGAZINE_MAX_FREE_INDEX (in
+ * BOUNDARY_SIZE multiples) in total.  Nodes are moved from and to the
+ * shared free lists MAGAZINE_BATCH at a time.
+ */
+#define MAGAZINE_DEPTH          8
+#define MAGAZINE_BATCH          (MAGAZINE_DEPTH / 2)
+#define MAGAZINE_MAX_FREE_INDEX 64
+
+#define CACHELINE_SIZE          64
+
+/*
+ * Regions (huge pages or NUMA binding): nodes up to REGION_MAX_NODE bytes
+ * are carved out of REGION_SIZE big mappings, larger nodes are mapped
+ * separately.  With APR_ALLOCATOR_NUMA_LOCAL the regions are hashed by
+ * address in REGION_HASH_SIZE buckets, to find the node they belong to.
+ */
+#define REGION_SIZE             (2 * 1024 * 1024)
+#define REGION_MAX_NODE         (REGION_SIZE / 4)
+#define REGION_HASH_SIZE        256 /* must be a power of two */
+#define region_hash(base_) \
+    ((((apr_uintptr_t)(base_)) / REGION_SIZE) & (REGION_HASH_SIZE - 1))
+
 /* 
  * Timing constants for killing subprocesses
  * There is a total 3-second delay between sending a SIGINT 
@@ -107,9 +162,105 @@ static unsigned int boundary_size;
  * indices, but quantities of BOUNDARY_SIZE big memory blocks.
  */
 
-struct apr_allocator_t {
+#if APR_HAS_THREADS
+typedef struct allocator_magazine_t {
+    /** Non-zero while a thread is using this slot */
+    volatile apr_uint32_t busy;
+    /** Memory size (in BOUNDARY_SIZE multiples) held in free[] */
+    apr_uint32_t          free_index;
+    /** Number of nodes in each of the free[] lists */
+    apr_uint32_t          count[MAX_INDEX];
+    /** Lists of free nodes, slots as in apr_allocator_t (0 is unused) */
+    apr_memnode_t        *free[MAX_INDEX];
+    /** Statistics, added to the allocator's ones when asked for */
+    apr_uint64_t          reuse_count;
+    apr_uint64_t          free_count;
+} allocator_magazine_t;
+
+#define SIZEOF_MAGAZINE_T   APR_ALIGN(sizeof(allocator_magazine_t), \
+                                      CACHELINE_SIZE)
+
+/** The background thread of apr_allocator_decay_set() */
+typedef struct allocator_decay_thread_t {
+    /** Private pool (and allocator) of the thread and its sync objects */
+    apr_pool_t         *pool;
+    apr_thread_t       *thread;
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t  *cond;
+    /** How often to trim */
+    apr_interval_time_t interval;
+    /** Set to have the thread exit */
+    int                 stop;
+} allocator_decay_thread_t;
+#endif /* APR_HAS_THREADS */
+
+/**
+ * The free lists, and the region the nodes are carved out of.  An
+ * allocator has one, plus one per NUMA node with APR_ALLOCATOR_NUMA_LOCAL.
+ */
+typedef struct allocator_heap_t {
     /** largest used index into free[], always < MAX_INDEX */
-    apr_size_t        max_index;
+    apr_size_t          max_index;
+    /**
+     * Lists of free nodes. Slot 0 is unused (see sink below),
+     * and the slots 1..MAX_INDEX-1 contain nodes of sizes
+     * (i+1) * BOUNDARY_SIZE. Example for BOUNDARY_INDEX == 12:
+     * slot  1: size  8192
+     * slot  2: size 12288
+     * ...
+     * slot 19: size 81920
+     */
+    apr_memnode_t      *free[MAX_INDEX];
+    /** Number of nodes in each of the free[] lists */
+    apr_uint32_t        free_count[MAX_INDEX];
+    /**
+     * The lowest number of nodes each of the free[] lists held since
+     * decay_epoch.  Since the lists are LIFO, this many nodes at the bottom
+     * of each list were not used meanwhile.  @see apr_allocator_trim()
+     */
+    apr_uint32_t        free_lowwater[MAX_INDEX];
+    /** Bit i is set when free[i] is not empty, maintained under the mutex
+     * but read atomically by the thread caches before taking it */
+    volatile apr_uint32_t free_bitmap;
+    /**
+     * The sink: oversized nodes (index >= MAX_INDEX), in a treap ordered
+     * by size.  @see sink_insert()
+     */
+    apr_memnode_t      *sink;
+    /** Number of nodes in the sink */
+    apr_size_t          sink_count;
+    /** Same as free_lowwater[], for the sink (which is not LIFO) */
+    apr_size_t          sink_lowwater;
+#if ALLOCATOR_HAS_REGIONS
+    /** The free space left in the current region */
+    char               *region_avail;
+    char               *region_endp;
+#endif /* ALLOCATOR_HAS_REGIONS */
+    /** NUMA node the regions are bound to, or -1 */
+    int                 numa_node;
+} allocator_heap_t;
+
+#if ALLOCATOR_HAS_REGIONS
+/** A region, malloc()ed aside so that all of it can be carved */
+typedef struct allocator_region_t allocator_region_t;
+
+struct allocator_region_t {
+    allocator_region_t *next;
+    /** Next in the same region_hash[] bucket */
+    allocator_region_t *hash_next;
+    char               *base;
+    /** The heap whose nodes are carved out of the region */
+    allocator_heap_t   *heap;
+};
+
+/* Whether the node was carved out of a region, rather than mapped alone */
+#define region_node_is_carved(node_) \
+    (((apr_size_t)(node_)->index + 1) << BOUNDARY_INDEX <= REGION_MAX_NODE)
+
+static apr_size_t region_page_size;
+#endif /* ALLOCATOR_HAS_REGIONS */
+
+struct apr_allocator_t {
     /** Total size (in BOUNDARY_SIZE multiples) of unused memory before
      * blocks are given back. @see apr_allocator_max_free_set().
      * @note Initialized to APR_ALLOCATOR_MAX_FREE_UNLIMITED,
@@ -121,31 +272,301 @@ struct apr_allocator_t {
      * before blocks are given back. Range: 0..max_free_index
      */
     apr_size_t        current_free_index;
+    /** Creation flags, @see apr_allocator_create_ex() */
+    apr_uint32_t      flags;
 #if APR_HAS_THREADS
     apr_thread_mutex_t *mutex;
 #endif /* APR_HAS_THREADS */
     apr_pool_t         *owner;
+    /** The free lists, used for all the nodes unless heaps is set */
+    allocator_heap_t    heap;
     /**
-     * Lists of free nodes. Slot 0 is used for oversized nodes,
-     * and the slots 1..MAX_INDEX-1 contain nodes of sizes
-     * (i+1) * BOUNDARY_SIZE. Example for BOUNDARY_INDEX == 12:
-     * slot  0: nodes larger than 81920
-     * slot  1: size  8192
-     * slot  2: size 12288
-     * ...
-     * slot 19: size 81920
+     * Nodes of destroyed pools, ready to hold new pools without going
+     * through the free lists.  At most POOL_CACHE_MAX of them.
      */
-    apr_memnode_t      *free[MAX_INDEX];
+    apr_memnode_t      *pool_cache;
+    /** Their number, changed under the mutex but peeked at without */
+    volatile apr_uint32_t pool_cache_count;
+    /** Same as free_lowwater[], for the pool_cache */
+    apr_uint32_t        pool_cache_lowwater;
+    /** Statistics of the shared free lists, maintained under the mutex */
+    apr_allocator_stats_t stats;
+    /** Idle time before free nodes are trimmed, 0 to trim them all */
+    apr_interval_time_t decay;
+    /** When the free_lowwater[] started to be recorded */
+    apr_time_t          decay_epoch;
+#if APR_HAS_THREADS
+    /** APR_MAGAZINE_COUNT thread caches, each SIZEOF_MAGAZINE_T bytes, or
+     * NULL unless created with APR_ALLOCATOR_THREAD_CACHE.
+     */
+    char               *magazines;
+    /** The malloc()ed block magazines was aligned from */
+    void               *magazines_mem;
+    /** The trimming thread, if any */
+    allocator_decay_thread_t *decay_thread;
+#endif /* APR_HAS_THREADS */
+#if ALLOCATOR_HAS_REGIONS
+    /** Set when the nodes are carved out of regions */
+    int                 use_regions;
+    /** All the regions, unmapped on destroy */
+    allocator_region_t *regions;
+    /** Set once MAP_HUGETLB failed, don't bother trying again */
+    int                 no_hugetlb;
+    /** What madvise() gives back memory by: the system page size, or
+     * REGION_SIZE once some regions are MAP_HUGETLB ones, whose pages
+     * can only be given back whole.
+     */
+    apr_size_t          purge_size;
+#endif /* ALLOCATOR_HAS_REGIONS */
+#if ALLOCATOR_HAS_NUMA
+    /** With APR_ALLOCATOR_NUMA_LOCAL, the heap of each NUMA node (created
+     * on first use), and the regions hashed by address to tell which heap
+     * the nodes given back belong to.  NULL otherwise.
+     */
+    allocator_heap_t  **heaps;
+    allocator_region_t **region_hash;
+#endif /* ALLOCATOR_HAS_NUMA */
+    /** NUMA node the regions are bound to, APR_ALLOCATOR_NUMA_LOCAL,
+     * or -1 */
+    int                 numa_node;
 };
 
 #define SIZEOF_ALLOCATOR_T  APR_ALIGN_DEFAULT(sizeof(apr_allocator_t))
 
+/* The size of a node, including the apr_memnode_t */
+#define node_size(node_) ((apr_size_t)((node_)->index + 1) << BOUNDARY_INDEX)
+
+/* Lowest and highest bits set in a (non-zero) bitmap */
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+#define bitmap_lowest(bits_)  ((apr_uint32_t)__builtin_ctz(bits_))
+#define bitmap_highest(bits_) ((apr_uint32_t)(31 - __builtin_clz(bits_)))
+#else
+static APR_INLINE apr_uint32_t bitmap_lowest(apr_uint32_t bits)
+{
+    apr_uint32_t i = 0;
+
+    while (!(bits & 1)) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+}
+
+static APR_INLINE apr_uint32_t bitmap_highest(apr_uint32_t bits)
+{
+    apr_uint32_t i = 0;
+
+    while (bits >>= 1)
+        i++;
+    return i;
+}
+#endif
+
+/* To be called when free[index] was emptied, with the mutex held */
+static APR_INLINE void free_list_emptied(allocator_heap_t *heap,
+                                         apr_uint32_t index)
+{
+    heap->free_bitmap &= ~((apr_uint32_t)1 << index);
+    heap->max_index = heap->free_bitmap
+                      ? bitmap_highest(heap->free_bitmap) : 0;
+}
+
+/* To be called when count nodes were taken from free[index], with the
+ * mutex held.
+ */
+static APR_INLINE void free_list_taken(allocator_heap_t *heap,
+                                       apr_uint32_t index, apr_uint32_t count)
+{
+    heap->free_count[index] -= count;
+    if (heap->free_count[index] < heap->free_lowwater[index])
+        heap->free_lowwater[index] = heap->free_count[index];
+
+    if (heap->free[index] == NULL)
+        free_list_emptied(heap, index);
+}
+
+/*
+ * The sink is a treap (a binary search tree by node index, heap ordered
+ * by a priority hashed from the node address), holding one node per
+ * size, with the other nodes of that size chained to it by their next
+ * field.  The tree links live in the first bytes of the nodes' memory,
+ * which is never purged, so insertion, best fit and removal are all in
+ * O(log n) without any allocation.
+ */
+typedef struct sink_link_t {
+    apr_memnode_t *left;
+    apr_memnode_t *right;
+} sink_link_t;
+
+#define sink_link(node_) \
+    ((sink_link_t *)((char *)(node_) + APR_MEMNODE_T_SIZE))
+
+static APR_INLINE apr_uint32_t sink_priority(const apr_memnode_t *node)
+{
+    apr_uint32_t x = (apr_uint32_t)((apr_uintptr_t)node >> 12);
+
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
+
+/* Split the tree t into the nodes smaller than index, put at *l, and
+ * the larger ones, put at *r.
+ */
+static APR_INLINE void sink_split(apr_memnode_t *t, apr_uint32_t index,
+                                  apr_memnode_t **l, apr_memnode_t **r)
+{
+    while (t != NULL) {
+        if (t->index < index) {
+            *l = t;
+            l = &sink_link(t)->right;
+            t = *l;
+        }
+        else {
+            *r = t;
+            r = &sink_link(t)->left;
+            t = *r;
+        }
+    }
+    *l = *r = NULL;
+}
+
+/* Put at *ref the merge of the trees l and r, all of l being smaller */
+static APR_INLINE void sink_merge(apr_memnode_t **ref, apr_memnode_t *l,
+                                  apr_memnode_t *r)
+{
+    while (l != NULL && r != NULL) {
+        if (sink_priority(l) >= sink_priority(r)) {
+            *ref = l;
+            ref = &sink_link(l)->right;
+            l = *ref;
+        }
+        else {
+            *ref = r;
+            ref = &sink_link(r)->left;
+            r = *ref;
+        }
+    }
+    *ref = l != NULL ? l : r;
+}
+
+/* Put an oversized node in the sink, with the mutex held */
+static APR_INLINE void sink_insert(allocator_heap_t *heap,
+                                   apr_memnode_t *node)
+{
+    apr_memnode_t *t, **ref;
+    apr_uint32_t priority;
+
+    heap->sink_count++;
+
+    for (t = heap->sink; t != NULL;
+         t = node->index < t->index ? sink_link(t)->left
+                                    : sink_link(t)->right) {
+        if (t->index == node->index) {
+            node->next = t->next;
+            t->next = node;
+            return;
+        }
+    }
+
+    APR_VALGRIND_UNDEFINED(sink_link(node), sizeof(sink_link_t));
+
+    /* Go down to where the node's priority fits, and make what is there
+     * its subtrees.
+     */
+    priority = sink_priority(node);
+    ref = &heap->sink;
+    while ((t = *ref) != NULL && sink_priority(t) >= priority)
+        ref = node->index < t->index ? &sink_link(t)->left
+                                     : &sink_link(t)->right;
+    node->next = NULL;
+    sink_split(t, node->index, &sink_link(node)->left,
+               &sink_link(node)->right);
+    *ref = node;
+}
+
+/* Remove a node of the size of the one at *ref, with the mutex held */
+static APR_INLINE apr_memnode_t *sink_remove(allocator_heap_t *heap,
+                                             apr_memnode_t **ref)
+{
+    apr_memnode_t *t = *ref, *node;
+
+    /* Rather take the chained nodes, which leaves the tree alone */
+    if ((node = t->next) != NULL)
+        t->next = node->next;
+    else {
+        node = t;
+        sink_merge(ref, sink_link(t)->left, sink_link(t)->right);
+    }
+
+    heap->sink_count--;
+    if (heap->sink_count < heap->sink_lowwater)
+        heap->sink_lowwater = heap->sink_count;
+
+    return node;
+}
+
+/* Take the smallest node of the sink that is at least index big,
+ * with the mutex held.
+ */
+static APR_INLINE apr_memnode_t *sink_take(allocator_heap_t *heap,
+                                           apr_uint32_t index)
+{
+    apr_memnode_t *t, **ref = &heap->sink, **fit = NULL;
+
+    while ((t = *ref) != NULL) {
+        if (t->index < index) {
+            ref = &sink_link(t)->right;
+            continue;
+        }
+        fit = ref;
+        if (t->index == index)
+            break;
+        ref = &sink_link(t)->left;
+    }
+
+    return fit != NULL ? sink_remove(heap, fit) : NULL;
+}
+
+/* Take the largest node of the sink, with the mutex held */
+static APR_INLINE apr_memnode_t *sink_take_largest(allocator_heap_t *heap)
+{
+    apr_memnode_t **ref = &heap->sink;
+
+    if (*ref == NULL)
+        return NULL;
+
+    while (sink_link(*ref)->right != NULL)
+        ref = &sink_link(*ref)->right;
+
+    return sink_remove(heap, ref);
+}
 
 /*
  * Allocator
  */
 
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
+{
+    return apr_allocator_create_ex(allocator, 0);
+}
+
+#if ALLOCATOR_HAS_REGIONS
+/* Have the nodes of a new allocator carved out of regions */
+static void allocator_use_regions(apr_allocator_t *allocator)
+{
+    if (!region_page_size)
+        region_page_size = sysconf(_SC_PAGESIZE);
+    allocator->use_regions = 1;
+    allocator->purge_size = region_page_size;
+}
+#endif /* ALLOCATOR_HAS_REGIONS */
+
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags)
 {
     apr_allocator_t *new_allocator;
 
@@ -156,29 +577,275 @@ APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
 
     memset(new_allocator, 0, SIZEOF_ALLOCATOR_T);
     new_allocator->max_free_index = APR_ALLOCATOR_MAX_FREE_UNLIMITED;
+    new_allocator->flags = flags;
+    new_allocator->heap.numa_node = -1;
+    new_allocator->numa_node = -1;
+
+#if ALLOCATOR_HAS_REGIONS
+    if (flags & APR_ALLOCATOR_HUGE_PAGES)
+        allocator_use_regions(new_allocator);
+#else
+    new_allocator->flags &= ~APR_ALLOCATOR_HUGE_PAGES;
+#endif
+
+#if APR_HAS_THREADS
+    if (flags & APR_ALLOCATOR_THREAD_CACHE) {
+        apr_size_t size = APR_MAGAZINE_COUNT * SIZEOF_MAGAZINE_T;
+
+        if ((new_allocator->magazines_mem = malloc(size + CACHELINE_SIZE))
+            == NULL) {
+            free(new_allocator);
+            return APR_ENOMEM;
+        }
+        new_allocator->magazines = (char *)APR_ALIGN(
+                (apr_uintptr_t)new_allocator->magazines_mem, CACHELINE_SIZE);
+        memset(new_allocator->magazines, 0, size);
+    }
+#endif /* APR_HAS_THREADS */
 
     *allocator = new_allocator;
 
     return APR_SUCCESS;
 }
 
-APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
+#if ALLOCATOR_HAS_NUMA
+/* Set the preferred NUMA node of [mem, mem + size), before any page
+ * is touched.
+ */
+static int numa_bind(void *mem, apr_size_t size, int numa_node)
 {
-    apr_uint32_t index;
-    apr_memnode_t *node, **ref;
+    unsigned long mask[NUMA_MAX_NODES / NUMA_MASK_BITS];
 
-    for (index = 0; index < MAX_INDEX; index++) {
-        ref = &allocator->free[index];
-        while ((node = *ref) != NULL) {
-            *ref = node->next;
+    memset(mask, 0, sizeof(mask));
+    mask[numa_node / NUMA_MASK_BITS] = 1UL << (numa_node % NUMA_MASK_BITS);
+
+    /* The kernel wants one more bit than the mask has */
+    return syscall(SYS_mbind, mem, size, NUMA_MPOL_PREFERRED,
+                   mask, NUMA_MAX_NODES + 1, 0);
+}
+#endif /* ALLOCATOR_HAS_NUMA */
+
+APR_DECLARE(apr_status_t) apr_allocator_numa_node_current(int *numa_node)
+{
+#if ALLOCATOR_HAS_NUMA
+    unsigned int cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+        return errno == ENOSYS ? APR_ENOTIMPL : errno;
+
+    *numa_node = (int)node;
+
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_allocator_create_numa(apr_allocator_t **allocator,
+                                                    int numa_node,
+                                                    apr_uint32_t flags)
+{
+#if ALLOCATOR_HAS_NUMA
+    apr_allocator_t *new_allocator;
+    apr_status_t rv;
+    apr_size_t page_size;
+    int probe_node = numa_node;
+    void *mem;
+
+    *allocator = NULL;
+
+    if (numa_node == APR_ALLOCATOR_NUMA_CURRENT
+        || numa_node == APR_ALLOCATOR_NUMA_LOCAL) {
+        if ((rv = apr_allocator_numa_node_current(&probe_node))
+            != APR_SUCCESS)
+            return rv;
+        if (numa_node == APR_ALLOCATOR_NUMA_CURRENT)
+            numa_node = probe_node;
+    }
+    if (probe_node < 0 || probe_node >= NUMA_MAX_NODES)
+        return APR_EINVAL;
+
+    /* Let the kernel tell whether the node exists (and has memory),
+     * rather than finding out on the first allocation.
+     */
+    page_size = sysconf(_SC_PAGESIZE);
+    mem = mmap(NULL, page_size, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE|MAP_ANON, -1, 0);
+    if (mem == MAP_FAILED)
+        return errno;
+    rv = numa_bind(mem, page_size, probe_node) != 0 ? errno : APR_SUCCESS;
+    munmap(mem, page_size);
+    if (rv != APR_SUCCESS)
+        return rv == ENOSYS || rv == EPERM ? APR_ENOTIMPL : rv;
+
+    if ((rv = apr_allocator_create_ex(&new_allocator, flags))
+        != APR_SUCCESS)
+        return rv;
+
+    if (!new_allocator->use_regions)
+        allocator_use_regions(new_allocator);
+    new_allocator->numa_node = numa_node;
+
+    if (numa_node == APR_ALLOCATOR_NUMA_LOCAL) {
+        new_allocator->heaps = calloc(NUMA_MAX_NODES,
+                                      sizeof(allocator_heap_t *));
+        new_allocator->region_hash = calloc(REGION_HASH_SIZE,
+                                            sizeof(allocator_region_t *));
+        if (!new_allocator->heaps || !new_allocator->region_hash) {
+            apr_allocator_destroy(new_allocator);
+            return APR_ENOMEM;
+        }
+    }
+    else {
+        new_allocator->heap.numa_node = numa_node;
+    }
+
+    *allocator = new_allocator;
+
+    return APR_SUCCESS;
+#else
+    *allocator = NULL;
+
+    return APR_ENOTIMPL;
+#endif
+}
+
+#if ALLOCATOR_HAS_NUMA
+/* The heap of the NUMA node the calling thread is running on, created
+ * on first use, or the allocator's own one if the node can't be told.
+ */
+static allocator_heap_t *numa_heap_current(apr_allocator_t *allocator)
+{
+    allocator_heap_t *heap;
+    unsigned int cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0
+        || node >= NUMA_MAX_NODES)
+        return &allocator->heap;
+
+    if ((heap = allocator->heaps[node]) == NULL) {
+        if ((heap = calloc(1, sizeof(*heap))) == NULL)
+            return &allocator->heap;
+        heap->numa_node = (int)node;
+
+        /* Another thread may have been faster */
+        if (apr_atomic_casptr((volatile void **)&allocator->heaps[node],
+                              heap, NULL) != NULL) {
+            free(heap);
+            heap = allocator->heaps[node];
+        }
+    }
+
+    return heap;
+}
+#endif /* ALLOCATOR_HAS_NUMA */
+
+/* The heap which the calling thread allocates from */
+static APR_INLINE
+allocator_heap_t *allocator_heap_get(apr_allocator_t *allocator)
+{
+#if ALLOCATOR_HAS_NUMA
+    if (allocator->heaps)
+        return numa_heap_current(allocator);
+#endif
+    return &allocator->heap;
+}
+
+static APR_INLINE void node_list_destroy(apr_allocator_t *allocator,
+                                         apr_memnode_t *node)
+{
+    apr_memnode_t *next;
+
+    while (node != NULL) {
+        next = node->next;
+#if ALLOCATOR_HAS_REGIONS
+        if (allocator->use_regions) {
+            /* Carved nodes go away with their region */
+            if (!region_node_is_carved(node))
+                munmap(node, (apr_size_t)(node->index+1) << BOUNDARY_INDEX);
+        }
+        else
+#endif
 #if APR_ALLOCATOR_USES_MMAP
-            munmap((char *)node - GUARDPAGE_SIZE,
-                   2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
+        munmap((char *)node - GUARDPAGE_SIZE,
+               2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
 #else
-            free(node);
+        free(node);
+#endif
+        node = next;
+    }
+}
+
+#if APR_HAS_THREADS
+static void decay_thread_stop(apr_allocator_t *allocator);
+#endif
+
+static void heap_destroy(apr_allocator_t *allocator, allocator_heap_t *heap)
+{
+    apr_uint32_t index;
+
+    apr_memnode_t *node;
+
+    for (index = 0; index < MAX_INDEX; index++) {
+        node_list_destroy(allocator, heap->free[index]);
+    }
+    while ((node = sink_take_largest(heap)) != NULL) {
+        node->next = NULL;
+        node_list_destroy(allocator, node);
+    }
+}
+
+APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
+{
+    apr_uint32_t index;
+
+#if APR_HAS_THREADS
+    if (allocator->decay_thread)
+        decay_thread_stop(allocator);
 #endif
+
+    heap_destroy(allocator, &allocator->heap);
+#if ALLOCATOR_HAS_NUMA
+    if (allocator->heaps) {
+        for (index = 0; index < NUMA_MAX_NODES; index++) {
+            if (allocator->heaps[index]) {
+                heap_destroy(allocator, allocator->heaps[index]);
+                free(allocator->heaps[index]);
+            }
+        }
+        free(allocator->heaps);
+    }
+#endif /* ALLOCATOR_HAS_NUMA */
+    node_list_destroy(allocator, allocator->pool_cache);
+
+#if APR_HAS_THREADS
+    if (allocator->magazines) {
+        allocator_magazine_t *mag;
+        apr_uint32_t slot;
+
+        for (slot = 0; slot < APR_MAGAZINE_COUNT; slot++) {
+            mag = apr_magazine_slot(allocator->magazines, SIZEOF_MAGAZINE_T,
+                                    slot);
+            for (index = 1; index < MAX_INDEX; index++) {
+                node_list_destroy(allocator, mag->free[index]);
+            }
         }
+        free(allocator->magazines_mem);
+    }
+#endif /* APR_HAS_THREADS */
+
+#if ALLOCATOR_HAS_REGIONS
+    while (allocator->regions) {
+        allocator_region_t *region = allocator->regions;
+
+        allocator->regions = region->next;
+        munmap(region->base, REGION_SIZE);
+        free(region);
     }
+#endif /* ALLOCATOR_HAS_REGIONS */
+#if ALLOCATOR_HAS_NUMA
+    free(allocator->region_hash);
+#endif
 
     free(allocator);
 }
@@ -208,6 +875,11 @@ APR_DECLARE(apr_pool_t *) apr_allocator_owner_get(apr_allocator_t *allocator)
     return allocator->owner;
 }
 
+APR_DECLARE(int) apr_allocator_numa_node_get(apr_allocator_t *allocator)
+{
+    return allocator->numa_node;
+}
+
 APR_DECLARE(void) apr_allocator_max_free_set(apr_allocator_t *allocator,
                                              apr_size_t in_size)
 {
@@ -235,15 +907,573 @@ APR_DECLARE(void) apr_allocator_max_free_set(apr_allocator_t *allocator,
 #endif
 }
 
+#if APR_HAS_THREADS
+/*
+ * Thread caches
+ */
+
+#define magazine_acquire(allocator) \
+    ((allocator_magazine_t *)apr_magazine_acquire((allocator)->magazines, \
+                                                  SIZEOF_MAGAZINE_T))
+#define magazine_release(mag) apr_magazine_release(mag)
+
+/* Take a node of the given index from the calling thread's cache,
+ * refilling the cache from the heap's free list if needed.
+ */
 static APR_INLINE
-apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
+apr_memnode_t *magazine_alloc(apr_allocator_t *allocator,
+                              allocator_heap_t *heap, apr_size_t index)
 {
-    apr_memnode_t *node, **ref;
-    apr_uint32_t max_index, upper_index;
-    apr_size_t size, i, index;
+    allocator_magazine_t *mag;
+    apr_memnode_t *node, *batch = NULL, *last = NULL;
+    apr_uint32_t count = 0;
 
-    /* Round up the block size to the next boundary, but always
-     * allocate at least a certain size (MIN_ALLOC).
+    if ((mag = magazine_acquire(allocator)) == NULL)
+        return NULL;
+
+    /* The bitmap is only peeked at to avoid locking for nothing, it is
+     * checked again under the mutex.  The slot is not held while waiting
+     * for the mutex, see apr_magazine_lock().
+     */
+    if (mag->free[index] == NULL
+        && (apr_atomic_read32(&heap->free_bitmap)
+            & ((apr_uint32_t)1 << index))) {
+        magazine_release(mag);
+
+        if (allocator->mutex)
+            apr_thread_mutex_lock(allocator->mutex);
+
+        while (count < MAGAZINE_BATCH
+               && (node = heap->free[index]) != NULL) {
+            heap->free[index] = node->next;
+            if ((node->next = batch) == NULL)
+                last = node;
+            batch = node;
+            count++;
+        }
+
+        if (count) {
+            allocator->stats.free_bytes -= (apr_size_t)count * (index + 1)
+                                           << BOUNDARY_INDEX;
+            allocator->current_free_index += count * (index + 1);
+            if (allocator->current_free_index > allocator->max_free_index)
+                allocator->current_free_index = allocator->max_free_index;
+
+            free_list_taken(heap, (apr_uint32_t)index, count);
+        }
+
+        if (allocator->mutex)
+            apr_thread_mutex_unlock(allocator->mutex);
+
+        if (batch == NULL)
+            return NULL;
+
+        if ((mag = magazine_acquire(allocator)) == NULL) {
+            /* Another thread took the slot meanwhile, keep one node and
+             * give the others back.
+             */
+            node = batch;
+            batch = node->next;
+            if (allocator->mutex)
+                apr_thread_mutex_lock(allocator->mutex);
+            allocator->stats.reuse_count++;
+            if (batch) {
+                if ((last->next = heap->free[index]) == NULL) {
+                    heap->free_bitmap |= (apr_uint32_t)1 << index;
+                    if (index > heap->max_index)
+                        heap->max_index = index;
+                }
+                heap->free[index] = batch;
+                heap->free_count[index] += count - 1;
+                allocator->stats.free_bytes += (apr_size_t)(count - 1)
+                                               * (index + 1)
+                                               << BOUNDARY_INDEX;
+                if (allocator->current_free_index >= (count - 1) * (index + 1))
+                    allocator->current_free_index -= (count - 1) * (index + 1);
+                else
+                    allocator->current_free_index = 0;
+            }
+            if (allocator->mutex)
+                apr_thread_mutex_unlock(allocator->mutex);
+            return node;
+        }
+
+        /* The slot may have been refilled meanwhile, append to it */
+        last->next = mag->free[index];
+        mag->free[index] = batch;
+        mag->count[index] += count;
+        mag->free_index += count * (index + 1);
+    }
+
+    if ((node = mag->free[index]) != NULL) {
+        mag->free[index] = node->next;
+        mag->count[index]--;
+        mag->free_index -= index + 1;
+        mag->reuse_count++;
+    }
+
+    magazine_release(mag);
+
+    return node;
+}
+
+/* Keep as many of the given nodes as fit in the calling thread's cache,
+ * and return the list of those which have to go to the shared lists.
+ */
+static APR_INLINE
+apr_memnode_t *magazine_free(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+    allocator_magazine_t *mag;
+    apr_memnode_t *next, *flush, *rest = NULL;
+    apr_uint32_t index, n;
+
+    if ((mag = magazine_acquire(allocator)) == NULL)
+        return node;
+
+    do {
+        next = node->next;
+        index = node->index;
+
+        if (index >= MAX_INDEX) {
+            node->next = rest;
+            rest = node;
+            continue;
+        }
+
+        if (mag->count[index] >= MAGAZINE_DEPTH
+            || mag->free_index + index + 1 > MAGAZINE_MAX_FREE_INDEX) {
+            /* Make room by handing a batch of this size back */
+            for (n = 0; n < MAGAZINE_BATCH
+                        && (flush = mag->free[index]) != NULL; n++) {
+                mag->free[index] = flush->next;
+                flush->next = rest;
+                rest = flush;
+            }
+            mag->count[index] -= n;
+            mag->free_index -= n * (index + 1);
+            /* They will be counted again by the shared lists */
+            mag->free_count -= n;
+
+            if (mag->free_index + index + 1 > MAGAZINE_MAX_FREE_INDEX) {
+                node->next = rest;
+                rest = node;
+                continue;
+            }
+        }
+
+        APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                              (node->index+1) << BOUNDARY_INDEX);
+
+        node->next = mag->free[index];
+        mag->free[index] = node;
+        mag->count[index]++;
+        mag->free_index += index + 1;
+        mag->free_count++;
+    } while ((node = next) != NULL);
+
+    magazine_release(mag);
+
+    return rest;
+}
+#endif /* APR_HAS_THREADS */
+
+static APR_INLINE
+void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node);
+
+#if ALLOCATOR_HAS_REGIONS
+/*
+ * Regions
+ */
+
+/* Map *size bytes (a multiple of the page size) aligned on REGION_SIZE.
+ * For APR_ALLOCATOR_HUGE_PAGES, preferably from the reserved huge pages,
+ * in which case *size is rounded up to REGION_SIZE, otherwise asking for
+ * transparent huge pages.  The mapping is bound to the heap's NUMA node,
+ * if any.
+ */
+static char *region_map(apr_allocator_t *allocator, allocator_heap_t *heap,
+                        apr_size_t *size)
+{
+    apr_size_t len = *size;
+    char *mem, *aligned;
+
+#ifdef MAP_HUGETLB
+    if ((allocator->flags & APR_ALLOCATOR_HUGE_PAGES)
+        && !allocator->no_hugetlb) {
+        /* Pages of REGION_SIZE, whatever the system's default size */
+        len = APR_ALIGN(len, REGION_SIZE);
+        mem = mmap(NULL, len, PROT_READ|PROT_WRITE,
+                   MAP_PRIVATE|MAP_ANON|MAP_HUGETLB
+#ifdef MAP_HUGE_2MB
+                   |MAP_HUGE_2MB
+#endif
+                   , -1, 0);
+        if (mem != MAP_FAILED) {
+            allocator->purge_size = REGION_SIZE;
+            aligned = mem;
+            *size = len;
+            goto bind;
+        }
+
+        allocator->no_hugetlb = 1;
+        len = *size;
+    }
+#endif
+
+    /* Over-map so that the region can be aligned, then trim */
+    mem = mmap(NULL, len + REGION_SIZE, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE|MAP_ANON, -1, 0);
+    if (mem == MAP_FAILED)
+        return NULL;
+
+    aligned = (char *)APR_ALIGN((apr_uintptr_t)mem, REGION_SIZE);
+    if (aligned != mem)
+        munmap(mem, aligned - mem);
+    munmap(aligned + len, (mem + REGION_SIZE) - aligned);
+
+#ifdef MADV_HUGEPAGE
+    if (allocator->flags & APR_ALLOCATOR_HUGE_PAGES)
+        madvise(aligned, len, MADV_HUGEPAGE);
+#endif
+
+#ifdef MAP_HUGETLB
+bind:
+#endif
+#if ALLOCATOR_HAS_NUMA
+    if (heap->numa_node >= 0)
+        numa_bind(aligned, len, heap->numa_node);
+#endif
+
+    return aligned;
+}
+
+/* Get a new node of the given size, carved out of the heap's current
+ * region or mapped on its own when large.
+ */
+static apr_memnode_t *region_alloc(apr_allocator_t *allocator,
+                                   allocator_heap_t *heap, apr_size_t size)
+{
+    apr_memnode_t *node, *tail = NULL;
+    allocator_region_t *region;
+    apr_size_t map_size = REGION_SIZE, tail_size;
+    char *mem;
+
+    if (size > REGION_MAX_NODE) {
+        size = APR_ALIGN(size, region_page_size);
+        if ((mem = region_map(allocator, heap, &size)) == NULL)
+            return NULL;
+
+        node = (apr_memnode_t *)mem;
+        node->index = (apr_uint32_t)(size >> BOUNDARY_INDEX) - 1;
+        node->endp = mem + size;
+
+        return node;
+    }
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+    if ((apr_size_t)(heap->region_endp - heap->region_avail) < size) {
+        if ((region = malloc(sizeof(*region))) == NULL
+            || (mem = region_map(allocator, heap, &map_size)) == NULL) {
+#if APR_HAS_THREADS
+            if (allocator->mutex)
+                apr_thread_mutex_unlock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+            free(region);
+            return NULL;
+        }
+
+        /* What is left of the current region becomes a free node */
+        tail_size = APR_ALIGN(heap->region_endp - heap->region_avail + 1,
+                              BOUNDARY_SIZE) - BOUNDARY_SIZE;
+        if (tail_size >= MIN_ALLOC) {
+            tail = (apr_memnode_t *)heap->region_avail;
+            tail->next = NULL;
+            tail->index = (apr_uint32_t)(tail_size >> BOUNDARY_INDEX) - 1;
+            tail->endp = (char *)tail + tail_size;
+        }
+
+        region->base = mem;
+        region->heap = heap;
+        region->next = allocator->regions;
+        allocator->regions = region;
+#if ALLOCATOR_HAS_NUMA
+        if (allocator->region_hash) {
+            region->hash_next = allocator->region_hash[region_hash(mem)];
+            allocator->region_hash[region_hash(mem)] = region;
+        }
+#endif /* ALLOCATOR_HAS_NUMA */
+        heap->region_avail = mem;
+        heap->region_endp = mem + REGION_SIZE;
+    }
+
+    node = (apr_memnode_t *)heap->region_avail;
+    heap->region_avail += size;
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+    node->index = (apr_uint32_t)(size >> BOUNDARY_INDEX) - 1;
+    node->endp = (char *)node + size;
+
+    if (tail)
+        allocator_free(allocator, tail);
+
+    return node;
+}
+
+/* Give back to the system the pages of a node carved out of a region,
+ * keeping the node itself.  Returns 0 if the node was not carved (and is
+ * to be given back as a whole), 1 if it was purged, or -1 if it was not
+ * purged now: because it does not span a whole huge page, or was purged
+ * already and not used since.  A purged node is marked with a NULL
+ * first_avail, which taking it from the free lists resets.
+ */
+static APR_INLINE
+int region_node_purge(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+    apr_size_t purge_size;
+    char *beginp, *endp;
+
+    if (!allocator->use_regions || !region_node_is_carved(node))
+        return 0;
+    if (node->first_avail == NULL)
+        return -1;
+
+    purge_size = allocator->purge_size;
+    beginp = (char *)APR_ALIGN((apr_uintptr_t)node + APR_MEMNODE_T_SIZE,
+                               purge_size);
+    endp = (char *)((apr_uintptr_t)node->endp & ~(purge_size - 1));
+    if (beginp >= endp || madvise(beginp, endp - beginp, MADV_DONTNEED) != 0)
+        return -1;
+
+    node->first_avail = NULL;
+    return 1;
+}
+#else
+#define region_node_purge(allocator, node) 0
+#endif /* ALLOCATOR_HAS_REGIONS */
+
+/* The heap a node given back belongs to, with the mutex held, or NULL
+ * if the node is not to be kept: with APR_ALLOCATOR_NUMA_LOCAL, only the
+ * nodes carved out of regions are, the others being mapped on their own
+ * for the node of the thread asking for them.
+ */
+static APR_INLINE
+allocator_heap_t *allocator_heap_of(apr_allocator_t *allocator,
+                                    apr_memnode_t *node)
+{
+#if ALLOCATOR_HAS_NUMA
+    if (allocator->region_hash) {
+        allocator_region_t *region;
+        char *base;
+
+        if (!region_node_is_carved(node))
+            return NULL;
+
+        base = (char *)((apr_uintptr_t)node & ~((apr_uintptr_t)REGION_SIZE
+                                                - 1));
+        for (region = allocator->region_hash[region_hash(base)];
+             region != NULL; region = region->hash_next) {
+            if (region->base == base)
+                return region->heap;
+        }
+    }
+#endif /* ALLOCATOR_HAS_NUMA */
+
+    return &allocator->heap;
+}
+
+/* Account for a node just taken from the system, which unlike the
+ * free lists is done without holding the mutex: with relaxed atomic
+ * increments where the compiler has 64 bit ones, the mutex otherwise.
+ */
+#if defined(__ATOMIC_RELAXED) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+#define STATS_ATOMIC 1
+#define stats_add(counter_, n_) \
+    ((void)__atomic_fetch_add(&(counter_), (n_), __ATOMIC_RELAXED))
+#define stats_load(counter_) __atomic_load_n(&(counter_), __ATOMIC_RELAXED)
+#else
+#define STATS_ATOMIC 0
+#endif
+
+static APR_INLINE
+void allocator_stats_fresh(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+#if STATS_ATOMIC
+    stats_add(allocator->stats.fresh_count, 1);
+    stats_add(allocator->stats.fresh_bytes, node_size(node));
+#else
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+    allocator->stats.fresh_count++;
+    allocator->stats.fresh_bytes += node_size(node);
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+#endif /* STATS_ATOMIC */
+}
+
+/*
+ * Allocation profiling
+ *
+ * When enabled by apr_pool_profile_start(), about one in profile_rate
+ * allocations is recorded in a fixed size table of sites, keyed by the
+ * tag pointer of the pool and the caller: its file and line when it went
+ * through the APR_POOL_PROFILE macros, its address otherwise.  Recording
+ * takes a
+ * spin lock rather than a mutex, and never allocates, since it happens
+ * from within the allocators being profiled.
+ */
+
+#define PROFILE_SITES       1024 /* must be a power of two */
+#define PROFILE_PROBES      16
+#define PROFILE_TAG_LEN     48
+
+/* Where an allocation comes from, passed down by the public functions */
+typedef struct profile_caller_t {
+    const void   *addr;      /* the return address of the public function */
+    const char   *file_line; /* or NULL if not called through the macros */
+} profile_caller_t;
+
+static APR_INLINE profile_caller_t profile_caller(const void *addr,
+                                                  const char *file_line)
+{
+    profile_caller_t caller;
+
+    caller.addr = addr;
+    caller.file_line = file_line;
+    return caller;
+}
+
+#if defined(__GNUC__)
+#define PROFILE_CALLER_AT(file_line) \
+    profile_caller(__builtin_return_address(0), file_line)
+#else
+#define PROFILE_CALLER_AT(file_line) profile_caller(NULL, file_line)
+#endif
+#define PROFILE_CALLER() PROFILE_CALLER_AT(NULL)
+
+typedef struct profile_site_t {
+    const char   *tag_key; /* the pool's tag pointer, part of the key */
+    const void   *caller_key; /* the file_line if any, else the address */
+    const void   *caller;
+    const char   *file_line;
+    apr_uint64_t  samples; /* zero for unused entries */
+    apr_uint64_t  alloc_bytes;
+    apr_uint64_t  node_bytes;
+    char          tag[PROFILE_TAG_LEN];
+} profile_site_t;
+
+static profile_site_t profile_sites[PROFILE_SITES];
+static apr_uint64_t profile_dropped; /* samples which found no room */
+static volatile apr_uint32_t profile_lock;
+static volatile apr_uint32_t profile_seq;
+/* Zero when not profiling, otherwise a sample is taken whenever a 32 bit
+ * random number is below profile_threshold.
+ */
+static volatile apr_uint32_t profile_rate;
+static volatile apr_uint32_t profile_threshold;
+
+static APR_INLINE apr_uint32_t profile_hash(apr_uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
+
+/* Draw for allocations which may happen from any thread */
+static APR_INLINE int profile_draw_shared(const void *p)
+{
+    apr_uint32_t seq = apr_atomic_inc32(&profile_seq);
+
+    return profile_hash(seq * 0x9e3779b1
+                        ^ (apr_uint32_t)((apr_uintptr_t)p >> 4))
+           < profile_threshold;
+}
+
+static APR_INLINE void profile_lock_acquire(void)
+{
+#if APR_HAS_THREADS
+    while (apr_atomic_cas32(&profile_lock, 1, 0) != 0)
+        apr_thread_yield();
+#endif
+}
+
+static APR_INLINE void profile_lock_release(void)
+{
+#if APR_HAS_THREADS
+    apr_atomic_cas32(&profile_lock, 0, 1);
+#endif
+}
+
+/* The sizes are scaled by the rate to estimate the bytes not sampled */
+static void profile_record(const char *tag, profile_caller_t caller,
+                           apr_size_t alloc_bytes, apr_size_t node_bytes)
+{
+    apr_uint32_t rate = profile_rate, i, n;
+    profile_site_t *site;
+    const void *key;
+
+    if (!rate)
+        return;
+
+    key = caller.file_line ? (const void *)caller.file_line : caller.addr;
+    i = profile_hash((apr_uint32_t)((apr_uintptr_t)key
+                                    ^ ((apr_uintptr_t)tag >> 3) * 31));
+
+    profile_lock_acquire();
+    for (n = 0; n < PROFILE_PROBES; n++, i++) {
+        site = &profile_sites[i & (PROFILE_SITES - 1)];
+        if (!site->samples) {
+            site->tag_key = tag;
+            site->caller_key = key;
+            site->caller = caller.addr;
+            site->file_line = caller.file_line;
+            if (tag)
+                apr_cpystrn(site->tag, tag, sizeof(site->tag));
+            else
+                site->tag[0] = '\0';
+            break;
+        }
+        if (site->tag_key == tag && site->caller_key == key)
+            break;
+    }
+    if (n < PROFILE_PROBES) {
+        site->samples++;
+        site->alloc_bytes += (apr_uint64_t)alloc_bytes * rate;
+        site->node_bytes += (apr_uint64_t)node_bytes * rate;
+    }
+    else {
+        profile_dropped++;
+    }
+    profile_lock_release();
+}
+
+static APR_INLINE
+apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size,
+                              const char *tag, profile_caller_t caller)
+{
+    allocator_heap_t *heap;
+    apr_memnode_t *node;
+    apr_uint32_t max_index, upper_index, bits;
+    apr_size_t size, i, index;
+
+    /* Round up the block size to the next boundary, but always
+     * allocate at least a certain size (MIN_ALLOC).
      */
     size = APR_ALIGN(in_size + APR_MEMNODE_T_SIZE, BOUNDARY_SIZE);
     if (size < in_size) {
@@ -261,55 +1491,47 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
         return NULL;
     }
 
+    heap = allocator_heap_get(allocator);
+
+#if APR_HAS_THREADS
+    /* Try the calling thread's cache first, without locking */
+    if (allocator->magazines && index < MAX_INDEX
+        && (node = magazine_alloc(allocator, heap, index)) != NULL) {
+        goto have_node;
+    }
+#endif /* APR_HAS_THREADS */
+
     /* First see if there are any nodes in the area we know
      * our node will fit into.
      */
-    if (index <= allocator->max_index) {
+    if (index <= heap->max_index) {
 #if APR_HAS_THREADS
         if (allocator->mutex)
             apr_thread_mutex_lock(allocator->mutex);
 #endif /* APR_HAS_THREADS */
 
-        /* Walk the free list to see if there are
-         * any nodes on it of the requested size
+        /* Look for the smallest non-empty list of nodes of
+         * the requested size.
          *
          * If there is no exact match, look for nodes
          * of up to twice the requested size, so we
          * won't unnecessarily allocate more memory
          * nor waste too much of what we have.
-         *
-         * NOTE: an optimization would be to check
-         * allocator->free[index] first and if no
-         * node is present, directly use
-         * allocator->free[max_index].  This seems
-         * like overkill though and could cause
-         * memory waste.
          */
-        max_index = allocator->max_index;
+        max_index = (apr_uint32_t)heap->max_index;
         upper_index = 2 * index < max_index ? 2 * index : max_index;
-        ref = &allocator->free[index];
-        i = index;
-        while (*ref == NULL && i < upper_index) {
-           ref++;
-           i++;
-        }
-
-        if ((node = *ref) != NULL) {
-            /* If we have found a node and it doesn't have any
-             * nodes waiting in line behind it _and_ we are on
-             * the highest available index, find the new highest
-             * available index
-             */
-            if ((*ref = node->next) == NULL && i >= max_index) {
-                do {
-                    ref--;
-                    max_index--;
-                }
-                while (*ref == NULL && max_index > 0);
-
-                allocator->max_index = max_index;
-            }
-
+        bits = heap->free_bitmap
+               & ~(((apr_uint32_t)1 << index) - 1)
+               & (((apr_uint32_t)2 << upper_index) - 1);
+
+        if (bits) {
+            i = bitmap_lowest(bits);
+            node = heap->free[i];
+            heap->free[i] = node->next;
+            free_list_taken(heap, (apr_uint32_t)i, 1);
+
+            allocator->stats.reuse_count++;
+            allocator->stats.free_bytes -= node_size(node);
             allocator->current_free_index += node->index + 1;
             if (allocator->current_free_index > allocator->max_free_index)
                 allocator->current_free_index = allocator->max_free_index;
@@ -328,25 +1550,20 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
 #endif /* APR_HAS_THREADS */
     }
 
-    /* If we found nothing, seek the sink (at index 0), if
-     * it is not empty.
+    /* If we found nothing, seek the sink, if it is not empty.
      */
-    else if (allocator->free[0]) {
+    else if (heap->sink != NULL) {
 #if APR_HAS_THREADS
         if (allocator->mutex)
             apr_thread_mutex_lock(allocator->mutex);
 #endif /* APR_HAS_THREADS */
 
-        /* Walk the free list to see if there are
-         * any nodes on it of the requested size
-         */
-        ref = &allocator->free[0];
-        while ((node = *ref) != NULL && index > node->index)
-            ref = &node->next;
-
-        if (node) {
-            *ref = node->next;
-
+        /* Best fit among the nodes of the requested size or more */
+        if ((node = sink_take(heap, (apr_uint32_t)index)) != NULL) {
+            allocator->stats.reuse_count++;
+            allocator->stats.free_bytes -= node_size(node);
+            allocator->stats.sink_count--;
+            allocator->stats.sink_bytes -= node_size(node);
             allocator->current_free_index += node->index + 1;
             if (allocator->current_free_index > allocator->max_free_index)
                 allocator->current_free_index = allocator->max_free_index;
@@ -368,6 +1585,16 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
     /* If we haven't got a suitable node, malloc a new one
      * and initialize it.
      */
+#if ALLOCATOR_HAS_REGIONS
+    if (allocator->use_regions) {
+        if ((node = region_alloc(allocator, heap, size)) == NULL)
+            return NULL;
+
+        allocator_stats_fresh(allocator, node);
+        goto have_node;
+    }
+#endif /* ALLOCATOR_HAS_REGIONS */
+
 #if APR_ALLOCATOR_GUARD_PAGES
     if ((node = mmap(NULL, size + 2 * GUARDPAGE_SIZE, PROT_NONE,
                      MAP_PRIVATE|MAP_ANON, -1, 0)) == MAP_FAILED)
@@ -389,10 +1616,15 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
     node->index = index;
     node->endp = (char *)node + size;
 
+    allocator_stats_fresh(allocator, node);
+
 have_node:
     node->next = NULL;
     node->first_avail = (char *)node + APR_MEMNODE_T_SIZE;
 
+    if (profile_rate && profile_draw_shared(node))
+        profile_record(tag, caller, 0, node_size(node));
+
     APR_VALGRIND_UNDEFINED(node->first_avail, size - APR_MEMNODE_T_SIZE);
 
     return node;
@@ -401,16 +1633,21 @@ have_node:
 static APR_INLINE
 void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
 {
+    allocator_heap_t *heap;
     apr_memnode_t *next, *freelist = NULL;
-    apr_uint32_t index, max_index;
+    apr_uint32_t index;
     apr_uint32_t max_free_index, current_free_index;
 
 #if APR_HAS_THREADS
+    if (allocator->magazines
+        && (node = magazine_free(allocator, node)) == NULL) {
+        return;
+    }
+
     if (allocator->mutex)
         apr_thread_mutex_lock(allocator->mutex);
 #endif /* APR_HAS_THREADS */
 
-    max_index = allocator->max_index;
     max_free_index = allocator->max_free_index;
     current_free_index = allocator->current_free_index;
 
@@ -424,20 +1661,39 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
         APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
                               (node->index+1) << BOUNDARY_INDEX);
 
-        if (max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED
-            && index + 1 > current_free_index) {
-            node->next = freelist;
-            freelist = node;
+        allocator->stats.free_count++;
+
+        heap = allocator_heap_of(allocator, node);
+        if (heap == NULL
+            || (max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED
+                && index + 1 > current_free_index)) {
+            /* Carved nodes stay on the free lists, without their pages */
+            int purged = region_node_purge(allocator, node);
+
+            if (purged >= 0) {
+                allocator->stats.release_count++;
+                allocator->stats.release_bytes += node_size(node);
+            }
+            if (purged == 0) {
+                node->next = freelist;
+                freelist = node;
+                continue;
+            }
         }
-        else if (index < MAX_INDEX) {
+
+        allocator->stats.free_bytes += node_size(node);
+
+        if (index < MAX_INDEX) {
             /* Add the node to the appropriate 'size' bucket.  Adjust
              * the max_index when appropriate.
              */
-            if ((node->next = allocator->free[index]) == NULL
-                && index > max_index) {
-                max_index = index;
+            if ((node->next = heap->free[index]) == NULL) {
+                heap->free_bitmap |= (apr_uint32_t)1 << index;
+                if (index > heap->max_index)
+                    heap->max_index = index;
             }
-            allocator->free[index] = node;
+            heap->free[index] = node;
+            heap->free_count[index]++;
             if (current_free_index >= index + 1)
                 current_free_index -= index + 1;
             else
@@ -445,10 +1701,11 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
         }
         else {
             /* This node is too large to keep in a specific size bucket,
-             * just add it to the sink (at index 0).
+             * just add it to the sink.
              */
-            node->next = allocator->free[0];
-            allocator->free[0] = node;
+            sink_insert(heap, node);
+            allocator->stats.sink_count++;
+            allocator->stats.sink_bytes += node_size(node);
             if (current_free_index >= index + 1)
                 current_free_index -= index + 1;
             else
@@ -456,30 +1713,22 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
         }
     } while ((node = next) != NULL);
 
-    allocator->max_index = max_index;
     allocator->current_free_index = current_free_index;
+    if (allocator->stats.free_bytes > allocator->stats.free_bytes_max)
+        allocator->stats.free_bytes_max = allocator->stats.free_bytes;
 
 #if APR_HAS_THREADS
     if (allocator->mutex)
         apr_thread_mutex_unlock(allocator->mutex);
 #endif /* APR_HAS_THREADS */
 
-    while (freelist != NULL) {
-        node = freelist;
-        freelist = node->next;
-#if APR_ALLOCATOR_USES_MMAP
-        munmap((char *)node - GUARDPAGE_SIZE,
-               2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
-#else
-        free(node);
-#endif
-    }
+    node_list_destroy(allocator, freelist);
 }
 
 APR_DECLARE(apr_memnode_t *) apr_allocator_alloc(apr_allocator_t *allocator,
                                                  apr_size_t size)
 {
-    return allocator_alloc(allocator, size);
+    return allocator_alloc(allocator, size, NULL, PROFILE_CALLER());
 }
 
 APR_DECLARE(void) apr_allocator_free(apr_allocator_t *allocator,
@@ -488,9 +1737,372 @@ APR_DECLARE(void) apr_allocator_free(apr_allocator_t *allocator,
     allocator_free(allocator, node);
 }
 
+APR_DECLARE(void) apr_allocator_stats_get(apr_allocator_t *allocator,
+                                          apr_allocator_stats_t *stats)
+{
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
 
+    *stats = allocator->stats;
+    stats->pool_cache_count = allocator->pool_cache_count;
+#if STATS_ATOMIC
+    stats->fresh_count = stats_load(allocator->stats.fresh_count);
+    stats->fresh_bytes = stats_load(allocator->stats.fresh_bytes);
+#endif
 
-/*
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+
+    if (allocator->magazines) {
+        allocator_magazine_t *mag;
+        apr_uint32_t slot;
+
+        for (slot = 0; slot < APR_MAGAZINE_COUNT; slot++) {
+            mag = apr_magazine_slot(allocator->magazines, SIZEOF_MAGAZINE_T,
+                                    slot);
+            apr_magazine_lock(mag);
+
+            stats->reuse_count += mag->reuse_count;
+            stats->free_count += mag->free_count;
+            stats->free_bytes += (apr_size_t)mag->free_index << BOUNDARY_INDEX;
+
+            magazine_release(mag);
+        }
+    }
+#endif /* APR_HAS_THREADS */
+}
+
+/*
+ * Decay trimming
+ */
+
+/* Start recording which free nodes get used, with the mutex held */
+static APR_INLINE void heap_epoch_start(allocator_heap_t *heap)
+{
+    memcpy(heap->free_lowwater, heap->free_count,
+           sizeof(heap->free_lowwater));
+    heap->sink_lowwater = heap->sink_count;
+}
+
+static void decay_epoch_start(apr_allocator_t *allocator, apr_time_t now)
+{
+    allocator->decay_epoch = now;
+    heap_epoch_start(&allocator->heap);
+    allocator->pool_cache_lowwater = allocator->pool_cache_count;
+#if ALLOCATOR_HAS_NUMA
+    if (allocator->heaps) {
+        apr_uint32_t node;
+
+        for (node = 0; node < NUMA_MAX_NODES; node++) {
+            if (allocator->heaps[node])
+                heap_epoch_start(allocator->heaps[node]);
+        }
+    }
+#endif /* ALLOCATOR_HAS_NUMA */
+}
+
+/* Trim the free lists and sink of a heap, with the mutex held, adding
+ * the nodes to be unmapped to *freelist.  Returns the bytes released.
+ */
+static apr_size_t heap_trim(apr_allocator_t *allocator,
+                            allocator_heap_t *heap,
+                            apr_memnode_t **freelist)
+{
+    apr_memnode_t *node, *next, **ref, *keep = NULL;
+    apr_uint32_t index, max_index, count;
+    apr_size_t n, released = 0;
+    int purged;
+
+    max_index = (apr_uint32_t)heap->max_index;
+    for (index = 1; index <= max_index; index++) {
+        n = allocator->decay > 0 ? heap->free_lowwater[index]
+                                 : heap->free_count[index];
+        if (n == 0)
+            continue;
+
+        /* Cut the n nodes at the bottom of the list */
+        ref = &heap->free[index];
+        for (count = heap->free_count[index] - (apr_uint32_t)n; count;
+             count--)
+            ref = &(*ref)->next;
+        node = *ref;
+        *ref = NULL;
+
+        count = 0;
+        for (; node != NULL; node = next) {
+            next = node->next;
+
+            /* Carved nodes stay on the free lists, without their pages */
+            purged = region_node_purge(allocator, node);
+            if (purged >= 0) {
+                allocator->stats.release_count++;
+                allocator->stats.release_bytes += node_size(node);
+                released += node_size(node);
+            }
+            if (purged != 0) {
+                node->next = NULL;
+                *ref = node;
+                ref = &node->next;
+                continue;
+            }
+
+            allocator->stats.free_bytes -= node_size(node);
+            allocator->current_free_index += index + 1;
+            node->next = *freelist;
+            *freelist = node;
+            count++;
+        }
+
+        if (count)
+            free_list_taken(heap, index, count);
+    }
+
+    /* The sink is sorted by size rather than use, give back its largest
+     * nodes first.
+     */
+    n = allocator->decay > 0 ? heap->sink_lowwater : heap->sink_count;
+    while (n-- && (node = sink_take_largest(heap)) != NULL) {
+        allocator->stats.sink_count--;
+        allocator->stats.sink_bytes -= node_size(node);
+
+        purged = region_node_purge(allocator, node);
+        if (purged >= 0) {
+            allocator->stats.release_count++;
+            allocator->stats.release_bytes += node_size(node);
+            released += node_size(node);
+        }
+        if (purged != 0) {
+            node->next = keep;
+            keep = node;
+            continue;
+        }
+
+        allocator->stats.free_bytes -= node_size(node);
+        allocator->current_free_index += node->index + 1;
+        node->next = *freelist;
+        *freelist = node;
+    }
+    for (node = keep; node != NULL; node = next) {
+        next = node->next;
+        sink_insert(heap, node);
+        allocator->stats.sink_count++;
+        allocator->stats.sink_bytes += node_size(node);
+    }
+
+    return released;
+}
+
+/* Trim the nodes kept for new pools, with the mutex held, like the free
+ * lists (they are not carved out of regions).
+ */
+static apr_size_t pool_cache_trim(apr_allocator_t *allocator,
+                                  apr_memnode_t **freelist)
+{
+    apr_memnode_t *node, *next, **ref;
+    apr_uint32_t n, count;
+    apr_size_t released = 0;
+
+    n = allocator->decay > 0 ? allocator->pool_cache_lowwater
+                             : allocator->pool_cache_count;
+    if (n == 0)
+        return 0;
+
+    /* Cut the n nodes at the bottom of the list */
+    ref = &allocator->pool_cache;
+    for (count = allocator->pool_cache_count - n; count; count--)
+        ref = &(*ref)->next;
+    node = *ref;
+    *ref = NULL;
+
+    for (; node != NULL; node = next) {
+        next = node->next;
+
+        allocator->pool_cache_count--;
+        allocator->stats.release_count++;
+        allocator->stats.release_bytes += node_size(node);
+        allocator->stats.free_bytes -= node_size(node);
+        allocator->current_free_index += node->index + 1;
+        released += node_size(node);
+        node->next = *freelist;
+        *freelist = node;
+    }
+
+    return released;
+}
+
+APR_DECLARE(apr_size_t) apr_allocator_trim(apr_allocator_t *allocator)
+{
+    apr_memnode_t *freelist = NULL;
+    apr_size_t released;
+    apr_time_t now = apr_time_now();
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+    if (allocator->decay > 0 && now - allocator->decay_epoch < allocator->decay) {
+#if APR_HAS_THREADS
+        if (allocator->mutex)
+            apr_thread_mutex_unlock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+        return 0;
+    }
+
+    released = heap_trim(allocator, &allocator->heap, &freelist);
+    released += pool_cache_trim(allocator, &freelist);
+#if ALLOCATOR_HAS_NUMA
+    if (allocator->heaps) {
+        apr_uint32_t node;
+
+        for (node = 0; node < NUMA_MAX_NODES; node++) {
+            if (allocator->heaps[node])
+                released += heap_trim(allocator, allocator->heaps[node],
+                                      &freelist);
+        }
+    }
+#endif /* ALLOCATOR_HAS_NUMA */
+
+    if (allocator->current_free_index > allocator->max_free_index)
+        allocator->current_free_index = allocator->max_free_index;
+
+    decay_epoch_start(allocator, now);
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+    node_list_destroy(allocator, freelist);
+
+    return released;
+}
+
+#if APR_HAS_THREADS
+static void * APR_THREAD_FUNC decay_thread_func(apr_thread_t *thd,
+                                                void *data)
+{
+    apr_allocator_t *allocator = data;
+    allocator_decay_thread_t *dt = allocator->decay_thread;
+
+    apr_thread_mutex_lock(dt->mutex);
+    while (!dt->stop) {
+        apr_thread_cond_timedwait(dt->cond, dt->mutex, dt->interval);
+        if (dt->stop)
+            break;
+
+        apr_thread_mutex_unlock(dt->mutex);
+        apr_allocator_trim(allocator);
+        apr_thread_mutex_lock(dt->mutex);
+    }
+    apr_thread_mutex_unlock(dt->mutex);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static apr_status_t decay_thread_start(apr_allocator_t *allocator,
+                                       apr_interval_time_t interval)
+{
+    allocator_decay_thread_t *dt;
+    apr_pool_t *pool;
+    apr_status_t rv;
+
+    /* The thread outlives the pools of this allocator */
+    if ((rv = apr_pool_create_unmanaged_ex(&pool, NULL, NULL)) != APR_SUCCESS)
+        return rv;
+
+    dt = apr_pcalloc(pool, sizeof(*dt));
+    dt->pool = pool;
+    dt->interval = interval;
+
+    if ((rv = apr_thread_mutex_create(&dt->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                      pool)) != APR_SUCCESS
+        || (rv = apr_thread_cond_create(&dt->cond, pool)) != APR_SUCCESS) {
+        apr_pool_destroy(pool);
+        return rv;
+    }
+
+    allocator->decay_thread = dt;
+    if ((rv = apr_thread_create(&dt->thread, NULL, decay_thread_func,
+                                allocator, pool)) != APR_SUCCESS) {
+        allocator->decay_thread = NULL;
+        apr_pool_destroy(pool);
+        return rv;
+    }
+
+    return APR_SUCCESS;
+}
+
+static void decay_thread_stop(apr_allocator_t *allocator)
+{
+    allocator_decay_thread_t *dt = allocator->decay_thread;
+    apr_status_t rv;
+
+    apr_thread_mutex_lock(dt->mutex);
+    dt->stop = 1;
+    apr_thread_cond_signal(dt->cond);
+    apr_thread_mutex_unlock(dt->mutex);
+
+    apr_thread_join(&rv, dt->thread);
+
+    allocator->decay_thread = NULL;
+    apr_pool_destroy(dt->pool);
+}
+#endif /* APR_HAS_THREADS */
+
+APR_DECLARE(apr_status_t) apr_allocator_decay_set(apr_allocator_t *allocator,
+                                                  apr_interval_time_t decay,
+                                                  apr_uint32_t flags)
+{
+    if (decay < 0)
+        return APR_EINVAL;
+
+#if APR_HAS_THREADS
+    if ((flags & APR_ALLOCATOR_DECAY_THREAD) && decay > 0
+        && allocator->mutex == NULL)
+        return APR_EINVAL;
+
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+#else
+    if (flags & APR_ALLOCATOR_DECAY_THREAD)
+        return APR_ENOTIMPL;
+#endif /* APR_HAS_THREADS */
+
+    allocator->decay = decay;
+    decay_epoch_start(allocator, apr_time_now());
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+
+    if ((flags & APR_ALLOCATOR_DECAY_THREAD) && decay > 0) {
+        allocator_decay_thread_t *dt = allocator->decay_thread;
+
+        if (dt == NULL)
+            return decay_thread_start(allocator, decay);
+
+        /* Wake the thread up to wait for the new interval */
+        apr_thread_mutex_lock(dt->mutex);
+        dt->interval = decay;
+        apr_thread_cond_signal(dt->cond);
+        apr_thread_mutex_unlock(dt->mutex);
+    }
+    else if (allocator->decay_thread) {
+        decay_thread_stop(allocator);
+    }
+#endif /* APR_HAS_THREADS */
+
+    return APR_SUCCESS;
+}
+
+
+
+/*
  * Debug level
  */
 
@@ -548,19 +2160,37 @@ struct apr_pool_t {
     apr_pool_t          **ref;
     cleanup_t            *cleanups;
     cleanup_t            *free_cleanups;
+    apr_uint32_t          cleanups_count; /* in cleanups, killed included */
+    apr_uint32_t          cleanups_dead; /* killed, still in cleanups */
+    apr_uint64_t          cleanups_registered; /* for apr_pool_rewind() */
     apr_allocator_t      *allocator;
     struct process_chain *subprocesses;
     apr_abortfunc_t       abort_fn;
     apr_hash_t           *user_data;
     const char           *tag;
+    apr_uint64_t          children_created; /* for apr_pool_rewind() */
+    apr_uint64_t          child_serial; /* children_created of the parent */
 
 #if APR_HAS_THREADS
 	apr_thread_mutex_t   *user_mutex;
+    apr_uint32_t          concurrent; /* apr_pool_create_concurrent() */
 #endif
 #if !APR_POOL_DEBUG
     apr_memnode_t        *active;
     apr_memnode_t        *self; /* The node containing the pool itself */
     char                 *self_first_avail;
+    apr_size_t            stat_node_bytes; /* held in the ring */
+    apr_size_t            stat_node_bytes_max;
+    apr_uint32_t          stat_clear;
+    apr_uint32_t          profile_seed; /* sampling state, 0 until seeded */
+    apr_memnode_t        *arena; /* apr_pool_create_arena() */
+    apr_memnode_t        *arena_cleanups; /* holding them, out of the arena */
+    apr_byte_t            arena_frozen;
+    apr_byte_t            arena_readonly;
+    apr_byte_t            marked; /* apr_pool_mark() since the last clear */
+#if APR_HAS_THREADS
+    volatile apr_uint32_t refill_lock; /* concurrent pools' node refills */
+#endif
 
 #else /* APR_POOL_DEBUG */
     apr_pool_t           *joined; /* the caller has guaranteed that this pool
@@ -571,6 +2201,7 @@ struct apr_pool_t {
     unsigned int          stat_alloc;
     unsigned int          stat_total_alloc;
     unsigned int          stat_clear;
+    apr_size_t            stat_bytes_max; /* as of the last clear */
 #if APR_HAS_THREADS
     apr_os_thread_t       owner;
     apr_thread_mutex_t   *mutex;
@@ -613,12 +2244,94 @@ static apr_file_t *file_stderr = NULL;
  */
 
 static void run_cleanups(cleanup_t **c);
+static void rewind_cleanups(apr_pool_t *pool, const apr_pool_mark_t *mark);
 static void free_proc_chain(struct process_chain *procs);
 
 #if APR_POOL_DEBUG
 static void pool_destroy_debug(apr_pool_t *pool, const char *file_line);
 #endif
 
+/*
+ * Walk the pool tree rooted at pool, depth first.  When fn returns
+ * anything other than 0, abort the traversal and return the value
+ * returned by fn.
+ */
+#if APR_HAS_THREADS
+#if APR_POOL_DEBUG
+#define pool_tree_mutex(pool) ((pool)->mutex)
+#else
+/* Children are linked and unlinked under their parent's allocator mutex */
+#define pool_tree_mutex(pool) apr_allocator_mutex_get((pool)->allocator)
+#endif
+
+/* The mutexes held by the walk, which are not necessarily nested ones */
+struct pool_walk_lock {
+    apr_thread_mutex_t *mutex;
+    const struct pool_walk_lock *up;
+};
+#else
+struct pool_walk_lock;
+#endif /* APR_HAS_THREADS */
+
+static int pool_walk_tree(apr_pool_t *pool,
+                          int (*fn)(apr_pool_t *pool, void *data),
+                          void *data,
+                          const struct pool_walk_lock *held)
+{
+    int rv;
+    apr_pool_t *child;
+#if APR_HAS_THREADS
+    struct pool_walk_lock lock;
+
+    lock.mutex = pool_tree_mutex(pool);
+    lock.up = held;
+    for (; held; held = held->up) {
+        if (held->mutex == lock.mutex) {
+            lock.mutex = NULL;
+            break;
+        }
+    }
+#endif /* APR_HAS_THREADS */
+
+    rv = fn(pool, data);
+    if (rv)
+        return rv;
+
+#if APR_HAS_THREADS
+    if (lock.mutex) {
+        apr_thread_mutex_lock(lock.mutex);
+    }
+#endif /* APR_HAS_THREADS */
+
+    child = pool->child;
+    while (child) {
+#if APR_HAS_THREADS
+        rv = pool_walk_tree(child, fn, data, &lock);
+#else
+        rv = pool_walk_tree(child, fn, data, NULL);
+#endif
+        if (rv)
+            break;
+
+        child = child->sibling;
+    }
+
+#if APR_HAS_THREADS
+    if (lock.mutex) {
+        apr_thread_mutex_unlock(lock.mutex);
+    }
+#endif /* APR_HAS_THREADS */
+
+    return rv;
+}
+
+static int apr_pool_walk_tree(apr_pool_t *pool,
+                              int (*fn)(apr_pool_t *pool, void *data),
+                              void *data)
+{
+    return pool_walk_tree(pool, fn, data, NULL);
+}
+
 #if !APR_POOL_DEBUG
 /*
  * Initialization
@@ -796,56 +2509,33 @@ static APR_INLINE void pool_concurrency_set_destroyed(apr_pool_t *pool) { }
  * Memory allocation
  */
 
-APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
+/* Account for a node the pool just took from its allocator, which is the
+ * only time the pool grows and thus where the high-water mark is taken.
+ */
+static APR_INLINE void pool_stats_node_taken(apr_pool_t *pool,
+                                             apr_memnode_t *node)
 {
-    apr_memnode_t *active, *node;
-    void *mem;
-    apr_size_t size, free_index;
-
-    pool_concurrency_set_used(pool);
-    size = APR_ALIGN_DEFAULT(in_size);
-#if HAVE_VALGRIND
-    if (apr_running_on_valgrind)
-        size += 2 * REDZONE;
-#endif
-    if (size < in_size) {
-        pool_concurrency_set_idle(pool);
-        if (pool->abort_fn)
-            pool->abort_fn(APR_ENOMEM);
-
-        return NULL;
-    }
-    active = pool->active;
-
-    /* If the active node has enough bytes left, use it. */
-    if (size <= node_free_space(active)) {
-        mem = active->first_avail;
-        active->first_avail += size;
-        goto have_mem;
-    }
-
-    node = active->next;
-    if (size <= node_free_space(node)) {
-        list_remove(node);
-    }
-    else {
-        if ((node = allocator_alloc(pool->allocator, size)) == NULL) {
-            pool_concurrency_set_idle(pool);
-            if (pool->abort_fn)
-                pool->abort_fn(APR_ENOMEM);
-
-            return NULL;
-        }
-    }
-
-    node->free_index = 0;
+    pool->stat_node_bytes += node_size(node);
+    if (pool->stat_node_bytes > pool->stat_node_bytes_max)
+        pool->stat_node_bytes_max = pool->stat_node_bytes;
+}
 
-    mem = node->first_avail;
-    node->first_avail += size;
+/* Make node, which is out of the ring, the active node of the pool, and
+ * move the previously active node to its place in the ring: the nodes
+ * after the active one are kept sorted by decreasing free space.  Once
+ * the pool is marked they are left in the order they were added instead,
+ * see apr_pool_mark().
+ */
+static APR_INLINE void pool_active_push(apr_pool_t *pool, apr_memnode_t *node)
+{
+    apr_memnode_t *active = pool->active;
+    apr_size_t free_index;
 
     list_insert(node, active);
 
     pool->active = node;
+    if (pool->marked)
+        return;
 
     free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
                             BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
@@ -853,7 +2543,7 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
     active->free_index = free_index;
     node = active->next;
     if (free_index >= node->free_index)
-        goto have_mem;
+        return;
 
     do {
         node = node->next;
@@ -862,13 +2552,221 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
 
     list_remove(active);
     list_insert(active, node);
+}
 
-have_mem:
-#if HAVE_VALGRIND
-    if (!apr_running_on_valgrind) {
-        pool_concurrency_set_idle(pool);
-        return mem;
-    }
+/* Padding to put at p for the memory after it to be aligned */
+#define align_pad(p_, alignment_) \
+    ((apr_size_t)(APR_ALIGN((apr_uintptr_t)(p_), (alignment_)) \
+                  - (apr_uintptr_t)(p_)))
+
+/* Whether to sample an allocation from the pool, when profiling: pools
+ * being used by one thread at a time, they keep their own xorshift state,
+ * seeded on first use.
+ */
+static APR_INLINE int pool_profile_draw(apr_pool_t *pool)
+{
+    apr_uint32_t x;
+
+#if APR_HAS_THREADS
+    if (pool->concurrent)
+        return profile_draw_shared(pool);
+#endif
+
+    if ((x = pool->profile_seed) == 0) {
+        x = profile_hash(apr_atomic_inc32(&profile_seq) * 0x9e3779b1
+                         ^ (apr_uint32_t)((apr_uintptr_t)pool >> 4));
+        x |= 1;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pool->profile_seed = x;
+
+    return x < profile_threshold;
+}
+
+#if APR_HAS_THREADS
+/*
+ * Concurrent pools
+ *
+ * Allocations claim their block from the active node by moving its
+ * first_avail forward with a compare-and-swap, so that any number of
+ * threads can allocate at once.  Only when the active node is exhausted
+ * does a thread take the refill lock, to link a new node in the ring and
+ * make it the active one.  Since a thread may still be claiming space from
+ * a node after it was replaced, the nodes of the ring are never made
+ * active again, and their free_index is meaningless, until the pool is
+ * cleared.
+ */
+
+/* Concurrent pools take larger nodes, to refill less often */
+#define CONCURRENT_MIN_ALLOC (8 * MIN_ALLOC)
+
+static APR_INLINE void pool_refill_lock(apr_pool_t *pool)
+{
+    /* Held for an allocator_alloc() or allocator_free() at most */
+    while (apr_atomic_cas32(&pool->refill_lock, 1, 0) != 0)
+        apr_thread_yield();
+}
+
+static APR_INLINE void pool_refill_unlock(apr_pool_t *pool)
+{
+    apr_atomic_cas32(&pool->refill_lock, 0, 1);
+}
+
+static void *pool_palloc_concurrent(apr_pool_t *pool, apr_size_t in_size,
+                                    apr_size_t alignment,
+                                    profile_caller_t caller)
+{
+    apr_memnode_t *active, *node;
+    char *mem, *avail;
+    apr_size_t size, pad, offset = 0;
+
+    size = APR_ALIGN_DEFAULT(in_size);
+#if HAVE_VALGRIND
+    if (apr_running_on_valgrind) {
+        size += 2 * REDZONE;
+        offset = REDZONE;
+    }
+#endif
+    if (size < in_size || size + alignment < size)
+        goto nomem;
+
+    for (;;) {
+        active = *(apr_memnode_t *volatile *)&pool->active;
+        avail = *(char *volatile *)&active->first_avail;
+
+        pad = align_pad(avail + offset, alignment);
+        if (pad + size <= (apr_size_t)(active->endp - avail)) {
+            mem = avail + pad;
+            if (apr_atomic_casptr((volatile void **)&active->first_avail,
+                                  mem + size, avail) == avail)
+                break;
+            continue;
+        }
+
+        pool_refill_lock(pool);
+        if (pool->active != active) {
+            /* Another thread refilled meanwhile */
+            pool_refill_unlock(pool);
+            continue;
+        }
+
+        if (size + alignment <= CONCURRENT_MIN_ALLOC - APR_MEMNODE_T_SIZE)
+            node = allocator_alloc(pool->allocator,
+                                   CONCURRENT_MIN_ALLOC - APR_MEMNODE_T_SIZE,
+                                   pool->tag, caller);
+        else
+            node = allocator_alloc(pool->allocator,
+                                   size + alignment - APR_ALIGN_DEFAULT(1),
+                                   pool->tag, caller);
+        if (node == NULL) {
+            pool_refill_unlock(pool);
+            goto nomem;
+        }
+        pool_stats_node_taken(pool, node);
+
+        /* Our block is claimed before anyone else can see the node */
+        node->free_index = 0;
+        pad = align_pad(node->first_avail + offset, alignment);
+        mem = node->first_avail + pad;
+        node->first_avail = mem + size;
+
+        list_insert(node, active);
+
+        /* Don't replace the active node by one with less room left, as
+         * happens for large blocks.
+         */
+        if (node_free_space(node) > node_free_space(active))
+            apr_atomic_xchgptr((volatile void **)&pool->active, node);
+
+        pool_refill_unlock(pool);
+        break;
+    }
+
+#if HAVE_VALGRIND
+    if (apr_running_on_valgrind) {
+        mem += REDZONE;
+        VALGRIND_MEMPOOL_ALLOC(pool, mem, in_size);
+    }
+#endif
+    return mem;
+
+nomem:
+    if (pool->abort_fn)
+        pool->abort_fn(APR_ENOMEM);
+
+    return NULL;
+}
+#endif /* APR_HAS_THREADS */
+
+static APR_INLINE void *pool_palloc(apr_pool_t *pool, apr_size_t in_size,
+                                     profile_caller_t caller)
+{
+    apr_memnode_t *active, *node;
+    void *mem;
+    apr_size_t size;
+
+    if (profile_rate && pool_profile_draw(pool))
+        profile_record(pool->tag, caller, in_size, 0);
+
+#if APR_HAS_THREADS
+    if (pool->concurrent)
+        return pool_palloc_concurrent(pool, in_size, APR_ALIGN_DEFAULT(1),
+                                      caller);
+#endif
+
+    pool_concurrency_set_used(pool);
+    size = APR_ALIGN_DEFAULT(in_size);
+#if HAVE_VALGRIND
+    if (apr_running_on_valgrind)
+        size += 2 * REDZONE;
+#endif
+    if (size < in_size) {
+        pool_concurrency_set_idle(pool);
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    active = pool->active;
+
+    /* If the active node has enough bytes left, use it. */
+    if (size <= node_free_space(active)) {
+        mem = active->first_avail;
+        active->first_avail += size;
+        goto have_mem;
+    }
+
+    node = active->next;
+    if (!pool->marked && size <= node_free_space(node)) {
+        list_remove(node);
+    }
+    else {
+        if ((node = allocator_alloc(pool->allocator, size,
+                                    pool->tag, caller)) == NULL) {
+            pool_concurrency_set_idle(pool);
+            if (pool->abort_fn)
+                pool->abort_fn(APR_ENOMEM);
+
+            return NULL;
+        }
+        pool_stats_node_taken(pool, node);
+    }
+
+    node->free_index = 0;
+
+    mem = node->first_avail;
+    node->first_avail += size;
+
+    pool_active_push(pool, node);
+
+have_mem:
+#if HAVE_VALGRIND
+    if (!apr_running_on_valgrind) {
+        pool_concurrency_set_idle(pool);
+        return mem;
+    }
     else {
         mem = (char *)mem + REDZONE;
         VALGRIND_MEMPOOL_ALLOC(pool, mem, in_size);
@@ -881,6 +2779,11 @@ have_mem:
 #endif
 }
 
+APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t size)
+{
+    return pool_palloc(pool, size, PROFILE_CALLER());
+}
+
 /* Provide an implementation of apr_pcalloc for backward compatibility
  * with code built before apr_pcalloc was a macro
  */
@@ -894,22 +2797,334 @@ APR_DECLARE(void *) apr_pcalloc(apr_pool_t *pool, apr_size_t size)
 {
     void *mem;
 
-    if ((mem = apr_palloc(pool, size)) != NULL) {
+    if ((mem = pool_palloc(pool, size, PROFILE_CALLER())) != NULL) {
+        memset(mem, 0, size);
+    }
+
+    return mem;
+}
+
+static APR_INLINE void *pool_palloc_aligned(apr_pool_t *pool,
+                                            apr_size_t in_size,
+                                            apr_size_t alignment,
+                                            profile_caller_t caller)
+{
+    apr_memnode_t *active, *node;
+    char *mem;
+    apr_size_t size, pad, offset = 0;
+
+    if (alignment & (alignment - 1))
+        return NULL;
+    if (alignment <= APR_ALIGN_DEFAULT(1))
+        return pool_palloc(pool, in_size, caller);
+
+    if (profile_rate && pool_profile_draw(pool))
+        profile_record(pool->tag, caller, in_size, 0);
+
+#if APR_HAS_THREADS
+    if (pool->concurrent)
+        return pool_palloc_concurrent(pool, in_size, alignment, caller);
+#endif
+
+    pool_concurrency_set_used(pool);
+    size = APR_ALIGN_DEFAULT(in_size);
+#if HAVE_VALGRIND
+    if (apr_running_on_valgrind) {
+        size += 2 * REDZONE;
+        offset = REDZONE;
+    }
+#endif
+    if (size < in_size || size + alignment < size) {
+        pool_concurrency_set_idle(pool);
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    active = pool->active;
+
+    /* The padding is lost, but it is at most alignment bytes which would
+     * otherwise have been allocated in excess by the caller anyway.
+     */
+    pad = align_pad(active->first_avail + offset, alignment);
+    if (pad + size <= node_free_space(active)) {
+        mem = active->first_avail + pad;
+        active->first_avail = mem + size;
+        goto have_mem;
+    }
+
+    node = active->next;
+    pad = align_pad(node->first_avail + offset, alignment);
+    if (!pool->marked && pad + size <= node_free_space(node)) {
+        list_remove(node);
+    }
+    else {
+        /* Nodes' first_avail are only APR_ALIGN_DEFAULT()ed */
+        if ((node = allocator_alloc(pool->allocator,
+                                    size + alignment
+                                    - APR_ALIGN_DEFAULT(1),
+                                    pool->tag, caller)) == NULL) {
+            pool_concurrency_set_idle(pool);
+            if (pool->abort_fn)
+                pool->abort_fn(APR_ENOMEM);
+
+            return NULL;
+        }
+        pool_stats_node_taken(pool, node);
+        pad = align_pad(node->first_avail + offset, alignment);
+    }
+
+    node->free_index = 0;
+
+    mem = node->first_avail + pad;
+    node->first_avail = mem + size;
+
+    pool_active_push(pool, node);
+
+have_mem:
+#if HAVE_VALGRIND
+    if (apr_running_on_valgrind) {
+        mem += REDZONE;
+        VALGRIND_MEMPOOL_ALLOC(pool, mem, in_size);
+    }
+#endif
+    pool_concurrency_set_idle(pool);
+    return mem;
+}
+
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                       apr_size_t alignment)
+{
+    return pool_palloc_aligned(pool, size, alignment, PROFILE_CALLER());
+}
+
+APR_DECLARE(void *) apr_pcalloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                        apr_size_t alignment)
+{
+    void *mem;
+
+    if ((mem = pool_palloc_aligned(pool, size, alignment,
+                                   PROFILE_CALLER())) != NULL) {
         memset(mem, 0, size);
     }
 
     return mem;
 }
 
+APR_DECLARE(int) apr_palloc_grow(apr_pool_t *pool, void *mem,
+                                 apr_size_t size, apr_size_t new_size)
+{
+    apr_memnode_t *active;
+    apr_size_t end, new_end;
+    int grown = 0;
+
+#if APR_HAS_THREADS
+    /* Other threads may be past the end already */
+    if (pool->concurrent)
+        return 0;
+#endif
+#if HAVE_VALGRIND
+    /* The block is followed by its redzone */
+    if (apr_running_on_valgrind)
+        return 0;
+#endif
+
+    end = APR_ALIGN_DEFAULT(size);
+    new_end = APR_ALIGN_DEFAULT(new_size);
+    if (new_end < new_size || end < size)
+        return 0;
+
+    pool_concurrency_set_used(pool);
+    active = pool->active;
+    if ((char *)mem + end == active->first_avail
+            && (char *)mem >= (char *)active + APR_MEMNODE_T_SIZE
+            && (new_end <= end
+                || new_end - end <= node_free_space(active))) {
+        active->first_avail = (char *)mem + new_end;
+        grown = 1;
+    }
+    pool_concurrency_set_idle(pool);
+
+    return grown;
+}
+
+
+/*
+ * Pool statistics
+ */
+
+static void pool_stats_get(apr_pool_t *pool, apr_pool_stats_t *stats)
+{
+    apr_memnode_t *node = pool->self;
+
+    memset(stats, 0, sizeof(*stats));
+    do {
+        stats->node_count++;
+        stats->node_bytes += node->endp - (char *)node;
+        stats->used_bytes += node->first_avail - (char *)node
+                             - APR_MEMNODE_T_SIZE;
+    } while ((node = node->next) != pool->self);
+
+    stats->node_bytes_max = pool->stat_node_bytes_max;
+    stats->clear_count = pool->stat_clear;
+}
+
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_t *pool,
+                                     apr_pool_stats_t *stats)
+{
+    pool_concurrency_set_used(pool);
+    pool_stats_get(pool, stats);
+    pool_concurrency_set_idle(pool);
+}
+
 
 /*
  * Pool creation/destruction
  */
 
+/* The allocators keep the nodes of up to this many destroyed pools aside,
+ * to hold the next pools created without going through the free lists.
+ * That's for the short-lived pools created and destroyed all the time,
+ * e.g. per request.
+ */
+#define POOL_CACHE_MAX 16
+
+/* The thread caches recycle nodes without locking already, and the nodes
+ * carved out of regions have to go back to the heap of their region.
+ */
+static APR_INLINE int pool_cache_usable(apr_allocator_t *allocator)
+{
+    if (allocator->flags & APR_ALLOCATOR_THREAD_CACHE)
+        return 0;
+#if ALLOCATOR_HAS_REGIONS
+    if (allocator->use_regions)
+        return 0;
+#endif
+
+    return 1;
+}
+
+/* Get a node to hold a new pool */
+static APR_INLINE apr_memnode_t *pool_node_get(apr_allocator_t *allocator,
+                                               profile_caller_t caller)
+{
+    apr_memnode_t *node = NULL;
+
+    /* The cache is only peeked at to avoid locking for nothing, it is
+     * checked again under the mutex.
+     */
+    if (apr_atomic_read32(&allocator->pool_cache_count)) {
+#if APR_HAS_THREADS
+        if (allocator->mutex)
+            apr_thread_mutex_lock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+        if ((node = allocator->pool_cache) != NULL) {
+            allocator->pool_cache = node->next;
+            if (--allocator->pool_cache_count
+                < allocator->pool_cache_lowwater)
+                allocator->pool_cache_lowwater =
+                    allocator->pool_cache_count;
+            allocator->stats.reuse_count++;
+            allocator->stats.free_bytes -= node_size(node);
+            allocator->current_free_index += node->index + 1;
+            if (allocator->current_free_index > allocator->max_free_index)
+                allocator->current_free_index = allocator->max_free_index;
+        }
+
+#if APR_HAS_THREADS
+        if (allocator->mutex)
+            apr_thread_mutex_unlock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+    }
+
+    if (node == NULL)
+        return allocator_alloc(allocator, MIN_ALLOC - APR_MEMNODE_T_SIZE,
+                               NULL, caller);
+
+    node->next = NULL;
+    node->first_avail = (char *)node + APR_MEMNODE_T_SIZE;
+
+    if (profile_rate && profile_draw_shared(node))
+        profile_record(NULL, caller, 0, node_size(node));
+
+    APR_VALGRIND_UNDEFINED(node->first_avail,
+                           node_size(node) - APR_MEMNODE_T_SIZE);
+
+    return node;
+}
+
+/* Give back the nodes of a destroyed pool, chained from the one which
+ * held the pool, keeping that one aside if possible.  It counts against
+ * the max_free limit like the free lists.
+ */
+static APR_INLINE void pool_node_put(apr_allocator_t *allocator,
+                                     apr_memnode_t *self)
+{
+    apr_memnode_t *rest = self->next;
+    apr_size_t index = self->index;
+
+    if (index != (MIN_ALLOC >> BOUNDARY_INDEX) - 1
+        || !pool_cache_usable(allocator)) {
+        allocator_free(allocator, self);
+        return;
+    }
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+    if (allocator->pool_cache_count < POOL_CACHE_MAX
+        && (allocator->max_free_index == APR_ALLOCATOR_MAX_FREE_UNLIMITED
+            || index + 1 <= allocator->current_free_index)) {
+        APR_VALGRIND_NOACCESS((char *)self + APR_MEMNODE_T_SIZE,
+                              node_size(self) - APR_MEMNODE_T_SIZE);
+        self->next = allocator->pool_cache;
+        allocator->pool_cache = self;
+        allocator->pool_cache_count++;
+        allocator->stats.free_count++;
+        allocator->stats.free_bytes += node_size(self);
+        if (allocator->stats.free_bytes > allocator->stats.free_bytes_max)
+            allocator->stats.free_bytes_max = allocator->stats.free_bytes;
+        if (allocator->current_free_index >= index + 1)
+            allocator->current_free_index -= index + 1;
+        else
+            allocator->current_free_index = 0;
+        self = NULL;
+    }
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+    if (self)
+        allocator_free(allocator, self);
+    else if (rest)
+        allocator_free(allocator, rest);
+}
+
+static void arena_release(apr_pool_t *pool);
+
+/* Give back the nodes holding the cleanups of a pool with an arena, once
+ * they all ran.
+ */
+static APR_INLINE void arena_cleanups_free(apr_pool_t *pool)
+{
+    if (pool->arena_cleanups) {
+        allocator_free(pool->allocator, pool->arena_cleanups);
+        pool->arena_cleanups = NULL;
+    }
+}
+
 APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
 {
     apr_memnode_t *active;
 
+    if (pool->arena)
+        arena_release(pool);
+
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
 
@@ -917,60 +3132,298 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
     pool->pre_cleanups = NULL;
     pool_concurrency_set_idle(pool);
 
-    /* Destroy the subpools.  The subpools will detach themselves from
-     * this pool thus this loop is safe and easy.
-     */
-    while (pool->child)
-        apr_pool_destroy(pool->child);
+    /* Destroy the subpools.  The subpools will detach themselves from
+     * this pool thus this loop is safe and easy.
+     */
+    while (pool->child)
+        apr_pool_destroy(pool->child);
+
+    /* Run cleanups */
+    run_cleanups(&pool->cleanups);
+
+    pool_concurrency_set_used(pool);
+    pool->cleanups = NULL;
+    pool->free_cleanups = NULL;
+    pool->cleanups_count = pool->cleanups_dead = 0;
+    arena_cleanups_free(pool);
+
+    /* Free subprocesses */
+    free_proc_chain(pool->subprocesses);
+    pool->subprocesses = NULL;
+
+    /* Clear the user data. */
+    pool->user_data = NULL;
+
+    pool->stat_node_bytes = node_size(pool->self);
+    pool->stat_clear++;
+    pool->marked = 0;
+
+    /* Find the node attached to the pool structure, reset it, make
+     * it the active node and free the rest of the nodes.
+     */
+    active = pool->active = pool->self;
+    active->first_avail = pool->self_first_avail;
+
+    APR_IF_VALGRIND(VALGRIND_MEMPOOL_TRIM(pool, pool, 1));
+
+    if (active->next == active) {
+        pool_concurrency_set_idle(pool);
+        return;
+    }
+
+    *active->ref = NULL;
+    allocator_free(pool->allocator, active->next);
+    active->next = active;
+    active->ref = &active->next;
+
+    pool_concurrency_set_idle(pool);
+}
+
+#if APR_HAS_THREADS
+APR_DECLARE(void) apr_pool_mutex_set(apr_pool_t *pool,
+                                     apr_thread_mutex_t *mutex)
+{
+    pool->user_mutex = mutex;
+}
+#endif
+
+/*
+ * Savepoints
+ *
+ * A mark records the active node with its first free byte, and the node
+ * before it in the ring.  Once a pool is marked, the free space of the
+ * other nodes is no longer reused and the ring is no longer sorted, so
+ * everything allocated after the mark lands in the marked node or in new
+ * nodes, which are all linked between the two recorded ones.  Rewinding
+ * then only has to reset the marked node and free the nodes in between.
+ */
+
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    apr_memnode_t *active;
+
+    pool_concurrency_set_used(pool);
+
+    active = pool->active;
+    mark->node = active;
+    mark->avail = active->first_avail;
+    /* The ref of a node points to the next field, the first one, of the
+     * node before it.
+     */
+    mark->tail = (apr_memnode_t *)active->ref;
+    mark->cleanups = pool->cleanups_registered;
+    mark->children = pool->children_created;
+    pool->marked = 1;
+
+    pool_concurrency_set_idle(pool);
+}
+
+/* Whether mem was allocated from the pool after the mark */
+static int pool_mark_owns(apr_pool_t *pool, const apr_pool_mark_t *mark,
+                          const void *mem)
+{
+    apr_memnode_t *active = mark->node, *node;
+
+    if ((const char *)mem >= mark->avail && (const char *)mem < active->endp)
+        return 1;
+
+    node = ((apr_memnode_t *)mark->tail)->next;
+    for (; node != active; node = node->next) {
+        if ((const char *)mem >= (char *)node && (const char *)mem < node->endp)
+            return 1;
+    }
+
+    return 0;
+}
+
+APR_DECLARE(void) apr_pool_rewind(apr_pool_t *pool,
+                                  const apr_pool_mark_t *mark)
+{
+    apr_memnode_t *active, *tail, *freelist, *node;
+    apr_pool_t *child;
+
+    /* Destroy the subpools created after the mark, which are the first
+     * ones of the list.
+     */
+    while ((child = pool->child) != NULL
+           && child->child_serial > mark->children)
+        apr_pool_destroy(child);
+
+    rewind_cleanups(pool, mark);
+
+    pool_concurrency_set_used(pool);
+
+    active = mark->node;
+    tail = mark->tail;
+
+    active->first_avail = mark->avail;
+    active->free_index = 0;
+    pool->active = active;
+
+    if ((freelist = tail->next) == active) {
+        pool_concurrency_set_idle(pool);
+        return;
+    }
+
+    /* Unlink the nodes in between */
+    *active->ref = NULL;
+    tail->next = active;
+    active->ref = &tail->next;
+
+    for (node = freelist; node; node = node->next)
+        pool->stat_node_bytes -= node_size(node);
+    allocator_free(pool->allocator, freelist);
+
+    pool_concurrency_set_idle(pool);
+}
+
+/*
+ * Arenas
+ *
+ * An arena is one big node, made the active one of the pool so that the
+ * next allocations are packed into it.  Its usable part starts on a page
+ * boundary, so that freezing it can make all its whole pages read-only.
+ * The node header stays writable, it's before the first page.
+ */
+
+#if HAVE_SYS_MMAN_H && defined(PROT_READ)
+#define ARENA_CAN_PROTECT 1
+#else
+#define ARENA_CAN_PROTECT 0
+#endif
+
+static apr_size_t arena_page_size(void)
+{
+#if defined(_SC_PAGESIZE)
+    static apr_size_t page_size;
+
+    if (!page_size)
+        page_size = sysconf(_SC_PAGESIZE);
+    return page_size;
+#else
+    return 4096;
+#endif
+}
+
+#if ARENA_CAN_PROTECT
+static apr_status_t arena_protect(apr_memnode_t *node, int prot)
+{
+    apr_size_t page_size = arena_page_size();
+    char *beginp, *endp;
+
+    beginp = (char *)APR_ALIGN((apr_uintptr_t)node + APR_MEMNODE_T_SIZE,
+                               page_size);
+    endp = (char *)((apr_uintptr_t)node->endp & ~(page_size - 1));
+    if (beginp < endp && mprotect(beginp, endp - beginp, prot) != 0)
+        return errno;
+
+    return APR_SUCCESS;
+}
+#endif /* ARENA_CAN_PROTECT */
+
+/* The arena goes back to the allocator with the other nodes on clear or
+ * destroy.  It is made writable again before the cleanups run, for them
+ * to use the data in there as they please.
+ */
+static void arena_release(apr_pool_t *pool)
+{
+#if ARENA_CAN_PROTECT
+    if (pool->arena_readonly)
+        arena_protect(pool->arena, PROT_READ | PROT_WRITE);
+#endif
+    pool->arena = NULL;
+}
+
+APR_DECLARE(apr_status_t) apr_pool_create_arena(apr_pool_t **newpool,
+                                                apr_pool_t *parent,
+                                                apr_size_t size)
+{
+    apr_pool_t *pool;
+    apr_memnode_t *node;
+    apr_size_t page_size = arena_page_size();
+    apr_status_t rv;
+
+    if ((rv = apr_pool_create_ex(&pool, parent, NULL, NULL)) != APR_SUCCESS)
+        return rv;
 
-    /* Run cleanups */
-    run_cleanups(&pool->cleanups);
+    size = APR_ALIGN(size, page_size);
+    if (size == 0 || size + page_size < size
+        || (node = allocator_alloc(pool->allocator, size + page_size,
+                                   NULL, PROFILE_CALLER())) == NULL) {
+        apr_pool_destroy(pool);
+        if (parent && parent->abort_fn)
+            parent->abort_fn(APR_ENOMEM);
+        return APR_ENOMEM;
+    }
 
-    pool_concurrency_set_used(pool);
-    pool->cleanups = NULL;
-    pool->free_cleanups = NULL;
+    node->first_avail = (char *)APR_ALIGN((apr_uintptr_t)node->first_avail,
+                                          page_size);
+    node->free_index = 0;
+    pool_active_push(pool, node);
+    pool_stats_node_taken(pool, node);
 
-    /* Free subprocesses */
-    free_proc_chain(pool->subprocesses);
-    pool->subprocesses = NULL;
+    pool->arena = node;
+    pool->arena_frozen = 0;
+    pool->arena_readonly = 0;
 
-    /* Clear the user data. */
-    pool->user_data = NULL;
+    *newpool = pool;
+    return APR_SUCCESS;
+}
 
-    /* Find the node attached to the pool structure, reset it, make
-     * it the active node and free the rest of the nodes.
-     */
-    active = pool->active = pool->self;
-    active->first_avail = pool->self_first_avail;
+APR_DECLARE(apr_status_t) apr_pool_freeze(apr_pool_t *pool,
+                                          apr_uint32_t flags)
+{
+    apr_memnode_t *node = pool->arena;
 
-    APR_IF_VALGRIND(VALGRIND_MEMPOOL_TRIM(pool, pool, 1));
+    if (node == NULL)
+        return APR_EINVAL;
 
-    if (active->next == active) {
+    if (!pool->arena_frozen) {
+        /* No room left: the next allocations take other nodes */
+        pool_concurrency_set_used(pool);
+        node->first_avail = node->endp;
+        node->free_index = 0;
+        if (node != pool->active && !pool->marked) {
+            /* Keep the ring sorted, the nodes with the least room last */
+            list_remove(node);
+            list_insert(node, pool->active);
+        }
+        pool->arena_frozen = 1;
         pool_concurrency_set_idle(pool);
-        return;
     }
 
-    *active->ref = NULL;
-    allocator_free(pool->allocator, active->next);
-    active->next = active;
-    active->ref = &active->next;
+    if ((flags & APR_POOL_FREEZE_READONLY) && !pool->arena_readonly) {
+#if ARENA_CAN_PROTECT
+        apr_status_t rv;
 
-    pool_concurrency_set_idle(pool);
-}
+        if ((rv = arena_protect(node, PROT_READ)) != APR_SUCCESS)
+            return rv;
+        pool->arena_readonly = 1;
+#else
+        return APR_ENOTIMPL;
+#endif
+    }
 
-#if APR_HAS_THREADS
-APR_DECLARE(void) apr_pool_mutex_set(apr_pool_t *pool,
-                                     apr_thread_mutex_t *mutex)
-{
-    pool->user_mutex = mutex;
+    return APR_SUCCESS;
 }
-#endif
 
 APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
 {
     apr_memnode_t *active;
     apr_allocator_t *allocator;
 
+#if APR_HAS_THREADS
+    /* The decay thread of the allocator uses its mutex, which the cleanups
+     * of the owner pool are likely to destroy.
+     */
+    if (pool->allocator->decay_thread
+        && apr_allocator_owner_get(pool->allocator) == pool)
+        decay_thread_stop(pool->allocator);
+#endif /* APR_HAS_THREADS */
+
+    if (pool->arena)
+        arena_release(pool);
+
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
 
@@ -987,6 +3440,7 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
     /* Run cleanups */
     run_cleanups(&pool->cleanups);
     pool_concurrency_set_destroyed(pool);
+    arena_cleanups_free(pool);
 
     /* Free subprocesses */
     free_proc_chain(pool->subprocesses);
@@ -1028,7 +3482,7 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
     /* Free all the nodes in the pool (including the node holding the
      * pool struct), by giving them back to the allocator.
      */
-    allocator_free(allocator, active);
+    pool_node_put(allocator, active);
 
     /* If this pool happens to be the owner of the allocator, free
      * everything in the allocator (that includes the pool struct
@@ -1064,8 +3518,7 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     if (allocator == NULL)
         allocator = parent->allocator;
 
-    if ((node = allocator_alloc(allocator,
-                                MIN_ALLOC - APR_MEMNODE_T_SIZE)) == NULL) {
+    if ((node = pool_node_get(allocator, PROFILE_CALLER())) == NULL) {
         if (abort_fn)
             abort_fn(APR_ENOMEM);
 
@@ -1099,13 +3552,24 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     pool->child = NULL;
     pool->cleanups = NULL;
     pool->free_cleanups = NULL;
+    pool->cleanups_count = pool->cleanups_dead = 0;
     pool->pre_cleanups = NULL;
     pool->subprocesses = NULL;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->children_created = 0;
+    pool->cleanups_registered = 0;
+    pool->marked = 0;
+    pool->stat_node_bytes = pool->stat_node_bytes_max = node_size(node);
+    pool->stat_clear = 0;
+    pool->profile_seed = 0;
+    pool->arena = NULL;
+    pool->arena_cleanups = NULL;
 
 #if APR_HAS_THREADS
     pool->user_mutex = NULL;
+    pool->concurrent = 0;
+    pool->refill_lock = 0;
 #endif
 #ifdef NETWARE
     pool->owner_proc = (apr_os_proc_t)getnlmhandle();
@@ -1124,6 +3588,7 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
 
         parent->child = pool;
         pool->ref = &parent->child;
+        pool->child_serial = ++parent->children_created;
 
 #if APR_HAS_THREADS
         if (mutex)
@@ -1133,6 +3598,7 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     else {
         pool->sibling = NULL;
         pool->ref = NULL;
+        pool->child_serial = 0;
     }
 
     pool_concurrency_init(pool);
@@ -1161,16 +3627,16 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
 
             return APR_ENOMEM;
         }
-        if ((node = allocator_alloc(pool_allocator,
-                                   MIN_ALLOC - APR_MEMNODE_T_SIZE)) == NULL) {
+        if ((node = pool_node_get(pool_allocator,
+                                  PROFILE_CALLER())) == NULL) {
             if (abort_fn)
                 abort_fn(APR_ENOMEM);
 
             return APR_ENOMEM;
         }
     }
-    else if ((node = allocator_alloc(pool_allocator,
-                                     MIN_ALLOC - APR_MEMNODE_T_SIZE)) == NULL) {
+    else if ((node = pool_node_get(pool_allocator,
+                                   PROFILE_CALLER())) == NULL) {
         if (abort_fn)
             abort_fn(APR_ENOMEM);
 
@@ -1189,14 +3655,29 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
     pool->child = NULL;
     pool->cleanups = NULL;
     pool->free_cleanups = NULL;
+    pool->cleanups_count = pool->cleanups_dead = 0;
     pool->pre_cleanups = NULL;
     pool->subprocesses = NULL;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->children_created = 0;
+    pool->cleanups_registered = 0;
+    pool->marked = 0;
+    pool->stat_node_bytes = pool->stat_node_bytes_max = node_size(node);
+    pool->stat_clear = 0;
+    pool->profile_seed = 0;
+    pool->arena = NULL;
+    pool->arena_cleanups = NULL;
+    pool->child_serial = 0;
     pool->parent = NULL;
     pool->sibling = NULL;
     pool->ref = NULL;
 
+#if APR_HAS_THREADS
+    pool->user_mutex = NULL;
+    pool->concurrent = 0;
+    pool->refill_lock = 0;
+#endif
 #ifdef NETWARE
     pool->owner_proc = (apr_os_proc_t)getnlmhandle();
 #endif /* defined(NETWARE) */
@@ -1233,6 +3714,7 @@ struct psprintf_data {
     apr_pool_t      *pool;
     apr_byte_t       got_a_new_node;
     apr_memnode_t   *free;
+    profile_caller_t caller; /* for the profiler */
 };
 
 #define APR_PSPRINTF_MIN_STRINGSIZE 32
@@ -1261,7 +3743,8 @@ static int psprintf_flush(apr_vformatter_buff_t *vbuff)
         size = APR_PSPRINTF_MIN_STRINGSIZE;
 
     node = active->next;
-    if (!ps->got_a_new_node && size <= node_free_space(node)) {
+    if (!ps->got_a_new_node && !pool->marked
+        && size <= node_free_space(node)) {
 
         list_remove(node);
         list_insert(node, active);
@@ -1288,7 +3771,8 @@ static int psprintf_flush(apr_vformatter_buff_t *vbuff)
         node = pool->active;
     }
     else {
-        if ((node = allocator_alloc(pool->allocator, size)) == NULL)
+        if ((node = allocator_alloc(pool->allocator, size,
+                                    pool->tag, ps->caller)) == NULL)
             return -1;
 
         if (ps->got_a_new_node) {
@@ -1341,7 +3825,94 @@ static int add_redzone(int (*flush_func)(apr_vformatter_buff_t *b),
 }
 #endif
 
-APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
+#if APR_HAS_THREADS
+/* Concurrent pools can't format in place in the active node, whose space
+ * other threads may claim meanwhile.  The string is formatted on the stack,
+ * or in a private node once too long, then copied to the pool.  Like the
+ * refills, the private nodes are taken and given back under the refill
+ * lock, since the allocator may have no mutex.
+ */
+#define APR_PSPRINTF_CONCURRENT_BUFSIZE 256
+
+struct psprintf_concurrent_data {
+    apr_vformatter_buff_t vbuff;
+    apr_pool_t      *pool;
+    char            *buf;
+    apr_memnode_t   *node; /* holding buf, unless on the stack */
+    profile_caller_t caller;
+};
+
+static int psprintf_concurrent_flush(apr_vformatter_buff_t *vbuff)
+{
+    struct psprintf_concurrent_data *ps;
+    apr_memnode_t *node;
+    apr_size_t cur_len;
+
+    ps = (struct psprintf_concurrent_data *)vbuff;
+    cur_len = ps->vbuff.curpos - ps->buf;
+
+    pool_refill_lock(ps->pool);
+    node = allocator_alloc(ps->pool->allocator, cur_len << 1,
+                           ps->pool->tag, ps->caller);
+    pool_refill_unlock(ps->pool);
+    if (node == NULL)
+        return -1;
+
+    memcpy(node->first_avail, ps->buf, cur_len);
+    if (ps->node) {
+        pool_refill_lock(ps->pool);
+        allocator_free(ps->pool->allocator, ps->node);
+        pool_refill_unlock(ps->pool);
+    }
+
+    ps->node = node;
+    ps->buf = node->first_avail;
+    ps->vbuff.curpos = ps->buf + cur_len;
+    ps->vbuff.endpos = node->endp - 1; /* Save a byte for NUL terminator */
+
+    return 0;
+}
+
+static char *psprintf_concurrent(apr_pool_t *pool, const char *fmt,
+                                 va_list ap, profile_caller_t caller)
+{
+    struct psprintf_concurrent_data ps;
+    char buf[APR_PSPRINTF_CONCURRENT_BUFSIZE];
+    char *strp = NULL;
+    apr_size_t size;
+
+    ps.pool = pool;
+    ps.buf = buf;
+    ps.node = NULL;
+    ps.caller = caller;
+    ps.vbuff.curpos = buf;
+    ps.vbuff.endpos = buf + sizeof(buf) - 1;
+
+    if (apr_vformatter(psprintf_concurrent_flush, &ps.vbuff, fmt, ap) == -1) {
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+    }
+    else {
+        *ps.vbuff.curpos++ = '\0';
+
+        size = ps.vbuff.curpos - ps.buf;
+        if ((strp = pool_palloc_concurrent(pool, size, APR_ALIGN_DEFAULT(1),
+                                           caller)) != NULL)
+            memcpy(strp, ps.buf, size);
+    }
+
+    if (ps.node) {
+        pool_refill_lock(pool);
+        allocator_free(pool->allocator, ps.node);
+        pool_refill_unlock(pool);
+    }
+
+    return strp;
+}
+#endif /* APR_HAS_THREADS */
+
+static char *pool_vsprintf(apr_pool_t *pool, const char *fmt, va_list ap,
+                           profile_caller_t caller)
 {
     struct psprintf_data ps;
     char *strp;
@@ -1349,9 +3920,19 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     apr_memnode_t *active, *node;
     apr_size_t free_index;
 
+#if APR_HAS_THREADS
+    if (pool->concurrent) {
+        strp = psprintf_concurrent(pool, fmt, ap, caller);
+        if (profile_rate && strp && pool_profile_draw(pool))
+            profile_record(pool->tag, caller, strlen(strp) + 1, 0);
+        return strp;
+    }
+#endif
+
     pool_concurrency_set_used(pool);
     ps.node = active = pool->active;
     ps.pool = pool;
+    ps.caller = caller;
     ps.vbuff.curpos  = ps.node->first_avail;
 
     /* Save a byte for the NUL terminator */
@@ -1406,6 +3987,9 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     size = APR_ALIGN_DEFAULT(size);
     ps.node->first_avail += size;
 
+    if (profile_rate && pool_profile_draw(pool))
+        profile_record(pool->tag, caller, size, 0);
+
     if (ps.free)
         allocator_free(pool->allocator, ps.free);
 
@@ -1421,6 +4005,7 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     node = ps.node;
 
     node->free_index = 0;
+    pool_stats_node_taken(pool, node);
 
     list_insert(node, active);
 
@@ -1432,7 +4017,7 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     active->free_index = free_index;
     node = active->next;
 
-    if (free_index >= node->free_index) {
+    if (pool->marked || free_index >= node->free_index) {
         pool_concurrency_set_idle(pool);
         return strp;
     }
@@ -1461,6 +4046,11 @@ error:
     return NULL;
 }
 
+APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
+{
+    return pool_vsprintf(pool, fmt, ap, PROFILE_CALLER());
+}
+
 
 #else /* APR_POOL_DEBUG */
 /*
@@ -1468,46 +4058,6 @@ error:
  */
 
 
-/*
- * Walk the pool tree rooted at pool, depth first.  When fn returns
- * anything other than 0, abort the traversal and return the value
- * returned by fn.
- */
-static int apr_pool_walk_tree(apr_pool_t *pool,
-                              int (*fn)(apr_pool_t *pool, void *data),
-                              void *data)
-{
-    int rv;
-    apr_pool_t *child;
-
-    rv = fn(pool, data);
-    if (rv)
-        return rv;
-
-#if APR_HAS_THREADS
-    if (pool->mutex) {
-        apr_thread_mutex_lock(pool->mutex);
-                        }
-#endif /* APR_HAS_THREADS */
-
-    child = pool->child;
-    while (child) {
-        rv = apr_pool_walk_tree(child, fn, data);
-        if (rv)
-            break;
-
-        child = child->sibling;
-    }
-
-#if APR_HAS_THREADS
-    if (pool->mutex) {
-        apr_thread_mutex_unlock(pool->mutex);
-    }
-#endif /* APR_HAS_THREADS */
-
-    return rv;
-}
-
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALL)
 static void apr_pool_log_event(apr_pool_t *pool, const char *event,
                                const char *file_line, int deref)
@@ -1611,7 +4161,8 @@ static void apr_pool_check_owner(apr_pool_t *pool)
 {
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_OWNER)
 #if APR_HAS_THREADS
-    if (!apr_os_thread_equal(pool->owner, apr_os_thread_current())) {
+    if (!pool->concurrent
+        && !apr_os_thread_equal(pool->owner, apr_os_thread_current())) {
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALL)
         apr_pool_log_event(pool, "THREAD",
                            __FILE__ ":apr_pool_integrity check [owner]", 0);
@@ -1735,11 +4286,35 @@ APR_DECLARE(void) apr_pool_terminate(void)
  * Memory allocation (debug)
  */
 
-static void *pool_alloc(apr_pool_t *pool, apr_size_t size)
+/* Concurrent pools serialize their allocations with the pool's mutex */
+static APR_INLINE void pool_concurrent_lock(apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+    if (pool->concurrent && pool->mutex)
+        apr_thread_mutex_lock(pool->mutex);
+#endif
+}
+
+static APR_INLINE void pool_concurrent_unlock(apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+    if (pool->concurrent && pool->mutex)
+        apr_thread_mutex_unlock(pool->mutex);
+#endif
+}
+
+static void *pool_alloc(apr_pool_t *pool, apr_size_t size,
+                        apr_size_t alignment)
 {
     debug_node_t *node;
     void *mem;
 
+    /* Over-allocate for the alignment; what's recorded below is the
+     * malloc()ed block, so that it can be free()d.
+     */
+    if (alignment > APR_ALIGN_DEFAULT(1))
+        size += alignment;
+
     if ((mem = malloc(size)) == NULL) {
         if (pool->abort_fn)
             pool->abort_fn(APR_ENOMEM);
@@ -1747,9 +4322,12 @@ static void *pool_alloc(apr_pool_t *pool, apr_size_t size)
         return NULL;
     }
 
+    pool_concurrent_lock(pool);
+
     node = pool->nodes;
     if (node == NULL || node->index == 64) {
         if ((node = malloc(SIZEOF_DEBUG_NODE_T)) == NULL) {
+            pool_concurrent_unlock(pool);
             free(mem);
             if (pool->abort_fn)
                 pool->abort_fn(APR_ENOMEM);
@@ -1771,6 +4349,11 @@ static void *pool_alloc(apr_pool_t *pool, apr_size_t size)
     pool->stat_alloc++;
     pool->stat_total_alloc++;
 
+    pool_concurrent_unlock(pool);
+
+    if (alignment > APR_ALIGN_DEFAULT(1))
+        mem = (void *)APR_ALIGN((apr_uintptr_t)mem, alignment);
+
     return mem;
 }
 
@@ -1781,7 +4364,7 @@ APR_DECLARE(void *) apr_palloc_debug(apr_pool_t *pool, apr_size_t size,
 
     apr_pool_check_integrity(pool);
 
-    mem = pool_alloc(pool, size);
+    mem = pool_alloc(pool, size, 0);
 
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC)
     apr_pool_log_event(pool, "PALLOC", file_line, 1);
@@ -1797,7 +4380,7 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
 
     apr_pool_check_integrity(pool);
 
-    mem = pool_alloc(pool, size);
+    mem = pool_alloc(pool, size, 0);
     memset(mem, 0, size);
 
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC)
@@ -1807,6 +4390,59 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
     return mem;
 }
 
+APR_DECLARE(void *) apr_palloc_aligned_debug(apr_pool_t *pool,
+                                             apr_size_t size,
+                                             apr_size_t alignment,
+                                             const char *file_line)
+{
+    void *mem;
+
+    apr_pool_check_integrity(pool);
+
+    if (alignment & (alignment - 1))
+        return NULL;
+
+    mem = pool_alloc(pool, size, alignment);
+
+#if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC)
+    apr_pool_log_event(pool, "PALLOC", file_line, 1);
+#endif /* (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC) */
+
+    return mem;
+}
+
+APR_DECLARE(void *) apr_pcalloc_aligned_debug(apr_pool_t *pool,
+                                              apr_size_t size,
+                                              apr_size_t alignment,
+                                              const char *file_line)
+{
+    void *mem;
+
+    apr_pool_check_integrity(pool);
+
+    if (alignment & (alignment - 1))
+        return NULL;
+
+    mem = pool_alloc(pool, size, alignment);
+    if (mem)
+        memset(mem, 0, size);
+
+#if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC)
+    apr_pool_log_event(pool, "PCALLOC", file_line, 1);
+#endif /* (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC) */
+
+    return mem;
+}
+
+/* Each allocation is a malloc() of its own, so that overflows show up */
+APR_DECLARE(int) apr_palloc_grow(apr_pool_t *pool, void *mem,
+                                 apr_size_t size, apr_size_t new_size)
+{
+    apr_pool_check_integrity(pool);
+
+    return 0;
+}
+
 
 /*
  * Pool creation/destruction (debug)
@@ -1818,6 +4454,7 @@ static void pool_clear_debug(apr_pool_t *pool, const char *file_line)
 {
     debug_node_t *node;
     apr_uint32_t index;
+    apr_size_t size;
 
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
@@ -1839,6 +4476,7 @@ static void pool_clear_debug(apr_pool_t *pool, const char *file_line)
     run_cleanups(&pool->cleanups);
     pool->free_cleanups = NULL;
     pool->cleanups = NULL;
+    pool->cleanups_count = pool->cleanups_dead = 0;
 
     /* If new child pools showed up, this is a reason to raise a flag */
     if (pool->child)
@@ -1851,23 +4489,135 @@ static void pool_clear_debug(apr_pool_t *pool, const char *file_line)
     /* Clear the user data. */
     pool->user_data = NULL;
 
-    /* Free the blocks, scribbling over them first to help highlight
-     * use-after-free issues. */
+    size = apr_pool_num_bytes(pool, 0);
+    if (pool->stat_bytes_max < size)
+        pool->stat_bytes_max = size;
+
+    /* Free the blocks, scribbling over them first to help highlight
+     * use-after-free issues. */
+    while ((node = pool->nodes) != NULL) {
+        pool->nodes = node->next;
+
+        for (index = 0; index < node->index; index++) {
+            memset(node->beginp[index], POOL_POISON_BYTE,
+                   (char *)node->endp[index] - (char *)node->beginp[index]);
+            free(node->beginp[index]);
+        }
+
+        memset(node, POOL_POISON_BYTE, SIZEOF_DEBUG_NODE_T);
+        free(node);
+    }
+
+    pool->stat_alloc = 0;
+    pool->stat_clear++;
+}
+
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_t *pool,
+                                     apr_pool_stats_t *stats)
+{
+    debug_node_t *node;
+
+    memset(stats, 0, sizeof(*stats));
+    for (node = pool->nodes; node; node = node->next) {
+        stats->node_count += node->index;
+    }
+    stats->node_bytes = stats->used_bytes = apr_pool_num_bytes(pool, 0);
+    stats->node_bytes_max = pool->stat_bytes_max;
+    if (stats->node_bytes_max < stats->node_bytes)
+        stats->node_bytes_max = stats->node_bytes;
+    stats->clear_count = pool->stat_clear;
+}
+
+/* In debug mode, every allocation has its own entry in the debug nodes,
+ * the mark keeps the address of the next entry to be used.
+ */
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    debug_node_t *node = pool->nodes;
+
+    apr_pool_check_integrity(pool);
+
+    mark->node = node;
+    mark->avail = node ? (char *)&node->beginp[node->index] : NULL;
+    mark->tail = NULL;
+    mark->cleanups = pool->cleanups_registered;
+    mark->children = pool->children_created;
+}
+
+/* Whether mem was allocated from the pool after the mark */
+static int pool_mark_owns(apr_pool_t *pool, const apr_pool_mark_t *mark,
+                          const void *mem)
+{
+    debug_node_t *node;
+    apr_uint32_t index, first;
+
+    for (node = pool->nodes; node; node = node->next) {
+        first = 0;
+        if (node == mark->node)
+            first = (apr_uint32_t)((void **)mark->avail - node->beginp);
+
+        for (index = first; index < node->index; index++) {
+            if ((const char *)mem >= (char *)node->beginp[index]
+                && (const char *)mem < (char *)node->endp[index])
+                return 1;
+        }
+
+        if (node == mark->node)
+            break;
+    }
+
+    return 0;
+}
+
+APR_DECLARE(void) apr_pool_rewind(apr_pool_t *pool,
+                                  const apr_pool_mark_t *mark)
+{
+    debug_node_t *node;
+    apr_pool_t *child;
+    apr_uint32_t index, first;
+
+    apr_pool_check_integrity(pool);
+
+    while ((child = pool->child) != NULL
+           && child->child_serial > mark->children)
+        pool_destroy_debug(child, APR_POOL__FILE_LINE__);
+
+    rewind_cleanups(pool, mark);
+
     while ((node = pool->nodes) != NULL) {
-        pool->nodes = node->next;
+        first = 0;
+        if (node == mark->node)
+            first = (apr_uint32_t)((void **)mark->avail - node->beginp);
 
-        for (index = 0; index < node->index; index++) {
+        for (index = first; index < node->index; index++) {
             memset(node->beginp[index], POOL_POISON_BYTE,
                    (char *)node->endp[index] - (char *)node->beginp[index]);
             free(node->beginp[index]);
         }
 
+        if (node == mark->node) {
+            node->index = first;
+            break;
+        }
+
+        pool->nodes = node->next;
         memset(node, POOL_POISON_BYTE, SIZEOF_DEBUG_NODE_T);
         free(node);
     }
+}
 
-    pool->stat_alloc = 0;
-    pool->stat_clear++;
+/* Every allocation is a malloc() of its own, nothing to pack */
+APR_DECLARE(apr_status_t) apr_pool_create_arena(apr_pool_t **newpool,
+                                                apr_pool_t *parent,
+                                                apr_size_t size)
+{
+    return apr_pool_create_ex(newpool, parent, NULL, NULL);
+}
+
+APR_DECLARE(apr_status_t) apr_pool_freeze(apr_pool_t *pool,
+                                          apr_uint32_t flags)
+{
+    return APR_ENOTIMPL;
 }
 
 APR_DECLARE(void) apr_pool_clear_debug(apr_pool_t *pool,
@@ -1926,6 +4676,13 @@ static void pool_destroy_debug(apr_pool_t *pool, const char *file_line)
     apr_pool_log_event(pool, "DESTROY", file_line, 1);
 #endif /* (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE) */
 
+#if APR_HAS_THREADS
+    /* See apr_pool_destroy() */
+    if (pool->allocator != NULL && pool->allocator->decay_thread
+        && apr_allocator_owner_get(pool->allocator) == pool)
+        decay_thread_stop(pool->allocator);
+#endif /* APR_HAS_THREADS */
+
     pool_clear_debug(pool, file_line);
 
     /* Remove the pool from the parents child list */
@@ -2018,6 +4775,7 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex_debug(apr_pool_t **newpool,
 
         parent->child = pool;
         pool->ref = &parent->child;
+        pool->child_serial = ++parent->children_created;
 
 #if APR_HAS_THREADS
         if (parent->mutex)
@@ -2195,9 +4953,12 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     /*
      * Link the node in
      */
+    pool_concurrent_lock(pool);
+
     node = pool->nodes;
     if (node == NULL || node->index == 64) {
         if ((node = malloc(SIZEOF_DEBUG_NODE_T)) == NULL) {
+            pool_concurrent_unlock(pool);
             if (pool->abort_fn)
                 pool->abort_fn(APR_ENOMEM);
 
@@ -2213,6 +4974,8 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     node->endp[node->index] = ps.mem + ps.size;
     node->index++;
 
+    pool_concurrent_unlock(pool);
+
     return ps.mem;
 }
 
@@ -2334,7 +5097,38 @@ APR_DECLARE_NONSTD(char *) apr_psprintf(apr_pool_t *p, const char *fmt, ...)
     char *res;
 
     va_start(ap, fmt);
+#if APR_POOL_DEBUG
+    res = apr_pvsprintf(p, fmt, ap);
+#else
+    res = pool_vsprintf(p, fmt, ap, PROFILE_CALLER());
+#endif
+    va_end(ap);
+    return res;
+}
+
+APR_DECLARE(char *) apr_pvsprintf_debug(apr_pool_t *p, const char *file_line,
+                                        const char *fmt, va_list ap)
+{
+#if APR_POOL_DEBUG
+    return apr_pvsprintf(p, fmt, ap);
+#else
+    return pool_vsprintf(p, fmt, ap, PROFILE_CALLER_AT(file_line));
+#endif
+}
+
+APR_DECLARE_NONSTD(char *) apr_psprintf_debug(apr_pool_t *p,
+                                              const char *file_line,
+                                              const char *fmt, ...)
+{
+    va_list ap;
+    char *res;
+
+    va_start(ap, fmt);
+#if APR_POOL_DEBUG
     res = apr_pvsprintf(p, fmt, ap);
+#else
+    res = pool_vsprintf(p, fmt, ap, PROFILE_CALLER_AT(file_line));
+#endif
     va_end(ap);
     return res;
 }
@@ -2476,21 +5270,144 @@ APR_DECLARE(apr_status_t) apr_pool_userdata_get(void **data, const char *key,
 
 /*
  * Cleanup
+ *
+ * A cleanup killed or run through its handle is only marked as such, and
+ * left in the list for a later registration, kill or sweep to unlink, so
+ * that the handles never write to the entries next to theirs.  The entry
+ * generation is bumped each time a cleanup is killed or run, to tell the
+ * stale handles.
  */
 
 struct cleanup_t {
-    struct cleanup_t *next;
+    cleanup_t *next;
     const void *data;
+    /* NULL once killed or run, until the entry is unlinked */
     apr_status_t (*plain_cleanup_fn)(void *data);
     apr_status_t (*child_cleanup_fn)(void *data);
+    apr_uint32_t gen;
+    apr_uint64_t serial; /* cleanups_registered of the pool */
 };
 
+/* Link c at the head of the list *cref */
+#define cleanup_insert(c, cref) do {            \
+    (c)->next = *(cref);                        \
+    *(cref) = (c);                              \
+} while (0)
+
+/* Mark c as killed, and take its handles' validity away */
+#define cleanup_retire(c) do {                  \
+    (c)->plain_cleanup_fn = NULL;               \
+    (c)->gen++;                                 \
+} while (0)
+
+/* Take an entry for a new cleanup, from the free list or from a killed
+ * cleanup at the head of the list, else from the pool.
+ */
+#if !APR_POOL_DEBUG
+/* The cleanups are written to until the pool is cleared, so those of a
+ * pool with an arena are kept out of it, since it may be made read-only.
+ * Once frozen, the arena is not allocated from anymore.
+ */
+static cleanup_t *arena_cleanup_alloc(apr_pool_t *p)
+{
+    apr_memnode_t *node = p->arena_cleanups;
+    apr_size_t size = APR_ALIGN_DEFAULT(sizeof(cleanup_t));
+    cleanup_t *c;
+
+    if (node == NULL || size > node_free_space(node)) {
+        if ((node = allocator_alloc(p->allocator,
+                                    MIN_ALLOC - APR_MEMNODE_T_SIZE,
+                                    p->tag, PROFILE_CALLER())) == NULL) {
+            if (p->abort_fn)
+                p->abort_fn(APR_ENOMEM);
+
+            return NULL;
+        }
+        node->next = p->arena_cleanups;
+        p->arena_cleanups = node;
+    }
+
+    c = (cleanup_t *)node->first_avail;
+    node->first_avail += size;
+
+    return c;
+}
+#endif /* !APR_POOL_DEBUG */
+
+static cleanup_t *cleanup_alloc(apr_pool_t *p)
+{
+    cleanup_t *c;
+
+    if ((c = p->free_cleanups) != NULL) {
+        /* reuse a cleanup structure */
+        p->free_cleanups = c->next;
+    }
+    else if ((c = p->cleanups) != NULL && c->plain_cleanup_fn == NULL) {
+        p->cleanups = c->next;
+        p->cleanups_count--;
+        p->cleanups_dead--;
+    }
+    else {
+#if !APR_POOL_DEBUG
+        if (p->arena && !p->arena_frozen)
+            c = arena_cleanup_alloc(p);
+        else
+#endif
+        c = apr_palloc(p, sizeof(cleanup_t));
+        c->gen = 0;
+    }
+
+    return c;
+}
+
+/* Move all the killed cleanups to the free list */
+static void cleanup_sweep(apr_pool_t *p)
+{
+    cleanup_t *c, **lastp = &p->cleanups;
+
+    while ((c = *lastp) != NULL) {
+        if (c->plain_cleanup_fn == NULL) {
+            *lastp = c->next;
+            c->next = p->free_cleanups;
+            p->free_cleanups = c;
+        }
+        else {
+            lastp = &c->next;
+        }
+    }
+
+    p->cleanups_count -= p->cleanups_dead;
+    p->cleanups_dead = 0;
+}
+
 APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
                       apr_status_t (*plain_cleanup_fn)(void *data),
                       apr_status_t (*child_cleanup_fn)(void *data))
 {
     cleanup_t *c;
 
+#if APR_POOL_DEBUG
+    apr_pool_check_integrity(p);
+#endif /* APR_POOL_DEBUG */
+
+    if (p != NULL) {
+        c = cleanup_alloc(p);
+        c->data = data;
+        c->plain_cleanup_fn = plain_cleanup_fn;
+        c->child_cleanup_fn = child_cleanup_fn;
+        c->serial = ++p->cleanups_registered;
+        cleanup_insert(c, &p->cleanups);
+        p->cleanups_count++;
+    }
+}
+
+APR_DECLARE(void) apr_pool_cleanup_register_ex(apr_pool_cleanup_t *cleanup,
+                      apr_pool_t *p, const void *data,
+                      apr_status_t (*plain_cleanup_fn)(void *data),
+                      apr_status_t (*child_cleanup_fn)(void *data))
+{
+    cleanup_t *c = NULL;
+
 #if APR_POOL_DEBUG
     apr_pool_check_integrity(p);
 
@@ -2500,19 +5417,17 @@ APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
 #endif /* APR_POOL_DEBUG */
 
     if (p != NULL) {
-        if (p->free_cleanups) {
-            /* reuse a cleanup structure */
-            c = p->free_cleanups;
-            p->free_cleanups = c->next;
-        } else {
-            c = apr_palloc(p, sizeof(cleanup_t));
-        }
+        c = cleanup_alloc(p);
         c->data = data;
         c->plain_cleanup_fn = plain_cleanup_fn;
         c->child_cleanup_fn = child_cleanup_fn;
-        c->next = p->cleanups;
-        p->cleanups = c;
+        c->serial = ++p->cleanups_registered;
+        cleanup_insert(c, &p->cleanups);
+        p->cleanups_count++;
+        cleanup->gen = c->gen;
     }
+
+    cleanup->entry = c;
 }
 
 APR_DECLARE(void) apr_pool_pre_cleanup_register(apr_pool_t *p, const void *data,
@@ -2525,17 +5440,10 @@ APR_DECLARE(void) apr_pool_pre_cleanup_register(apr_pool_t *p, const void *data,
 #endif /* APR_POOL_DEBUG */
 
     if (p != NULL) {
-        if (p->free_cleanups) {
-            /* reuse a cleanup structure */
-            c = p->free_cleanups;
-            p->free_cleanups = c->next;
-        } else {
-            c = apr_palloc(p, sizeof(cleanup_t));
-        }
+        c = cleanup_alloc(p);
         c->data = data;
         c->plain_cleanup_fn = plain_cleanup_fn;
-        c->next = p->pre_cleanups;
-        p->pre_cleanups = c;
+        cleanup_insert(c, &p->pre_cleanups);
     }
 }
 
@@ -2565,6 +5473,8 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
 
         if (c->data == data && c->plain_cleanup_fn == cleanup_fn) {
             *lastp = c->next;
+            p->cleanups_count--;
+            cleanup_retire(c);
             /* move to freelist */
             c->next = p->free_cleanups;
             p->free_cleanups = c;
@@ -2590,6 +5500,7 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
 
         if (c->data == data && c->plain_cleanup_fn == cleanup_fn) {
             *lastp = c->next;
+            cleanup_retire(c);
             /* move to freelist */
             c->next = p->free_cleanups;
             p->free_cleanups = c;
@@ -2602,6 +5513,25 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
 
 }
 
+APR_DECLARE(void) apr_pool_cleanup_kill_ex(apr_pool_t *p,
+                                           const apr_pool_cleanup_t *cleanup)
+{
+    cleanup_t *c = cleanup->entry;
+
+#if APR_POOL_DEBUG
+    apr_pool_check_integrity(p);
+#endif /* APR_POOL_DEBUG */
+
+    if (c == NULL || c->gen != cleanup->gen)
+        return;
+
+    cleanup_retire(c);
+
+    /* Unlink them all once they are the majority */
+    if (++p->cleanups_dead > p->cleanups_count / 2)
+        cleanup_sweep(p);
+}
+
 APR_DECLARE(void) apr_pool_child_cleanup_set(apr_pool_t *p, const void *data,
                       apr_status_t (*plain_cleanup_fn)(void *),
                       apr_status_t (*child_cleanup_fn)(void *))
@@ -2633,14 +5563,68 @@ APR_DECLARE(apr_status_t) apr_pool_cleanup_run(apr_pool_t *p, void *data,
     return (*cleanup_fn)(data);
 }
 
+APR_DECLARE(apr_status_t) apr_pool_cleanup_run_ex(apr_pool_t *p,
+                                      const apr_pool_cleanup_t *cleanup)
+{
+    apr_status_t (*cleanup_fn)(void *);
+    cleanup_t *c = cleanup->entry;
+
+    if (c == NULL || c->gen != cleanup->gen)
+        return APR_SUCCESS;
+
+    cleanup_fn = c->plain_cleanup_fn;
+    apr_pool_cleanup_kill_ex(p, cleanup);
+
+    return (*cleanup_fn)((void *)c->data);
+}
+
 static void run_cleanups(cleanup_t **cref)
 {
-    cleanup_t *c = *cref;
+    cleanup_t *c;
+    apr_status_t (*cleanup_fn)(void *);
 
-    while (c) {
+    while ((c = *cref) != NULL) {
         *cref = c->next;
-        (*c->plain_cleanup_fn)((void *)c->data);
-        c = *cref;
+        if ((cleanup_fn = c->plain_cleanup_fn) != NULL) {
+            cleanup_retire(c);
+            (*cleanup_fn)((void *)c->data);
+        }
+    }
+}
+
+/* Run the cleanups registered since the mark, and forget the free ones
+ * whose memory is about to be released.  Those are the first ones of the
+ * list, whatever was unlinked from it since the mark.
+ */
+static void rewind_cleanups(apr_pool_t *pool, const apr_pool_mark_t *mark)
+{
+    cleanup_t *c, **lastp;
+    apr_status_t (*cleanup_fn)(void *);
+
+    while ((c = pool->cleanups) != NULL && c->serial > mark->cleanups) {
+        pool->cleanups = c->next;
+        pool->cleanups_count--;
+        if ((cleanup_fn = c->plain_cleanup_fn) != NULL) {
+            cleanup_retire(c);
+            (*cleanup_fn)((void *)c->data);
+        }
+        else {
+            pool->cleanups_dead--;
+        }
+
+        /* Reused from the free list, allocated before the mark */
+        if (!pool_mark_owns(pool, mark, c)) {
+            c->next = pool->free_cleanups;
+            pool->free_cleanups = c;
+        }
+    }
+
+    lastp = &pool->free_cleanups;
+    while ((c = *lastp) != NULL) {
+        if (pool_mark_owns(pool, mark, c))
+            *lastp = c->next;
+        else
+            lastp = &c->next;
     }
 }
 
@@ -2648,12 +5632,14 @@ static void run_cleanups(cleanup_t **cref)
 
 static void run_child_cleanups(cleanup_t **cref)
 {
-    cleanup_t *c = *cref;
+    cleanup_t *c;
 
-    while (c) {
+    while ((c = *cref) != NULL) {
         *cref = c->next;
-        (*c->child_cleanup_fn)((void *)c->data);
-        c = *cref;
+        if (c->plain_cleanup_fn != NULL) {
+            cleanup_retire(c);
+            (*c->child_cleanup_fn)((void *)c->data);
+        }
     }
 }
 
@@ -2817,16 +5803,49 @@ static void free_proc_chain(struct process_chain *procs)
  */
 
 #if !APR_POOL_DEBUG
+/* These record file_line for the profiler, see APR_POOL_PROFILE */
+
 APR_DECLARE(void *) apr_palloc_debug(apr_pool_t *pool, apr_size_t size,
                                      const char *file_line)
 {
-    return apr_palloc(pool, size);
+    return pool_palloc(pool, size, PROFILE_CALLER_AT(file_line));
 }
 
 APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
                                       const char *file_line)
 {
-    return apr_pcalloc(pool, size);
+    void *mem;
+
+    if ((mem = pool_palloc(pool, size,
+                           PROFILE_CALLER_AT(file_line))) != NULL) {
+        memset(mem, 0, size);
+    }
+
+    return mem;
+}
+
+APR_DECLARE(void *) apr_palloc_aligned_debug(apr_pool_t *pool,
+                                             apr_size_t size,
+                                             apr_size_t alignment,
+                                             const char *file_line)
+{
+    return pool_palloc_aligned(pool, size, alignment,
+                               PROFILE_CALLER_AT(file_line));
+}
+
+APR_DECLARE(void *) apr_pcalloc_aligned_debug(apr_pool_t *pool,
+                                              apr_size_t size,
+                                              apr_size_t alignment,
+                                              const char *file_line)
+{
+    void *mem;
+
+    if ((mem = pool_palloc_aligned(pool, size, alignment,
+                                   PROFILE_CALLER_AT(file_line))) != NULL) {
+        memset(mem, 0, size);
+    }
+
+    return mem;
 }
 
 APR_DECLARE(void) apr_pool_clear_debug(apr_pool_t *pool,
@@ -2876,6 +5895,26 @@ APR_DECLARE(void *) apr_pcalloc(apr_pool_t *pool, apr_size_t size)
     return apr_pcalloc_debug(pool, size, "undefined");
 }
 
+#undef apr_palloc_aligned
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                       apr_size_t alignment);
+
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                       apr_size_t alignment)
+{
+    return apr_palloc_aligned_debug(pool, size, alignment, "undefined");
+}
+
+#undef apr_pcalloc_aligned
+APR_DECLARE(void *) apr_pcalloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                        apr_size_t alignment);
+
+APR_DECLARE(void *) apr_pcalloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                        apr_size_t alignment)
+{
+    return apr_pcalloc_aligned_debug(pool, size, alignment, "undefined");
+}
+
 #undef apr_pool_clear
 APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool);
 
@@ -2922,3 +5961,250 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
 }
 
 #endif /* APR_POOL_DEBUG */
+
+
+/*
+ * Concurrent pools
+ */
+
+APR_DECLARE(apr_status_t) apr_pool_create_concurrent(apr_pool_t **newpool,
+                                                     apr_pool_t *parent,
+                                                     apr_abortfunc_t abort_fn,
+                                                     apr_allocator_t *allocator)
+{
+    apr_status_t rv;
+
+    rv = apr_pool_create_ex(newpool, parent, abort_fn, allocator);
+#if APR_HAS_THREADS
+    if (rv == APR_SUCCESS)
+        (*newpool)->concurrent = 1;
+#endif
+
+    return rv;
+}
+
+
+/*
+ * Allocation profiling
+ */
+
+APR_DECLARE(apr_status_t) apr_pool_profile_start(apr_uint32_t rate)
+{
+#if APR_POOL_DEBUG
+    return APR_ENOTIMPL;
+#else
+    if (rate == 0)
+        return APR_EINVAL;
+
+    profile_threshold = APR_UINT32_MAX / rate;
+    profile_rate = rate;
+
+    return APR_SUCCESS;
+#endif
+}
+
+APR_DECLARE(void) apr_pool_profile_stop(void)
+{
+    profile_rate = 0;
+    profile_threshold = 0;
+}
+
+APR_DECLARE(void) apr_pool_profile_reset(void)
+{
+    profile_lock_acquire();
+    memset(profile_sites, 0, sizeof(profile_sites));
+    profile_dropped = 0;
+    profile_lock_release();
+}
+
+APR_DECLARE(int) apr_pool_profile_walk(apr_pool_profile_fn_t *fn,
+                                       void *baton)
+{
+    profile_site_t entry;
+    apr_pool_profile_site_t site;
+    apr_size_t i;
+    int rv;
+
+    for (i = 0; i < PROFILE_SITES; i++) {
+        /* Don't call fn with the lock held, it may allocate */
+        profile_lock_acquire();
+        entry = profile_sites[i];
+        profile_lock_release();
+
+        if (!entry.samples)
+            continue;
+
+        site.tag = entry.tag_key ? entry.tag : NULL;
+        site.caller = entry.caller;
+        site.file_line = entry.file_line;
+        site.samples = entry.samples;
+        site.alloc_bytes = entry.alloc_bytes;
+        site.node_bytes = entry.node_bytes;
+        if ((rv = fn(baton, &site)) != 0)
+            return rv;
+    }
+
+    return 0;
+}
+
+/* Biggest first */
+static int profile_site_cmp(const void *a, const void *b)
+{
+    const profile_site_t *sa = a, *sb = b;
+    apr_uint64_t na = sa->alloc_bytes + sa->node_bytes;
+    apr_uint64_t nb = sb->alloc_bytes + sb->node_bytes;
+
+    return na < nb ? 1 : na > nb ? -1 : 0;
+}
+
+/* A pool of the tree, copied while the walk holds the allocators' mutexes
+ * and printed once it is over, since writing to the file may block.
+ */
+typedef struct profile_tree_pool_t {
+    struct profile_tree_pool_t *next;
+    const char   *tag;
+    int           depth;
+    apr_size_t    bytes_max;
+    unsigned int  clears;
+} profile_tree_pool_t;
+
+typedef struct profile_tree_t {
+    apr_pool_t *scratch;
+    apr_pool_t *root;
+    profile_tree_pool_t *first, **last;
+} profile_tree_t;
+
+static int profile_tree_copy(apr_pool_t *pool, void *data)
+{
+    profile_tree_t *tree = data;
+    profile_tree_pool_t *entry;
+    apr_pool_t *p;
+
+    entry = apr_palloc(tree->scratch, sizeof(*entry));
+    entry->depth = 0;
+    for (p = pool; p != tree->root; p = p->parent)
+        entry->depth++;
+
+    /* Only what the pool records itself may be read here, its nodes may
+     * be in use by another thread.
+     */
+    entry->tag = pool->tag ? apr_pstrdup(tree->scratch, pool->tag) : NULL;
+#if APR_POOL_DEBUG
+    entry->bytes_max = pool->stat_bytes_max;
+#else
+    entry->bytes_max = pool->stat_node_bytes_max;
+#endif
+    entry->clears = pool->stat_clear;
+
+    entry->next = NULL;
+    *tree->last = entry;
+    tree->last = &entry->next;
+
+    return 0;
+}
+
+static void profile_print_sites(apr_file_t *file, const profile_site_t *sites,
+                                apr_size_t count, int with_caller)
+{
+    apr_size_t i;
+
+    apr_file_printf(file, "%16s %16s %10s  %s\n",
+                    "alloc bytes", "node bytes", "samples",
+                    with_caller ? "caller tag" : "tag");
+    for (i = 0; i < count; i++) {
+        apr_file_printf(file, "%16" APR_UINT64_T_FMT
+                              " %16" APR_UINT64_T_FMT
+                              " %10" APR_UINT64_T_FMT "  ",
+                        sites[i].alloc_bytes, sites[i].node_bytes,
+                        sites[i].samples);
+        if (with_caller && sites[i].file_line)
+            apr_file_printf(file, "%s ", sites[i].file_line);
+        else if (with_caller)
+            apr_file_printf(file, "%pp ", sites[i].caller);
+        apr_file_printf(file, "%s\n",
+                        sites[i].tag_key ? sites[i].tag : "(untagged)");
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_pool_profile_dump(apr_file_t *file,
+                                                apr_pool_t *pool)
+{
+    apr_pool_t *scratch;
+    profile_site_t *sites, *tags;
+    apr_size_t nsites = 0, ntags = 0, i, j;
+    apr_uint64_t dropped;
+    profile_tree_t tree;
+    apr_status_t rv;
+
+    /* Not a subpool, which would show in the tree */
+    rv = apr_pool_create_unmanaged_ex(&scratch, NULL, NULL);
+    if (rv != APR_SUCCESS)
+        return rv;
+
+    sites = apr_palloc(scratch, sizeof(profile_sites));
+    tags = apr_palloc(scratch, sizeof(profile_sites));
+
+    profile_lock_acquire();
+    for (i = 0; i < PROFILE_SITES; i++) {
+        if (profile_sites[i].samples)
+            sites[nsites++] = profile_sites[i];
+    }
+    dropped = profile_dropped;
+    profile_lock_release();
+
+    /* Sites with the same tag, whatever the caller or the tag pointer */
+    for (i = 0; i < nsites; i++) {
+        for (j = 0; j < ntags; j++) {
+            if ((!tags[j].tag_key) == (!sites[i].tag_key)
+                && strcmp(tags[j].tag, sites[i].tag) == 0)
+                break;
+        }
+        if (j == ntags) {
+            tags[ntags++] = sites[i];
+        }
+        else {
+            tags[j].samples += sites[i].samples;
+            tags[j].alloc_bytes += sites[i].alloc_bytes;
+            tags[j].node_bytes += sites[i].node_bytes;
+        }
+    }
+    qsort(sites, nsites, sizeof(*sites), profile_site_cmp);
+    qsort(tags, ntags, sizeof(*tags), profile_site_cmp);
+
+    if (profile_rate)
+        apr_file_printf(file, "Pool allocation profile, sampling 1 in %u\n",
+                        profile_rate);
+    else
+        apr_file_printf(file, "Pool allocation profile, stopped\n");
+    if (dropped)
+        apr_file_printf(file, "%" APR_UINT64_T_FMT " samples dropped, "
+                        "too many sites\n", dropped);
+
+    apr_file_printf(file, "\nPer tag:\n");
+    profile_print_sites(file, tags, ntags, 0);
+    apr_file_printf(file, "\nPer site:\n");
+    profile_print_sites(file, sites, nsites, 1);
+
+    tree.scratch = scratch;
+    tree.root = pool ? pool : global_pool;
+    tree.first = NULL;
+    tree.last = &tree.first;
+    if (tree.root) {
+        profile_tree_pool_t *entry;
+
+        apr_pool_walk_tree(tree.root, profile_tree_copy, &tree);
+
+        apr_file_printf(file, "\nPool tree:\n");
+        for (entry = tree.first; entry; entry = entry->next) {
+            apr_file_printf(file,
+                            "%*s%s: %" APR_SIZE_T_FMT " bytes max, "
+                            "%u clears\n", 2 * entry->depth, "",
+                            entry->tag ? entry->tag : "(untagged)",
+                            entry->bytes_max, entry->clears);
+        }
+    }
+
+    apr_pool_destroy(scratch);
+
+    return apr_file_flush(file);
+}
@@ -0,0 +1,465 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_private.h"
+
+#include "apr_slab.h"
+#include "apr_allocator.h"
+#include "apr_thread_mutex.h"
+#include "apr_magazine.h"
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+/*
+ * Magic numbers
+ */
+
+#define CACHELINE_SIZE          64
+
+/* Objects are carved out of nodes of at least NODE_SIZE bytes, holding
+ * at least NODE_OBJECTS objects.
+ */
+#define NODE_SIZE               (64 * 1024 - APR_MEMNODE_T_SIZE)
+#define NODE_OBJECTS            16
+
+/*
+ * Thread caches (APR_SLAB_THREADS): a thread is mapped onto one of
+ * APR_MAGAZINE_COUNT slots (see apr_magazine.h), each slot caching up to
+ * MAGAZINE_DEPTH objects.  Objects are moved from and to the shared
+ * free list MAGAZINE_BATCH at a time.
+ */
+#define MAGAZINE_DEPTH          32
+#define MAGAZINE_BATCH          (MAGAZINE_DEPTH / 2)
+
+
+/*
+ * Structures
+ */
+
+/** A free object */
+typedef struct slab_obj_t slab_obj_t;
+
+struct slab_obj_t {
+    slab_obj_t *next;
+};
+
+#if APR_HAS_THREADS
+typedef struct slab_magazine_t {
+    /** Non-zero while a thread is using this slot */
+    volatile apr_uint32_t busy;
+    /** Number of objects in free */
+    apr_uint32_t          count;
+    /** The free objects */
+    slab_obj_t           *free;
+    /** Statistics, added to the slab's ones when asked for */
+    apr_uint64_t          alloc_calls;
+    apr_uint64_t          free_calls;
+} slab_magazine_t;
+
+#define SIZEOF_MAGAZINE_T   APR_ALIGN(sizeof(slab_magazine_t), \
+                                      CACHELINE_SIZE)
+#endif /* APR_HAS_THREADS */
+
+struct apr_slab_t {
+    apr_pool_t         *pool;
+    apr_allocator_t    *allocator;
+    /** Our cleanup in pool */
+    apr_pool_cleanup_t cleanup;
+    /** Size of the objects */
+    apr_size_t          size;
+    /** Size of the nodes, as passed to apr_allocator_alloc() */
+    apr_size_t          node_size;
+    /** The nodes the objects are carved from, linked by next */
+    apr_memnode_t      *nodes;
+    /** The space left in the current node */
+    char               *avail;
+    char               *endp;
+    /** The free objects (not in a thread cache) */
+    slab_obj_t         *free;
+    /** Statistics, @see apr_slab_stats_get() */
+    apr_slab_stats_t    stats;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+    /** APR_MAGAZINE_COUNT thread caches, each SIZEOF_MAGAZINE_T bytes, or
+     * NULL unless created with APR_SLAB_THREADS.
+     */
+    char               *magazines;
+#endif /* APR_HAS_THREADS */
+};
+
+
+/*
+ * Helpers
+ */
+
+static APR_INLINE void slab_lock(apr_slab_t *slab)
+{
+#if APR_HAS_THREADS
+    if (slab->mutex)
+        apr_thread_mutex_lock(slab->mutex);
+#endif /* APR_HAS_THREADS */
+}
+
+static APR_INLINE void slab_unlock(apr_slab_t *slab)
+{
+#if APR_HAS_THREADS
+    if (slab->mutex)
+        apr_thread_mutex_unlock(slab->mutex);
+#endif /* APR_HAS_THREADS */
+}
+
+/* Carve a new object, taking a new node if needed; with the mutex held */
+static slab_obj_t *slab_carve(apr_slab_t *slab)
+{
+    apr_memnode_t *node;
+    slab_obj_t *obj;
+
+    if ((apr_size_t)(slab->endp - slab->avail) < slab->size) {
+        if ((node = apr_allocator_alloc(slab->allocator,
+                                        slab->node_size)) == NULL)
+            return NULL;
+
+        node->next = slab->nodes;
+        slab->nodes = node;
+        slab->stats.node_count++;
+        slab->stats.node_bytes += node->endp - (char *)node;
+
+        slab->avail = (char *)APR_ALIGN((apr_uintptr_t)node->first_avail,
+                                        slab->size < CACHELINE_SIZE
+                                        ? slab->size : CACHELINE_SIZE);
+        slab->endp = node->endp;
+    }
+
+    obj = (slab_obj_t *)slab->avail;
+    slab->avail += slab->size;
+    slab->stats.object_count++;
+
+    return obj;
+}
+
+/* Take a free object or carve one; with the mutex held */
+static APR_INLINE slab_obj_t *slab_take(apr_slab_t *slab)
+{
+    slab_obj_t *obj;
+
+    if ((obj = slab->free) != NULL) {
+        slab->free = obj->next;
+        slab->stats.free_count--;
+        return obj;
+    }
+
+    return slab_carve(slab);
+}
+
+#if APR_HAS_THREADS
+#define magazine_acquire(slab) \
+    ((slab_magazine_t *)apr_magazine_acquire((slab)->magazines, \
+                                             SIZEOF_MAGAZINE_T))
+#define magazine_release(mag) apr_magazine_release(mag)
+
+/* Empty the thread caches, whose objects are about to be released */
+static void magazines_drain(apr_slab_t *slab)
+{
+    slab_magazine_t *mag;
+    apr_uint32_t i;
+
+    for (i = 0; i < APR_MAGAZINE_COUNT; i++) {
+        mag = apr_magazine_slot(slab->magazines, SIZEOF_MAGAZINE_T, i);
+        apr_magazine_lock(mag);
+        mag->free = NULL;
+        mag->count = 0;
+        magazine_release(mag);
+    }
+}
+#endif /* APR_HAS_THREADS */
+
+static void slab_abort(apr_slab_t *slab)
+{
+    apr_abortfunc_t fn = apr_pool_abort_get(slab->pool);
+
+    if (fn)
+        (fn)(APR_ENOMEM);
+}
+
+
+/*
+ * Creation/destruction
+ */
+
+static apr_status_t slab_cleanup(void *data)
+{
+    apr_slab_t *slab = data;
+
+    if (slab->nodes) {
+        apr_allocator_free(slab->allocator, slab->nodes);
+        slab->nodes = NULL;
+    }
+    slab->avail = slab->endp = NULL;
+    slab->free = NULL;
+    slab->stats.object_count = slab->stats.free_count = 0;
+    slab->stats.node_count = slab->stats.node_bytes = 0;
+#if APR_HAS_THREADS
+    if (slab->magazines)
+        magazines_drain(slab);
+#endif
+
+#if APR_POOL_DEBUG
+    if (slab->allocator != apr_pool_allocator_get(slab->pool)) {
+        apr_allocator_destroy(slab->allocator);
+    }
+#endif
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_slab_create(apr_slab_t **newslab,
+                                          apr_size_t size,
+                                          apr_uint32_t flags,
+                                          apr_pool_t *pool)
+{
+    apr_allocator_t *allocator = apr_pool_allocator_get(pool);
+    apr_slab_t *slab;
+#if APR_HAS_THREADS || APR_POOL_DEBUG
+    apr_status_t rv;
+#endif
+
+    *newslab = NULL;
+
+    if (size == 0)
+        return APR_EINVAL;
+
+    /* Don't let small objects straddle cache lines */
+    if (size < sizeof(slab_obj_t))
+        size = sizeof(slab_obj_t);
+    if (size < CACHELINE_SIZE) {
+        apr_size_t pow2 = sizeof(slab_obj_t);
+
+        while (pow2 < size)
+            pow2 <<= 1;
+        size = pow2;
+    }
+    else {
+        size = APR_ALIGN(size, CACHELINE_SIZE);
+    }
+
+#if APR_POOL_DEBUG
+    /* may be NULL for debug mode. */
+    if (allocator == NULL) {
+        if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS)
+            return rv;
+    }
+#endif
+
+    slab = apr_pcalloc(pool, sizeof(*slab));
+    slab->pool = pool;
+    slab->allocator = allocator;
+    slab->size = size;
+    slab->node_size = NODE_OBJECTS * size + CACHELINE_SIZE;
+    if (slab->node_size < NODE_SIZE)
+        slab->node_size = NODE_SIZE;
+    slab->stats.object_size = size;
+
+#if APR_HAS_THREADS
+    if (flags & APR_SLAB_THREADS) {
+        rv = apr_thread_mutex_create(&slab->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                     pool);
+        if (rv != APR_SUCCESS) {
+            slab_cleanup(slab);
+            return rv;
+        }
+
+        slab->magazines = apr_pcalloc_aligned(pool,
+                                              APR_MAGAZINE_COUNT
+                                              * SIZEOF_MAGAZINE_T,
+                                              CACHELINE_SIZE);
+    }
+#endif /* APR_HAS_THREADS */
+
+    apr_pool_cleanup_register_ex(&slab->cleanup, pool, slab, slab_cleanup,
+                                 apr_pool_cleanup_null);
+
+    *newslab = slab;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_slab_destroy(apr_slab_t *slab)
+{
+    apr_pool_cleanup_run_ex(slab->pool, &slab->cleanup);
+}
+
+
+/*
+ * Allocation
+ */
+
+APR_DECLARE(void *) apr_slab_alloc(apr_slab_t *slab)
+{
+    slab_obj_t *obj;
+#if APR_HAS_THREADS
+    slab_magazine_t *mag;
+
+    if (slab->magazines && (mag = magazine_acquire(slab)) != NULL) {
+        slab_obj_t *batch = NULL, *last = NULL;
+        apr_uint32_t count = 0;
+
+        if ((obj = mag->free) != NULL) {
+            mag->free = obj->next;
+            mag->count--;
+            mag->alloc_calls++;
+            magazine_release(mag);
+            return obj;
+        }
+
+        /* Refill a batch at once.  The slot is not held while waiting for
+         * the mutex, see apr_magazine_lock().
+         */
+        magazine_release(mag);
+        slab_lock(slab);
+        while (count < MAGAZINE_BATCH && (obj = slab_take(slab)) != NULL) {
+            if ((obj->next = batch) == NULL)
+                last = obj;
+            batch = obj;
+            count++;
+        }
+        slab_unlock(slab);
+
+        if ((obj = batch) == NULL) {
+            slab_abort(slab);
+            return NULL;
+        }
+        batch = obj->next;
+        count--;
+
+        if ((mag = magazine_acquire(slab)) == NULL) {
+            /* Another thread took the slot meanwhile, give the rest back */
+            slab_lock(slab);
+            if (batch) {
+                last->next = slab->free;
+                slab->free = batch;
+                slab->stats.free_count += count;
+            }
+            slab->stats.alloc_calls++;
+            slab_unlock(slab);
+            return obj;
+        }
+        if (batch) {
+            last->next = mag->free;
+            mag->free = batch;
+            mag->count += count;
+        }
+        mag->alloc_calls++;
+        magazine_release(mag);
+
+        return obj;
+    }
+#endif /* APR_HAS_THREADS */
+
+    slab_lock(slab);
+    obj = slab_take(slab);
+    slab->stats.alloc_calls++;
+    slab_unlock(slab);
+
+    if (obj == NULL)
+        slab_abort(slab);
+
+    return obj;
+}
+
+APR_DECLARE(void *) apr_slab_calloc(apr_slab_t *slab)
+{
+    void *obj;
+
+    if ((obj = apr_slab_alloc(slab)) != NULL)
+        memset(obj, 0, slab->size);
+
+    return obj;
+}
+
+APR_DECLARE(void) apr_slab_free(apr_slab_t *slab, void *mem)
+{
+    slab_obj_t *obj = mem;
+#if APR_HAS_THREADS
+    slab_magazine_t *mag;
+
+    if (slab->magazines && (mag = magazine_acquire(slab)) != NULL) {
+        slab_obj_t *flush = NULL, *last = NULL;
+        apr_uint32_t count = 0;
+
+        /* Make room by handing a batch back, once the slot is released
+         * since the mutex may have to be waited for (see
+         * apr_magazine_lock())
+         */
+        if (mag->count >= MAGAZINE_DEPTH) {
+            flush = last = mag->free;
+            for (count = 1; count < MAGAZINE_BATCH; count++)
+                last = last->next;
+            mag->free = last->next;
+            mag->count -= count;
+        }
+
+        obj->next = mag->free;
+        mag->free = obj;
+        mag->count++;
+        mag->free_calls++;
+        magazine_release(mag);
+
+        if (flush) {
+            slab_lock(slab);
+            last->next = slab->free;
+            slab->free = flush;
+            slab->stats.free_count += count;
+            slab_unlock(slab);
+        }
+
+        return;
+    }
+#endif /* APR_HAS_THREADS */
+
+    slab_lock(slab);
+    obj->next = slab->free;
+    slab->free = obj;
+    slab->stats.free_count++;
+    slab->stats.free_calls++;
+    slab_unlock(slab);
+}
+
+APR_DECLARE(void) apr_slab_stats_get(apr_slab_t *slab,
+                                     apr_slab_stats_t *stats)
+{
+    slab_lock(slab);
+    *stats = slab->stats;
+    slab_unlock(slab);
+
+#if APR_HAS_THREADS
+    if (slab->magazines) {
+        slab_magazine_t *mag;
+        apr_uint32_t i;
+
+        for (i = 0; i < APR_MAGAZINE_COUNT; i++) {
+            mag = apr_magazine_slot(slab->magazines, SIZEOF_MAGAZINE_T, i);
+            apr_magazine_lock(mag);
+
+            stats->free_count += mag->count;
+            stats->alloc_calls += mag->alloc_calls;
+            stats->free_calls += mag->free_calls;
+
+            magazine_release(mag);
+        }
+    }
+#endif /* APR_HAS_THREADS */
+}
@@ -0,0 +1,427 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_atomic.h"
+#include "apr_hash.h"
+#include "apr_time.h"
+
+#include "apr_bloom.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * A Bloom filter of m bits and k hash functions sets the k bits of a key
+ * when adding it, and tells that it was probably added if they are all
+ * set.  The false positive rate p for n keys is the lowest with
+ * m = -n ln(p) / ln(2)^2 and k = m / n ln(2).
+ *
+ * The k bit indexes are derived from two hashes of the key (h1 + i h2, as
+ * with double hashing, which is as good as k independent hashes), each
+ * mapped to [0, m) with a multiply and a shift rather than a modulo.
+ *
+ * The filter is a header followed by the bits, with the hash seeds in the
+ * header, so that it can be made in shared memory and used by processes
+ * having it at different addresses.  Setting bits is atomic, they are
+ * never cleared but by apr_bloom_clear().
+ */
+
+#define BLOOM_MAGIC      0x426c6f6d  /* "Blom" */
+#define BLOOM_MAX_HASHES 30
+#define BLOOM_MAX_BITS   (APR_UINT64_C(1) << 32)
+#define BLOOM_LN2        0.69314718055994530942
+
+/* The keys of a batch have their bits fetched at once */
+#define BLOOM_BATCH      8
+
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 1))
+#define BLOOM_PREFETCH(addr, rw) __builtin_prefetch((const void *)(addr), (rw))
+#else
+#define BLOOM_PREFETCH(addr, rw)
+#endif
+
+/* At the start of the filter's memory, followed by the bits */
+typedef struct bloom_header_t {
+    apr_uint32_t magic;
+    apr_uint32_t nhashes;
+    apr_uint64_t nbits;
+    apr_uint32_t seed1;
+    apr_uint32_t seed2;
+    volatile apr_uint32_t count;
+    apr_uint32_t reserved;
+} bloom_header_t;
+
+#define BLOOM_HEADER_SIZE APR_ALIGN(sizeof(bloom_header_t), 8)
+
+struct apr_bloom_t {
+    apr_pool_t *pool;
+    bloom_header_t *header;
+    volatile apr_uint32_t *bits;
+    apr_uint64_t nbits;
+    unsigned int nhashes;
+    unsigned int seed1;
+    unsigned int seed2;
+};
+
+/* libapr does not link with libm, these are precise enough for sizing */
+static double bloom_log(double x)
+{
+    double y, y2, term, sum = 0.0;
+    int e = 0, i;
+
+    /* x = 2^e y, y in [1, 2) */
+    while (x >= 2.0) {
+        x /= 2.0;
+        e++;
+    }
+    while (x < 1.0) {
+        x *= 2.0;
+        e--;
+    }
+
+    /* ln(x) = 2 atanh((x - 1) / (x + 1)) */
+    y = (x - 1.0) / (x + 1.0);
+    y2 = y * y;
+    term = y;
+    for (i = 1; i < 40; i += 2) {
+        sum += term / i;
+        term *= y2;
+    }
+    return 2.0 * sum + e * BLOOM_LN2;
+}
+
+static double bloom_exp(double x)
+{
+    double r, term, sum = 1.0;
+    int e, i;
+
+    /* x = e ln(2) + r, |r| <= ln(2) / 2 */
+    e = (int)(x / BLOOM_LN2 + (x < 0 ? -0.5 : 0.5));
+    r = x - e * BLOOM_LN2;
+    term = 1.0;
+    for (i = 1; i < 20; i++) {
+        term *= r / i;
+        sum += term;
+    }
+    for (; e > 0; e--) {
+        sum *= 2.0;
+    }
+    for (; e < 0; e++) {
+        sum /= 2.0;
+    }
+    return sum;
+}
+
+static int bloom_params(apr_size_t nelts, double fp_rate,
+                        apr_uint64_t *nbits, unsigned int *nhashes)
+{
+    double m, k;
+
+    if (!(fp_rate > 0.0 && fp_rate < 1.0)) {
+        return 0;
+    }
+    if (nelts < 1) {
+        nelts = 1;
+    }
+
+    m = -(double)nelts * bloom_log(fp_rate) / (BLOOM_LN2 * BLOOM_LN2);
+    if (m > (double)BLOOM_MAX_BITS) {
+        return 0;
+    }
+    k = m / nelts * BLOOM_LN2 + 0.5;
+
+    /* Whole words, rounded up */
+    *nbits = ((apr_uint64_t)m + 32) & ~APR_UINT64_C(31);
+    if (*nbits < 32) {
+        *nbits = 32;
+    }
+    if (*nbits > BLOOM_MAX_BITS) {
+        return 0;
+    }
+    *nhashes = (k < 1) ? 1 : (k > BLOOM_MAX_HASHES) ? BLOOM_MAX_HASHES
+                                                     : (unsigned int)k;
+    return 1;
+}
+
+static void bloom_init(apr_bloom_t *bloom, bloom_header_t *header,
+                       apr_pool_t *pool)
+{
+    bloom->pool = pool;
+    bloom->header = header;
+    bloom->bits = (apr_uint32_t *)((char *)header + BLOOM_HEADER_SIZE);
+    bloom->nbits = header->nbits;
+    bloom->nhashes = header->nhashes;
+    bloom->seed1 = header->seed1;
+    bloom->seed2 = header->seed2;
+}
+
+APR_DECLARE(apr_size_t) apr_bloom_size(apr_size_t nelts, double fp_rate)
+{
+    apr_uint64_t nbits;
+    unsigned int nhashes;
+
+    if (!bloom_params(nelts, fp_rate, &nbits, &nhashes)) {
+        return 0;
+    }
+    if (nbits / 8 > APR_SIZE_MAX - BLOOM_HEADER_SIZE) {
+        return 0;
+    }
+    return BLOOM_HEADER_SIZE + (apr_size_t)(nbits / 8);
+}
+
+APR_DECLARE(apr_status_t) apr_bloom_make(apr_bloom_t **bloom, void *mem,
+                                         apr_size_t size, apr_size_t nelts,
+                                         double fp_rate, apr_pool_t *pool)
+{
+    bloom_header_t *header = mem;
+    apr_time_t now = apr_time_now();
+    apr_uint64_t nbits;
+    unsigned int nhashes;
+
+    *bloom = NULL;
+
+    if (!bloom_params(nelts, fp_rate, &nbits, &nhashes)
+            || nbits / 8 > APR_SIZE_MAX - BLOOM_HEADER_SIZE) {
+        return APR_EINVAL;
+    }
+    if (size < BLOOM_HEADER_SIZE + nbits / 8) {
+        return APR_ENOSPC;
+    }
+
+    memset(mem, 0, BLOOM_HEADER_SIZE + (apr_size_t)(nbits / 8));
+    header->nhashes = nhashes;
+    header->nbits = nbits;
+    header->seed1 = (apr_uint32_t)((now >> 32) ^ now ^ (apr_uintptr_t)mem
+                                   ^ (apr_uintptr_t)&now);
+    header->seed2 = header->seed1 * 0x9e3779b9 + 1;
+    header->count = 0;
+    header->magic = BLOOM_MAGIC;
+
+    *bloom = apr_palloc(pool, sizeof(apr_bloom_t));
+    bloom_init(*bloom, header, pool);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_bloom_create(apr_bloom_t **bloom,
+                                           apr_size_t nelts, double fp_rate,
+                                           apr_pool_t *pool)
+{
+    apr_size_t size = apr_bloom_size(nelts, fp_rate);
+
+    if (!size) {
+        *bloom = NULL;
+        return APR_EINVAL;
+    }
+    return apr_bloom_make(bloom, apr_palloc(pool, size), size, nelts, fp_rate,
+                          pool);
+}
+
+APR_DECLARE(apr_status_t) apr_bloom_attach(apr_bloom_t **bloom, void *mem,
+                                           apr_pool_t *pool)
+{
+    bloom_header_t *header = mem;
+
+    *bloom = NULL;
+
+    if (header->magic != BLOOM_MAGIC || header->nbits < 32
+            || header->nbits > BLOOM_MAX_BITS || header->nbits % 32
+            || header->nhashes < 1 || header->nhashes > BLOOM_MAX_HASHES) {
+        return APR_EINVAL;
+    }
+
+    *bloom = apr_palloc(pool, sizeof(apr_bloom_t));
+    bloom_init(*bloom, header, pool);
+
+    return APR_SUCCESS;
+}
+
+/* The bit indexes of a key */
+static APR_INLINE void bloom_hash(const apr_bloom_t *bloom, const void *key,
+                                  apr_ssize_t klen, apr_uint32_t *idx)
+{
+    apr_uint32_t h1, h2;
+    unsigned int i;
+
+    h1 = apr_hashfunc_fast_seeded((const char *)key, &klen, bloom->seed1);
+    h2 = apr_hashfunc_fast_seeded((const char *)key, &klen, bloom->seed2) | 1;
+
+    for (i = 0; i < bloom->nhashes; i++) {
+        idx[i] = (apr_uint32_t)(((apr_uint64_t)h1 * bloom->nbits) >> 32);
+        h1 += h2;
+    }
+}
+
+static APR_INLINE int bloom_test(const apr_bloom_t *bloom,
+                                 const apr_uint32_t *idx)
+{
+    unsigned int i;
+
+    for (i = 0; i < bloom->nhashes; i++) {
+        if (!(bloom->bits[idx[i] >> 5] & (1U << (idx[i] & 31)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static APR_INLINE int bloom_set(apr_bloom_t *bloom, const apr_uint32_t *idx)
+{
+    unsigned int i;
+    int added = 0;
+
+    for (i = 0; i < bloom->nhashes; i++) {
+        volatile apr_uint32_t *word = &bloom->bits[idx[i] >> 5];
+        apr_uint32_t mask = 1U << (idx[i] & 31), old = *word;
+
+        /* Atomically, other processes may set bits of the same word */
+        while (!(old & mask)) {
+            apr_uint32_t prev = apr_atomic_cas32(word, old | mask, old);
+            if (prev == old) {
+                added = 1;
+                break;
+            }
+            old = prev;
+        }
+    }
+    if (added) {
+        apr_atomic_inc32(&bloom->header->count);
+    }
+    return added;
+}
+
+APR_DECLARE(int) apr_bloom_add(apr_bloom_t *bloom, const void *key,
+                               apr_ssize_t klen)
+{
+    apr_uint32_t idx[BLOOM_MAX_HASHES];
+
+    bloom_hash(bloom, key, klen, idx);
+    return bloom_set(bloom, idx);
+}
+
+APR_DECLARE(int) apr_bloom_check(const apr_bloom_t *bloom, const void *key,
+                                 apr_ssize_t klen)
+{
+    apr_uint32_t idx[BLOOM_MAX_HASHES];
+
+    bloom_hash(bloom, key, klen, idx);
+    return bloom_test(bloom, idx);
+}
+
+/* Hash a batch of keys and prefetch their bits */
+static apr_size_t bloom_hash_batch(const apr_bloom_t *bloom,
+                                   const void *const *keys,
+                                   const apr_ssize_t *klens,
+                                   apr_size_t n, int rw,
+                                   apr_uint32_t idx[][BLOOM_MAX_HASHES])
+{
+    apr_size_t j;
+    unsigned int i;
+
+    if (n > BLOOM_BATCH) {
+        n = BLOOM_BATCH;
+    }
+    for (j = 0; j < n; j++) {
+        bloom_hash(bloom, keys[j], klens ? klens[j] : APR_HASH_KEY_STRING,
+                   idx[j]);
+        for (i = 0; i < bloom->nhashes; i++) {
+            if (rw) {
+                BLOOM_PREFETCH(&bloom->bits[idx[j][i] >> 5], 1);
+            }
+            else {
+                BLOOM_PREFETCH(&bloom->bits[idx[j][i] >> 5], 0);
+            }
+        }
+    }
+    return n;
+}
+
+APR_DECLARE(void) apr_bloom_add_batch(apr_bloom_t *bloom,
+                                      const void *const *keys,
+                                      const apr_ssize_t *klens, apr_size_t n)
+{
+    apr_uint32_t idx[BLOOM_BATCH][BLOOM_MAX_HASHES];
+
+    while (n) {
+        apr_size_t batch = bloom_hash_batch(bloom, keys, klens, n, 1, idx), j;
+
+        for (j = 0; j < batch; j++) {
+            bloom_set(bloom, idx[j]);
+        }
+        keys += batch;
+        if (klens) {
+            klens += batch;
+        }
+        n -= batch;
+    }
+}
+
+APR_DECLARE(apr_size_t) apr_bloom_check_batch(const apr_bloom_t *bloom,
+                                              const void *const *keys,
+                                              const apr_ssize_t *klens,
+                                              apr_size_t n, char *found)
+{
+    apr_uint32_t idx[BLOOM_BATCH][BLOOM_MAX_HASHES];
+    apr_size_t count = 0;
+
+    while (n) {
+        apr_size_t batch = bloom_hash_batch(bloom, keys, klens, n, 0, idx), j;
+
+        for (j = 0; j < batch; j++) {
+            found[j] = (char)bloom_test(bloom, idx[j]);
+            count += found[j];
+        }
+        keys += batch;
+        if (klens) {
+            klens += batch;
+        }
+        found += batch;
+        n -= batch;
+    }
+    return count;
+}
+
+APR_DECLARE(void) apr_bloom_clear(apr_bloom_t *bloom)
+{
+    memset((void *)bloom->bits, 0, (apr_size_t)(bloom->nbits / 8));
+    apr_atomic_set32(&bloom->header->count, 0);
+}
+
+APR_DECLARE(apr_size_t) apr_bloom_count(const apr_bloom_t *bloom)
+{
+    return apr_atomic_read32(&bloom->header->count);
+}
+
+APR_DECLARE(double) apr_bloom_fp_rate(const apr_bloom_t *bloom)
+{
+    double fill = 1.0 - bloom_exp(-(double)bloom->nhashes
+                                  * apr_atomic_read32(&bloom->header->count)
+                                  / (double)bloom->nbits);
+    double rate = 1.0;
+    unsigned int i;
+
+    for (i = 0; i < bloom->nhashes; i++) {
+        rate *= fill;
+    }
+    return rate;
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(bloom)
@@ -0,0 +1,683 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_slab.h"
+
+#include "apr_btree.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * The internal form of a B+tree.
+ *
+ * The elements are kept in order in the leaves, which are chained from
+ * the least to the greatest for iterations.  An internal node with n keys
+ * has n + 1 children, its key i being the least element of the subtree of
+ * child i + 1 (so keys are always elements of the tree, and never dangle
+ * once an element is removed).  All the leaves are at the same depth, and
+ * every node but the root is at least half full.
+ *
+ * Both kinds of nodes take NODE_SIZE bytes, allocated from a slab which
+ * aligns them on cache lines.  Within a node, the position of a key is
+ * found by binary search since comparing is a call.
+ *
+ * An insertion splits at most one node per level plus the root, so that
+ * many nodes are reserved beforehand: once the tree is changing it can't
+ * run out of memory halfway.
+ */
+
+#define NODE_SIZE   256 /* tunable, a multiple of the cache line size */
+
+typedef struct btree_node_t {
+    unsigned int count;     /* elements of a leaf, keys of an inner node */
+    unsigned int is_leaf;
+} btree_node_t;
+
+#define LEAF_MAX    ((NODE_SIZE - sizeof(btree_node_t) - sizeof(void *)) \
+                     / sizeof(void *))
+#define LEAF_MIN    (LEAF_MAX / 2)
+
+#define INNER_MAX   ((NODE_SIZE - sizeof(btree_node_t) - sizeof(void *)) \
+                     / (2 * sizeof(void *)))
+#define INNER_MIN   (INNER_MAX / 2)
+
+typedef struct btree_leaf_t btree_leaf_t;
+
+struct btree_leaf_t {
+    btree_node_t  node;
+    btree_leaf_t *next;
+    void         *elems[LEAF_MAX];
+};
+
+typedef struct btree_inner_t {
+    btree_node_t  node;
+    void         *keys[INNER_MAX];
+    btree_node_t *children[INNER_MAX + 1];
+} btree_inner_t;
+
+struct apr_btree_index_t {
+    btree_leaf_t *leaf;
+    unsigned int  i;
+};
+
+struct apr_btree_t {
+    apr_pool_t             *pool;
+    apr_slab_t             *slab;
+    apr_btree_compare_fn_t *compare;
+    btree_node_t           *root;
+    btree_node_t           *spare;      /* Reserved nodes, chained */
+    unsigned int            nspare;
+    unsigned int            height;     /* 0 when the root is a leaf */
+    apr_size_t              count;
+    apr_btree_index_t       iterator;   /* For apr_btree_first(NULL, ...) */
+};
+
+#define AS_LEAF(n)  ((btree_leaf_t *)(n))
+#define AS_INNER(n) ((btree_inner_t *)(n))
+
+
+/*
+ * Nodes
+ */
+
+static apr_status_t reserve_nodes(apr_btree_t *bt)
+{
+    while (bt->nspare < bt->height + 2) {
+        btree_node_t *node = apr_slab_alloc(bt->slab);
+
+        if (node == NULL)
+            return APR_ENOMEM;
+        AS_LEAF(node)->next = AS_LEAF(bt->spare);
+        bt->spare = node;
+        bt->nspare++;
+    }
+    return APR_SUCCESS;
+}
+
+static btree_node_t *node_alloc(apr_btree_t *bt, int is_leaf)
+{
+    btree_node_t *node = bt->spare;
+
+    bt->spare = (btree_node_t *)AS_LEAF(node)->next;
+    bt->nspare--;
+
+    node->count = 0;
+    node->is_leaf = is_leaf;
+    if (is_leaf)
+        AS_LEAF(node)->next = NULL;
+    return node;
+}
+
+/* The child of an inner node to descend into for key: the number of keys
+ * not greater than it.  *eq tells whether the last of them is equal.
+ */
+static APR_INLINE unsigned int inner_pos(const apr_btree_t *bt,
+                                         const btree_inner_t *in,
+                                         const void *key, int *eq)
+{
+    unsigned int lo = 0, hi = in->node.count;
+
+    *eq = 0;
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        int c = bt->compare(key, in->keys[mid]);
+
+        if (c < 0) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+            *eq = (c == 0);
+        }
+    }
+    return lo;
+}
+
+/* The position of the first element of a leaf not less than key, *found
+ * telling whether it is equal.
+ */
+static APR_INLINE unsigned int leaf_pos(const apr_btree_t *bt,
+                                        const btree_leaf_t *leaf,
+                                        const void *key, int *found)
+{
+    unsigned int lo = 0, hi = leaf->node.count;
+
+    *found = 0;
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        int c = bt->compare(key, leaf->elems[mid]);
+
+        if (c > 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+            *found = (c == 0);
+        }
+    }
+    return lo;
+}
+
+static btree_leaf_t *find_leaf(const apr_btree_t *bt, const void *key)
+{
+    btree_node_t *node = bt->root;
+    int eq;
+
+    while (!node->is_leaf) {
+        node = AS_INNER(node)->children[inner_pos(bt, AS_INNER(node),
+                                                  key, &eq)];
+    }
+    return AS_LEAF(node);
+}
+
+static void *subtree_min(btree_node_t *node)
+{
+    while (!node->is_leaf) {
+        node = AS_INNER(node)->children[0];
+    }
+    return AS_LEAF(node)->elems[0];
+}
+
+
+/*
+ * Insertion
+ */
+
+/* Insert elem in the subtree of node, splitting the nodes that overflow:
+ * then *split is the new right sibling of node and *sep its least
+ * element.  Returns elem or the element equal to it.
+ */
+static void *node_insert(apr_btree_t *bt, btree_node_t *node, void *elem,
+                         btree_node_t **split, void **sep)
+{
+    *split = NULL;
+
+    if (node->is_leaf) {
+        btree_leaf_t *leaf = AS_LEAF(node), *right;
+        void *elems[LEAF_MAX + 1];
+        unsigned int pos, n, half;
+        int found;
+
+        pos = leaf_pos(bt, leaf, elem, &found);
+        if (found)
+            return leaf->elems[pos];
+
+        n = leaf->node.count;
+        if (n < LEAF_MAX) {
+            memmove(&leaf->elems[pos + 1], &leaf->elems[pos],
+                    (n - pos) * sizeof(void *));
+            leaf->elems[pos] = elem;
+            leaf->node.count++;
+            bt->count++;
+            return elem;
+        }
+
+        right = AS_LEAF(node_alloc(bt, 1));
+        memcpy(elems, leaf->elems, pos * sizeof(void *));
+        elems[pos] = elem;
+        memcpy(&elems[pos + 1], &leaf->elems[pos], (n - pos) * sizeof(void *));
+        half = (n + 1) / 2;
+        memcpy(leaf->elems, elems, half * sizeof(void *));
+        leaf->node.count = half;
+        memcpy(right->elems, &elems[half], (n + 1 - half) * sizeof(void *));
+        right->node.count = n + 1 - half;
+        right->next = leaf->next;
+        leaf->next = right;
+        bt->count++;
+
+        *split = &right->node;
+        *sep = right->elems[0];
+        return elem;
+    }
+    else {
+        btree_inner_t *in = AS_INNER(node), *right;
+        void *keys[INNER_MAX + 1];
+        btree_node_t *children[INNER_MAX + 2];
+        btree_node_t *csplit;
+        void *csep, *ret;
+        unsigned int i, n, half;
+        int eq;
+
+        i = inner_pos(bt, in, elem, &eq);
+        if (eq)
+            return in->keys[i - 1];
+        ret = node_insert(bt, in->children[i], elem, &csplit, &csep);
+        if (!csplit)
+            return ret;
+
+        n = in->node.count;
+        if (n < INNER_MAX) {
+            memmove(&in->keys[i + 1], &in->keys[i],
+                    (n - i) * sizeof(void *));
+            memmove(&in->children[i + 2], &in->children[i + 1],
+                    (n - i) * sizeof(btree_node_t *));
+            in->keys[i] = csep;
+            in->children[i + 1] = csplit;
+            in->node.count++;
+            return ret;
+        }
+
+        /* Split around the middle key, which moves up */
+        right = AS_INNER(node_alloc(bt, 0));
+        memcpy(keys, in->keys, i * sizeof(void *));
+        keys[i] = csep;
+        memcpy(&keys[i + 1], &in->keys[i], (n - i) * sizeof(void *));
+        memcpy(children, in->children, (i + 1) * sizeof(btree_node_t *));
+        children[i + 1] = csplit;
+        memcpy(&children[i + 2], &in->children[i + 1],
+               (n - i) * sizeof(btree_node_t *));
+
+        half = (n + 1) / 2;
+        memcpy(in->keys, keys, half * sizeof(void *));
+        memcpy(in->children, children, (half + 1) * sizeof(btree_node_t *));
+        in->node.count = half;
+        *sep = keys[half];
+        memcpy(right->keys, &keys[half + 1], (n - half) * sizeof(void *));
+        memcpy(right->children, &children[half + 1],
+               (n - half + 1) * sizeof(btree_node_t *));
+        right->node.count = n - half;
+
+        *split = &right->node;
+        return ret;
+    }
+}
+
+APR_DECLARE(void *) apr_btree_insert(apr_btree_t *bt, void *elem)
+{
+    btree_node_t *split;
+    void *sep, *ret;
+
+    if (reserve_nodes(bt) != APR_SUCCESS)
+        return NULL;
+
+    ret = node_insert(bt, bt->root, elem, &split, &sep);
+    if (split) {
+        btree_inner_t *root = AS_INNER(node_alloc(bt, 0));
+
+        root->node.count = 1;
+        root->keys[0] = sep;
+        root->children[0] = bt->root;
+        root->children[1] = split;
+        bt->root = &root->node;
+        bt->height++;
+    }
+    return ret;
+}
+
+
+/*
+ * Removal
+ */
+
+/* Refill the child i of in, which is one short of the minimum, from a
+ * sibling having more, or else merge it with one.
+ */
+static void rebalance(apr_btree_t *bt, btree_inner_t *in, unsigned int i)
+{
+    btree_node_t *child = in->children[i];
+    btree_node_t *left = i > 0 ? in->children[i - 1] : NULL;
+    btree_node_t *right = i < in->node.count ? in->children[i + 1] : NULL;
+    unsigned int min = child->is_leaf ? LEAF_MIN : INNER_MIN;
+    unsigned int j;
+
+    if (left && left->count > min) {
+        if (child->is_leaf) {
+            btree_leaf_t *c = AS_LEAF(child), *l = AS_LEAF(left);
+
+            memmove(&c->elems[1], &c->elems[0],
+                    c->node.count * sizeof(void *));
+            c->elems[0] = l->elems[--l->node.count];
+            c->node.count++;
+            in->keys[i - 1] = c->elems[0];
+        }
+        else {
+            btree_inner_t *c = AS_INNER(child), *l = AS_INNER(left);
+
+            memmove(&c->keys[1], &c->keys[0],
+                    c->node.count * sizeof(void *));
+            memmove(&c->children[1], &c->children[0],
+                    (c->node.count + 1) * sizeof(btree_node_t *));
+            c->keys[0] = in->keys[i - 1];
+            c->children[0] = l->children[l->node.count];
+            in->keys[i - 1] = l->keys[--l->node.count];
+            c->node.count++;
+        }
+        return;
+    }
+
+    if (right && right->count > min) {
+        if (child->is_leaf) {
+            btree_leaf_t *c = AS_LEAF(child), *r = AS_LEAF(right);
+
+            c->elems[c->node.count++] = r->elems[0];
+            memmove(&r->elems[0], &r->elems[1],
+                    --r->node.count * sizeof(void *));
+            in->keys[i] = r->elems[0];
+        }
+        else {
+            btree_inner_t *c = AS_INNER(child), *r = AS_INNER(right);
+
+            c->keys[c->node.count] = in->keys[i];
+            c->children[++c->node.count] = r->children[0];
+            in->keys[i] = r->keys[0];
+            memmove(&r->keys[0], &r->keys[1],
+                    (r->node.count - 1) * sizeof(void *));
+            memmove(&r->children[0], &r->children[1],
+                    r->node.count * sizeof(btree_node_t *));
+            r->node.count--;
+        }
+        return;
+    }
+
+    /* Merge the children j and j + 1 */
+    if (left) {
+        j = i - 1;
+        right = child;
+    }
+    else {
+        j = i;
+        left = child;
+    }
+    if (left->is_leaf) {
+        btree_leaf_t *l = AS_LEAF(left), *r = AS_LEAF(right);
+
+        memcpy(&l->elems[l->node.count], r->elems,
+               r->node.count * sizeof(void *));
+        l->node.count += r->node.count;
+        l->next = r->next;
+    }
+    else {
+        btree_inner_t *l = AS_INNER(left), *r = AS_INNER(right);
+
+        l->keys[l->node.count] = in->keys[j];
+        memcpy(&l->keys[l->node.count + 1], r->keys,
+               r->node.count * sizeof(void *));
+        memcpy(&l->children[l->node.count + 1], r->children,
+               (r->node.count + 1) * sizeof(btree_node_t *));
+        l->node.count += 1 + r->node.count;
+    }
+    apr_slab_free(bt->slab, right);
+
+    memmove(&in->keys[j], &in->keys[j + 1],
+            (in->node.count - j - 1) * sizeof(void *));
+    memmove(&in->children[j + 1], &in->children[j + 2],
+            (in->node.count - j - 1) * sizeof(btree_node_t *));
+    in->node.count--;
+}
+
+/* Remove the element equal to key (or the least one if key is NULL) from
+ * the subtree of node, *first telling whether it was the first of its
+ * leaf.
+ */
+static void *node_remove(apr_btree_t *bt, btree_node_t *node,
+                         const void *key, int *first)
+{
+    void *elem;
+
+    if (node->is_leaf) {
+        btree_leaf_t *leaf = AS_LEAF(node);
+        unsigned int pos = 0;
+        int found = (leaf->node.count != 0);
+
+        if (key)
+            pos = leaf_pos(bt, leaf, key, &found);
+        if (!found)
+            return NULL;
+
+        elem = leaf->elems[pos];
+        memmove(&leaf->elems[pos], &leaf->elems[pos + 1],
+                (--leaf->node.count - pos) * sizeof(void *));
+        *first = (pos == 0);
+    }
+    else {
+        btree_inner_t *in = AS_INNER(node);
+        unsigned int i = 0;
+        int eq;
+
+        if (key)
+            i = inner_pos(bt, in, key, &eq);
+        elem = node_remove(bt, in->children[i], key, first);
+        if (elem && in->children[i]->count < (in->children[i]->is_leaf
+                                              ? LEAF_MIN : INNER_MIN)) {
+            rebalance(bt, in, i);
+        }
+    }
+
+    return elem;
+}
+
+static void *btree_remove(apr_btree_t *bt, const void *key)
+{
+    btree_node_t *node = bt->root;
+    void *elem;
+    int first = 0;
+
+    if ((elem = node_remove(bt, node, key, &first)) == NULL)
+        return NULL;
+    bt->count--;
+
+    if (!node->is_leaf && node->count == 0) {
+        bt->root = AS_INNER(node)->children[0];
+        bt->height--;
+        apr_slab_free(bt->slab, node);
+    }
+
+    /* The least element of a leaf may be a key of an ancestor, unless it
+     * was rebalanced away: it must be replaced by the new least one.  (No
+     * key is ever the least element of the tree.)
+     */
+    if (first && key) {
+        node = bt->root;
+        while (!node->is_leaf) {
+            btree_inner_t *in = AS_INNER(node);
+            unsigned int i;
+            int eq;
+
+            i = inner_pos(bt, in, key, &eq);
+            if (eq) {
+                in->keys[i - 1] = subtree_min(in->children[i]);
+                break;
+            }
+            node = in->children[i];
+        }
+    }
+
+    return elem;
+}
+
+APR_DECLARE(void *) apr_btree_remove(apr_btree_t *bt, const void *key)
+{
+    return btree_remove(bt, key);
+}
+
+APR_DECLARE(void *) apr_btree_pop_min(apr_btree_t *bt)
+{
+    return btree_remove(bt, NULL);
+}
+
+
+/*
+ * Lookups and iterations
+ */
+
+APR_DECLARE(void *) apr_btree_find(const apr_btree_t *bt, const void *key)
+{
+    btree_leaf_t *leaf = find_leaf(bt, key);
+    unsigned int pos;
+    int found;
+
+    pos = leaf_pos(bt, leaf, key, &found);
+    return found ? leaf->elems[pos] : NULL;
+}
+
+/* Position the iterator on the first element not less than key, or the
+ * least one if key is NULL.
+ */
+static apr_btree_index_t *btree_seek(apr_pool_t *p, apr_btree_t *bt,
+                                     const void *key)
+{
+    apr_btree_index_t *bi;
+    btree_leaf_t *leaf;
+    unsigned int pos = 0;
+    int found;
+
+    if (key) {
+        leaf = find_leaf(bt, key);
+        pos = leaf_pos(bt, leaf, key, &found);
+        if (pos == leaf->node.count) {
+            leaf = leaf->next;
+            pos = 0;
+        }
+    }
+    else {
+        btree_node_t *node = bt->root;
+
+        while (!node->is_leaf) {
+            node = AS_INNER(node)->children[0];
+        }
+        leaf = AS_LEAF(node);
+    }
+    if (!leaf || !leaf->node.count)
+        return NULL;
+
+    if (p)
+        bi = apr_palloc(p, sizeof(*bi));
+    else
+        bi = &bt->iterator;
+    bi->leaf = leaf;
+    bi->i = pos;
+    return bi;
+}
+
+APR_DECLARE(void *) apr_btree_lower_bound(const apr_btree_t *bt,
+                                          const void *key)
+{
+    btree_leaf_t *leaf = find_leaf(bt, key);
+    unsigned int pos;
+    int found;
+
+    pos = leaf_pos(bt, leaf, key, &found);
+    if (pos == leaf->node.count) {
+        if ((leaf = leaf->next) == NULL)
+            return NULL;
+        pos = 0;
+    }
+    return leaf->elems[pos];
+}
+
+APR_DECLARE(apr_btree_index_t *) apr_btree_first(apr_pool_t *p,
+                                                 apr_btree_t *bt)
+{
+    return btree_seek(p, bt, NULL);
+}
+
+APR_DECLARE(apr_btree_index_t *) apr_btree_seek(apr_pool_t *p,
+                                                apr_btree_t *bt,
+                                                const void *key)
+{
+    return btree_seek(p, bt, key);
+}
+
+APR_DECLARE(apr_btree_index_t *) apr_btree_next(apr_btree_index_t *bi)
+{
+    if (++bi->i == bi->leaf->node.count) {
+        if ((bi->leaf = bi->leaf->next) == NULL)
+            return NULL;
+        bi->i = 0;
+    }
+    return bi;
+}
+
+APR_DECLARE(void *) apr_btree_this(apr_btree_index_t *bi)
+{
+    return bi->leaf->elems[bi->i];
+}
+
+APR_DECLARE(apr_size_t) apr_btree_count(const apr_btree_t *bt)
+{
+    return bt->count;
+}
+
+
+/*
+ * Creation and clearing
+ */
+
+static void free_nodes(apr_btree_t *bt, btree_node_t *node,
+                       btree_node_t *keep)
+{
+    if (!node->is_leaf) {
+        unsigned int i;
+
+        for (i = 0; i <= node->count; i++) {
+            free_nodes(bt, AS_INNER(node)->children[i], keep);
+        }
+    }
+    if (node != keep)
+        apr_slab_free(bt->slab, node);
+}
+
+APR_DECLARE(void) apr_btree_clear(apr_btree_t *bt)
+{
+    btree_node_t *root = bt->root;
+
+    if (!root->is_leaf) {
+        /* Keep the first leaf as the root */
+        btree_node_t *first = root;
+
+        while (!first->is_leaf) {
+            first = AS_INNER(first)->children[0];
+        }
+        free_nodes(bt, root, first);
+        root = first;
+        bt->root = root;
+        bt->height = 0;
+    }
+    root->count = 0;
+    AS_LEAF(root)->next = NULL;
+    bt->count = 0;
+}
+
+APR_DECLARE(apr_status_t) apr_btree_create(apr_btree_t **newbt,
+                                           apr_btree_compare_fn_t *compare,
+                                           apr_pool_t *pool)
+{
+    apr_btree_t *bt;
+    apr_status_t rv;
+
+    *newbt = NULL;
+
+    bt = apr_pcalloc(pool, sizeof(*bt));
+    bt->pool = pool;
+    bt->compare = compare;
+    if ((rv = apr_slab_create(&bt->slab, NODE_SIZE, 0,
+                              pool)) != APR_SUCCESS)
+        return rv;
+    if ((rv = reserve_nodes(bt)) != APR_SUCCESS)
+        return rv;
+    bt->root = node_alloc(bt, 1);
+
+    *newbt = bt;
+    return APR_SUCCESS;
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(btree)
@@ -0,0 +1,522 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_slab.h"
+#include "apr_time.h"
+#if APR_HAS_THREADS
+#include "apr_thread_mutex.h"
+#include "apr_thread_rwlock.h"
+#endif
+
+#include "apr_chash.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * The internal form of a concurrent hash table.
+ *
+ * The top bits of the hash of a key choose its stripe, the bottom ones its
+ * bucket in the stripe, whose collisions are chained as in apr_hash_t.
+ * Each stripe has its own read/write lock and bucket array, which it
+ * doubles by itself when it holds more entries than buckets.  The stripes
+ * are cache line aligned, so that threads locking different ones don't
+ * share their lines.
+ *
+ * The table has a pool of its own (a child of the creator's) on a private
+ * allocator with a mutex: the entries are taken from a slab shared by the
+ * stripes, whose per-thread caches keep threads off its mutex, and the
+ * bucket arrays past the initial ones are nodes of the allocator, given
+ * back when outgrown.
+ */
+
+#define CACHELINE_SIZE      64
+
+#define DEFAULT_STRIPES     64
+#define MAX_STRIPE_BITS     16
+
+#define INITIAL_MAX         15 /* tunable == 2^n - 1 */
+
+typedef struct chash_entry_t chash_entry_t;
+
+struct chash_entry_t {
+    chash_entry_t *next;
+    const void    *key;
+    const void    *val;
+    apr_uint32_t   hash;
+    apr_uint32_t   klen;
+};
+
+typedef struct chash_stripe_t {
+#if APR_HAS_THREADS
+    apr_thread_rwlock_t *lock;
+#endif
+    chash_entry_t      **array;
+    /* The node holding array, NULL for the initial one */
+    apr_memnode_t       *node;
+    unsigned int         count, max;
+} chash_stripe_t;
+
+#define SIZEOF_STRIPE_T     APR_ALIGN(sizeof(chash_stripe_t), CACHELINE_SIZE)
+
+struct apr_chash_t {
+    apr_pool_t          *pool;
+    apr_pool_t          *subpool;
+    apr_allocator_t     *allocator;
+    apr_slab_t          *slab;
+    char                *stripes;   /* SIZEOF_STRIPE_T bytes each */
+    unsigned int         stripe_shift, stripe_mask, seed;
+    apr_hashfunc_t       hash_func;
+};
+
+
+/*
+ * Stripes
+ */
+
+static APR_INLINE chash_stripe_t *stripe_get(const apr_chash_t *ht,
+                                             apr_uint32_t hash)
+{
+    return (chash_stripe_t *)(ht->stripes + ((hash >> ht->stripe_shift)
+                                             & ht->stripe_mask)
+                                            * SIZEOF_STRIPE_T);
+}
+
+static APR_INLINE void stripe_rdlock(chash_stripe_t *s)
+{
+#if APR_HAS_THREADS
+    apr_thread_rwlock_rdlock(s->lock);
+#endif
+}
+
+static APR_INLINE void stripe_wrlock(chash_stripe_t *s)
+{
+#if APR_HAS_THREADS
+    apr_thread_rwlock_wrlock(s->lock);
+#endif
+}
+
+static APR_INLINE void stripe_unlock(chash_stripe_t *s)
+{
+#if APR_HAS_THREADS
+    apr_thread_rwlock_unlock(s->lock);
+#endif
+}
+
+static APR_INLINE chash_entry_t **stripe_find(chash_stripe_t *s,
+                                              apr_uint32_t hash,
+                                              const void *key,
+                                              apr_size_t klen)
+{
+    chash_entry_t **hep, *he;
+
+    for (hep = &s->array[hash & s->max]; (he = *hep) != NULL;
+         hep = &he->next) {
+        if (he->hash == hash
+            && he->klen == klen
+            && memcmp(he->key, key, klen) == 0)
+            break;
+    }
+    return hep;
+}
+
+/* Double the buckets of a stripe, or more to fill the allocator's node;
+ * with the stripe write locked.  Failing to is not fatal, the chains just
+ * get longer.
+ */
+static void stripe_expand(apr_chash_t *ht, chash_stripe_t *s)
+{
+    apr_memnode_t *node;
+    chash_entry_t **array;
+    apr_size_t size;
+    unsigned int max, i;
+
+    max = s->max * 2 + 1;
+    size = sizeof(*array) * (max + 1);
+    if ((node = apr_allocator_alloc(ht->allocator, size)) == NULL)
+        return;
+    while (size * 2 <= (apr_size_t)(node->endp - node->first_avail)) {
+        size *= 2;
+        max = max * 2 + 1;
+    }
+    array = (chash_entry_t **)node->first_avail;
+    memset(array, 0, size);
+
+    for (i = 0; i <= s->max; i++) {
+        chash_entry_t *he = s->array[i];
+
+        while (he) {
+            chash_entry_t *next = he->next;
+            he->next = array[he->hash & max];
+            array[he->hash & max] = he;
+            he = next;
+        }
+    }
+
+    if (s->node)
+        apr_allocator_free(ht->allocator, s->node);
+    s->node = node;
+    s->array = array;
+    s->max = max;
+}
+
+static apr_status_t chash_cleanup(void *data)
+{
+    apr_chash_t *ht = data;
+    unsigned int i;
+
+    for (i = 0; i <= ht->stripe_mask; i++) {
+        chash_stripe_t *s = (chash_stripe_t *)(ht->stripes
+                                               + i * SIZEOF_STRIPE_T);
+        if (s->node) {
+            apr_allocator_free(ht->allocator, s->node);
+            s->node = NULL;
+        }
+    }
+    return APR_SUCCESS;
+}
+
+static APR_INLINE apr_uint32_t chash_hash(const apr_chash_t *ht,
+                                          const void *key,
+                                          apr_ssize_t *klen)
+{
+    apr_uint32_t hash;
+
+    if (!ht->hash_func)
+        return apr_hashfunc_fast_seeded(key, klen, ht->seed);
+
+    /* The stripe is chosen by the top bits, spread all of them (murmur3's
+     * finalizer)
+     */
+    hash = ht->hash_func(key, klen) ^ ht->seed;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+
+/*
+ * Hash creation functions.
+ */
+
+APR_DECLARE(apr_status_t) apr_chash_create(apr_chash_t **newht,
+                                           unsigned int stripes,
+                                           apr_hashfunc_t hash_func,
+                                           apr_pool_t *pool)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *subpool;
+    apr_chash_t *ht;
+    apr_time_t now = apr_time_now();
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    unsigned int bits, i;
+    apr_status_t rv;
+
+    *newht = NULL;
+
+    if (stripes == 0)
+        stripes = DEFAULT_STRIPES;
+    for (bits = 0; (1u << bits) < stripes && bits < MAX_STRIPE_BITS; bits++)
+        ;
+
+    if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS)
+        return rv;
+    if ((rv = apr_pool_create_ex(&subpool, pool, NULL,
+                                 allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, subpool);
+#if APR_HAS_THREADS
+    if ((rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT,
+                                      subpool)) != APR_SUCCESS)
+        goto failed;
+    apr_allocator_mutex_set(allocator, mutex);
+#endif
+
+    ht = apr_pcalloc(subpool, sizeof(*ht));
+    ht->pool = pool;
+    ht->subpool = subpool;
+    ht->allocator = allocator;
+    ht->hash_func = hash_func;
+    ht->seed = (unsigned int)((now >> 32) ^ now ^ (apr_uintptr_t)pool ^
+                              (apr_uintptr_t)ht ^ (apr_uintptr_t)&now) - 1;
+    ht->stripe_shift = bits ? 32 - bits : 0;
+    ht->stripe_mask = (1u << bits) - 1;
+
+    if ((rv = apr_slab_create(&ht->slab, sizeof(chash_entry_t),
+                              APR_SLAB_THREADS, subpool)) != APR_SUCCESS)
+        goto failed;
+
+    ht->stripes = apr_pcalloc_aligned(subpool,
+                                      (ht->stripe_mask + 1) * SIZEOF_STRIPE_T,
+                                      CACHELINE_SIZE);
+    for (i = 0; i <= ht->stripe_mask; i++) {
+        chash_stripe_t *s = (chash_stripe_t *)(ht->stripes
+                                               + i * SIZEOF_STRIPE_T);
+
+        s->max = INITIAL_MAX;
+        s->array = apr_pcalloc(subpool, sizeof(*s->array) * (s->max + 1));
+#if APR_HAS_THREADS
+        /* The locks are allocated one after the other, keep them off each
+         * other's cache line.
+         */
+        apr_palloc(subpool, CACHELINE_SIZE);
+        if ((rv = apr_thread_rwlock_create(&s->lock,
+                                           subpool)) != APR_SUCCESS)
+            goto failed;
+#endif
+    }
+
+    apr_pool_cleanup_register(subpool, ht, chash_cleanup,
+                              apr_pool_cleanup_null);
+
+    *newht = ht;
+    return APR_SUCCESS;
+
+failed:
+    apr_pool_destroy(subpool);
+    return rv;
+}
+
+APR_DECLARE(void) apr_chash_destroy(apr_chash_t *ht)
+{
+    apr_pool_destroy(ht->subpool);
+}
+
+
+/*
+ * Hash operations.
+ */
+
+APR_DECLARE(void *) apr_chash_get(apr_chash_t *ht, const void *key,
+                                  apr_ssize_t klen)
+{
+    apr_uint32_t hash = chash_hash(ht, key, &klen);
+    chash_stripe_t *s = stripe_get(ht, hash);
+    chash_entry_t *he;
+    const void *val = NULL;
+
+    stripe_rdlock(s);
+    if ((he = *stripe_find(s, hash, key, klen)) != NULL)
+        val = he->val;
+    stripe_unlock(s);
+
+    return (void *)val;
+}
+
+/* Add an entry to a stripe write locked, where find stopped */
+static apr_status_t stripe_add(apr_chash_t *ht, chash_stripe_t *s,
+                               chash_entry_t **hep, apr_uint32_t hash,
+                               const void *key, apr_ssize_t klen,
+                               const void *val)
+{
+    chash_entry_t *he;
+
+    if ((he = apr_slab_alloc(ht->slab)) == NULL)
+        return APR_ENOMEM;
+    he->next = NULL;
+    he->key = key;
+    he->val = val;
+    he->hash = hash;
+    he->klen = (apr_uint32_t)klen;
+    *hep = he;
+
+    if (++s->count > s->max)
+        stripe_expand(ht, s);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_chash_set(apr_chash_t *ht, const void *key,
+                                        apr_ssize_t klen, const void *val,
+                                        void **old_val)
+{
+    apr_uint32_t hash;
+    chash_stripe_t *s;
+    chash_entry_t **hep;
+    const void *prev = NULL;
+    apr_status_t rv = APR_SUCCESS;
+
+    if (!val) {
+        prev = apr_chash_remove(ht, key, klen);
+        if (old_val)
+            *old_val = (void *)prev;
+        return APR_SUCCESS;
+    }
+
+    hash = chash_hash(ht, key, &klen);
+    if ((apr_uint64_t)klen > APR_UINT32_MAX)
+        return APR_EINVAL;
+    s = stripe_get(ht, hash);
+
+    stripe_wrlock(s);
+    hep = stripe_find(s, hash, key, klen);
+    if (*hep) {
+        prev = (*hep)->val;
+        (*hep)->val = val;
+    }
+    else {
+        rv = stripe_add(ht, s, hep, hash, key, klen, val);
+    }
+    stripe_unlock(s);
+
+    if (old_val)
+        *old_val = (void *)prev;
+    return rv;
+}
+
+APR_DECLARE(void *) apr_chash_remove(apr_chash_t *ht, const void *key,
+                                     apr_ssize_t klen)
+{
+    apr_uint32_t hash = chash_hash(ht, key, &klen);
+    chash_stripe_t *s = stripe_get(ht, hash);
+    chash_entry_t **hep, *he;
+    const void *val = NULL;
+
+    stripe_wrlock(s);
+    hep = stripe_find(s, hash, key, klen);
+    if ((he = *hep) != NULL) {
+        val = he->val;
+        *hep = he->next;
+        s->count--;
+    }
+    stripe_unlock(s);
+
+    if (he)
+        apr_slab_free(ht->slab, he);
+    return (void *)val;
+}
+
+APR_DECLARE(apr_status_t) apr_chash_get_or_make(apr_chash_t *ht,
+                                                const void *key,
+                                                apr_ssize_t klen,
+                                                apr_chash_make_fn_t *make,
+                                                void *baton, void **val)
+{
+    apr_uint32_t hash = chash_hash(ht, key, &klen);
+    chash_stripe_t *s = stripe_get(ht, hash);
+    chash_entry_t **hep, *he;
+    apr_status_t rv;
+
+    stripe_rdlock(s);
+    if ((he = *stripe_find(s, hash, key, klen)) != NULL) {
+        *val = (void *)he->val;
+    }
+    stripe_unlock(s);
+    if (he)
+        return APR_SUCCESS;
+
+    if ((apr_uint64_t)klen > APR_UINT32_MAX)
+        return APR_EINVAL;
+
+    /* Missing when read locked, look again now that it's write locked */
+    stripe_wrlock(s);
+    hep = stripe_find(s, hash, key, klen);
+    if (*hep) {
+        *val = (void *)(*hep)->val;
+        rv = APR_SUCCESS;
+    }
+    else {
+        *val = NULL;
+        rv = make(baton, &key, klen, val);
+        if (rv == APR_SUCCESS && *val) {
+            rv = stripe_add(ht, s, hep, hash, key, klen, *val);
+        }
+        if (rv != APR_SUCCESS) {
+            *val = NULL;
+        }
+    }
+    stripe_unlock(s);
+
+    return rv;
+}
+
+APR_DECLARE(int) apr_chash_do(apr_hash_do_callback_fn_t *comp,
+                              void *rec, apr_chash_t *ht)
+{
+    unsigned int i, j;
+    int rv = 1;
+
+    for (i = 0; rv && i <= ht->stripe_mask; i++) {
+        chash_stripe_t *s = (chash_stripe_t *)(ht->stripes
+                                               + i * SIZEOF_STRIPE_T);
+
+        stripe_rdlock(s);
+        for (j = 0; rv && j <= s->max; j++) {
+            chash_entry_t *he;
+
+            for (he = s->array[j]; rv && he; he = he->next) {
+                rv = (*comp)(rec, he->key, he->klen, he->val);
+            }
+        }
+        stripe_unlock(s);
+    }
+
+    return rv != 0;
+}
+
+APR_DECLARE(unsigned int) apr_chash_count(apr_chash_t *ht)
+{
+    unsigned int i, count = 0;
+
+    for (i = 0; i <= ht->stripe_mask; i++) {
+        chash_stripe_t *s = (chash_stripe_t *)(ht->stripes
+                                               + i * SIZEOF_STRIPE_T);
+
+        stripe_rdlock(s);
+        count += s->count;
+        stripe_unlock(s);
+    }
+
+    return count;
+}
+
+APR_DECLARE(void) apr_chash_clear(apr_chash_t *ht)
+{
+    unsigned int i, j;
+
+    for (i = 0; i <= ht->stripe_mask; i++) {
+        chash_stripe_t *s = (chash_stripe_t *)(ht->stripes
+                                               + i * SIZEOF_STRIPE_T);
+
+        stripe_wrlock(s);
+        for (j = 0; s->count && j <= s->max; j++) {
+            chash_entry_t *he = s->array[j];
+
+            s->array[j] = NULL;
+            while (he) {
+                chash_entry_t *next = he->next;
+                apr_slab_free(ht->slab, he);
+                s->count--;
+                he = next;
+            }
+        }
+        stripe_unlock(s);
+    }
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(chash)
@@ -71,6 +71,12 @@ struct apr_hash_index_t {
  * modular arithmetic.
  * The count of hash entries may be greater depending on the chosen
  * collision rate.
+ *
+ * With APR_HASH_INCREMENTAL, the entries are moved to a doubled array a
+ * few buckets at a time.  While they are, old_array is set and its
+ * buckets from migrated up to old_max still hold their entries (new ones
+ * included), each of them standing for the buckets i and i + old_max + 1
+ * of the new array, which are not even initialized yet.
  */
 struct apr_hash_t {
     apr_pool_t          *pool;
@@ -79,10 +85,19 @@ struct apr_hash_t {
     unsigned int         count, max, seed;
     apr_hashfunc_t       hash_func;
     apr_hash_entry_t    *free;  /* List of recycled entries */
+    apr_hash_entry_t   **old_array;  /* Array being migrated, or NULL */
+    unsigned int         old_max, migrated;
+    unsigned int         flags;
 };
 
 #define INITIAL_MAX 15 /* tunable == 2^n - 1 */
 
+/* Buckets migrated for every entry added to an incremental table: at
+ * least one, so that a migration always completes before the array has
+ * to double again.
+ */
+#define MIGRATE_BUCKETS 4
+
 
 /*
  * Hash creation functions.
@@ -107,6 +122,9 @@ APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool)
                               (apr_uintptr_t)ht ^ (apr_uintptr_t)&now) - 1;
     ht->array = alloc_array(ht, ht->max);
     ht->hash_func = NULL;
+    ht->old_array = NULL;
+    ht->old_max = ht->migrated = 0;
+    ht->flags = 0;
 
     return ht;
 }
@@ -119,6 +137,30 @@ APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool,
     return ht;
 }
 
+APR_DECLARE(apr_hash_t *) apr_hash_make_ex(apr_pool_t *pool,
+                                           apr_hashfunc_t hash_func,
+                                           unsigned int flags)
+{
+    apr_hash_t *ht = apr_hash_make(pool);
+    ht->hash_func = hash_func;
+    ht->flags = flags;
+    return ht;
+}
+
+/*
+ * The chain of the bucket i (up to ht->max) as seen by iterations: when
+ * migrating, the buckets of the old array not migrated yet take the place
+ * of the ones of the new array they will be split into.
+ */
+static APR_INLINE apr_hash_entry_t *bucket_chain(const apr_hash_t *ht,
+                                                 unsigned int i)
+{
+    if (ht->old_array && (i & ht->old_max) >= ht->migrated) {
+        return (i <= ht->old_max) ? ht->old_array[i] : NULL;
+    }
+    return ht->array[i];
+}
+
 
 /*
  * Hash iteration functions.
@@ -131,7 +173,7 @@ APR_DECLARE(apr_hash_index_t *) apr_hash_next(apr_hash_index_t *hi)
         if (hi->index > hi->ht->max)
             return NULL;
 
-        hi->this = hi->ht->array[hi->index++];
+        hi->this = bucket_chain(hi->ht, hi->index++);
     }
     hi->next = hi->this->next;
     return hi;
@@ -190,6 +232,28 @@ APR_DECLARE(void *) apr_hash_this_val(apr_hash_index_t *hi)
  * Expanding a hash table
  */
 
+static void migrate_buckets(apr_hash_t *ht, unsigned int n)
+{
+    while (n-- && ht->migrated <= ht->old_max) {
+        apr_hash_entry_t *he = ht->old_array[ht->migrated];
+
+        /* the new array is cleared as it gets used */
+        ht->array[ht->migrated] = NULL;
+        ht->array[ht->migrated + ht->old_max + 1] = NULL;
+        ht->old_array[ht->migrated++] = NULL;
+        while (he) {
+            apr_hash_entry_t *next = he->next;
+            unsigned int i = he->hash & ht->max;
+            he->next = ht->array[i];
+            ht->array[i] = he;
+            he = next;
+        }
+    }
+    if (ht->migrated > ht->old_max) {
+        ht->old_array = NULL;
+    }
+}
+
 static void expand_array(apr_hash_t *ht)
 {
     apr_hash_index_t *hi;
@@ -197,6 +261,23 @@ static void expand_array(apr_hash_t *ht)
     unsigned int new_max;
 
     new_max = ht->max * 2 + 1;
+
+    if (ht->flags & APR_HASH_INCREMENTAL) {
+        /* Leave the entries in the current array for now, they move on
+         * with the next additions (a migration in progress always ends
+         * first, but for safety let's not rely on it).
+         */
+        if (ht->old_array) {
+            migrate_buckets(ht, ht->old_max + 1);
+        }
+        ht->old_array = ht->array;
+        ht->old_max = ht->max;
+        ht->migrated = 0;
+        ht->array = apr_palloc(ht->pool, sizeof(*ht->array) * (new_max + 1));
+        ht->max = new_max;
+        return;
+    }
+
     new_array = alloc_array(ht, new_max);
     for (hi = apr_hash_first(NULL, ht); hi; hi = apr_hash_next(hi)) {
         unsigned int i = hi->this->hash & new_max;
@@ -207,8 +288,8 @@ static void expand_array(apr_hash_t *ht)
     ht->max = new_max;
 }
 
-static unsigned int hashfunc_default(const char *char_key, apr_ssize_t *klen,
-                                     unsigned int hash)
+static unsigned int hashfunc_legacy(const char *char_key, apr_ssize_t *klen,
+                                    unsigned int hash)
 {
     const unsigned char *key = (const unsigned char *)char_key;
     const unsigned char *p;
@@ -270,7 +351,128 @@ static unsigned int hashfunc_default(const char *char_key, apr_ssize_t *klen,
 APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *char_key,
                                                       apr_ssize_t *klen)
 {
-    return hashfunc_default(char_key, klen, 0);
+    return hashfunc_legacy(char_key, klen, 0);
+}
+
+/*
+ * The fast hash function, after Wang Yi's wyhash: the key is read 8 or 16
+ * bytes at a time (in little endian order, so that the values are the
+ * same everywhere), each pair of words being folded by a multiplication
+ * of 64 by 64 bits whose high and low halves are xor'ed.  The three lanes
+ * of the long keys' loop are independent, for the CPU to overlap them.
+ */
+
+#define HASH_S0 APR_UINT64_C(0xa0761d6478bd642f)
+#define HASH_S1 APR_UINT64_C(0xe7037ed1a0b428db)
+#define HASH_S2 APR_UINT64_C(0x8ebc6af09c88c6e3)
+#define HASH_S3 APR_UINT64_C(0x589965cc75374cc3)
+
+static APR_INLINE apr_uint64_t hash_mix(apr_uint64_t a, apr_uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128)a * b;
+    return (apr_uint64_t)r ^ (apr_uint64_t)(r >> 64);
+#else
+    apr_uint64_t ha = a >> 32, hb = b >> 32;
+    apr_uint64_t la = (apr_uint32_t)a, lb = (apr_uint32_t)b;
+    apr_uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    apr_uint64_t t = rl + (rm0 << 32), c = t < rl;
+    apr_uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + c);
+#endif
+}
+
+static APR_INLINE apr_uint64_t hash_read64(const unsigned char *p)
+{
+    apr_uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if APR_IS_BIGENDIAN
+    v = ((v & APR_UINT64_C(0x00000000ffffffff)) << 32) | (v >> 32);
+    v = ((v & APR_UINT64_C(0x0000ffff0000ffff)) << 16)
+        | ((v >> 16) & APR_UINT64_C(0x0000ffff0000ffff));
+    v = ((v & APR_UINT64_C(0x00ff00ff00ff00ff)) << 8)
+        | ((v >> 8) & APR_UINT64_C(0x00ff00ff00ff00ff));
+#endif
+    return v;
+}
+
+static APR_INLINE apr_uint64_t hash_read32(const unsigned char *p)
+{
+    return (apr_uint64_t)p[0] | ((apr_uint64_t)p[1] << 8)
+           | ((apr_uint64_t)p[2] << 16) | ((apr_uint64_t)p[3] << 24);
+}
+
+static unsigned int hashfunc_fast(const char *char_key, apr_ssize_t *klen,
+                                  apr_uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *)char_key;
+    apr_size_t len, i;
+    apr_uint64_t a, b;
+
+    if (*klen == APR_HASH_KEY_STRING) {
+        *klen = strlen(char_key);
+    }
+    len = (apr_size_t)*klen;
+
+    seed ^= hash_mix(seed ^ HASH_S0, HASH_S1);
+    if (len <= 16) {
+        if (len >= 4) {
+            apr_size_t d = (len >> 3) << 2;
+            a = (hash_read32(p) << 32) | hash_read32(p + d);
+            b = (hash_read32(p + len - 4) << 32) | hash_read32(p + len - 4 - d);
+        }
+        else if (len > 0) {
+            a = ((apr_uint64_t)p[0] << 16) | ((apr_uint64_t)p[len >> 1] << 8)
+                | p[len - 1];
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        i = len;
+        if (i > 48) {
+            apr_uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = hash_mix(hash_read64(p) ^ HASH_S1,
+                                hash_read64(p + 8) ^ seed);
+                see1 = hash_mix(hash_read64(p + 16) ^ HASH_S2,
+                                hash_read64(p + 24) ^ see1);
+                see2 = hash_mix(hash_read64(p + 32) ^ HASH_S3,
+                                hash_read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = hash_mix(hash_read64(p) ^ HASH_S1,
+                            hash_read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = hash_read64(p + i - 16);
+        b = hash_read64(p + i - 8);
+    }
+
+    a = hash_mix(a ^ HASH_S1, b ^ seed);
+    a = hash_mix(a ^ HASH_S0 ^ len, HASH_S1);
+    return (unsigned int)(a ^ (a >> 32));
+}
+
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_fast(const char *char_key,
+                                                   apr_ssize_t *klen)
+{
+    return hashfunc_fast(char_key, klen, 0);
+}
+
+APR_DECLARE(unsigned int) apr_hashfunc_fast_seeded(const char *char_key,
+                                                   apr_ssize_t *klen,
+                                                   unsigned int seed)
+{
+    return hashfunc_fast(char_key, klen, seed);
 }
 
 /*
@@ -293,10 +495,14 @@ static apr_hash_entry_t **find_entry(apr_hash_t *ht,
     if (ht->hash_func)
         hash = ht->hash_func(key, &klen);
     else
-        hash = hashfunc_default(key, &klen, ht->seed);
+        hash = hashfunc_fast(key, &klen, ht->seed);
 
     /* scan linked list */
-    for (hep = &ht->array[hash & ht->max], he = *hep;
+    if (ht->old_array && (hash & ht->old_max) >= ht->migrated)
+        hep = &ht->old_array[hash & ht->old_max];
+    else
+        hep = &ht->array[hash & ht->max];
+    for (he = *hep;
          he; hep = &he->next, he = *hep) {
         if (he->hash == hash
             && he->klen == klen
@@ -338,10 +544,30 @@ APR_DECLARE(apr_hash_t *) apr_hash_copy(apr_pool_t *pool,
     ht->seed = orig->seed;
     ht->hash_func = orig->hash_func;
     ht->array = (apr_hash_entry_t **)((char *)ht + sizeof(apr_hash_t));
+    ht->old_array = NULL;
+    ht->old_max = ht->migrated = 0;
+    ht->flags = orig->flags;
 
     new_vals = (apr_hash_entry_t *)((char *)(ht) + sizeof(apr_hash_t) +
                                     sizeof(*ht->array) * (orig->max + 1));
     j = 0;
+    if (orig->old_array) {
+        /* The copy is done migrating */
+        memset(ht->array, 0, sizeof(*ht->array) * (ht->max + 1));
+        for (i = 0; i <= ht->max; i++) {
+            apr_hash_entry_t *orig_entry = bucket_chain(orig, i);
+            for (; orig_entry; orig_entry = orig_entry->next) {
+                unsigned int k = orig_entry->hash & ht->max;
+                new_vals[j].hash = orig_entry->hash;
+                new_vals[j].key = orig_entry->key;
+                new_vals[j].klen = orig_entry->klen;
+                new_vals[j].val = orig_entry->val;
+                new_vals[j].next = ht->array[k];
+                ht->array[k] = &new_vals[j++];
+            }
+        }
+        return ht;
+    }
     for (i = 0; i <= ht->max; i++) {
         apr_hash_entry_t **new_entry = &(ht->array[i]);
         apr_hash_entry_t *orig_entry = orig->array[i];
@@ -377,6 +603,7 @@ APR_DECLARE(void) apr_hash_set(apr_hash_t *ht,
                                const void *val)
 {
     apr_hash_entry_t **hep;
+    unsigned int count = ht->count;
     hep = find_entry(ht, key, klen, val);
     if (*hep) {
         if (!val) {
@@ -394,6 +621,10 @@ APR_DECLARE(void) apr_hash_set(apr_hash_t *ht,
             if (ht->count > ht->max) {
                 expand_array(ht);
             }
+            /* move on with the migration when adding, only */
+            else if (ht->old_array && ht->count > count) {
+                migrate_buckets(ht, MIGRATE_BUCKETS);
+            }
         }
     }
     /* else key not present and val==NULL */
@@ -456,6 +687,9 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
     res->pool = p;
     res->free = NULL;
     res->hash_func = base->hash_func;
+    res->old_array = NULL;
+    res->old_max = res->migrated = 0;
+    res->flags = base->flags;
     res->count = base->count;
     res->max = (overlay->max > base->max) ? overlay->max : base->max;
     if (base->count + overlay->count > res->max) {
@@ -469,7 +703,7 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
     }
     j = 0;
     for (k = 0; k <= base->max; k++) {
-        for (iter = base->array[k]; iter; iter = iter->next) {
+        for (iter = bucket_chain(base, k); iter; iter = iter->next) {
             i = iter->hash & res->max;
             new_vals[j].klen = iter->klen;
             new_vals[j].key = iter->key;
@@ -482,11 +716,11 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
     }
 
     for (k = 0; k <= overlay->max; k++) {
-        for (iter = overlay->array[k]; iter; iter = iter->next) {
+        for (iter = bucket_chain(overlay, k); iter; iter = iter->next) {
             if (res->hash_func)
                 hash = res->hash_func(iter->key, &iter->klen);
             else
-                hash = hashfunc_default(iter->key, &iter->klen, res->seed);
+                hash = hashfunc_fast(iter->key, &iter->klen, res->seed);
             i = hash & res->max;
             for (ent = res->array[i]; ent; ent = ent->next) {
                 if ((ent->klen == iter->klen) &&
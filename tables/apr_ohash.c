@@ -0,0 +1,659 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_time.h"
+
+#include "apr_ohash.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * The internal form of an open addressing hash table.
+ *
+ * The entries live in the slots array, and for each slot the ctrl array
+ * has a byte telling whether it is empty, deleted (a tombstone) or full,
+ * in which case the byte holds 7 bits of the hash of its key (H2).  The
+ * rest of the hash (H1) gives where to start looking for the key; the
+ * ctrl bytes are then matched against H2 a group at a time, and only the
+ * slots whose byte matches have their key compared.  A group with an
+ * empty slot ends the search, otherwise the next group to look at is
+ * chosen by quadratic probing, which visits every group of the table
+ * since the capacity is a power of two.
+ *
+ * Groups start at any slot, so the first GROUP_WIDTH ctrl bytes are
+ * mirrored after the last ones to read a group wrapping around the end
+ * of the table in one go.
+ *
+ * Both arrays share a memory node taken from the pool's allocator, and
+ * given back when the table is resized or its pool cleared, rather than
+ * leaving every outgrown array behind in the pool.
+ *
+ * This is the design of Google's "Swiss tables" (abseil.io).
+ */
+
+typedef signed char ohash_ctrl_t;
+
+#define CTRL_EMPTY   ((ohash_ctrl_t)-128)    /* 0x80 */
+#define CTRL_DELETED ((ohash_ctrl_t)-2)      /* 0xfe */
+#define CTRL_IS_FULL(c) ((c) >= 0)
+
+#define H1(hash) ((apr_size_t)(hash) >> 7)
+#define H2(hash) ((ohash_ctrl_t)((hash) & 0x7f))
+
+typedef struct ohash_slot_t {
+    const void  *key;
+    apr_ssize_t  klen;
+    const void  *val;
+} ohash_slot_t;
+
+struct apr_ohash_index_t {
+    apr_ohash_t *ht;
+    apr_size_t   index;
+};
+
+struct apr_ohash_t {
+    apr_pool_t        *pool;
+    apr_allocator_t   *allocator; /* NULL to allocate from the pool */
+    apr_memnode_t     *node;
+    ohash_ctrl_t      *ctrl;    /* NULL until the first entry is added */
+    ohash_slot_t      *slots;
+    apr_size_t         mask;    /* capacity - 1 */
+    apr_size_t         growth_left; /* empty slots usable before resizing */
+    unsigned int       count, seed;
+    apr_hashfunc_t     hash_func;
+    apr_ohash_index_t  iterator;  /* For apr_ohash_first(NULL, ...) */
+};
+
+#define MIN_CAPACITY 16     /* power of 2, at least GROUP_WIDTH */
+
+/* At most 7/8 of the slots are used (full or deleted), so that some are
+ * left empty to end the searches.
+ */
+#define MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+
+/*
+ * Groups of ctrl bytes.  The matching functions return a bitmask with
+ * one bit (or byte with SWAR) per slot of the group, bit_lowest() and
+ * bit_highest() give the slot of the first and last matches.
+ */
+
+#if defined(__SSE2__)
+
+#define GROUP_WIDTH 16
+#define GROUP_SHIFT 0
+
+typedef __m128i group_t;
+typedef apr_uint32_t bitmask_t;
+
+static APR_INLINE group_t group_load(const ohash_ctrl_t *ctrl)
+{
+    return _mm_loadu_si128((const __m128i *)ctrl);
+}
+
+static APR_INLINE bitmask_t group_match(group_t g, ohash_ctrl_t h2)
+{
+    return (bitmask_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), g));
+}
+
+static APR_INLINE bitmask_t group_match_empty(group_t g)
+{
+    return group_match(g, CTRL_EMPTY);
+}
+
+/* Empty or deleted slots, the only ones with their top bit set */
+static APR_INLINE bitmask_t group_match_free(group_t g)
+{
+    return (bitmask_t)_mm_movemask_epi8(g);
+}
+
+#else /* !__SSE2__ */
+
+/* Portable version working on 8 bytes at a time in a 64-bit integer,
+ * with the top bit of each byte flagging the matches.  group_match() may
+ * also flag a full byte following a real match, which is harmless since
+ * the keys are compared anyway.
+ */
+#define GROUP_WIDTH 8
+#define GROUP_SHIFT 3
+
+typedef apr_uint64_t group_t;
+typedef apr_uint64_t bitmask_t;
+
+#define GROUP_LSBS APR_UINT64_C(0x0101010101010101)
+#define GROUP_MSBS APR_UINT64_C(0x8080808080808080)
+
+static APR_INLINE group_t group_load(const ohash_ctrl_t *ctrl)
+{
+    group_t g;
+
+    memcpy(&g, ctrl, sizeof(g));
+#if APR_IS_BIGENDIAN
+    /* Have the first ctrl byte in the lowest bits */
+    g = ((g & APR_UINT64_C(0x00000000ffffffff)) << 32)
+        | ((g >> 32) & APR_UINT64_C(0x00000000ffffffff));
+    g = ((g & APR_UINT64_C(0x0000ffff0000ffff)) << 16)
+        | ((g >> 16) & APR_UINT64_C(0x0000ffff0000ffff));
+    g = ((g & APR_UINT64_C(0x00ff00ff00ff00ff)) << 8)
+        | ((g >> 8) & APR_UINT64_C(0x00ff00ff00ff00ff));
+#endif
+    return g;
+}
+
+static APR_INLINE bitmask_t group_match(group_t g, ohash_ctrl_t h2)
+{
+    group_t x = g ^ (GROUP_LSBS * (apr_byte_t)h2);
+
+    return (x - GROUP_LSBS) & ~x & GROUP_MSBS;
+}
+
+/* 0x80 is the only value with bit 7 set and bit 1 clear */
+static APR_INLINE bitmask_t group_match_empty(group_t g)
+{
+    return g & ~(g << 6) & GROUP_MSBS;
+}
+
+/* 0x80 and 0xfe are the only values with bit 7 set and bit 0 clear */
+static APR_INLINE bitmask_t group_match_free(group_t g)
+{
+    return g & ~(g << 7) & GROUP_MSBS;
+}
+
+#endif /* !__SSE2__ */
+
+static APR_INLINE unsigned int bit_lowest(bitmask_t bits)
+{
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+    return (unsigned int)__builtin_ctzll(bits) >> GROUP_SHIFT;
+#else
+    unsigned int n = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        n++;
+    }
+    return n >> GROUP_SHIFT;
+#endif
+}
+
+static APR_INLINE unsigned int bit_highest(bitmask_t bits)
+{
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+    return (unsigned int)(63 - __builtin_clzll(bits)) >> GROUP_SHIFT;
+#else
+    unsigned int n = 0;
+    while (bits >>= 1) {
+        n++;
+    }
+    return n >> GROUP_SHIFT;
+#endif
+}
+
+
+/*
+ * Hashing and probing.
+ */
+
+static APR_INLINE apr_uint32_t ohash_hash(const apr_ohash_t *ht,
+                                          const void *key,
+                                          apr_ssize_t *klen)
+{
+    apr_uint32_t hash;
+
+    if (!ht->hash_func)
+        return apr_hashfunc_fast_seeded(key, klen, ht->seed);
+
+    /* Spread all the bits over H1 and H2 (murmur3's finalizer) */
+    hash = ht->hash_func(key, klen) ^ ht->seed;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static APR_INLINE void set_ctrl(apr_ohash_t *ht, apr_size_t i,
+                                ohash_ctrl_t c)
+{
+    ht->ctrl[i] = c;
+    if (i < GROUP_WIDTH) {
+        ht->ctrl[ht->mask + 1 + i] = c;
+    }
+}
+
+static ohash_slot_t *find_slot(const apr_ohash_t *ht, const void *key,
+                               apr_ssize_t klen, apr_uint32_t hash)
+{
+    apr_size_t offset = H1(hash) & ht->mask;
+    apr_size_t step = 0;
+
+    for (;;) {
+        group_t g = group_load(ht->ctrl + offset);
+        bitmask_t match = group_match(g, H2(hash));
+
+        while (match) {
+            ohash_slot_t *slot = ht->slots
+                                 + ((offset + bit_lowest(match)) & ht->mask);
+            if (slot->klen == klen && memcmp(slot->key, key, klen) == 0) {
+                return slot;
+            }
+            match &= match - 1;
+        }
+        if (group_match_empty(g)) {
+            return NULL;
+        }
+        step += GROUP_WIDTH;
+        offset = (offset + step) & ht->mask;
+    }
+}
+
+/* The first empty or deleted slot on the probe sequence of hash */
+static apr_size_t find_free(const apr_ohash_t *ht, apr_uint32_t hash)
+{
+    apr_size_t offset = H1(hash) & ht->mask;
+    apr_size_t step = 0;
+
+    for (;;) {
+        bitmask_t match = group_match_free(group_load(ht->ctrl + offset));
+
+        if (match) {
+            return (offset + bit_lowest(match)) & ht->mask;
+        }
+        step += GROUP_WIDTH;
+        offset = (offset + step) & ht->mask;
+    }
+}
+
+
+/*
+ * Resizing.
+ */
+
+static apr_status_t ohash_cleanup(void *data)
+{
+    apr_ohash_t *ht = data;
+
+    if (ht->node) {
+        apr_allocator_free(ht->allocator, ht->node);
+        ht->node = NULL;
+    }
+    ht->ctrl = NULL;
+    ht->slots = NULL;
+    ht->mask = 0;
+    ht->growth_left = 0;
+    ht->count = 0;
+
+    return APR_SUCCESS;
+}
+
+static int resize(apr_ohash_t *ht, apr_size_t capacity)
+{
+    ohash_ctrl_t *old_ctrl = ht->ctrl;
+    ohash_slot_t *old_slots = ht->slots;
+    apr_memnode_t *old_node = ht->node;
+    apr_size_t old_capacity = old_ctrl ? ht->mask + 1 : 0;
+    apr_size_t size = capacity * sizeof(ohash_slot_t) + capacity + GROUP_WIDTH;
+    apr_size_t i;
+
+    /* One block for both arrays, the slots first for their alignment */
+    if (ht->allocator) {
+        apr_memnode_t *node = apr_allocator_alloc(ht->allocator, size);
+
+        if (!node) {
+            apr_abortfunc_t fn = apr_pool_abort_get(ht->pool);
+            if (fn)
+                (fn)(APR_ENOMEM);
+            return 0;
+        }
+        if (!old_node) {
+            apr_pool_cleanup_register(ht->pool, ht, ohash_cleanup,
+                                      apr_pool_cleanup_null);
+        }
+        ht->node = node;
+        ht->slots = (ohash_slot_t *)node->first_avail;
+    }
+    else {
+        ht->slots = apr_palloc(ht->pool, size);
+    }
+    ht->ctrl = (ohash_ctrl_t *)(ht->slots + capacity);
+    memset(ht->ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH);
+    ht->mask = capacity - 1;
+    ht->growth_left = MAX_LOAD(capacity) - ht->count;
+
+    for (i = 0; i < old_capacity; i++) {
+        if (CTRL_IS_FULL(old_ctrl[i])) {
+            apr_ssize_t klen = old_slots[i].klen;
+            apr_uint32_t hash = ohash_hash(ht, old_slots[i].key, &klen);
+            apr_size_t j = find_free(ht, hash);
+
+            set_ctrl(ht, j, H2(hash));
+            ht->slots[j] = old_slots[i];
+        }
+    }
+    if (old_node) {
+        apr_allocator_free(ht->allocator, old_node);
+    }
+    return 1;
+}
+
+/* Rehash the table in place to get rid of the tombstones: the full slots
+ * are first marked deleted and the deleted ones empty, then each entry is
+ * moved to the first free slot of its probe sequence, swapping it with
+ * any entry still to be moved found there.
+ */
+static void drop_deletes(apr_ohash_t *ht)
+{
+    apr_size_t capacity = ht->mask + 1;
+    apr_size_t i;
+
+    for (i = 0; i < capacity; i++) {
+        ht->ctrl[i] = CTRL_IS_FULL(ht->ctrl[i]) ? CTRL_DELETED : CTRL_EMPTY;
+    }
+    memcpy(ht->ctrl + capacity, ht->ctrl, GROUP_WIDTH);
+
+    for (i = 0; i < capacity; i++) {
+        while (ht->ctrl[i] == CTRL_DELETED) {
+            ohash_slot_t *slot = ht->slots + i;
+            apr_ssize_t klen = slot->klen;
+            apr_uint32_t hash = ohash_hash(ht, slot->key, &klen);
+            apr_size_t start = H1(hash) & ht->mask;
+            apr_size_t j = find_free(ht, hash);
+
+            /* Already in the first group where it could go? */
+            if (((i - start) & ht->mask) / GROUP_WIDTH
+                == ((j - start) & ht->mask) / GROUP_WIDTH) {
+                set_ctrl(ht, i, H2(hash));
+                break;
+            }
+            if (ht->ctrl[j] == CTRL_EMPTY) {
+                set_ctrl(ht, j, H2(hash));
+                ht->slots[j] = *slot;
+                set_ctrl(ht, i, CTRL_EMPTY);
+                break;
+            }
+            else {
+                /* Swap with the entry still to be moved, then move it */
+                ohash_slot_t tmp = ht->slots[j];
+                set_ctrl(ht, j, H2(hash));
+                ht->slots[j] = *slot;
+                *slot = tmp;
+            }
+        }
+    }
+    ht->growth_left = MAX_LOAD(capacity) - ht->count;
+}
+
+static apr_size_t capacity_for(apr_size_t count)
+{
+    apr_size_t capacity = MIN_CAPACITY;
+
+    while (MAX_LOAD(capacity) < count) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+/* Make room for one more entry, returns zero if out of memory */
+static int grow(apr_ohash_t *ht)
+{
+    apr_size_t capacity = ht->mask + 1;
+
+    if (!ht->ctrl) {
+        return resize(ht, MIN_CAPACITY);
+    }
+    if ((apr_size_t)ht->count * 32 <= capacity * 25) {
+        /* Mostly tombstones, no need for a larger array */
+        drop_deletes(ht);
+        return 1;
+    }
+    return resize(ht, capacity * 2);
+}
+
+
+/*
+ * Hash creation functions.
+ */
+
+APR_DECLARE(apr_ohash_t *) apr_ohash_make(apr_pool_t *pool)
+{
+    apr_ohash_t *ht;
+    apr_time_t now = apr_time_now();
+
+    ht = apr_palloc(pool, sizeof(apr_ohash_t));
+    ht->pool = pool;
+    ht->allocator = apr_pool_allocator_get(pool);
+    ht->node = NULL;
+    ht->ctrl = NULL;
+    ht->slots = NULL;
+    ht->mask = 0;
+    ht->growth_left = 0;
+    ht->count = 0;
+    ht->seed = (unsigned int)((now >> 32) ^ now ^ (apr_uintptr_t)pool ^
+                              (apr_uintptr_t)ht ^ (apr_uintptr_t)&now) - 1;
+    ht->hash_func = NULL;
+
+    return ht;
+}
+
+APR_DECLARE(apr_ohash_t *) apr_ohash_make_custom(apr_pool_t *pool,
+                                                 apr_hashfunc_t hash_func)
+{
+    apr_ohash_t *ht = apr_ohash_make(pool);
+    ht->hash_func = hash_func;
+    return ht;
+}
+
+APR_DECLARE(void) apr_ohash_reserve(apr_ohash_t *ht, unsigned int count)
+{
+    apr_size_t capacity = capacity_for(count);
+
+    if (!ht->ctrl || capacity > ht->mask + 1) {
+        resize(ht, capacity);
+    }
+}
+
+
+/*
+ * Hash iteration functions.
+ */
+
+APR_DECLARE(apr_ohash_index_t *) apr_ohash_next(apr_ohash_index_t *hi)
+{
+    apr_ohash_t *ht = hi->ht;
+    apr_size_t capacity = ht->ctrl ? ht->mask + 1 : 0;
+
+    while (++hi->index < capacity) {
+        if (CTRL_IS_FULL(ht->ctrl[hi->index])) {
+            return hi;
+        }
+    }
+    return NULL;
+}
+
+APR_DECLARE(apr_ohash_index_t *) apr_ohash_first(apr_pool_t *p,
+                                                 apr_ohash_t *ht)
+{
+    apr_ohash_index_t *hi;
+
+    if (p)
+        hi = apr_palloc(p, sizeof(*hi));
+    else
+        hi = &ht->iterator;
+
+    hi->ht = ht;
+    hi->index = (apr_size_t)-1;
+    return apr_ohash_next(hi);
+}
+
+APR_DECLARE(void) apr_ohash_this(apr_ohash_index_t *hi,
+                                 const void **key,
+                                 apr_ssize_t *klen,
+                                 void **val)
+{
+    ohash_slot_t *slot = hi->ht->slots + hi->index;
+
+    if (key)  *key  = slot->key;
+    if (klen) *klen = slot->klen;
+    if (val)  *val  = (void *)slot->val;
+}
+
+APR_DECLARE(const void *) apr_ohash_this_key(apr_ohash_index_t *hi)
+{
+    return hi->ht->slots[hi->index].key;
+}
+
+APR_DECLARE(apr_ssize_t) apr_ohash_this_key_len(apr_ohash_index_t *hi)
+{
+    return hi->ht->slots[hi->index].klen;
+}
+
+APR_DECLARE(void *) apr_ohash_this_val(apr_ohash_index_t *hi)
+{
+    return (void *)hi->ht->slots[hi->index].val;
+}
+
+APR_DECLARE(int) apr_ohash_do(apr_hash_do_callback_fn_t *comp,
+                              void *rec, const apr_ohash_t *ht)
+{
+    apr_size_t capacity = ht->ctrl ? ht->mask + 1 : 0;
+    apr_size_t i;
+
+    for (i = 0; i < capacity; i++) {
+        if (CTRL_IS_FULL(ht->ctrl[i])) {
+            const ohash_slot_t *slot = ht->slots + i;
+            if (!(*comp)(rec, slot->key, slot->klen, slot->val)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * Lookup, insertion and deletion.
+ */
+
+APR_DECLARE(void *) apr_ohash_get(const apr_ohash_t *ht, const void *key,
+                                  apr_ssize_t klen)
+{
+    ohash_slot_t *slot;
+
+    if (!ht->count) {
+        return NULL;
+    }
+    slot = find_slot(ht, key, klen, ohash_hash(ht, key, &klen));
+    return slot ? (void *)slot->val : NULL;
+}
+
+static void delete_slot(apr_ohash_t *ht, ohash_slot_t *slot)
+{
+    apr_size_t i = slot - ht->slots;
+    bitmask_t empty_before, empty_after;
+
+    /* The slot can be emptied rather than marked deleted if no search
+     * could have gone past it, i.e. if there never were GROUP_WIDTH non
+     * empty slots in a row around it.
+     */
+    empty_before = group_match_empty(group_load(ht->ctrl
+                                     + ((i - GROUP_WIDTH) & ht->mask)));
+    empty_after = group_match_empty(group_load(ht->ctrl + i));
+    if (empty_before && empty_after
+        && (GROUP_WIDTH - 1 - bit_highest(empty_before))
+           + bit_lowest(empty_after) < GROUP_WIDTH) {
+        set_ctrl(ht, i, CTRL_EMPTY);
+        ht->growth_left++;
+    }
+    else {
+        set_ctrl(ht, i, CTRL_DELETED);
+    }
+    ht->count--;
+}
+
+APR_DECLARE(void) apr_ohash_set(apr_ohash_t *ht, const void *key,
+                                apr_ssize_t klen, const void *val)
+{
+    apr_uint32_t hash;
+    ohash_slot_t *slot;
+    apr_size_t i;
+
+    if (!ht->ctrl) {
+        if (!val || !grow(ht)) {
+            return;
+        }
+    }
+
+    hash = ohash_hash(ht, key, &klen);
+    slot = find_slot(ht, key, klen, hash);
+    if (slot) {
+        if (val) {
+            slot->val = val;
+        }
+        else {
+            delete_slot(ht, slot);
+        }
+        return;
+    }
+    if (!val) {
+        return;
+    }
+
+    i = find_free(ht, hash);
+    if (ht->ctrl[i] == CTRL_EMPTY) {
+        if (!ht->growth_left) {
+            if (!grow(ht)) {
+                return;
+            }
+            i = find_free(ht, hash);
+        }
+        if (ht->ctrl[i] == CTRL_EMPTY) {
+            ht->growth_left--;
+        }
+    }
+    set_ctrl(ht, i, H2(hash));
+    slot = ht->slots + i;
+    slot->key = key;
+    slot->klen = klen;
+    slot->val = val;
+    ht->count++;
+}
+
+APR_DECLARE(unsigned int) apr_ohash_count(const apr_ohash_t *ht)
+{
+    return ht->count;
+}
+
+APR_DECLARE(void) apr_ohash_clear(apr_ohash_t *ht)
+{
+    if (ht->ctrl) {
+        memset(ht->ctrl, CTRL_EMPTY, ht->mask + 1 + GROUP_WIDTH);
+        ht->growth_left = MAX_LOAD(ht->mask + 1);
+        ht->count = 0;
+    }
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(ohash)
@@ -23,38 +23,56 @@
  *  can removed if/when needed.
  */
 
+/*
+ * Each element is a single node (a "tower"), allocated with as many
+ * forward pointers as its height, so that a search follows one pointer
+ * per step and touches one node per element visited.  Only the bottom
+ * level is linked backward; the predecessors of a node at the upper
+ * levels, which a removal needs, are found by walking back the bottom
+ * level to the nearest higher nodes (a few steps on average).
+ *
+ * The head is a node of SKIPLIST_MAXHEIGHT levels holding no element,
+ * allocated with the first insertion.
+ *
+ * The secondary indexes (apr_skiplist_add_index()) are skip lists of
+ * their own, listed in sl->index; the nodes of an element in the main
+ * list and in each index are chained by nextindex/previndex, in the order
+ * of sl->index.
+ */
+
+#include "apr_general.h"
 #include "apr_skiplist.h"
 
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#define SKIPLIST_MAXHEIGHT 32
+
 struct apr_skiplist {
     apr_skiplist_compare compare;
     apr_skiplist_compare comparek;
     int height;
     int preheight;
     size_t size;
-    apr_skiplistnode *top;
-    apr_skiplistnode *bottom;
-    /* These two are needed for appending */
-    apr_skiplistnode *topend;
-    apr_skiplistnode *bottomend;
+    apr_skiplistnode *head;
     apr_skiplist *index;
     apr_array_header_t *memlist;
-    apr_skiplistnode **stack;
-    size_t stack_pos,
-           stack_len;
     apr_pool_t *pool;
 };
 
 struct apr_skiplistnode {
     void *data;
-    apr_skiplistnode *next;
     apr_skiplistnode *prev;
-    apr_skiplistnode *down;
-    apr_skiplistnode *up;
     apr_skiplistnode *previndex;
     apr_skiplistnode *nextindex;
-    apr_skiplist *sl;
+    int height;
+    apr_skiplistnode *next[1];  /* Actually height of them */
 };
 
+#define NODE_SIZE(height) (APR_OFFSETOF(apr_skiplistnode, next) \
+                           + (height) * sizeof(apr_skiplistnode *))
+
 static int get_b_rand(void)
 {
     static int ph = 32;         /* More bits than we will ever use */
@@ -67,58 +85,50 @@ static int get_b_rand(void)
     return ((randseq & (1 << (ph - 1))) >> (ph - 1));
 }
 
+/*
+ * With a pool, the memory is recycled by size: each chunk is preceded by
+ * the index of its size in sl->memlist, whose free list it goes back to.
+ */
 typedef struct {
     size_t size;
-    apr_array_header_t *list;
+    void *free;         /* Linked through the first bytes of the chunks */
 } memlist_t;
 
-typedef struct {
-    void *ptr;
-    char inuse;
-} chunk_t;
+#define CHUNK_HEADER APR_ALIGN_DEFAULT(sizeof(apr_size_t))
 
 APR_DECLARE(void *) apr_skiplist_alloc(apr_skiplist *sl, size_t size)
 {
     if (sl->pool) {
-        void *ptr;
-        int found_size = 0;
+        char *ptr;
         int i;
-        chunk_t *newchunk;
         memlist_t *memlist = (memlist_t *)sl->memlist->elts;
         for (i = 0; i < sl->memlist->nelts; i++) {
-            if (memlist->size == size) {
-                int j;
-                chunk_t *chunk = (chunk_t *)memlist->list->elts;
-                found_size = 1;
-                for (j = 0; j < memlist->list->nelts; j++) {
-                    if (!chunk->inuse) {
-                        chunk->inuse = 1;
-                        return chunk->ptr;
-                    }
-                    chunk++;
-                }
-                break; /* no free of this size; punt */
+            if (memlist[i].size == size) {
+                break;
             }
-            memlist++;
-        }
-        /* no free chunks */
-        ptr = apr_palloc(sl->pool, size);
-        if (!ptr) {
-            return ptr;
         }
-        /*
-         * is this a new sized chunk? If so, we need to create a new
-         * array of them. Otherwise, re-use what we already have.
-         */
-        if (!found_size) {
+        if (i == sl->memlist->nelts) {
             memlist = apr_array_push(sl->memlist);
             memlist->size = size;
-            memlist->list = apr_array_make(sl->pool, 20, sizeof(chunk_t));
+            memlist->free = NULL;
+        }
+        else {
+            memlist += i;
+            if (memlist->free) {
+                ptr = memlist->free;
+                memlist->free = *(void **)ptr;
+                return ptr;
+            }
+        }
+        if (size < sizeof(void *)) {
+            size = sizeof(void *);
+        }
+        ptr = apr_palloc(sl->pool, CHUNK_HEADER + size);
+        if (!ptr) {
+            return ptr;
         }
-        newchunk = apr_array_push(memlist->list);
-        newchunk->ptr = ptr;
-        newchunk->inuse = 1;
-        return ptr;
+        *(apr_size_t *)ptr = i;
+        return ptr + CHUNK_HEADER;
     }
     else {
         return malloc(size);
@@ -131,60 +141,13 @@ APR_DECLARE(void) apr_skiplist_free(apr_skiplist *sl, void *mem)
         free(mem);
     }
     else {
-        int i;
-        memlist_t *memlist = (memlist_t *)sl->memlist->elts;
-        for (i = 0; i < sl->memlist->nelts; i++) {
-            int j;
-            chunk_t *chunk = (chunk_t *)memlist->list->elts;
-            for (j = 0; j < memlist->list->nelts; j++) {
-                if (chunk->ptr == mem) {
-                    chunk->inuse = 0;
-                    return;
-                }
-                chunk++;
-            }
-            memlist++;
-        }
+        apr_size_t i = *(apr_size_t *)((char *)mem - CHUNK_HEADER);
+        memlist_t *memlist = (memlist_t *)sl->memlist->elts + i;
+        *(void **)mem = memlist->free;
+        memlist->free = mem;
     }
 }
 
-static apr_status_t skiplist_stack_push(apr_skiplist *sl, apr_skiplistnode *m)
-{
-    if (sl->stack_pos >= sl->stack_len) {
-        apr_skiplistnode **ptr;
-        size_t len = sl->stack_pos * 2;
-        if (len < 32) {
-            len = 32;
-        }
-        if (sl->pool) {
-            ptr = apr_palloc(sl->pool, len * sizeof(*ptr));
-            if (ptr) {
-                memcpy(ptr, sl->stack, sl->stack_pos * sizeof(*ptr));
-            }
-        }
-        else {
-            ptr = realloc(sl->stack, len * sizeof(*ptr));
-        }
-        if (!ptr) {
-            return APR_ENOMEM;
-        }
-        sl->stack = ptr;
-        sl->stack_len = len;
-    }
-    sl->stack[sl->stack_pos++] = m;
-    return APR_SUCCESS;
-}
-
-static APR_INLINE apr_skiplistnode *skiplist_stack_pop(apr_skiplist *sl)
-{
-    return (sl->stack_pos > 0) ? sl->stack[--sl->stack_pos] : NULL;
-}
-
-static APR_INLINE void skiplist_stack_clear(apr_skiplist *sl)
-{
-    sl->stack_pos = 0;
-}
-
 static apr_status_t skiplisti_init(apr_skiplist **s, apr_pool_t *p)
 {
     apr_skiplist *sl;
@@ -198,16 +161,6 @@ static apr_status_t skiplisti_init(apr_skiplist **s, apr_pool_t *p)
             return APR_ENOMEM;
         }
     }
-#if 0
-    sl->compare = (apr_skiplist_compare) NULL;
-    sl->comparek = (apr_skiplist_compare) NULL;
-    sl->height = 0;
-    sl->preheight = 0;
-    sl->size = 0;
-    sl->top = NULL;
-    sl->bottom = NULL;
-    sl->index = NULL;
-#endif
     sl->pool = p;
     *s = sl;
     return APR_SUCCESS;
@@ -229,9 +182,18 @@ static int indexing_compk(void *ac, void *b)
 APR_DECLARE(apr_status_t) apr_skiplist_init(apr_skiplist **s, apr_pool_t *p)
 {
     apr_skiplist *sl;
-    skiplisti_init(s, p);
+    apr_status_t rv;
+    if ((rv = skiplisti_init(s, p)) != APR_SUCCESS) {
+        return rv;
+    }
     sl = *s;
-    skiplisti_init(&(sl->index), p);
+    if ((rv = skiplisti_init(&(sl->index), p)) != APR_SUCCESS) {
+        if (!p) {
+            free(sl);
+        }
+        *s = NULL;
+        return rv;
+    }
     apr_skiplist_set_compare(sl->index, indexing_comp, indexing_compk);
     return APR_SUCCESS;
 }
@@ -253,14 +215,16 @@ APR_DECLARE(void) apr_skiplist_add_index(apr_skiplist *sl,
                         apr_skiplist_compare comp,
                         apr_skiplist_compare compk)
 {
-    apr_skiplistnode *m;
+    apr_skiplistnode *m, *q;
     apr_skiplist *ni;
-    int icount = 0;
+    int icount = 0, j;
     apr_skiplist_find(sl->index, (void *)comp, &m);
     if (m) {
         return;                 /* Index already there! */
     }
-    skiplisti_init(&ni, sl->pool);
+    if (skiplisti_init(&ni, sl->pool) != APR_SUCCESS) {
+        return;
+    }
     apr_skiplist_set_compare(ni, comp, compk);
     /* Build the new index... This can be expensive! */
     m = apr_skiplist_insert(sl->index, ni);
@@ -269,69 +233,59 @@ APR_DECLARE(void) apr_skiplist_add_index(apr_skiplist *sl,
         icount++;
     }
     for (m = apr_skiplist_getlist(sl); m; apr_skiplist_next(sl, &m)) {
-        int j = icount - 1;
         apr_skiplistnode *nsln;
-        nsln = apr_skiplist_insert(ni, m->data);
-        /* skip from main index down list */
-        while (j > 0) {
-            m = m->nextindex;
-            j--;
+        nsln = apr_skiplist_add(ni, m->data);
+        /* skip the nodes of the preceding indexes */
+        for (q = m, j = 0; j < icount; j++) {
+            q = q->nextindex;
         }
-        /* insert this node in the indexlist after m */
-        nsln->nextindex = m->nextindex;
-        if (m->nextindex) {
-            m->nextindex->previndex = nsln;
+        /* insert this node in the index chain after q */
+        nsln->nextindex = q->nextindex;
+        if (q->nextindex) {
+            q->nextindex->previndex = nsln;
         }
-        nsln->previndex = m;
-        m->nextindex = nsln;
+        nsln->previndex = q;
+        q->nextindex = nsln;
     }
 }
 
 APR_DECLARE(apr_skiplistnode *) apr_skiplist_getlist(apr_skiplist *sl)
 {
-    if (!sl->bottom) {
+    if (!sl->head) {
         return NULL;
     }
-    return sl->bottom->next;
+    return sl->head->next[0];
 }
 
 APR_DECLARE(void *) apr_skiplist_find(apr_skiplist *sl, void *data, apr_skiplistnode **iter)
 {
     if (!sl->compare) {
+        if (iter) {
+            *iter = NULL;
+        }
         return NULL;
     }
     return apr_skiplist_find_compare(sl, data, iter, sl->compare);
 }
 
-static int skiplisti_find_compare(apr_skiplist *sl, void *data,
-                           apr_skiplistnode **ret,
-                           apr_skiplist_compare comp)
+static apr_skiplistnode *skiplisti_find_compare(apr_skiplist *sl, void *data,
+                                                apr_skiplist_compare comp)
 {
-    int count = 0;
-    apr_skiplistnode *m;
-    m = sl->top;
-    while (m) {
-        int compared;
-        compared = (m->next) ? comp(data, m->next->data) : -1;
-        if (compared == 0) {
-            m = m->next;
-            while (m->down) {
-                m = m->down;
+    apr_skiplistnode *m = sl->head, *n;
+    int l;
+    for (l = sl->height - 1; l >= 0; l--) {
+        while ((n = m->next[l]) != NULL) {
+            int compared = comp(data, n->data);
+            if (compared == 0) {
+                return n;
             }
-            *ret = m;
-            return count;
-        }
-        if (compared < 0) {
-            m = m->down;
-            count++;
-        }
-        else {
-            m = m->next;
-            count++;
+            if (compared < 0) {
+                break;
+            }
+            m = n;
         }
     }
-    *ret = NULL;
-    return count;
+    return NULL;
 }
 
 APR_DECLARE(void *) apr_skiplist_find_compare(apr_skiplist *sli, void *data,
@@ -353,7 +307,7 @@ APR_DECLARE(void *) apr_skiplist_find_compare(apr_skiplist *sli, void *data,
         }
         sl = (apr_skiplist *) m->data;
     }
-    skiplisti_find_compare(sl, data, &m, sl->comparek);
+    m = skiplisti_find_compare(sl, data, sl->comparek);
     if (iter) {
         *iter = m;
     }
@@ -366,7 +320,7 @@ APR_DECLARE(void *) apr_skiplist_next(apr_skiplist *sl, apr_skiplistnode **iter)
     if (!*iter) {
         return NULL;
     }
-    *iter = (*iter)->next;
+    *iter = (*iter)->next[0];
     return (*iter) ? ((*iter)->data) : NULL;
 }
 
@@ -382,20 +336,17 @@ APR_DECLARE(void *) apr_skiplist_previous(apr_skiplist *sl, apr_skiplistnode **i
 static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
                                         apr_skiplist_compare comp, int add)
 {
-    apr_skiplistnode *m, *p, *tmp, *ret = NULL;
-    int nh = 1, ch;
-    if (!sl->top) {
-        sl->height = 1;
-        sl->topend = sl->bottomend = sl->top = sl->bottom =
-            (apr_skiplistnode *)apr_skiplist_alloc(sl, sizeof(apr_skiplistnode));
-        sl->top->next = NULL;
-        sl->top->data = NULL;
-        sl->top->prev = NULL;
-        sl->top->up = NULL;
-        sl->top->down = NULL;
-        sl->top->nextindex = NULL;
-        sl->top->previndex = NULL;
-        sl->top->sl = sl;
+    apr_skiplistnode *update[SKIPLIST_MAXHEIGHT];
+    apr_skiplistnode *m, *n, *ret;
+    int nh = 1, l;
+    if (!sl->head) {
+        sl->head = apr_skiplist_alloc(sl, NODE_SIZE(SKIPLIST_MAXHEIGHT));
+        if (!sl->head) {
+            return NULL;
+        }
+        memset(sl->head, 0, NODE_SIZE(SKIPLIST_MAXHEIGHT));
+        sl->head->height = SKIPLIST_MAXHEIGHT;
+        sl->height = 0;
     }
     if (sl->preheight) {
         while (nh < sl->preheight && get_b_rand()) {
@@ -403,98 +354,64 @@ static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
         }
     }
     else {
-        while (nh <= sl->height && get_b_rand()) {
+        while (nh <= sl->height && nh < SKIPLIST_MAXHEIGHT && get_b_rand()) {
             nh++;
         }
     }
-    ch = sl->height;
 
-    /* Now we have in nh the height at which we wish to insert our new node,
-     * and in ch the current height: don't create skip paths to the inserted
-     * element until the walk down through the tree (which decrements ch)
-     * reaches nh. From there, any walk down pushes the current node on a
-     * stack (the node(s) after which we would insert) to pop back through
-     * for insertion later.
+    /* Walk down from the top, remembering at each level the node after
+     * which to link the new one.  Equal elements are kept before it.
      */
-    m = sl->top;
-    while (m) {
-        int compared = -1;
-        if (m->next) {
-            compared = comp(data, m->next->data);
-        }
-        if (compared == 0 && !add) {
-            /* Keep the existing element(s) */
-            skiplist_stack_clear(sl);
-            return NULL;
-        }
-        if (compared < 0) {
-            if (ch <= nh) {
-                /* push on stack */
-                skiplist_stack_push(sl, m);
+    m = sl->head;
+    for (l = sl->height - 1; l >= 0; l--) {
+        while ((n = m->next[l]) != NULL) {
+            int compared = comp(data, n->data);
+            if (compared == 0 && !add) {
+                /* Keep the existing element(s) */
+                return NULL;
             }
-            m = m->down;
-            ch--;
-        }
-        else {
-            m = m->next;
+            if (compared < 0) {
+                break;
+            }
+            m = n;
         }
+        update[l] = m;
     }
-    /* Pop the stack and insert nodes */
-    p = NULL;
-    while ((m = skiplist_stack_pop(sl))) {
-        tmp = (apr_skiplistnode *)apr_skiplist_alloc(sl, sizeof(apr_skiplistnode));
-        tmp->next = m->next;
-        if (m->next) {
-            m->next->prev = tmp;
-        }
-        tmp->prev = m;
-        tmp->up = NULL;
-        tmp->nextindex = tmp->previndex = NULL;
-        tmp->down = p;
-        if (p) {
-            p->up = tmp;
-        }
-        else {
-            /* This sets ret to the bottom-most node we are inserting */
-            ret = tmp;
-        }
-        tmp->data = data;
-        tmp->sl = sl;
-        m->next = tmp;
-        p = tmp;
-    }
-
-    /* Now we are sure the node is inserted, grow our tree to 'nh' tall */
-    for (; sl->height < nh; sl->height++) {
-        m = (apr_skiplistnode *)apr_skiplist_alloc(sl, sizeof(apr_skiplistnode));
-        tmp = (apr_skiplistnode *)apr_skiplist_alloc(sl, sizeof(apr_skiplistnode));
-        m->up = m->prev = m->nextindex = m->previndex = NULL;
-        m->next = tmp;
-        m->down = sl->top;
-        m->data = NULL;
-        m->sl = sl;
-        if (sl->top) {
-            sl->top->up = m;
-        }
-        else {
-            sl->bottom = sl->bottomend = m;
-        }
-        sl->top = sl->topend = tmp->prev = m;
-        tmp->up = tmp->next = tmp->nextindex = tmp->previndex = NULL;
-        tmp->down = p;
-        tmp->data = data;
-        tmp->sl = sl;
-        p = p->up = tmp;
+    for (l = sl->height; l < nh; l++) {
+        update[l] = sl->head;
+    }
+
+    ret = apr_skiplist_alloc(sl, NODE_SIZE(nh));
+    if (!ret) {
+        return NULL;
+    }
+    ret->data = data;
+    ret->height = nh;
+    ret->nextindex = ret->previndex = NULL;
+    for (l = 0; l < nh; l++) {
+        ret->next[l] = update[l]->next[l];
+        update[l]->next[l] = ret;
     }
+    ret->prev = (update[0] != sl->head) ? update[0] : NULL;
+    if (ret->next[0]) {
+        ret->next[0]->prev = ret;
+    }
+    if (sl->height < nh) {
+        sl->height = nh;
+    }
+
     if (sl->index != NULL) {
         /*
          * this is a external insertion, we must insert into each index as
          * well
          */
-        apr_skiplistnode *ni, *li;
+        apr_skiplistnode *p, *ni, *li;
         li = ret;
         for (p = apr_skiplist_getlist(sl->index); p; apr_skiplist_next(sl->index, &p)) {
-            ni = apr_skiplist_insert((apr_skiplist *) p->data, ret->data);
+            ni = apr_skiplist_add((apr_skiplist *) p->data, ret->data);
+            if (!ni) {
+                break;
+            }
             li->nextindex = ni;
             ni->previndex = li;
             li = ni;
@@ -543,61 +460,60 @@ APR_DECLARE(int) apr_skiplist_remove(apr_skiplist *sl, void *data, apr_skiplist_
 #if 0
 void skiplist_print_struct(apr_skiplist * sl, char *prefix)
 {
-    apr_skiplistnode *p, *q;
+    apr_skiplistnode *p;
     fprintf(stderr, "Skiplist Structure (height: %d)\n", sl->height);
-    p = sl->bottom;
-    while (p) {
-        q = p;
-        fprintf(stderr, prefix);
-        while (q) {
-            fprintf(stderr, "%p ", q->data);
-            q = q->up;
-        }
-        fprintf(stderr, "\n");
-        p = p->next;
+    for (p = apr_skiplist_getlist(sl); p; p = p->next[0]) {
+        fprintf(stderr, "%s%p (%d)\n", prefix, p->data, p->height);
     }
 }
 #endif
 
-static int skiplisti_remove(apr_skiplist *sl, apr_skiplistnode *m, apr_skiplist_freefunc myfree)
+/* Take m out of the levels of sl */
+static void skiplisti_unlink(apr_skiplist *sl, apr_skiplistnode *m)
 {
-    apr_skiplistnode *p;
-    if (!m) {
-        return 0;
-    }
-    if (m->nextindex) {
-        skiplisti_remove(m->nextindex->sl, m->nextindex, NULL);
-    }
-    while (m->up) {
-        m = m->up;
-    }
-    while (m) {
-        p = m;
-        p->prev->next = p->next;/* take me out of the list */
-        if (p->next) {
-            p->next->prev = p->prev;    /* take me out of the list */
-        }
-        m = m->down;
-        /* This only frees the actual data in the bottom one */
-        if (!m && myfree && p->data) {
-            myfree(p->data);
+    apr_skiplistnode *p = m->prev ? m->prev : sl->head;
+    int l;
+    for (l = 0; l < m->height; l++) {
+        /* The predecessor at level l is the nearest node before m that
+         * high, the head being higher than all.
+         */
+        while (p->height <= l) {
+            p = p->prev ? p->prev : sl->head;
         }
-        apr_skiplist_free(sl, p);
+        p->next[l] = m->next[l];
+    }
+    if (m->next[0]) {
+        m->next[0]->prev = m->prev;
     }
     sl->size--;
-    while (sl->top && sl->top->next == NULL) {
-        /* While the row is empty and we are not on the bottom row */
-        p = sl->top;
-        sl->top = sl->top->down;/* Move top down one */
-        if (sl->top) {
-            sl->top->up = NULL; /* Make it think its the top */
-        }
-        apr_skiplist_free(sl, p);
+    while (sl->height > 0 && sl->head->next[sl->height - 1] == NULL) {
+        /* While the top level is empty */
         sl->height--;
     }
-    if (!sl->top) {
-        sl->bottom = NULL;
+}
+
+static int skiplisti_remove(apr_skiplist *sl, apr_skiplistnode *m, apr_skiplist_freefunc myfree)
+{
+    if (!m) {
+        return 0;
     }
+    if (m->nextindex) {
+        /* The chain follows the order of the indexes */
+        apr_skiplistnode *p, *ni = m->nextindex;
+        for (p = apr_skiplist_getlist(sl->index); p && ni;
+             apr_skiplist_next(sl->index, &p)) {
+            apr_skiplist *isl = (apr_skiplist *) p->data;
+            apr_skiplistnode *next = ni->nextindex;
+            skiplisti_unlink(isl, ni);
+            apr_skiplist_free(isl, ni);
+            ni = next;
+        }
+    }
+    skiplisti_unlink(sl, m);
+    if (myfree && m->data) {
+        myfree(m->data);
+    }
+    apr_skiplist_free(sl, m);
     return sl->height;  /* return 1; ?? */
 }
 
@@ -617,38 +533,42 @@ APR_DECLARE(int) apr_skiplist_remove_compare(apr_skiplist *sli,
         }
         sl = (apr_skiplist *) m->data;
     }
-    skiplisti_find_compare(sl, data, &m, comp);
+    m = skiplisti_find_compare(sl, data, comp);
     if (!m) {
         return 0;
     }
     while (m->previndex) {
         m = m->previndex;
     }
-    return skiplisti_remove(sl, m, myfree);
+    return skiplisti_remove(sli, m, myfree);
 }
 
 APR_DECLARE(void) apr_skiplist_remove_all(apr_skiplist *sl, apr_skiplist_freefunc myfree)
 {
     /*
-     * This must remove even the place holder nodes (bottom though top)
-     * because we specify in the API that one can free the Skiplist after
-     * making this call without memory leaks
+     * This must remove even the head because we specify in the API that
+     * one can free the Skiplist after making this call without memory
+     * leaks
      */
-    apr_skiplistnode *m, *p, *u;
-    m = sl->bottom;
+    apr_skiplistnode *m, *p;
+    if (sl->index) {
+        for (p = apr_skiplist_getlist(sl->index); p; apr_skiplist_next(sl->index, &p)) {
+            apr_skiplist_remove_all((apr_skiplist *) p->data, NULL);
+        }
+    }
+    m = apr_skiplist_getlist(sl);
     while (m) {
-        p = m->next;
-        if (p && myfree && p->data)
-            myfree(p->data);
-        while (m) {
-            u = m->up;
-            apr_skiplist_free(sl, m);
-            m = u;
+        p = m->next[0];
+        if (myfree && m->data) {
+            myfree(m->data);
         }
+        apr_skiplist_free(sl, m);
         m = p;
     }
-    sl->top = sl->bottom = NULL;
-    sl->topend = sl->bottomend = NULL;
+    if (sl->head) {
+        apr_skiplist_free(sl, sl->head);
+        sl->head = NULL;
+    }
     sl->height = 0;
     sl->size = 0;
 }
@@ -692,21 +612,25 @@ APR_DECLARE(int) apr_skiplist_preheight(const apr_skiplist *sl)
 
 APR_DECLARE(void) apr_skiplist_set_preheight(apr_skiplist *sl, int to)
 {
+    if (to > SKIPLIST_MAXHEIGHT) {
+        to = SKIPLIST_MAXHEIGHT;
+    }
     sl->preheight = (to > 0) ? to : 0;
 }
 
-static void skiplisti_destroy(void *vsl)
-{
-    apr_skiplist_destroy((apr_skiplist *) vsl, NULL);
-    apr_skiplist_free((apr_skiplist *) vsl, vsl);
-}
-
 APR_DECLARE(void) apr_skiplist_destroy(apr_skiplist *sl, apr_skiplist_freefunc myfree)
 {
-    while (apr_skiplist_pop(sl->index, skiplisti_destroy) != NULL)
-        ;
+    apr_skiplist *ni;
+    if (sl->index) {
+        while ((ni = apr_skiplist_pop(sl->index, NULL)) != NULL) {
+            apr_skiplist_destroy(ni, NULL);
+        }
+    }
     apr_skiplist_remove_all(sl, myfree);
     if (!sl->pool) {
+        if (sl->index) {
+            apr_skiplist_destroy(sl->index, NULL);
+        }
         free(sl);
     }
 }
@@ -716,7 +640,7 @@ APR_DECLARE(apr_skiplist *) apr_skiplist_merge(apr_skiplist *sl1, apr_skiplist *
     /* Check integrity! */
     apr_skiplist temp;
     struct apr_skiplistnode *b2;
-    if (sl1->bottomend == NULL || sl1->bottomend->prev == NULL) {
+    if (sl1->size == 0) {
         apr_skiplist_remove_all(sl1, NULL);
         temp = *sl1;
         *sl1 = *sl2;
@@ -724,7 +648,7 @@ APR_DECLARE(apr_skiplist *) apr_skiplist_merge(apr_skiplist *sl1, apr_skiplist *
         /* swap them so that sl2 can be freed normally upon return. */
         return sl1;
     }
-    if(sl2->bottom == NULL || sl2->bottom->next == NULL) {
+    if (sl2->size == 0) {
         apr_skiplist_remove_all(sl2, NULL);
         return sl1;
     }
@@ -104,19 +104,47 @@ APR_DECLARE(void *) apr_array_pop(apr_array_header_t *arr)
     return arr->elts + (arr->elt_size * (--arr->nelts));
 }
 
-APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
+/* Make room for new_size elements, in place if the elements are the last
+ * allocation of the pool, and clear the new ones if asked to.
+ *
+ * The elements of an array made by apr_array_copy_hdr() are never grown in
+ * place (as that would share them with the copied array): either they come
+ * from another pool, or the header was allocated after them.
+ */
+static void array_grow(apr_array_header_t *arr, int new_size, int clear)
 {
-    if (arr->nelts == arr->nalloc) {
-        int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
-        char *new_data;
+    apr_size_t size = (apr_size_t)arr->nalloc * arr->elt_size;
+    apr_size_t grown = (apr_size_t)(new_size - arr->nalloc) * arr->elt_size;
 
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
+    if (arr->nalloc > 0
+            && apr_palloc_grow(arr->pool, arr->elts, size, size + grown)) {
+        if (clear) {
+            memset(arr->elts + size, 0, grown);
+        }
+    }
+    else {
+        char *new_data = apr_palloc(arr->pool, size + grown);
 
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
-        memset(new_data + arr->nalloc * arr->elt_size, 0,
-               arr->elt_size * (new_size - arr->nalloc));
+        memcpy(new_data, arr->elts, size);
+        if (clear) {
+            memset(new_data + size, 0, grown);
+        }
         arr->elts = new_data;
-        arr->nalloc = new_size;
+    }
+    arr->nalloc = new_size;
+}
+
+APR_DECLARE(void) apr_array_reserve(apr_array_header_t *arr, int nelts)
+{
+    if (nelts > arr->nalloc) {
+        array_grow(arr, nelts, 1);
+    }
+}
+
+APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
+{
+    if (arr->nelts == arr->nalloc) {
+        array_grow(arr, (arr->nalloc <= 0) ? 1 : arr->nalloc * 2, 1);
     }
 
     ++arr->nelts;
@@ -126,14 +154,7 @@ APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
 static void *apr_array_push_noclear(apr_array_header_t *arr)
 {
     if (arr->nelts == arr->nalloc) {
-        int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
-        char *new_data;
-
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
-
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
-        arr->elts = new_data;
-        arr->nalloc = new_size;
+        array_grow(arr, (arr->nalloc <= 0) ? 1 : arr->nalloc * 2, 0);
     }
 
     ++arr->nelts;
@@ -147,17 +168,12 @@ APR_DECLARE(void) apr_array_cat(apr_array_header_t *dst,
 
     if (dst->nelts + src->nelts > dst->nalloc) {
 	int new_size = (dst->nalloc <= 0) ? 1 : dst->nalloc * 2;
-	char *new_data;
 
 	while (dst->nelts + src->nelts > new_size) {
 	    new_size *= 2;
 	}
 
-	new_data = apr_pcalloc(dst->pool, elt_size * new_size);
-	memcpy(new_data, dst->elts, dst->nalloc * elt_size);
-
-	dst->elts = new_data;
-	dst->nalloc = new_size;
+	array_grow(dst, new_size, 1);
     }
 
     memcpy(dst->elts + dst->nelts * elt_size, src->elts,
@@ -282,6 +298,343 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
 }
 
 
+/*
+ * Sorting and searching arrays.
+ *
+ * apr_array_sort() is an introsort: a quicksort with a median of three
+ * pivot, switching to a heapsort when it goes too deep (so it's never
+ * quadratic) and leaving the small partitions to a final insertion sort.
+ * The elements are swapped as 32 or 64 bits integers when they have that
+ * size, as arrays of pointers and integers do.
+ *
+ * apr_array_sort_key() is an LSD radix sort on an integer key, one byte
+ * per pass, skipping the passes where all the keys have the same byte.
+ */
+
+/* Below this, partitions are left to the insertion sort */
+#define SORT_INSERTION_MAX 16
+
+/* Below this, apr_array_sort_key() does an insertion sort */
+#define SORT_RADIX_MIN 64
+
+static APR_INLINE void elt_swap(char *a, char *b, apr_size_t size)
+{
+    if (size == sizeof(apr_uint64_t)) {
+        apr_uint64_t t;
+        memcpy(&t, a, sizeof(t));
+        memcpy(a, b, sizeof(t));
+        memcpy(b, &t, sizeof(t));
+    }
+    else if (size == sizeof(apr_uint32_t)) {
+        apr_uint32_t t;
+        memcpy(&t, a, sizeof(t));
+        memcpy(a, b, sizeof(t));
+        memcpy(b, &t, sizeof(t));
+    }
+    else {
+        while (size >= sizeof(apr_uint64_t)) {
+            apr_uint64_t t;
+            memcpy(&t, a, sizeof(t));
+            memcpy(a, b, sizeof(t));
+            memcpy(b, &t, sizeof(t));
+            a += sizeof(t);
+            b += sizeof(t);
+            size -= sizeof(t);
+        }
+        while (size--) {
+            char t = *a;
+            *a++ = *b;
+            *b++ = t;
+        }
+    }
+}
+
+static void insertion_sort(char *base, apr_size_t n, apr_size_t size,
+                           apr_array_compare_fn_t *cmp)
+{
+    apr_size_t i, j;
+
+    for (i = 1; i < n; i++) {
+        for (j = i; j > 0 && cmp(base + (j - 1) * size, base + j * size) > 0;
+             j--) {
+            elt_swap(base + (j - 1) * size, base + j * size, size);
+        }
+    }
+}
+
+static void heap_sift(char *base, apr_size_t root, apr_size_t n,
+                      apr_size_t size, apr_array_compare_fn_t *cmp)
+{
+    apr_size_t child;
+
+    while ((child = 2 * root + 1) < n) {
+        if (child + 1 < n
+                && cmp(base + child * size, base + (child + 1) * size) < 0) {
+            child++;
+        }
+        if (cmp(base + root * size, base + child * size) >= 0) {
+            break;
+        }
+        elt_swap(base + root * size, base + child * size, size);
+        root = child;
+    }
+}
+
+static void heap_sort(char *base, apr_size_t n, apr_size_t size,
+                      apr_array_compare_fn_t *cmp)
+{
+    apr_size_t i;
+
+    for (i = n / 2; i-- > 0; ) {
+        heap_sift(base, i, n, size, cmp);
+    }
+    for (i = n; --i > 0; ) {
+        elt_swap(base, base + i * size, size);
+        heap_sift(base, 0, i, size, cmp);
+    }
+}
+
+static void intro_sort(char *base, apr_size_t n, apr_size_t size,
+                       apr_array_compare_fn_t *cmp, int depth)
+{
+    while (n > SORT_INSERTION_MAX) {
+        char *lo = base, *mid = base + (n / 2) * size;
+        char *hi = base + (n - 1) * size;
+        apr_size_t i, j;
+
+        if (depth-- == 0) {
+            heap_sort(base, n, size, cmp);
+            return;
+        }
+
+        /* Median of three as the pivot, moved first; the least of the
+         * three then bounds the scan down, the greatest the scan up.
+         */
+        if (cmp(mid, lo) < 0) {
+            elt_swap(mid, lo, size);
+        }
+        if (cmp(hi, mid) < 0) {
+            elt_swap(hi, mid, size);
+            if (cmp(mid, lo) < 0) {
+                elt_swap(mid, lo, size);
+            }
+        }
+        elt_swap(lo, mid, size);
+
+        i = 0;
+        j = n - 1;
+        for (;;) {
+            while (cmp(base + ++i * size, base) < 0)
+                ;
+            while (cmp(base + --j * size, base) > 0)
+                ;
+            if (i >= j) {
+                break;
+            }
+            elt_swap(base + i * size, base + j * size, size);
+        }
+        elt_swap(base, base + j * size, size);
+
+        /* Recurse into the smaller side, loop on the larger */
+        if (j < n - j - 1) {
+            intro_sort(base, j, size, cmp, depth);
+            base += (j + 1) * size;
+            n -= j + 1;
+        }
+        else {
+            intro_sort(base + (j + 1) * size, n - j - 1, size, cmp, depth);
+            n = j;
+        }
+    }
+}
+
+APR_DECLARE(void) apr_array_sort(apr_array_header_t *arr,
+                                 apr_array_compare_fn_t *cmp)
+{
+    apr_size_t n = arr->nelts, size = arr->elt_size;
+    int depth = 0;
+
+    if (arr->nelts < 2) {
+        return;
+    }
+
+    while (n >>= 1) {
+        depth += 2;
+    }
+    intro_sort(arr->elts, arr->nelts, size, cmp, depth);
+    insertion_sort(arr->elts, arr->nelts, size, cmp);
+}
+
+/* The key of an element, as an unsigned integer in the same order */
+static APR_INLINE apr_uint64_t elt_key(const char *elt, apr_size_t key_size,
+                                       apr_uint64_t flip)
+{
+    apr_uint64_t key;
+
+    switch (key_size) {
+    case 1:
+        key = *(const apr_byte_t *)elt;
+        break;
+    case 2: {
+        apr_uint16_t k;
+        memcpy(&k, elt, sizeof(k));
+        key = k;
+        break;
+    }
+    case 4: {
+        apr_uint32_t k;
+        memcpy(&k, elt, sizeof(k));
+        key = k;
+        break;
+    }
+    default:
+        memcpy(&key, elt, sizeof(key));
+        break;
+    }
+
+    return key ^ flip;
+}
+
+APR_DECLARE(apr_status_t) apr_array_sort_key(apr_array_header_t *arr,
+                                             apr_size_t key_offset,
+                                             apr_size_t key_size,
+                                             int is_signed)
+{
+    apr_size_t n = arr->nelts, size = arr->elt_size, i, pass;
+    apr_size_t counts[sizeof(apr_uint64_t)][256];
+    apr_uint64_t flip;
+    char *src, *dst, *swap;
+
+    if ((key_size != 1 && key_size != 2 && key_size != 4 && key_size != 8)
+            || key_offset + key_size > size) {
+        return APR_EINVAL;
+    }
+    if (arr->nelts < 2) {
+        return APR_SUCCESS;
+    }
+    flip = is_signed ? APR_UINT64_C(1) << (key_size * 8 - 1) : 0;
+
+    if (n < SORT_RADIX_MIN) {
+        char *base = arr->elts + key_offset;
+        apr_size_t j;
+
+        for (i = 1; i < n; i++) {
+            for (j = i; j > 0 && (elt_key(base + (j - 1) * size, key_size, flip)
+                                  > elt_key(base + j * size, key_size, flip));
+                 j--) {
+                elt_swap(arr->elts + (j - 1) * size, arr->elts + j * size,
+                         size);
+            }
+        }
+        return APR_SUCCESS;
+    }
+
+    dst = malloc(n * size);
+    if (dst == NULL) {
+        return APR_ENOMEM;
+    }
+
+    /* All the histograms in one go */
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < n; i++) {
+        apr_uint64_t key = elt_key(arr->elts + i * size + key_offset,
+                                   key_size, flip);
+        for (pass = 0; pass < key_size; pass++) {
+            counts[pass][(key >> (pass * 8)) & 0xff]++;
+        }
+    }
+
+    src = arr->elts;
+    for (pass = 0; pass < key_size; pass++) {
+        apr_size_t *count = counts[pass], sum = 0, c;
+        unsigned int shift = (unsigned int)pass * 8, b;
+
+        /* All the same byte, nothing to do */
+        if (count[(elt_key(src + key_offset, key_size, flip) >> shift)
+                  & 0xff] == n) {
+            continue;
+        }
+
+        for (b = 0; b < 256; b++) {
+            c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for (i = 0; i < n; i++) {
+            const char *elt = src + i * size;
+            b = (unsigned int)(elt_key(elt + key_offset, key_size, flip)
+                               >> shift) & 0xff;
+            memcpy(dst + count[b]++ * size, elt, size);
+        }
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != arr->elts) {
+        memcpy(arr->elts, src, n * size);
+        free(src);
+    }
+    else {
+        free(dst);
+    }
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void *) apr_array_bsearch(const apr_array_header_t *arr,
+                                      const void *key,
+                                      apr_array_compare_fn_t *cmp,
+                                      int *index)
+{
+    int lo = 0, hi = arr->nelts;
+
+    /* The first element not less than the key */
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (cmp(arr->elts + mid * arr->elt_size, key) < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    if (index) {
+        *index = lo;
+    }
+    if (lo < arr->nelts && cmp(arr->elts + lo * arr->elt_size, key) == 0) {
+        return arr->elts + lo * arr->elt_size;
+    }
+    return NULL;
+}
+
+APR_DECLARE(void) apr_array_sort_unique(apr_array_header_t *arr,
+                                        apr_array_compare_fn_t *cmp)
+{
+    apr_size_t size = arr->elt_size;
+    char *last, *elt, *end;
+
+    apr_array_sort(arr, cmp);
+    if (arr->nelts < 2) {
+        return;
+    }
+
+    last = arr->elts;
+    end = arr->elts + arr->nelts * size;
+    for (elt = last + size; elt < end; elt += size) {
+        if (cmp(last, elt) != 0) {
+            last += size;
+            if (last != elt) {
+                memcpy(last, elt, size);
+            }
+        }
+    }
+    arr->nelts = (int)((last - arr->elts) / size) + 1;
+}
+
+
 /*****************************************************************
  *
  * The "table" functions.
@@ -299,6 +652,18 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
 #define TABLE_INDEX_IS_INITIALIZED(t, i) ((t)->index_initialized & (1 << (i)))
 #define TABLE_SET_INDEX_INITIALIZED(t, i) ((t)->index_initialized |= (1 << (i)))
 
+/* Tables smaller than this are searched with the index above only */
+#define TABLE_HINDEX_MIN_NELTS 32
+
+/* apr_table_compress() finds the duplicate keys of tables smaller than
+ * this by sorting them, and of larger ones with a temporary hash table.
+ * Build with -DTABLE_COMPRESS_HASH_MIN=2 (or a huge value) to time one
+ * method against the other with test/testtableperf.
+ */
+#ifndef TABLE_COMPRESS_HASH_MIN
+#define TABLE_COMPRESS_HASH_MIN 16
+#endif
+
 /* Compute the "checksum" for a key, consisting of the first
  * 4 bytes, normalized for case-insensitivity and packed into
  * an int...this checksum allows us to do a single integer
@@ -355,6 +720,26 @@ struct apr_table_t {
     apr_uint32_t index_initialized;
     int index_first[TABLE_HASH_SIZE];
     int index_last[TABLE_HASH_SIZE];
+    /* Since the index above only looks at the first character of the
+     * keys, many keys sharing it ("X-...", "Sec-...") make lookups
+     * linear.  So once the table holds TABLE_HINDEX_MIN_NELTS entries,
+     * a second index hashing the whole key (case-insensitively) is
+     * maintained alongside:
+     *   - hindex_bucket[h & (hindex_nbuckets - 1)] is the offset of the
+     *     first entry whose key hashes to h, or -1 if there is none,
+     *     and hindex_tail[] the offset of the last one
+     *   - hindex_next[i] is the offset of the next entry after i in
+     *     the same bucket, or -1, so that the chains are in table order
+     * The index has room for hindex_nalloc entries and is only used
+     * when hindex_live is set; it is rebuilt (in place when possible)
+     * by table_reindex() and whenever the table outgrows it.
+     */
+    int *hindex_bucket;
+    int *hindex_tail;
+    int *hindex_next;
+    int hindex_nbuckets;
+    int hindex_nalloc;
+    int hindex_live;
 };
 
 /* keep state for apr_table_getm() */
@@ -387,6 +772,131 @@ static apr_table_entry_t *do_table_push(const char *func, apr_table_t *t)
 #define table_push(t)	((apr_table_entry_t *) apr_array_push_noclear(&(t)->a))
 #endif /* MAKE_TABLE_PROFILE */
 
+static APR_INLINE apr_uint32_t table_hindex_hash(const char *key)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    apr_uint32_t hash = 2166136261U;
+
+    /* FNV-1a on the lowercased key */
+    while (*k) {
+        hash ^= (apr_uint32_t)apr_tolower(*k++);
+        hash *= 16777619U;
+    }
+    return hash ^ (hash >> 16);
+}
+
+static APR_INLINE void table_hindex_insert(apr_table_t *t, int i,
+                                           const char *key)
+{
+    int b = (int)(table_hindex_hash(key) & (t->hindex_nbuckets - 1));
+
+    t->hindex_next[i] = -1;
+    if (t->hindex_bucket[b] < 0) {
+        t->hindex_bucket[b] = i;
+    }
+    else {
+        t->hindex_next[t->hindex_tail[b]] = i;
+    }
+    t->hindex_tail[b] = i;
+}
+
+static void table_hindex_build(apr_table_t *t)
+{
+    apr_table_entry_t *elts = (apr_table_entry_t *)t->a.elts;
+    int i;
+
+    if (t->a.nelts < TABLE_HINDEX_MIN_NELTS) {
+        t->hindex_live = 0;
+        return;
+    }
+    if (t->hindex_nalloc < t->a.nalloc) {
+        int nbuckets = TABLE_HINDEX_MIN_NELTS;
+        while (nbuckets < t->a.nalloc) {
+            nbuckets <<= 1;
+        }
+        t->hindex_bucket = apr_palloc(t->a.pool, (2 * nbuckets + t->a.nalloc)
+                                                 * sizeof(int));
+        t->hindex_tail = t->hindex_bucket + nbuckets;
+        t->hindex_next = t->hindex_tail + nbuckets;
+        t->hindex_nbuckets = nbuckets;
+        t->hindex_nalloc = t->a.nalloc;
+    }
+    memset(t->hindex_bucket, 0xff, t->hindex_nbuckets * sizeof(int));
+    for (i = 0; i < t->a.nelts; i++) {
+        table_hindex_insert(t, i, elts[i].key);
+    }
+    t->hindex_live = 1;
+}
+
+/* Account for the entry just pushed with the given key */
+static APR_INLINE void table_hindex_push(apr_table_t *t, const char *key)
+{
+    if (t->hindex_live && t->a.nelts <= t->hindex_nalloc) {
+        table_hindex_insert(t, t->a.nelts - 1, key);
+    }
+    else if (t->a.nelts >= TABLE_HINDEX_MIN_NELTS) {
+        table_hindex_build(t);
+    }
+}
+
+/* Find where to start looking for key among the entries sharing its
+ * TABLE_HASH(): the first of them without the whole key index, else the
+ * first actual match, or one past the last of them if there is none.
+ */
+static APR_INLINE apr_table_entry_t *table_first(const apr_table_t *t,
+                                                 const char *key,
+                                                 apr_uint32_t checksum,
+                                                 int hash)
+{
+    apr_table_entry_t *elts = (apr_table_entry_t *)t->a.elts;
+    int i;
+
+    if (!t->hindex_live) {
+        return elts + t->index_first[hash];
+    }
+    i = t->hindex_bucket[table_hindex_hash(key) & (t->hindex_nbuckets - 1)];
+    for (; i >= 0; i = t->hindex_next[i]) {
+        if ((checksum == elts[i].key_checksum) &&
+            !strcasecmp(elts[i].key, key)) {
+            return elts + i;
+        }
+    }
+    return elts + t->index_last[hash] + 1;
+}
+
+/* Offset of the next entry to look at after the one at i, following
+ * the whole key index if any (the result may exceed index_last).
+ */
+static APR_INLINE int table_next(const apr_table_t *t, int i)
+{
+    if (!t->hindex_live) {
+        return i + 1;
+    }
+    return (t->hindex_next[i] >= 0) ? t->hindex_next[i] : t->a.nelts;
+}
+
+/* Whether other entries than elt (the first one matching key) may match
+ * key too, as far as the whole key index can tell.
+ */
+static APR_INLINE int table_has_dups(const apr_table_t *t,
+                                     const apr_table_entry_t *elt,
+                                     const char *key, apr_uint32_t checksum)
+{
+    apr_table_entry_t *elts = (apr_table_entry_t *)t->a.elts;
+    int i;
+
+    if (!t->hindex_live) {
+        return 1;
+    }
+    for (i = t->hindex_next[elt - elts]; i >= 0; i = t->hindex_next[i]) {
+        if ((checksum == elts[i].key_checksum) &&
+            !strcasecmp(elts[i].key, key)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 APR_DECLARE(const apr_array_header_t *) apr_table_elts(const apr_table_t *t)
 {
     return (const apr_array_header_t *)t;
@@ -406,6 +916,9 @@ APR_DECLARE(apr_table_t *) apr_table_make(apr_pool_t *p, int nelts)
     t->creator = __builtin_return_address(0);
 #endif
     t->index_initialized = 0;
+    t->hindex_bucket = NULL;
+    t->hindex_nalloc = 0;
+    t->hindex_live = 0;
     return t;
 }
 
@@ -428,6 +941,9 @@ APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p, const apr_table_t *t)
     memcpy(new->index_first, t->index_first, sizeof(int) * TABLE_HASH_SIZE);
     memcpy(new->index_last, t->index_last, sizeof(int) * TABLE_HASH_SIZE);
     new->index_initialized = t->index_initialized;
+    new->hindex_bucket = NULL;
+    new->hindex_nalloc = 0;
+    table_hindex_build(new);
     return new;
 }
 
@@ -460,12 +976,14 @@ static void table_reindex(apr_table_t *t)
             TABLE_SET_INDEX_INITIALIZED(t, hash);
         }
     }
+    table_hindex_build(t);
 }
 
 APR_DECLARE(void) apr_table_clear(apr_table_t *t)
 {
     t->a.nelts = 0;
     t->index_initialized = 0;
+    t->hindex_live = 0;
 }
 
 APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
@@ -484,7 +1002,7 @@ APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
         return NULL;
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
+    next_elt = table_first(t, key, checksum, hash);
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
 
     for (; next_elt <= end_elt; next_elt++) {
@@ -513,7 +1031,7 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
+    next_elt = table_first(t, key, checksum, hash);
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
@@ -529,6 +1047,9 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
             next_elt->val = apr_pstrdup(t->a.pool, val);
 
             /* Remove any other instances of this key */
+            if (!table_has_dups(t, next_elt, key, checksum)) {
+                return;
+            }
             for (next_elt++; next_elt <= end_elt; next_elt++) {
                 if ((checksum == next_elt->key_checksum) &&
                     !strcasecmp(next_elt->key, key)) {
@@ -567,6 +1088,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_hindex_push(t, next_elt->key);
 }
 
 APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
@@ -585,7 +1107,7 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
+    next_elt = table_first(t, key, checksum, hash);
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
@@ -601,6 +1123,9 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
             next_elt->val = (char *)val;
 
             /* Remove any other instances of this key */
+            if (!table_has_dups(t, next_elt, key, checksum)) {
+                return;
+            }
             for (next_elt++; next_elt <= end_elt; next_elt++) {
                 if ((checksum == next_elt->key_checksum) &&
                     !strcasecmp(next_elt->key, key)) {
@@ -639,6 +1164,7 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_hindex_push(t, key);
 }
 
 APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
@@ -655,7 +1181,7 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
         return;
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
+    next_elt = table_first(t, key, checksum, hash);
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
     must_reindex = 0;
     for (; next_elt <= end_elt; next_elt++) {
@@ -710,7 +1236,7 @@ APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
+    next_elt = table_first(t, key, checksum, hash);
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
 
     for (; next_elt <= end_elt; next_elt++) {
@@ -730,6 +1256,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_hindex_push(t, next_elt->key);
 }
 
 APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
@@ -765,7 +1292,7 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
+    next_elt = table_first(t, key, checksum, hash);
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
 
     for (; next_elt <= end_elt; next_elt++) {
@@ -785,6 +1312,7 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_hindex_push(t, key);
 }
 
 APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
@@ -805,6 +1333,7 @@ APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
     elts->key = apr_pstrdup(t->a.pool, key);
     elts->val = apr_pstrdup(t->a.pool, val);
     elts->key_checksum = checksum;
+    table_hindex_push(t, elts->key);
 }
 
 APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
@@ -838,6 +1367,7 @@ APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
     elts->key = (char *)key;
     elts->val = (char *)val;
     elts->key_checksum = checksum;
+    table_hindex_push(t, key);
 }
 
 APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
@@ -868,6 +1398,8 @@ APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
     res->a.pool = p;
     copy_array_hdr_core(&res->a, &overlay->a);
     apr_array_cat(&res->a, &base->a);
+    res->hindex_bucket = NULL;
+    res->hindex_nalloc = 0;
     table_reindex(res);
     return res;
 }
@@ -974,8 +1506,9 @@ APR_DECLARE(int) apr_table_vdo(apr_table_do_callback_fn_t *comp,
             if (TABLE_INDEX_IS_INITIALIZED(t, hash)) {
                 apr_uint32_t checksum;
                 COMPUTE_KEY_CHECKSUM(argp, checksum);
-                for (i = t->index_first[hash];
-                     rv && (i <= t->index_last[hash]); ++i) {
+                for (i = (int)(table_first(t, argp, checksum, hash) - elts);
+                     rv && (i <= t->index_last[hash]);
+                     i = table_next(t, i)) {
                     if (elts[i].key && (checksum == elts[i].key_checksum) &&
                                         !strcasecmp(elts[i].key, argp)) {
                         rv = (*comp) (rec, elts[i].key, elts[i].val);
@@ -1093,6 +1626,129 @@ static apr_table_entry_t **table_mergesort(apr_pool_t *pool,
     return values;
 }
 
+/* Remove the entries whose key was set to NULL by the compress functions */
+static void table_squeeze(apr_table_t *t)
+{
+    apr_table_entry_t *src = (apr_table_entry_t *)t->a.elts;
+    apr_table_entry_t *dst = (apr_table_entry_t *)t->a.elts;
+    apr_table_entry_t *last_elt = src + t->a.nelts;
+
+    do {
+        if (src->key) {
+            *dst++ = *src;
+        }
+    } while (++src < last_elt);
+    t->a.nelts -= (int)(last_elt - dst);
+}
+
+/* Set the value of the first entry of a run of duplicates (elts[i],
+ * elts[next[i]], ...) to all their values, in table order, separated
+ * by ", ".
+ */
+static void table_merge_dups(apr_table_t *t, int i, const int *next)
+{
+    apr_table_entry_t *elts = (apr_table_entry_t *)t->a.elts;
+    apr_size_t len = 0;
+    char *new_val;
+    char *val_dst;
+    int j;
+
+    for (j = i; j >= 0; j = next[j]) {
+        len += strlen(elts[j].val);
+        len += 2; /* for ", " or trailing null */
+    }
+    new_val = (char *)apr_palloc(t->a.pool, len);
+    val_dst = new_val;
+    for (j = i; j >= 0; j = next[j]) {
+        if (j != i) {
+            *val_dst++ = ',';
+            *val_dst++ = ' ';
+        }
+        len = strlen(elts[j].val);
+        memcpy(val_dst, elts[j].val, len);
+        val_dst += len;
+    }
+    *val_dst = 0;
+    elts[i].val = new_val;
+}
+
+/* Linear time apr_table_compress(), finding the duplicates with an open
+ * addressing hash table of the entries' offsets (plus one, zero meaning
+ * an empty slot).
+ */
+static void table_compress_hash(apr_table_t *t, unsigned flags)
+{
+    apr_table_entry_t *elts = (apr_table_entry_t *)t->a.elts;
+    int nelts = t->a.nelts;
+    int nslots = 16;
+    int *slots;
+    int *next;
+    int *tail;
+    int i;
+    int dups_found = 0;
+
+    while (nslots < 2 * nelts) {
+        nslots <<= 1;
+    }
+    slots = (int *)apr_pcalloc(t->a.pool, nslots * sizeof(int));
+    next = (int *)apr_palloc(t->a.pool, 2 * nelts * sizeof(int));
+    tail = next + nelts;
+
+    for (i = 0; i < nelts; i++) {
+        apr_uint32_t h = table_hindex_hash(elts[i].key);
+        int first;
+
+        next[i] = -1;
+        for (;;) {
+            h &= nslots - 1;
+            first = slots[h] - 1;
+            if (first < 0) {
+                slots[h] = i + 1;
+                tail[i] = i;
+                break;
+            }
+            if ((elts[i].key_checksum == elts[first].key_checksum) &&
+                !strcasecmp(elts[i].key, elts[first].key)) {
+                /* A duplicate: chain it to the first one */
+                next[tail[first]] = i;
+                tail[first] = i;
+                dups_found = 1;
+                break;
+            }
+            h++;
+        }
+    }
+    if (!dups_found) {
+        /* The first character index is fine, only restore the other one
+         * in case apr_table_overlap() appended entries.
+         */
+        if (!t->hindex_live) {
+            table_hindex_build(t);
+        }
+        return;
+    }
+
+    for (i = 0; i < nelts; i++) {
+        int j;
+
+        if (!elts[i].key || next[i] < 0) {
+            continue;
+        }
+        if (flags == APR_OVERLAP_TABLES_MERGE) {
+            table_merge_dups(t, i, next);
+        }
+        else { /* overwrite */
+            elts[i].val = elts[tail[i]].val;
+        }
+        for (j = next[i]; j >= 0; j = next[j]) {
+            elts[j].key = NULL;
+        }
+    }
+
+    table_squeeze(t);
+    table_reindex(t);
+}
+
 APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
 {
     apr_table_entry_t **sort_array;
@@ -1106,6 +1762,10 @@ APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
     if (t->a.nelts <= 1) {
         return;
     }
+    if (t->a.nelts >= TABLE_COMPRESS_HASH_MIN) {
+        table_compress_hash(t, flags);
+        return;
+    }
 
     /* Copy pointers to all the table elements into an
      * array and sort to allow for easy detection of
@@ -1186,15 +1846,7 @@ APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
 
     /* Shift elements to the left to fill holes left by removing duplicates */
     if (dups_found) {
-        apr_table_entry_t *src = (apr_table_entry_t *)t->a.elts;
-        apr_table_entry_t *dst = (apr_table_entry_t *)t->a.elts;
-        apr_table_entry_t *last_elt = src + t->a.nelts;
-        do {
-            if (src->key) {
-                *dst++ = *src;
-            }
-        } while (++src < last_elt);
-        t->a.nelts -= (int)(last_elt - dst);
+        table_squeeze(t);
     }
 
     table_reindex(t);
@@ -1206,6 +1858,7 @@ static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
     register int idx;
 
     apr_array_cat(&t->a,&s->a);
+    t->hindex_live = 0;
 
     if (n == 0) {
         memcpy(t->index_first,s->index_first,sizeof(int) * TABLE_HASH_SIZE);
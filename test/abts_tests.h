@@ -88,7 +88,13 @@ const struct testlist {
     {testqueue},
     {testreslist},
     {testlfsabi},
-    {testskiplist}
+    {testskiplist},
+    {testslab},
+    {testohash},
+    {testchash},
+    {testbtree},
+    {testtimerwheel},
+    {testbloom}
 };
 
 #endif /* APR_TEST_INCLUDES */
@@ -0,0 +1,238 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_shm.h"
+#include "apr_thread_proc.h"
+#include "apr_bloom.h"
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#define BLOOM_N 10000
+
+/* BLOOM_N keys added, BLOOM_N others never */
+static const char **make_keys(apr_pool_t *pool, const char *prefix)
+{
+    const char **keys = apr_palloc(pool, 2 * BLOOM_N * sizeof(char *));
+    int i;
+
+    for (i = 0; i < 2 * BLOOM_N; i++) {
+        keys[i] = apr_psprintf(pool, "%s%d", prefix, i);
+    }
+    return keys;
+}
+
+static void bloom_size(abts_case *tc, void *data)
+{
+    apr_bloom_t *bloom;
+    apr_size_t size;
+
+    ABTS_INT_EQUAL(tc, 0, (int)apr_bloom_size(100, 0.0));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_bloom_size(100, 1.0));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_bloom_size(100, -0.5));
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_bloom_create(&bloom, 100, 2.0, p));
+    ABTS_PTR_EQUAL(tc, NULL, bloom);
+
+    /* About 9.6 bits per key for 1% */
+    size = apr_bloom_size(BLOOM_N, 0.01);
+    ABTS_TRUE(tc, size > BLOOM_N * 9.5 / 8 && size < BLOOM_N * 9.7 / 8);
+
+    /* Smaller rates take more bits */
+    ABTS_TRUE(tc, apr_bloom_size(BLOOM_N, 0.001) > size);
+    ABTS_TRUE(tc, apr_bloom_size(1, 0.5) > 0);
+}
+
+static void bloom_basic(abts_case *tc, void *data)
+{
+    apr_bloom_t *bloom;
+    const char **keys = make_keys(p, "key");
+    int i, added, missing, fp;
+    double rate;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_bloom_create(&bloom, BLOOM_N, 0.01, p));
+    ABTS_PTR_EQUAL(tc, p, apr_bloom_pool_get(bloom));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_bloom_count(bloom));
+    ABTS_INT_EQUAL(tc, 0, apr_bloom_check(bloom, "key0",
+                                          APR_HASH_KEY_STRING));
+
+    for (i = 0, added = 0; i < BLOOM_N; i++) {
+        added += apr_bloom_add(bloom, keys[i], APR_HASH_KEY_STRING) != 0;
+    }
+    ABTS_TRUE(tc, added > BLOOM_N * 98 / 100);
+    ABTS_INT_EQUAL(tc, added, (int)apr_bloom_count(bloom));
+
+    /* Added already */
+    ABTS_INT_EQUAL(tc, 0, apr_bloom_add(bloom, keys[0], APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, added, (int)apr_bloom_count(bloom));
+
+    /* No false negative, about 1% false positives */
+    for (i = 0, missing = 0; i < BLOOM_N; i++) {
+        missing += !apr_bloom_check(bloom, keys[i], strlen(keys[i]));
+    }
+    ABTS_INT_EQUAL(tc, 0, missing);
+    for (fp = 0; i < 2 * BLOOM_N; i++) {
+        fp += apr_bloom_check(bloom, keys[i], APR_HASH_KEY_STRING) != 0;
+    }
+    ABTS_TRUE(tc, fp < BLOOM_N * 2 / 100);
+    rate = apr_bloom_fp_rate(bloom);
+    ABTS_TRUE(tc, rate > 0.005 && rate < 0.015);
+
+    apr_bloom_clear(bloom);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_bloom_count(bloom));
+    for (i = 0, fp = 0; i < BLOOM_N; i++) {
+        fp += apr_bloom_check(bloom, keys[i], APR_HASH_KEY_STRING) != 0;
+    }
+    ABTS_INT_EQUAL(tc, 0, fp);
+}
+
+static void bloom_batch(abts_case *tc, void *data)
+{
+    apr_bloom_t *bloom;
+    const char **keys = make_keys(p, "batch");
+    apr_uint32_t *ints = apr_palloc(p, 2 * BLOOM_N * sizeof(apr_uint32_t));
+    const void **ikeys = apr_palloc(p, 2 * BLOOM_N * sizeof(void *));
+    apr_ssize_t *klens = apr_palloc(p, 2 * BLOOM_N * sizeof(apr_ssize_t));
+    char *found = apr_palloc(p, 2 * BLOOM_N);
+    apr_size_t n;
+    int i, ok;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_bloom_create(&bloom, BLOOM_N, 0.01, p));
+
+    /* Strings, in batches of odd sizes */
+    for (i = 0; i < BLOOM_N; i += 999) {
+        apr_bloom_add_batch(bloom, (const void *const *)keys + i, NULL,
+                            (i + 999 < BLOOM_N) ? 999 : BLOOM_N - i);
+    }
+    n = apr_bloom_check_batch(bloom, (const void *const *)keys, NULL,
+                              2 * BLOOM_N, found);
+    for (i = 0, ok = 1; i < 2 * BLOOM_N; i++) {
+        ok &= ((found[i] != 0)
+               == apr_bloom_check(bloom, keys[i], APR_HASH_KEY_STRING));
+        if (i < BLOOM_N) {
+            ok &= (found[i] != 0);
+        }
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_TRUE(tc, n >= BLOOM_N && n < BLOOM_N + BLOOM_N * 2 / 100);
+
+    /* Binary keys, with zeros */
+    apr_bloom_clear(bloom);
+    for (i = 0; i < 2 * BLOOM_N; i++) {
+        ints[i] = (apr_uint32_t)i << 8;
+        ikeys[i] = &ints[i];
+        klens[i] = sizeof(apr_uint32_t);
+    }
+    apr_bloom_add_batch(bloom, ikeys, klens, BLOOM_N);
+    n = apr_bloom_check_batch(bloom, ikeys, klens, 2 * BLOOM_N, found);
+    for (i = 0, ok = 1; i < BLOOM_N; i++) {
+        ok &= (found[i] != 0);
+        ok &= apr_bloom_check(bloom, &ints[i], sizeof(apr_uint32_t));
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_TRUE(tc, n >= BLOOM_N && n < BLOOM_N + BLOOM_N * 2 / 100);
+}
+
+static void bloom_memory(abts_case *tc, void *data)
+{
+    apr_bloom_t *bloom, *other;
+    apr_size_t size = apr_bloom_size(1000, 0.01);
+    void *mem = apr_palloc(p, size);
+    void *junk = apr_pcalloc(p, size);
+
+    ABTS_INT_EQUAL(tc, APR_ENOSPC,
+                   apr_bloom_make(&bloom, mem, size - 1, 1000, 0.01, p));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_bloom_make(&bloom, mem, size, 1000, 0.01, p));
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_bloom_attach(&other, junk, p));
+
+    /* Both handles see the same filter */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_bloom_attach(&other, mem, p));
+    apr_bloom_add(bloom, "one", APR_HASH_KEY_STRING);
+    apr_bloom_add(other, "two", APR_HASH_KEY_STRING);
+    ABTS_TRUE(tc, apr_bloom_check(other, "one", APR_HASH_KEY_STRING));
+    ABTS_TRUE(tc, apr_bloom_check(bloom, "two", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 2, (int)apr_bloom_count(bloom));
+}
+
+#if APR_HAS_SHARED_MEMORY && APR_HAS_FORK
+static void bloom_shm(abts_case *tc, void *data)
+{
+    apr_bloom_t *bloom;
+    apr_shm_t *shm;
+    apr_proc_t proc;
+    apr_status_t rv;
+    const char **keys = make_keys(p, "shm");
+    int i, missing, exitcode;
+    apr_exit_why_e why;
+
+    rv = apr_shm_create(&shm, apr_bloom_size(BLOOM_N, 0.01), NULL, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Anonymous shared memory");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "Error allocating shared memory block", rv);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_bloom_make(&bloom, apr_shm_baseaddr_get(shm),
+                                  apr_shm_size_get(shm), BLOOM_N, 0.01, p));
+
+    /* The child adds the keys, the parent finds them */
+    rv = apr_proc_fork(&proc, p);
+    if (rv == APR_INCHILD) {
+        apr_bloom_t *child;
+
+        if (apr_bloom_attach(&child, apr_shm_baseaddr_get(shm), p)) {
+            exit(1);
+        }
+        apr_bloom_add_batch(child, (const void *const *)keys, NULL, BLOOM_N);
+        exit(0);
+    }
+    ABTS_INT_EQUAL(tc, APR_INPARENT, rv);
+    apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
+    ABTS_INT_EQUAL(tc, APR_PROC_EXIT, why);
+    ABTS_INT_EQUAL(tc, 0, exitcode);
+
+    for (i = 0, missing = 0; i < BLOOM_N; i++) {
+        missing += !apr_bloom_check(bloom, keys[i], APR_HASH_KEY_STRING);
+    }
+    ABTS_INT_EQUAL(tc, 0, missing);
+    ABTS_TRUE(tc, apr_bloom_count(bloom) > BLOOM_N * 98 / 100);
+
+    apr_shm_destroy(shm);
+}
+#endif
+
+abts_suite *testbloom(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, bloom_size, NULL);
+    abts_run_test(suite, bloom_basic, NULL);
+    abts_run_test(suite, bloom_batch, NULL);
+    abts_run_test(suite, bloom_memory, NULL);
+#if APR_HAS_SHARED_MEMORY && APR_HAS_FORK
+    abts_run_test(suite, bloom_shm, NULL);
+#endif
+
+    return suite;
+}
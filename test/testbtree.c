@@ -0,0 +1,242 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_btree.h"
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#define BTREE_N 20000
+
+static int int_compare(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int str_compare(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+/* Check that iterating yields the elements marked in present, in order */
+static void check_contents(abts_case *tc, apr_btree_t *bt,
+                           const char *present)
+{
+    apr_btree_index_t *bi;
+    int i = 0, n = 0, ok = 1;
+
+    for (bi = apr_btree_first(NULL, bt); bi; bi = apr_btree_next(bi)) {
+        int v = *(int *)apr_btree_this(bi);
+
+        while (i < BTREE_N && !present[i]) {
+            i++;
+        }
+        ok &= (v == i);
+        i++;
+        n++;
+    }
+    while (i < BTREE_N && !present[i]) {
+        i++;
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_INT_EQUAL(tc, BTREE_N, i);
+    ABTS_INT_EQUAL(tc, n, (int)apr_btree_count(bt));
+
+    for (i = 0, ok = 1; i < BTREE_N; i++) {
+        int *v = apr_btree_find(bt, &i);
+        ok &= present[i] ? (v && *v == i) : (v == NULL);
+    }
+    ABTS_TRUE(tc, ok);
+}
+
+static void btree_basic(abts_case *tc, void *data)
+{
+    apr_btree_t *bt;
+    apr_btree_index_t *bi;
+    char *dup = apr_pstrdup(p, "baton");
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_btree_create(&bt, str_compare, p));
+    ABTS_PTR_EQUAL(tc, p, apr_btree_pool_get(bt));
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_first(NULL, bt));
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_find(bt, "baton"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_pop_min(bt));
+
+    ABTS_STR_EQUAL(tc, "baton", apr_btree_insert(bt, "baton"));
+    ABTS_STR_EQUAL(tc, "apple", apr_btree_insert(bt, "apple"));
+    ABTS_STR_EQUAL(tc, "cherry", apr_btree_insert(bt, "cherry"));
+    ABTS_INT_EQUAL(tc, 3, (int)apr_btree_count(bt));
+
+    /* An equal element is not inserted */
+    ABTS_TRUE(tc, apr_btree_insert(bt, dup) != dup);
+    ABTS_INT_EQUAL(tc, 3, (int)apr_btree_count(bt));
+
+    ABTS_STR_EQUAL(tc, "baton", apr_btree_find(bt, "baton"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_find(bt, "banana"));
+    ABTS_STR_EQUAL(tc, "baton", apr_btree_lower_bound(bt, "banana"));
+    ABTS_STR_EQUAL(tc, "apple", apr_btree_lower_bound(bt, ""));
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_lower_bound(bt, "date"));
+
+    bi = apr_btree_seek(p, bt, "b");
+    ABTS_PTR_NOTNULL(tc, bi);
+    ABTS_STR_EQUAL(tc, "baton", apr_btree_this(bi));
+    bi = apr_btree_next(bi);
+    ABTS_PTR_NOTNULL(tc, bi);
+    ABTS_STR_EQUAL(tc, "cherry", apr_btree_this(bi));
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_next(bi));
+
+    ABTS_STR_EQUAL(tc, "baton", apr_btree_remove(bt, "baton"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_remove(bt, "baton"));
+    ABTS_STR_EQUAL(tc, "apple", apr_btree_pop_min(bt));
+    ABTS_STR_EQUAL(tc, "cherry", apr_btree_pop_min(bt));
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_pop_min(bt));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_btree_count(bt));
+}
+
+static void btree_random(abts_case *tc, void *data)
+{
+    apr_btree_t *bt;
+    int *vals = apr_palloc(p, BTREE_N * sizeof(int));
+    char *present = apr_pcalloc(p, BTREE_N);
+    int i, ok;
+
+    srand(42);
+    for (i = 0; i < BTREE_N; i++) {
+        vals[i] = i;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_btree_create(&bt, int_compare, p));
+
+    /* Insert in random order, enough to make the tree a few levels deep */
+    for (i = 0, ok = 1; i < 2 * BTREE_N; i++) {
+        int k = rand() % BTREE_N;
+        int *v = apr_btree_insert(bt, &vals[k]);
+        ok &= (v == &vals[k]);
+        present[k] = 1;
+    }
+    ABTS_TRUE(tc, ok);
+    check_contents(tc, bt, present);
+
+    /* Remove and reinsert at random, the removals rebalancing the tree.
+     * The removed elements are clobbered, so that a lookup going by one
+     * still referenced in the tree would fail.
+     */
+    for (i = 0, ok = 1; i < 4 * BTREE_N; i++) {
+        int k = rand() % BTREE_N;
+
+        if (rand() % 3) {
+            int *v = apr_btree_remove(bt, &k);
+            ok &= present[k] ? (v == &vals[k]) : (v == NULL);
+            present[k] = 0;
+            vals[k] = -1;
+        }
+        else {
+            vals[k] = k;
+            apr_btree_insert(bt, &vals[k]);
+            present[k] = 1;
+        }
+    }
+    ABTS_TRUE(tc, ok);
+    check_contents(tc, bt, present);
+
+    /* Pop the least half */
+    for (i = 0, ok = 1; i < BTREE_N / 2; i++) {
+        if (present[i]) {
+            ok &= (apr_btree_pop_min(bt) == &vals[i]);
+            present[i] = 0;
+            vals[i] = -1;
+        }
+    }
+    ABTS_TRUE(tc, ok);
+    check_contents(tc, bt, present);
+
+    /* Remove the rest in order, from the greatest */
+    for (i = BTREE_N - 1, ok = 1; i >= 0; i--) {
+        if (present[i]) {
+            ok &= (apr_btree_remove(bt, &i) == &vals[i]);
+            present[i] = 0;
+        }
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_btree_count(bt));
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_first(NULL, bt));
+}
+
+static void btree_range(abts_case *tc, void *data)
+{
+    apr_btree_t *bt;
+    apr_btree_index_t *bi;
+    int *vals = apr_palloc(p, BTREE_N * sizeof(int));
+    int i, lo, hi, n, ok;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_btree_create(&bt, int_compare, p));
+
+    /* Even values only, in descending order */
+    for (i = BTREE_N - 1; i >= 0; i--) {
+        vals[i] = 2 * i;
+        apr_btree_insert(bt, &vals[i]);
+    }
+    ABTS_INT_EQUAL(tc, BTREE_N, (int)apr_btree_count(bt));
+
+    /* [lo, hi) */
+    lo = 1001;
+    hi = 3001;
+    for (bi = apr_btree_seek(NULL, bt, &lo), n = 0, ok = 1;
+         bi && *(int *)apr_btree_this(bi) < hi;
+         bi = apr_btree_next(bi)) {
+        ok &= (*(int *)apr_btree_this(bi) == 1002 + 2 * n);
+        n++;
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_INT_EQUAL(tc, 1000, n);
+
+    lo = 2 * BTREE_N - 2;
+    ABTS_PTR_NOTNULL(tc, apr_btree_seek(NULL, bt, &lo));
+    lo++;
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_seek(NULL, bt, &lo));
+
+    apr_btree_clear(bt);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_btree_count(bt));
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_first(NULL, bt));
+    lo = 2;
+    ABTS_PTR_EQUAL(tc, NULL, apr_btree_find(bt, &lo));
+
+    /* Still usable */
+    for (i = 0; i < BTREE_N; i++) {
+        apr_btree_insert(bt, &vals[i]);
+    }
+    ABTS_INT_EQUAL(tc, BTREE_N, (int)apr_btree_count(bt));
+    ABTS_PTR_EQUAL(tc, &vals[1], apr_btree_find(bt, &lo));
+}
+
+abts_suite *testbtree(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, btree_basic, NULL);
+    abts_run_test(suite, btree_random, NULL);
+    abts_run_test(suite, btree_range, NULL);
+
+    return suite;
+}
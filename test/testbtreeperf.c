@@ -0,0 +1,276 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares apr_btree_t and apr_skiplist as ordered containers of 64 bits
+ * integers (referenced, as both do): time per insertion in random order,
+ * successful and failed lookup, per element when iterating and when
+ * popping the least ones until empty, plus the memory used per element
+ * (as taken from the allocator, the elements aside).
+ */
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_btree.h"
+#include "apr_skiplist.h"
+#include "apr_time.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_MAX_COUNT 1000000
+#define MIN_COUNT 10000
+#define LOOKUP_STRIDE 7919
+
+typedef struct {
+    const char *name;
+    void *(*make)(apr_pool_t *p);
+    void (*insert)(void *c, void *elem);
+    void *(*find)(void *c, void *key);
+    long (*iterate)(void *c);
+    void *(*pop_min)(void *c);
+} container_ops_t;
+
+static int u64_compare(const void *a, const void *b)
+{
+    apr_uint64_t x = *(const apr_uint64_t *)a, y = *(const apr_uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int u64_skiplist_compare(void *a, void *b)
+{
+    return u64_compare(a, b);
+}
+
+static void *btree_make(apr_pool_t *p)
+{
+    apr_btree_t *bt;
+
+    if (apr_btree_create(&bt, u64_compare, p) != APR_SUCCESS) {
+        exit(-1);
+    }
+    return bt;
+}
+
+static void btree_insert(void *c, void *elem)
+{
+    apr_btree_insert(c, elem);
+}
+
+static void *btree_find(void *c, void *key)
+{
+    return apr_btree_find(c, key);
+}
+
+static long btree_iterate(void *c)
+{
+    apr_btree_index_t *bi;
+    long n = 0;
+
+    for (bi = apr_btree_first(NULL, c); bi; bi = apr_btree_next(bi)) {
+        n += apr_btree_this(bi) != NULL;
+    }
+    return n;
+}
+
+static void *btree_pop_min(void *c)
+{
+    return apr_btree_pop_min(c);
+}
+
+static void *skiplist_make(apr_pool_t *p)
+{
+    apr_skiplist *sl;
+
+    if (apr_skiplist_init(&sl, p) != APR_SUCCESS) {
+        exit(-1);
+    }
+    apr_skiplist_set_compare(sl, u64_skiplist_compare, u64_skiplist_compare);
+    return sl;
+}
+
+static void skiplist_insert(void *c, void *elem)
+{
+    apr_skiplist_insert(c, elem);
+}
+
+static void *skiplist_find(void *c, void *key)
+{
+    return apr_skiplist_find(c, key, NULL);
+}
+
+static long skiplist_iterate(void *c)
+{
+    apr_skiplistnode *node;
+    long n = 0;
+
+    for (node = apr_skiplist_getlist(c); node; apr_skiplist_next(c, &node)) {
+        n++;
+    }
+    return n;
+}
+
+static void *skiplist_pop_min(void *c)
+{
+    return apr_skiplist_pop(c, NULL);
+}
+
+static const container_ops_t containers[] = {
+    { "apr_btree", btree_make, btree_insert, btree_find, btree_iterate,
+      btree_pop_min },
+    { "apr_skiplist", skiplist_make, skiplist_insert, skiplist_find,
+      skiplist_iterate, skiplist_pop_min }
+};
+
+static long max_count = DEFAULT_MAX_COUNT;
+
+/* Bytes held by the pools of an allocator, or in its free lists */
+static apr_size_t held_bytes(apr_allocator_t *allocator)
+{
+    apr_allocator_stats_t stats;
+
+    apr_allocator_stats_get(allocator, &stats);
+    return (apr_size_t)(stats.fresh_bytes - stats.release_bytes)
+           - stats.free_bytes;
+}
+
+static double ns_per(apr_time_t start, long n)
+{
+    return (double)(apr_time_now() - start) * 1000.0 / n;
+}
+
+/* vals[0..n) are inserted, vals[n..2n) are looked up but missing; the
+ * values are scattered so the insertion order is random.
+ */
+static void bench(apr_pool_t *pool, const container_ops_t *ops,
+                  apr_uint64_t *vals, long n)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *p;
+    apr_size_t used;
+    apr_time_t start;
+    double insert, hit, miss, iterate, pop;
+    apr_uint64_t last = 0;
+    void *c;
+    long i, found = 0;
+    int ordered = 1;
+
+    apr_allocator_create(&allocator);
+    apr_pool_create_ex(&p, pool, NULL, allocator);
+    apr_allocator_owner_set(allocator, p);
+    used = held_bytes(allocator);
+
+    start = apr_time_now();
+    c = ops->make(p);
+    for (i = 0; i < n; i++) {
+        ops->insert(c, &vals[i]);
+    }
+    insert = ns_per(start, n);
+    used = held_bytes(allocator) - used;
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        found += ops->find(c, &vals[(i * LOOKUP_STRIDE) % n]) != NULL;
+    }
+    hit = ns_per(start, n);
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        found += ops->find(c, &vals[n + (i * LOOKUP_STRIDE) % n]) == NULL;
+    }
+    miss = ns_per(start, n);
+
+    start = apr_time_now();
+    found += ops->iterate(c);
+    iterate = ns_per(start, n);
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        apr_uint64_t *v = ops->pop_min(c);
+
+        ordered &= (v && *v >= last);
+        last = v ? *v : last;
+    }
+    pop = ns_per(start, n);
+
+    if (found != 3 * n || !ordered || ops->pop_min(c)) {
+        fprintf(stderr, "%s: inconsistent results (%ld found out of %ld)\n",
+                ops->name, found, 3 * n);
+        exit(-1);
+    }
+
+    printf("    %-12s %9ld %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", ops->name,
+           n, insert, hit, miss, iterate, pop, (double)used / n);
+    fflush(stdout);
+
+    apr_pool_destroy(p);
+}
+
+int main(int argc, const char *const *argv)
+{
+    apr_pool_t *pool;
+    apr_getopt_t *opt;
+    apr_status_t rv;
+    const char *optarg;
+    char optchar;
+    apr_uint64_t *vals;
+    unsigned int m;
+    long i, n;
+
+    printf("APR B+tree Performance Test\n===========================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS) {
+        exit(-1);
+    }
+
+    if (apr_getopt_init(&opt, pool, argc, argv) != APR_SUCCESS) {
+        exit(-1);
+    }
+    while ((rv = apr_getopt(opt, "n:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            max_count = atol(optarg);
+        }
+    }
+    if ((rv != APR_SUCCESS && rv != APR_EOF) || max_count < MIN_COUNT) {
+        fprintf(stderr, "Usage: %s [-n max elements, at least %d]\n",
+                argv[0], MIN_COUNT);
+        exit(-1);
+    }
+
+    /* Distinct since the multiplier is odd */
+    vals = apr_palloc(pool, 2 * max_count * sizeof(apr_uint64_t));
+    for (i = 0; i < 2 * max_count; i++) {
+        vals[i] = (apr_uint64_t)i * APR_UINT64_C(0x9e3779b97f4a7c15);
+    }
+
+    printf("64 bits keys (ns per operation, bytes per element)\n");
+    printf("    %-12s %9s %8s %8s %8s %8s %8s %8s\n",
+           "container", "elements", "insert", "hit", "miss", "iterate",
+           "pop-min", "memory");
+    for (n = MIN_COUNT; n <= max_count; n *= 10) {
+        for (m = 0; m < sizeof(containers) / sizeof(containers[0]); m++) {
+            bench(pool, &containers[m], vals, n);
+        }
+    }
+
+    apr_pool_destroy(pool);
+    return 0;
+}
@@ -0,0 +1,311 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_chash.h"
+#include "apr_thread_proc.h"
+
+#define NKEYS 10000
+
+static void chash_set_get(abts_case *tc, void *data)
+{
+    apr_chash_t *h;
+    void *old;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_chash_create(&h, 0, NULL, p));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(h, "key", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 0, apr_chash_count(h));
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_chash_set(h, "key", APR_HASH_KEY_STRING, "value",
+                                 &old));
+    ABTS_PTR_EQUAL(tc, NULL, old);
+    ABTS_STR_EQUAL(tc, "value", apr_chash_get(h, "key", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "value", apr_chash_get(h, "key", 3));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(h, "ke", APR_HASH_KEY_STRING));
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_chash_set(h, "key", APR_HASH_KEY_STRING, "new", &old));
+    ABTS_STR_EQUAL(tc, "value", old);
+    ABTS_STR_EQUAL(tc, "new", apr_chash_get(h, "key", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 1, apr_chash_count(h));
+
+    ABTS_STR_EQUAL(tc, "new", apr_chash_remove(h, "key", APR_HASH_KEY_STRING));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_remove(h, "key", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 0, apr_chash_count(h));
+
+    apr_chash_set(h, "key", APR_HASH_KEY_STRING, "again", NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_chash_set(h, "key", APR_HASH_KEY_STRING, NULL, &old));
+    ABTS_STR_EQUAL(tc, "again", old);
+    ABTS_INT_EQUAL(tc, 0, apr_chash_count(h));
+    ABTS_PTR_EQUAL(tc, p, apr_chash_pool_get(h));
+
+    apr_chash_destroy(h);
+}
+
+static int count_do(void *rec, const void *key, apr_ssize_t klen,
+                    const void *value)
+{
+    int *count = rec;
+
+    (*count)++;
+    return *count < 10;
+}
+
+static void chash_many(abts_case *tc, void *data)
+{
+    apr_chash_t *h;
+    char **keys;
+    int i, count;
+
+    /* A single stripe, growing */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_chash_create(&h, 1, NULL, p));
+    keys = apr_palloc(p, NKEYS * sizeof(char *));
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = apr_psprintf(p, "key%d", i);
+        apr_chash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i], NULL);
+    }
+    ABTS_INT_EQUAL(tc, NKEYS, apr_chash_count(h));
+    for (i = 0; i < NKEYS; i++) {
+        ABTS_PTR_EQUAL(tc, keys[i],
+                       apr_chash_get(h, keys[i], APR_HASH_KEY_STRING));
+    }
+    for (i = 0; i < NKEYS; i += 2) {
+        ABTS_PTR_EQUAL(tc, keys[i],
+                       apr_chash_remove(h, keys[i], APR_HASH_KEY_STRING));
+    }
+    ABTS_INT_EQUAL(tc, NKEYS / 2, apr_chash_count(h));
+    for (i = 0; i < NKEYS; i++) {
+        ABTS_PTR_EQUAL(tc, (i % 2) ? keys[i] : NULL,
+                       apr_chash_get(h, keys[i], APR_HASH_KEY_STRING));
+    }
+
+    count = 0;
+    ABTS_INT_EQUAL(tc, 0, apr_chash_do(count_do, &count, h));
+    ABTS_INT_EQUAL(tc, 10, count);
+
+    apr_chash_clear(h);
+    ABTS_INT_EQUAL(tc, 0, apr_chash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(h, keys[1], APR_HASH_KEY_STRING));
+    count = 0;
+    ABTS_INT_EQUAL(tc, 1, apr_chash_do(count_do, &count, h));
+    ABTS_INT_EQUAL(tc, 0, count);
+
+    apr_chash_destroy(h);
+}
+
+static unsigned int hash_bad(const char *key, apr_ssize_t *klen)
+{
+    if (*klen == APR_HASH_KEY_STRING) {
+        *klen = strlen(key);
+    }
+    return (unsigned int)*klen;
+}
+
+static void chash_custom(abts_case *tc, void *data)
+{
+    apr_chash_t *h;
+    char *keys[200];
+    int i;
+
+    /* All the keys of a length collide, lookups must still work */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_chash_create(&h, 16, hash_bad, p));
+    for (i = 0; i < 200; i++) {
+        keys[i] = apr_psprintf(p, "%03d", i);
+        apr_chash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i], NULL);
+    }
+    for (i = 0; i < 200; i += 2) {
+        apr_chash_remove(h, keys[i], APR_HASH_KEY_STRING);
+    }
+    ABTS_INT_EQUAL(tc, 100, apr_chash_count(h));
+    for (i = 0; i < 200; i++) {
+        ABTS_PTR_EQUAL(tc, (i % 2) ? keys[i] : NULL,
+                       apr_chash_get(h, keys[i], APR_HASH_KEY_STRING));
+    }
+}
+
+typedef struct {
+    apr_pool_t *pool;
+    int made;
+} make_baton_t;
+
+static apr_status_t make_value(void *baton, const void **key,
+                               apr_ssize_t klen, void **val)
+{
+    make_baton_t *mb = baton;
+
+    if (strncmp(*key, "fail", klen) == 0)
+        return APR_EGENERAL;
+    if (strncmp(*key, "none", klen) == 0)
+        return APR_SUCCESS;
+    *key = apr_pstrmemdup(mb->pool, *key, klen);
+    *val = apr_psprintf(mb->pool, "made %d", ++mb->made);
+    return APR_SUCCESS;
+}
+
+static void chash_get_or_make(abts_case *tc, void *data)
+{
+    apr_chash_t *h;
+    make_baton_t mb;
+    char key[16];
+    void *val;
+
+    mb.pool = p;
+    mb.made = 0;
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_chash_create(&h, 4, NULL, p));
+
+    /* The key is a temporary, the made entry must use the copy */
+    strcpy(key, "key");
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_chash_get_or_make(h, key, APR_HASH_KEY_STRING,
+                                         make_value, &mb, &val));
+    ABTS_STR_EQUAL(tc, "made 1", val);
+    strcpy(key, "xxx");
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_chash_get_or_make(h, "key", APR_HASH_KEY_STRING,
+                                         make_value, &mb, &val));
+    ABTS_STR_EQUAL(tc, "made 1", val);
+    ABTS_INT_EQUAL(tc, 1, mb.made);
+
+    ABTS_INT_EQUAL(tc, APR_EGENERAL,
+                   apr_chash_get_or_make(h, "fail", APR_HASH_KEY_STRING,
+                                         make_value, &mb, &val));
+    ABTS_PTR_EQUAL(tc, NULL, val);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_chash_get_or_make(h, "none", APR_HASH_KEY_STRING,
+                                         make_value, &mb, &val));
+    ABTS_PTR_EQUAL(tc, NULL, val);
+    ABTS_INT_EQUAL(tc, 1, apr_chash_count(h));
+
+    apr_chash_destroy(h);
+}
+
+#if APR_HAS_THREADS
+
+#define CHASH_THREADS   4
+#define CHASH_KEYS      2000
+#define CHASH_LOOPS     20
+
+typedef struct {
+    apr_chash_t *h;
+    char **keys;
+    apr_uint32_t made[CHASH_KEYS];
+} chash_shared_t;
+
+static apr_status_t make_shared(void *baton, const void **key,
+                                apr_ssize_t klen, void **val)
+{
+    chash_shared_t *shared = baton;
+    int i = atoi(*key);
+
+    /* Under the stripe lock: at most one thread gets here per key */
+    shared->made[i]++;
+    *val = shared->keys[i];
+    return APR_SUCCESS;
+}
+
+static void * APR_THREAD_FUNC chash_thread(apr_thread_t *thd, void *data)
+{
+    chash_shared_t *shared = data;
+    apr_uint64_t own[CHASH_KEYS / 10];
+    int i, loop, failed = 0;
+
+    for (loop = 0; loop < CHASH_LOOPS; loop++) {
+        /* The shared keys are made by the first thread getting there */
+        for (i = 0; i < CHASH_KEYS; i++) {
+            const char *key = shared->keys[i];
+            void *val;
+
+            if (apr_chash_get_or_make(shared->h, key, APR_HASH_KEY_STRING,
+                                      make_shared, shared, &val)
+                != APR_SUCCESS || val != key)
+                failed = 1;
+            if (apr_chash_get(shared->h, key, APR_HASH_KEY_STRING) != key)
+                failed = 1;
+        }
+
+        /* Meanwhile the others add and remove their own keys */
+        for (i = 0; i < CHASH_KEYS / 10; i++) {
+            own[i] = ((apr_uint64_t)(apr_uintptr_t)&own << 16) + i;
+            if (apr_chash_set(shared->h, &own[i], sizeof(own[i]), &own[i],
+                              NULL) != APR_SUCCESS)
+                failed = 1;
+        }
+        for (i = 0; i < CHASH_KEYS / 10; i++) {
+            if (apr_chash_get(shared->h, &own[i], sizeof(own[i])) != &own[i]
+                || apr_chash_remove(shared->h, &own[i],
+                                    sizeof(own[i])) != &own[i])
+                failed = 1;
+        }
+    }
+
+    apr_thread_exit(thd, failed ? APR_EGENERAL : APR_SUCCESS);
+    return NULL;
+}
+
+static void chash_threads(abts_case *tc, void *data)
+{
+    chash_shared_t *shared = apr_pcalloc(p, sizeof(*shared));
+    apr_thread_t *threads[CHASH_THREADS];
+    apr_status_t rv;
+    int i, made = 0;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_chash_create(&shared->h, 0, NULL, p));
+    shared->keys = apr_palloc(p, CHASH_KEYS * sizeof(char *));
+    for (i = 0; i < CHASH_KEYS; i++) {
+        shared->keys[i] = apr_psprintf(p, "%d", i);
+    }
+
+    for (i = 0; i < CHASH_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, chash_thread, shared, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < CHASH_THREADS; i++) {
+        apr_thread_join(&rv, threads[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    /* Each shared key was made once, and they are all that's left */
+    for (i = 0; i < CHASH_KEYS; i++) {
+        made += shared->made[i] == 1;
+    }
+    ABTS_INT_EQUAL(tc, CHASH_KEYS, made);
+    ABTS_INT_EQUAL(tc, CHASH_KEYS, apr_chash_count(shared->h));
+
+    apr_chash_destroy(shared->h);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testchash(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, chash_set_get, NULL);
+    abts_run_test(suite, chash_many, NULL);
+    abts_run_test(suite, chash_custom, NULL);
+    abts_run_test(suite, chash_get_or_make, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, chash_threads, NULL);
+#endif
+
+    return suite;
+}
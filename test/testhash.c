@@ -511,6 +511,158 @@ static void overlay_fetch(abts_case *tc, void *data)
                        apr_hash_get(overlay, "overlay5", APR_HASH_KEY_STRING));
 }
 
+/* Every key of keys[0..n) must be found once in h, with its own value */
+static void check_incremental(abts_case *tc, apr_hash_t *h, char **keys,
+                              int n)
+{
+    apr_hash_index_t *hi;
+    char *seen = apr_pcalloc(p, n);
+    int i, count = 0;
+
+    ABTS_INT_EQUAL(tc, n, apr_hash_count(h));
+    for (i = 0; i < n; i++) {
+        ABTS_PTR_EQUAL(tc, keys[i], apr_hash_get(h, keys[i],
+                                                 APR_HASH_KEY_STRING));
+    }
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(h, "missing", APR_HASH_KEY_STRING));
+    for (hi = apr_hash_first(p, h); hi; hi = apr_hash_next(hi)) {
+        i = atoi(apr_hash_this_key(hi));
+        ABTS_PTR_EQUAL(tc, keys[i], apr_hash_this_val(hi));
+        seen[i]++;
+        count++;
+    }
+    ABTS_INT_EQUAL(tc, n, count);
+    for (i = 0; i < n; i++) {
+        ABTS_INT_EQUAL(tc, 1, seen[i]);
+    }
+}
+
+static void hash_incremental(abts_case *tc, void *data)
+{
+    apr_hash_t *h, *small;
+    char **keys;
+    int i, n;
+
+    keys = apr_palloc(p, 600 * sizeof(char *));
+    for (i = 0; i < 600; i++) {
+        keys[i] = apr_psprintf(p, "%d", i);
+    }
+    small = apr_hash_make(p);
+    apr_hash_set(small, keys[0], APR_HASH_KEY_STRING, keys[0]);
+
+    /* Stop at every stage of the migrations */
+    for (n = 1; n < 600; n += 7) {
+        h = apr_hash_make_ex(p, NULL, APR_HASH_INCREMENTAL);
+        for (i = 0; i < n; i++) {
+            apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+        }
+        check_incremental(tc, h, keys, n);
+        check_incremental(tc, apr_hash_copy(p, h), keys, n);
+        check_incremental(tc, apr_hash_overlay(p, small, h), keys, n);
+        check_incremental(tc, apr_hash_overlay(p, h, small), keys, n);
+    }
+
+    /* Replacing or deleting entries while iterating, amid a migration */
+    h = apr_hash_make_ex(p, NULL, APR_HASH_INCREMENTAL);
+    for (i = 0; i < 140; i++) {
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, "odd");
+    }
+    for (i = 0; i < 140; i += 2) {
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    n = 0;
+    {
+        apr_hash_index_t *hi;
+
+        for (hi = apr_hash_first(p, h); hi; hi = apr_hash_next(hi)) {
+            const char *key = apr_hash_this_key(hi);
+            if (atoi(key) % 2) {
+                apr_hash_set(h, key, APR_HASH_KEY_STRING, NULL);
+            }
+            else {
+                apr_hash_set(h, key, APR_HASH_KEY_STRING, keys[atoi(key) / 2]);
+            }
+            n++;
+        }
+    }
+    ABTS_INT_EQUAL(tc, 140, n);
+    ABTS_INT_EQUAL(tc, 70, apr_hash_count(h));
+    for (i = 0; i < 140; i++) {
+        ABTS_PTR_EQUAL(tc, (i % 2) ? NULL : keys[i / 2],
+                       apr_hash_get(h, keys[i], APR_HASH_KEY_STRING));
+    }
+
+    /* Growing a lot */
+    h = apr_hash_make_ex(p, NULL, APR_HASH_INCREMENTAL);
+    for (i = 0; i < 100000; i++) {
+        apr_hash_set(h, apr_psprintf(p, "%d", i), APR_HASH_KEY_STRING, h);
+    }
+    ABTS_INT_EQUAL(tc, 100000, apr_hash_count(h));
+    for (i = 0; i < 100000; i += 97) {
+        ABTS_PTR_EQUAL(tc, h, apr_hash_get(h, apr_psprintf(p, "%d", i),
+                                           APR_HASH_KEY_STRING));
+    }
+    apr_hash_clear(h);
+    ABTS_INT_EQUAL(tc, 0, apr_hash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_first(NULL, h));
+}
+
+static void hash_func_fast(abts_case *tc, void *data)
+{
+    static const struct {
+        const char *key;
+        unsigned int hash;
+    } known[] = {
+        { "", 0x82cbab5e },
+        { "a", 0x4928b353 },
+        { "abc", 0x1c7af396 },
+        { "hello", 0x55eb04b4 },
+        { "0123456789abcdef", 0x42a39f63 },
+        { "The quick brown fox jumps over the lazy dog", 0xa924290a },
+        { "The quick brown fox jumps over the lazy dog, "
+          "then over the lazy cat, then back", 0xa1916cd2 }
+    };
+    unsigned char buf[200];
+    unsigned int hashes[200];
+    apr_ssize_t klen;
+    int i, j;
+
+    /* The same values everywhere */
+    for (i = 0; i < (int)(sizeof(known) / sizeof(known[0])); i++) {
+        klen = APR_HASH_KEY_STRING;
+        ABTS_INT_EQUAL(tc, known[i].hash,
+                       apr_hashfunc_fast(known[i].key, &klen));
+        ABTS_INT_EQUAL(tc, strlen(known[i].key), klen);
+        ABTS_INT_EQUAL(tc, known[i].hash,
+                       apr_hashfunc_fast_seeded(known[i].key, &klen, 0));
+        ABTS_TRUE(tc, known[i].hash
+                      != apr_hashfunc_fast_seeded(known[i].key, &klen, 1));
+    }
+
+    /* Every length, and every byte, counts */
+    memset(buf, 0, sizeof(buf));
+    for (i = 0; i < 200; i++) {
+        klen = i;
+        hashes[i] = apr_hashfunc_fast((const char *)buf, &klen);
+        for (j = 0; j < i; j++) {
+            ABTS_TRUE(tc, hashes[i] != hashes[j]);
+        }
+    }
+    for (i = 0; i < 200; i++) {
+        buf[i] = 1;
+        klen = 200;
+        hashes[i] = apr_hashfunc_fast((const char *)buf, &klen);
+        buf[i] = 0;
+        for (j = 0; j < i; j++) {
+            ABTS_TRUE(tc, hashes[i] != hashes[j]);
+        }
+    }
+
+    /* The legacy values are kept */
+    klen = APR_HASH_KEY_STRING;
+    ABTS_INT_EQUAL(tc, 3595978, apr_hashfunc_default("abcd", &klen));
+}
+
 abts_suite *testhash(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -536,6 +688,9 @@ abts_suite *testhash(abts_suite *suite)
     abts_run_test(suite, overlay_same, NULL);
     abts_run_test(suite, overlay_fetch, NULL);
 
+    abts_run_test(suite, hash_incremental, NULL);
+    abts_run_test(suite, hash_func_fast, NULL);
+
     return suite;
 }
 
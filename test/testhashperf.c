@@ -0,0 +1,455 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares apr_hash_t (also with APR_HASH_INCREMENTAL) and apr_ohash_t:
+ * time per insertion, successful and failed lookup, and per entry when
+ * iterating, plus the memory used per entry (as taken from the allocator,
+ * keys and values aside), for string keys (URL like) and binary keys (16
+ * bytes).  The longest insertion, in microseconds, is timed separately.
+ *
+ * The hash functions (apr_hashfunc_default() and apr_hashfunc_fast()) are
+ * compared first, by key length.  After the string keys, lookups by
+ * several threads at once are timed in an apr_hash_t behind an
+ * apr_thread_rwlock_t and in an apr_chash_t (with -n 50000 or more).
+ */
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_hash.h"
+#include "apr_ohash.h"
+#include "apr_chash.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_rwlock.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_MAX_COUNT 1000000
+#define BINARY_KLEN 16
+#define LOOKUP_STRIDE 7919
+#define HASHFUNC_BYTES (64 * 1024 * 1024)
+#define HASHFUNC_BUFSIZE 65536
+#define THREADS_COUNT 100000
+#define THREADS_LOOKUPS 2000000
+#define DEFAULT_MAX_THREADS 8
+
+typedef struct {
+    const char *name;
+    void *(*make)(apr_pool_t *p);
+    void (*set)(void *h, const void *key, apr_ssize_t klen, const void *val);
+    void *(*get)(void *h, const void *key, apr_ssize_t klen);
+    int (*iterate)(apr_pool_t *p, void *h);
+} map_ops_t;
+
+static void *hash_make(apr_pool_t *p)
+{
+    return apr_hash_make(p);
+}
+
+static void hash_set(void *h, const void *key, apr_ssize_t klen,
+                     const void *val)
+{
+    apr_hash_set(h, key, klen, val);
+}
+
+static void *hash_make_incremental(apr_pool_t *p)
+{
+    return apr_hash_make_ex(p, NULL, APR_HASH_INCREMENTAL);
+}
+
+static void *hash_get(void *h, const void *key, apr_ssize_t klen)
+{
+    return apr_hash_get(h, key, klen);
+}
+
+static int hash_iterate(apr_pool_t *p, void *h)
+{
+    apr_hash_index_t *hi;
+    int n = 0;
+
+    for (hi = apr_hash_first(p, h); hi; hi = apr_hash_next(hi)) {
+        n += apr_hash_this_val(hi) != NULL;
+    }
+    return n;
+}
+
+static void *ohash_make(apr_pool_t *p)
+{
+    return apr_ohash_make(p);
+}
+
+static void ohash_set(void *h, const void *key, apr_ssize_t klen,
+                      const void *val)
+{
+    apr_ohash_set(h, key, klen, val);
+}
+
+static void *ohash_get(void *h, const void *key, apr_ssize_t klen)
+{
+    return apr_ohash_get(h, key, klen);
+}
+
+static int ohash_iterate(apr_pool_t *p, void *h)
+{
+    apr_ohash_index_t *hi;
+    int n = 0;
+
+    for (hi = apr_ohash_first(p, h); hi; hi = apr_ohash_next(hi)) {
+        n += apr_ohash_this_val(hi) != NULL;
+    }
+    return n;
+}
+
+static const map_ops_t maps[] = {
+    { "apr_hash",  hash_make,  hash_set,  hash_get,  hash_iterate },
+    { "apr_hash/i", hash_make_incremental, hash_set, hash_get, hash_iterate },
+    { "apr_ohash", ohash_make, ohash_set, ohash_get, ohash_iterate }
+};
+
+static long max_count = DEFAULT_MAX_COUNT;
+static int max_threads = DEFAULT_MAX_THREADS;
+
+/* Bytes held by the pools of an allocator, or in its free lists */
+static apr_size_t held_bytes(apr_allocator_t *allocator)
+{
+    apr_allocator_stats_t stats;
+
+    apr_allocator_stats_get(allocator, &stats);
+    return (apr_size_t)(stats.fresh_bytes - stats.release_bytes)
+           - stats.free_bytes;
+}
+
+static double ns_per(apr_time_t start, long n)
+{
+    return (double)(apr_time_now() - start) * 1000.0 / n;
+}
+
+/* keys[0..n) are inserted, keys[n..2n) are looked up but missing.  The
+ * lookups go through the keys in a scattered order (LOOKUP_STRIDE being
+ * prime to n), since following the insertion order would favor apr_hash,
+ * whose entries are allocated in that order.
+ */
+static void bench(apr_pool_t *pool, const map_ops_t *ops, const char **keys,
+                  apr_ssize_t klen, long n)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *p;
+    apr_size_t used;
+    apr_time_t start;
+    apr_interval_time_t worst = 0;
+    double insert, hit, miss, iterate;
+    void *h;
+    long i;
+    int found = 0;
+
+    apr_allocator_create(&allocator);
+    apr_pool_create_ex(&p, pool, NULL, allocator);
+    apr_allocator_owner_set(allocator, p);
+    used = held_bytes(allocator);
+
+    start = apr_time_now();
+    h = ops->make(p);
+    for (i = 0; i < n; i++) {
+        ops->set(h, keys[i], klen, keys[i]);
+    }
+    insert = ns_per(start, n);
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        found += ops->get(h, keys[(i * LOOKUP_STRIDE) % n], klen) != NULL;
+    }
+    hit = ns_per(start, n);
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        found += ops->get(h, keys[n + (i * LOOKUP_STRIDE) % n], klen) != NULL;
+    }
+    miss = ns_per(start, n);
+
+    start = apr_time_now();
+    found += ops->iterate(p, h);
+    iterate = ns_per(start, n);
+
+    used = held_bytes(allocator) - used;
+    if (found != 2 * n) {
+        fprintf(stderr, "%s: found %d entries out of %ld\n",
+                ops->name, found, 2 * n);
+        exit(-1);
+    }
+
+    /* Time every insertion in a new table, apart since it costs */
+    apr_pool_clear(p);
+    h = ops->make(p);
+    for (i = 0; i < n; i++) {
+        apr_interval_time_t spent;
+
+        start = apr_time_now();
+        ops->set(h, keys[i], klen, keys[i]);
+        spent = apr_time_now() - start;
+        if (spent > worst) {
+            worst = spent;
+        }
+    }
+
+    printf("    %-10s %9ld %8.1f %8.1f %8.1f %8.1f %8.1f %8ld\n", ops->name,
+           n, insert, hit, miss, iterate,
+           (double)used / n, (long)worst);
+    apr_pool_destroy(p);
+}
+
+static void bench_hashfunc(apr_pool_t *pool)
+{
+    static const apr_ssize_t lengths[] = { 4, 8, 16, 24, 32, 64, 128, 256,
+                                           1024, 4096 };
+    static const struct {
+        const char *name;
+        apr_hashfunc_t func;
+    } funcs[] = {
+        { "default", apr_hashfunc_default },
+        { "fast", apr_hashfunc_fast }
+    };
+    unsigned char *buf = apr_palloc(pool, HASHFUNC_BUFSIZE + 4096);
+    volatile unsigned int sink = 0;
+    unsigned int i, f;
+
+    for (i = 0; i < HASHFUNC_BUFSIZE + 4096; i++) {
+        buf[i] = (unsigned char)((i * 2654435761UL) >> 13);
+    }
+
+    printf("Hash functions (ns per key, MB/s)\n");
+    printf("    %8s", "length");
+    for (f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++) {
+        printf(" %10s %10s", funcs[f].name, "MB/s");
+    }
+    printf("\n");
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        long n = HASHFUNC_BYTES / lengths[i];
+
+        printf("    %8ld", (long)lengths[i]);
+        for (f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++) {
+            apr_time_t start = apr_time_now();
+            double spent;
+            long j;
+
+            /* Unaligned keys, at various offsets */
+            for (j = 0; j < n; j++) {
+                apr_ssize_t klen = lengths[i];
+                sink += funcs[f].func((const char *)buf
+                                      + (j * 61) % HASHFUNC_BUFSIZE, &klen);
+            }
+            spent = ns_per(start, n);
+            printf(" %10.1f %10.0f", spent, lengths[i] * 1000.0 / spent);
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+static void bench_all(apr_pool_t *pool, const char *name, const char **keys,
+                      apr_ssize_t klen)
+{
+    long n;
+    unsigned int m;
+
+    printf("%s keys (ns per operation, bytes per entry, worst insert in "
+           "us)\n", name);
+    printf("    %-10s %9s %8s %8s %8s %8s %8s %8s\n",
+           "map", "entries", "insert", "hit", "miss", "iterate", "memory",
+           "worst");
+    for (n = 1000; n <= max_count; n *= 10) {
+        for (m = 0; m < sizeof(maps) / sizeof(maps[0]); m++) {
+            bench(pool, &maps[m], keys, klen, n);
+        }
+    }
+    printf("\n");
+}
+
+#if APR_HAS_THREADS
+
+typedef struct {
+    apr_hash_t *hash;
+    apr_thread_rwlock_t *lock;
+    apr_chash_t *chash;
+    const char **keys;
+    long start;
+    int found;
+} lookups_t;
+
+static void * APR_THREAD_FUNC hash_lookups(apr_thread_t *thd, void *data)
+{
+    lookups_t *l = data;
+    long i;
+
+    for (i = 0; i < THREADS_LOOKUPS; i++) {
+        const char *key = l->keys[(l->start + i * LOOKUP_STRIDE)
+                                  % THREADS_COUNT];
+
+        apr_thread_rwlock_rdlock(l->lock);
+        l->found += apr_hash_get(l->hash, key, APR_HASH_KEY_STRING) != NULL;
+        apr_thread_rwlock_unlock(l->lock);
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC chash_lookups(apr_thread_t *thd, void *data)
+{
+    lookups_t *l = data;
+    long i;
+
+    for (i = 0; i < THREADS_LOOKUPS; i++) {
+        const char *key = l->keys[(l->start + i * LOOKUP_STRIDE)
+                                  % THREADS_COUNT];
+
+        l->found += apr_chash_get(l->chash, key, APR_HASH_KEY_STRING) != NULL;
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+/* Millions of lookups per second, all threads together */
+static double run_lookups(apr_pool_t *pool, lookups_t *shared, int n,
+                          apr_thread_start_t func)
+{
+    apr_thread_t **threads = apr_palloc(pool, n * sizeof(apr_thread_t *));
+    lookups_t *l = apr_palloc(pool, n * sizeof(lookups_t));
+    apr_time_t start;
+    apr_status_t rv;
+    int i;
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        l[i] = *shared;
+        l[i].start = i * (THREADS_COUNT / n);
+        if (apr_thread_create(&threads[i], NULL, func, &l[i],
+                              pool) != APR_SUCCESS) {
+            exit(-1);
+        }
+    }
+    for (i = 0; i < n; i++) {
+        apr_thread_join(&rv, threads[i]);
+        if (l[i].found != THREADS_LOOKUPS) {
+            fprintf(stderr, "found %d entries out of %d\n",
+                    l[i].found, THREADS_LOOKUPS);
+            exit(-1);
+        }
+    }
+    return (double)n * THREADS_LOOKUPS / (apr_time_now() - start);
+}
+
+static void bench_threads(apr_pool_t *pool, const char **keys)
+{
+    lookups_t shared;
+    long i;
+    int n;
+
+    shared.keys = keys;
+    shared.found = 0;
+    shared.hash = apr_hash_make(pool);
+    if (apr_thread_rwlock_create(&shared.lock, pool) != APR_SUCCESS
+        || apr_chash_create(&shared.chash, 0, NULL, pool) != APR_SUCCESS) {
+        exit(-1);
+    }
+    for (i = 0; i < THREADS_COUNT; i++) {
+        apr_hash_set(shared.hash, keys[i], APR_HASH_KEY_STRING, keys[i]);
+        apr_chash_set(shared.chash, keys[i], APR_HASH_KEY_STRING, keys[i],
+                      NULL);
+    }
+
+    printf("Concurrent lookups (millions per second, %d entries)\n",
+           THREADS_COUNT);
+    printf("    %8s %16s %16s\n", "threads", "apr_hash+rwlock", "apr_chash");
+    for (n = 1; n <= max_threads; n *= 2) {
+        double hash = run_lookups(pool, &shared, n, hash_lookups);
+        double chash = run_lookups(pool, &shared, n, chash_lookups);
+
+        printf("    %8d %16.1f %16.1f\n", n, hash, chash);
+    }
+    printf("\n");
+}
+
+#endif /* APR_HAS_THREADS */
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_getopt_t *opt;
+    apr_status_t rv;
+    char optchar;
+    const char *optarg;
+    const char **keys;
+    long i;
+
+    printf("APR Hash Performance Test\n=========================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS) {
+        exit(-1);
+    }
+
+    if (apr_getopt_init(&opt, pool, argc, argv) != APR_SUCCESS) {
+        exit(-1);
+    }
+    while ((rv = apr_getopt(opt, "n:t:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            max_count = atol(optarg);
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+        }
+    }
+    if ((rv != APR_SUCCESS && rv != APR_EOF) || max_count < 1000
+        || max_threads < 1) {
+        fprintf(stderr, "Usage: %s [-n max entries, at least 1000] "
+                "[-t max threads]\n", argv[0]);
+        exit(-1);
+    }
+
+    bench_hashfunc(pool);
+    apr_pool_clear(pool);
+
+    keys = apr_palloc(pool, 2 * max_count * sizeof(char *));
+
+    for (i = 0; i < 2 * max_count; i++) {
+        keys[i] = apr_psprintf(pool, "/static/assets/%08lx/image-%ld.png",
+                               (unsigned long)(i * 2654435761UL), i);
+    }
+    bench_all(pool, "String", keys, APR_HASH_KEY_STRING);
+#if APR_HAS_THREADS
+    if (2 * max_count >= THREADS_COUNT) {
+        bench_threads(pool, keys);
+    }
+#endif
+    apr_pool_clear(pool);
+
+    keys = apr_palloc(pool, 2 * max_count * sizeof(char *));
+    for (i = 0; i < 2 * max_count; i++) {
+        apr_uint64_t *key = apr_palloc(pool, BINARY_KLEN);
+        key[0] = (apr_uint64_t)i * APR_UINT64_C(0x9e3779b97f4a7c15);
+        key[1] = (apr_uint64_t)i;
+        keys[i] = (const char *)key;
+    }
+    bench_all(pool, "Binary", keys, BINARY_KLEN);
+
+    apr_pool_destroy(pool);
+    return 0;
+}
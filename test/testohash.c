@@ -0,0 +1,259 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_ohash.h"
+
+#define NKEYS 10000
+
+static void ohash_set_get(abts_case *tc, void *data)
+{
+    apr_ohash_t *h = apr_ohash_make(p);
+
+    ABTS_PTR_NOTNULL(tc, h);
+    ABTS_PTR_EQUAL(tc, NULL, apr_ohash_get(h, "key", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 0, apr_ohash_count(h));
+
+    apr_ohash_set(h, "key", APR_HASH_KEY_STRING, "value");
+    ABTS_STR_EQUAL(tc, "value", apr_ohash_get(h, "key", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "value", apr_ohash_get(h, "key", 3));
+    ABTS_PTR_EQUAL(tc, NULL, apr_ohash_get(h, "ke", APR_HASH_KEY_STRING));
+
+    apr_ohash_set(h, "key", APR_HASH_KEY_STRING, "new");
+    ABTS_STR_EQUAL(tc, "new", apr_ohash_get(h, "key", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 1, apr_ohash_count(h));
+
+    apr_ohash_set(h, "key", APR_HASH_KEY_STRING, NULL);
+    ABTS_PTR_EQUAL(tc, NULL, apr_ohash_get(h, "key", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 0, apr_ohash_count(h));
+    apr_ohash_set(h, "key", APR_HASH_KEY_STRING, NULL);
+    ABTS_INT_EQUAL(tc, 0, apr_ohash_count(h));
+    ABTS_PTR_EQUAL(tc, p, apr_ohash_pool_get(h));
+}
+
+static void ohash_binary_keys(abts_case *tc, void *data)
+{
+    apr_ohash_t *h = apr_ohash_make(p);
+    int *keys = apr_palloc(p, NKEYS * sizeof(int));
+    int i;
+
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i * 7919;
+        apr_ohash_set(h, &keys[i], sizeof(int), &keys[i]);
+    }
+    ABTS_INT_EQUAL(tc, NKEYS, apr_ohash_count(h));
+    for (i = 0; i < NKEYS; i++) {
+        int key = i * 7919;
+        ABTS_PTR_EQUAL(tc, &keys[i], apr_ohash_get(h, &key, sizeof(int)));
+        key++;
+        if (key % 7919) {
+            ABTS_PTR_EQUAL(tc, NULL, apr_ohash_get(h, &key, sizeof(int)));
+        }
+    }
+
+    /* Keys are compared with their length */
+    apr_ohash_set(h, "\0\0\0\0\0", 5, "five");
+    apr_ohash_set(h, "\0\0\0\0\0", 4, "four");
+    ABTS_STR_EQUAL(tc, "five", apr_ohash_get(h, "\0\0\0\0\0", 5));
+    ABTS_STR_EQUAL(tc, "four", apr_ohash_get(h, "\0\0\0\0\0", 4));
+}
+
+static void ohash_delete_churn(abts_case *tc, void *data)
+{
+    apr_pool_t *subp;
+    apr_ohash_t *h;
+    char **keys;
+    apr_size_t used;
+    apr_pool_stats_t stats;
+    int i, round;
+
+    apr_pool_create(&subp, p);
+    h = apr_ohash_make(subp);
+    keys = apr_palloc(subp, NKEYS * sizeof(char *));
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = apr_psprintf(subp, "key%d", i);
+    }
+    for (i = 0; i < NKEYS / 2; i++) {
+        apr_ohash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    apr_pool_stats_get(subp, &stats);
+    used = stats.used_bytes;
+
+    /* Replace the entries over and over: the tombstones must be dropped
+     * in place, without resizing
+     */
+    for (round = 0; round < 20; round++) {
+        for (i = 0; i < NKEYS / 2; i++) {
+            int old = (i + round * (NKEYS / 2)) % NKEYS;
+            int new = (old + NKEYS / 2) % NKEYS;
+            apr_ohash_set(h, keys[old], APR_HASH_KEY_STRING, NULL);
+            apr_ohash_set(h, keys[new], APR_HASH_KEY_STRING, keys[new]);
+        }
+        ABTS_INT_EQUAL(tc, NKEYS / 2, apr_ohash_count(h));
+    }
+    apr_pool_stats_get(subp, &stats);
+    ABTS_TRUE(tc, stats.used_bytes == used);
+
+    /* After an even number of rounds, the first half is back */
+    for (i = 0; i < NKEYS; i++) {
+        if (i < NKEYS / 2) {
+            ABTS_PTR_EQUAL(tc, keys[i],
+                           apr_ohash_get(h, keys[i], APR_HASH_KEY_STRING));
+        }
+        else {
+            ABTS_PTR_EQUAL(tc, NULL,
+                           apr_ohash_get(h, keys[i], APR_HASH_KEY_STRING));
+        }
+    }
+
+    apr_pool_destroy(subp);
+}
+
+static unsigned int hash_bad(const char *key, apr_ssize_t *klen)
+{
+    if (*klen == APR_HASH_KEY_STRING) {
+        *klen = strlen(key);
+    }
+    return (unsigned int)*klen;
+}
+
+static void ohash_custom(abts_case *tc, void *data)
+{
+    apr_ohash_t *h = apr_ohash_make_custom(p, hash_bad);
+    char *keys[200];
+    int i;
+
+    /* All the keys of a length collide, lookups must still work */
+    for (i = 0; i < 200; i++) {
+        keys[i] = apr_psprintf(p, "%03d", i);
+        apr_ohash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    for (i = 0; i < 200; i += 2) {
+        apr_ohash_set(h, keys[i], APR_HASH_KEY_STRING, NULL);
+    }
+    ABTS_INT_EQUAL(tc, 100, apr_ohash_count(h));
+    for (i = 0; i < 200; i++) {
+        ABTS_PTR_EQUAL(tc, (i % 2) ? keys[i] : NULL,
+                       apr_ohash_get(h, keys[i], APR_HASH_KEY_STRING));
+    }
+}
+
+static int count_do(void *rec, const void *key, apr_ssize_t klen,
+                    const void *value)
+{
+    int *count = rec;
+
+    (*count)++;
+    return *count < 10;
+}
+
+static void ohash_iterate(abts_case *tc, void *data)
+{
+    apr_ohash_t *h = apr_ohash_make(p);
+    apr_ohash_index_t *hi;
+    int seen[100];
+    int i, count;
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_ohash_first(NULL, h));
+
+    memset(seen, 0, sizeof(seen));
+    for (i = 0; i < 100; i++) {
+        apr_ohash_set(h, apr_psprintf(p, "%d", i), APR_HASH_KEY_STRING,
+                      apr_psprintf(p, "%d", i * 2));
+    }
+
+    /* Deleting the current entry is allowed */
+    count = 0;
+    for (hi = apr_ohash_first(p, h); hi; hi = apr_ohash_next(hi)) {
+        const char *key;
+        apr_ssize_t klen;
+        void *val;
+
+        apr_ohash_this(hi, (const void **)&key, &klen, &val);
+        ABTS_PTR_EQUAL(tc, key, apr_ohash_this_key(hi));
+        ABTS_INT_EQUAL(tc, klen, apr_ohash_this_key_len(hi));
+        ABTS_PTR_EQUAL(tc, val, apr_ohash_this_val(hi));
+        ABTS_INT_EQUAL(tc, (int)strlen(key), (int)klen);
+        ABTS_INT_EQUAL(tc, atoi(key) * 2, atoi(val));
+        seen[atoi(key)]++;
+        count++;
+        if (atoi(key) % 2) {
+            apr_ohash_set(h, key, klen, NULL);
+        }
+    }
+    ABTS_INT_EQUAL(tc, 100, count);
+    for (i = 0; i < 100; i++) {
+        ABTS_INT_EQUAL(tc, 1, seen[i]);
+    }
+    ABTS_INT_EQUAL(tc, 50, apr_ohash_count(h));
+
+    count = 0;
+    ABTS_INT_EQUAL(tc, 0, apr_ohash_do(count_do, &count, h));
+    ABTS_INT_EQUAL(tc, 10, count);
+
+    apr_ohash_clear(h);
+    ABTS_INT_EQUAL(tc, 0, apr_ohash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_ohash_first(NULL, h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_ohash_get(h, "2", APR_HASH_KEY_STRING));
+    count = 0;
+    ABTS_INT_EQUAL(tc, 1, apr_ohash_do(count_do, &count, h));
+    ABTS_INT_EQUAL(tc, 0, count);
+}
+
+static void ohash_reserve(abts_case *tc, void *data)
+{
+    apr_pool_t *subp;
+    apr_ohash_t *h;
+    apr_pool_stats_t stats;
+    apr_size_t used;
+    int *keys;
+    int i;
+
+    apr_pool_create(&subp, p);
+    h = apr_ohash_make(subp);
+    keys = apr_palloc(subp, NKEYS * sizeof(int));
+    apr_ohash_reserve(h, NKEYS);
+    apr_pool_stats_get(subp, &stats);
+    used = stats.used_bytes;
+
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i;
+        apr_ohash_set(h, &keys[i], sizeof(int), &keys[i]);
+    }
+    apr_pool_stats_get(subp, &stats);
+    ABTS_TRUE(tc, stats.used_bytes == used);
+    ABTS_INT_EQUAL(tc, NKEYS, apr_ohash_count(h));
+
+    apr_pool_destroy(subp);
+}
+
+abts_suite *testohash(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, ohash_set_get, NULL);
+    abts_run_test(suite, ohash_binary_keys, NULL);
+    abts_run_test(suite, ohash_delete_churn, NULL);
+    abts_run_test(suite, ohash_custom, NULL);
+    abts_run_test(suite, ohash_iterate, NULL);
+    abts_run_test(suite, ohash_reserve, NULL);
+
+    return suite;
+}
@@ -19,6 +19,11 @@
 #include "apr_pools.h"
 #include "apr_errno.h"
 #include "apr_file_io.h"
+#include "apr_strings.h"
+#include "apr_tables.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_mutex.h"
+#include "apr_time.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -64,6 +69,78 @@ static void calloc_bytes(abts_case *tc, void *data)
     }
 }
 
+static void aligned_bytes(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_size_t alignment;
+    char *mem, *prev = NULL;
+    int i;
+
+    apr_pool_create(&pool, pmain);
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_palloc_aligned(pool, 10, 48));
+
+    for (alignment = 1; alignment <= 8192; alignment <<= 1) {
+        for (i = 0; i < 4; i++) {
+            /* Misalign the next allocation */
+            apr_palloc(pool, 8);
+
+            mem = apr_palloc_aligned(pool, alignment + i * 24, alignment);
+            ABTS_PTR_NOTNULL(tc, mem);
+            ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)mem & (alignment - 1)));
+            memset(mem, i, alignment + i * 24);
+            ABTS_ASSERT(tc, "reused memory", mem != prev);
+            prev = mem;
+        }
+    }
+
+    /* Larger than a node */
+    mem = apr_pcalloc_aligned(pool, 100000, 4096);
+    ABTS_PTR_NOTNULL(tc, mem);
+    ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)mem & 4095));
+    for (i = 0; i < 100000; i++) {
+        if (mem[i] != 0)
+            break;
+    }
+    ABTS_INT_EQUAL(tc, 100000, i);
+
+    apr_pool_destroy(pool);
+}
+
+static void grow_bytes(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    char *mem, *next;
+
+    apr_pool_create(&pool, pmain);
+    mem = apr_palloc(pool, 100);
+
+#if APR_POOL_DEBUG
+    /* Never in place */
+    ABTS_INT_EQUAL(tc, 0, apr_palloc_grow(pool, mem, 100, 200));
+    next = apr_palloc(pool, 8);
+    ABTS_INT_EQUAL(tc, 0, apr_palloc_grow(pool, next, 8, 16));
+#else
+    ABTS_INT_EQUAL(tc, 1, apr_palloc_grow(pool, mem, 100, 200));
+    memset(mem, 'x', 100);
+    next = apr_palloc(pool, 8);
+    ABTS_PTR_EQUAL(tc, mem + 200, next);
+
+    /* Not the last block any more */
+    ABTS_INT_EQUAL(tc, 0, apr_palloc_grow(pool, mem, 200, 300));
+
+    /* More than the room left */
+    ABTS_INT_EQUAL(tc, 0, apr_palloc_grow(pool, next, 8, 1024 * 1024));
+
+    /* Shrunk, the next allocation takes the space back */
+    ABTS_INT_EQUAL(tc, 1, apr_palloc_grow(pool, next, 8, 0));
+    ABTS_PTR_EQUAL(tc, next, apr_palloc(pool, 16));
+    ABTS_INT_EQUAL(tc, 'x', mem[99]);
+#endif
+
+    apr_pool_destroy(pool);
+}
+
 static void parent_pool(abts_case *tc, void *data)
 {
     apr_status_t rv;
@@ -139,6 +216,1010 @@ static void test_cleanups(abts_case *tc, void *data)
     }
 }
 
+#define HANDLES 1000
+
+static apr_status_t count_cleanup(void *data)
+{
+    (*(int *)data)++;
+    return APR_SUCCESS;
+}
+
+static void test_cleanup_handles(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_pool_cleanup_t c[HANDLES];
+    int counts[HANDLES];
+    apr_status_t rv;
+    int i, n;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (n = 0; n < 2; n++) {
+        for (i = 0; i < HANDLES; i++) {
+            counts[i] = 0;
+            apr_pool_cleanup_register_ex(&c[i], pool, &counts[i],
+                                         count_cleanup,
+                                         apr_pool_cleanup_null);
+            ABTS_PTR_NOTNULL(tc, c[i].entry);
+        }
+
+        /* Kill every other one, out of order, and run a few */
+        for (i = 1; i < HANDLES; i += 2) {
+            apr_pool_cleanup_kill_ex(pool, &c[(i * 7) % HANDLES]);
+        }
+        for (i = 0; i < HANDLES; i += 100) {
+            rv = apr_pool_cleanup_run_ex(pool, &c[i]);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_INT_EQUAL(tc, 1, counts[i]);
+        }
+
+        /* The remaining ones, and only those, run on clear */
+        apr_pool_clear(pool);
+        for (i = 0; i < HANDLES; i++) {
+            ABTS_INT_EQUAL(tc, (i % 2 == 0), counts[i]);
+        }
+    }
+
+    /* Stale handles don't touch the cleanup reusing their entry */
+    counts[0] = counts[1] = 0;
+    apr_pool_cleanup_register_ex(&c[0], pool, &counts[0], count_cleanup,
+                                 apr_pool_cleanup_null);
+    apr_pool_cleanup_kill_ex(pool, &c[0]);
+    apr_pool_cleanup_register_ex(&c[1], pool, &counts[1], count_cleanup,
+                                 apr_pool_cleanup_null);
+    ABTS_PTR_EQUAL(tc, c[0].entry, c[1].entry);
+    apr_pool_cleanup_kill_ex(pool, &c[0]);
+    rv = apr_pool_cleanup_run_ex(pool, &c[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, counts[0] + counts[1]);
+    apr_pool_clear(pool);
+    ABTS_INT_EQUAL(tc, 1, counts[1]);
+
+    /* Killing the data/function pair still works */
+    counts[0] = 0;
+    apr_pool_cleanup_register_ex(&c[0], pool, &counts[0], count_cleanup,
+                                 apr_pool_cleanup_null);
+    apr_pool_cleanup_register_ex(&c[1], pool, &counts[1], count_cleanup,
+                                 apr_pool_cleanup_null);
+    apr_pool_cleanup_kill(pool, &counts[1], count_cleanup);
+    apr_pool_cleanup_kill_ex(pool, &c[0]);
+    apr_pool_destroy(pool);
+    ABTS_INT_EQUAL(tc, 0, counts[0]);
+}
+
+static void test_huge_pages(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_size_t sizes[] = { 100, 9000, 70000, 300000, 600000, 3000000 };
+    char *mem[sizeof(sizes) / sizeof(sizes[0])];
+    apr_memnode_t *nodes[4];
+#if defined(__linux__)
+    apr_allocator_stats_t stats, again;
+#endif
+    int i, n;
+
+    rv = apr_allocator_create_ex(&allocator, APR_ALLOCATOR_HUGE_PAGES);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_ex(&pool, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, pool);
+
+    for (n = 0; n < 3; n++) {
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            mem[i] = apr_palloc(pool, sizes[i]);
+            ABTS_PTR_NOTNULL(tc, mem[i]);
+            memset(mem[i], i, sizes[i]);
+        }
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            ABTS_INT_EQUAL(tc, i, mem[i][0]);
+            ABTS_INT_EQUAL(tc, i, mem[i][sizes[i] - 1]);
+        }
+
+        /* Have the carved nodes purged rather than kept on clear */
+        if (n == 1)
+            apr_allocator_max_free_set(allocator, 1);
+        apr_pool_clear(pool);
+    }
+
+    apr_pool_destroy(pool);
+
+#if defined(__linux__)
+    /* Four of the largest carved nodes fill a region */
+    rv = apr_allocator_create_ex(&allocator, APR_ALLOCATOR_HUGE_PAGES);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < 4; i++) {
+        nodes[i] = apr_allocator_alloc(allocator,
+                                       512 * 1024 - APR_MEMNODE_T_SIZE);
+        ABTS_PTR_NOTNULL(tc, nodes[i]);
+    }
+    for (i = 1; i < 4; i++) {
+        ABTS_PTR_EQUAL(tc, (char *)nodes[0] + i * 512 * 1024, nodes[i]);
+    }
+    for (i = 0; i < 4; i++) {
+        apr_allocator_free(allocator, nodes[i]);
+    }
+
+    /* Purged nodes are kept, but not purged (nor counted) again */
+    apr_allocator_trim(allocator);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_SIZE_EQUAL(tc, 0, apr_allocator_trim(allocator));
+    apr_allocator_stats_get(allocator, &again);
+    ABTS_SIZE_EQUAL(tc, stats.release_count, again.release_count);
+    ABTS_SIZE_EQUAL(tc, stats.release_bytes, again.release_bytes);
+    apr_allocator_destroy(allocator);
+#endif
+}
+
+static void test_numa(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_pool_t *pool, *sub;
+    apr_memnode_t *small, *large;
+    apr_status_t rv;
+    int node;
+    char *mem;
+
+    rv = apr_allocator_numa_node_current(&node);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "NUMA node of the current thread");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_allocator_create_numa(&allocator, APR_ALLOCATOR_NUMA_CURRENT, 0);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "NUMA binding");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, node, apr_allocator_numa_node_get(allocator));
+
+    rv = apr_pool_create_ex(&pool, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, pool);
+
+    rv = apr_pool_create(&sub, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_EQUAL(tc, allocator, apr_pool_allocator_get(sub));
+    mem = apr_palloc(sub, 100000);
+    ABTS_PTR_NOTNULL(tc, mem);
+    memset(mem, 'x', 100000);
+
+    apr_pool_destroy(pool);
+
+    /* Free lists per node, in one allocator */
+    rv = apr_allocator_create_numa(&allocator, APR_ALLOCATOR_NUMA_LOCAL, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_ALLOCATOR_NUMA_LOCAL,
+                   apr_allocator_numa_node_get(allocator));
+
+    small = apr_allocator_alloc(allocator, 10000);
+    large = apr_allocator_alloc(allocator, 1000000);
+    ABTS_PTR_NOTNULL(tc, small);
+    ABTS_PTR_NOTNULL(tc, large);
+    memset(small->first_avail, 'x', 10000);
+    memset(large->first_avail, 'x', 1000000);
+    apr_allocator_free(allocator, small);
+    apr_allocator_free(allocator, large);
+
+    /* The large node is not kept, nor rounded up to 2MB */
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 2, (int)stats.free_count);
+    ABTS_INT_EQUAL(tc, 1, (int)stats.release_count);
+    ABTS_TRUE(tc, stats.release_bytes < 1100000);
+    ABTS_TRUE(tc, stats.free_bytes >= 10000 && stats.free_bytes < 20000);
+
+    rv = apr_pool_create_ex(&pool, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, pool);
+    mem = apr_palloc(pool, 100000);
+    ABTS_PTR_NOTNULL(tc, mem);
+    memset(mem, 'x', 100000);
+    apr_pool_destroy(pool);
+
+    rv = apr_allocator_create_numa(&allocator, 1023, 0);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+}
+
+static void test_allocator_stats(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_memnode_t *node, *big;
+    apr_status_t rv;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    node = apr_allocator_alloc(allocator, 10000);
+    big = apr_allocator_alloc(allocator, 1000000);
+    ABTS_PTR_NOTNULL(tc, node);
+    ABTS_PTR_NOTNULL(tc, big);
+    apr_allocator_free(allocator, node);
+    apr_allocator_free(allocator, big);
+
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 2, (int)stats.fresh_count);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.reuse_count);
+    ABTS_INT_EQUAL(tc, 2, (int)stats.free_count);
+    ABTS_INT_EQUAL(tc, 1, (int)stats.sink_count);
+    ABTS_ASSERT(tc, "free bytes", stats.free_bytes == stats.fresh_bytes);
+    ABTS_ASSERT(tc, "free bytes max", stats.free_bytes_max == stats.free_bytes);
+
+    node = apr_allocator_alloc(allocator, 10000);
+    big = apr_allocator_alloc(allocator, 1000000);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 2, (int)stats.fresh_count);
+    ABTS_INT_EQUAL(tc, 2, (int)stats.reuse_count);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.sink_count);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.free_bytes);
+
+    apr_allocator_max_free_set(allocator, 1);
+    apr_allocator_free(allocator, big);
+    apr_allocator_free(allocator, node);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 4, (int)stats.free_count);
+    ABTS_ASSERT(tc, "nodes released", stats.release_count >= 1);
+    ABTS_ASSERT(tc, "bytes released", stats.release_bytes >= 1000000);
+
+    apr_allocator_destroy(allocator);
+}
+
+#define FIT_NODES 100
+
+static void test_pool_cache(abts_case *tc, void *data)
+{
+#if APR_POOL_DEBUG
+    ABTS_NOT_IMPL(tc, "Pool cache with APR_POOL_DEBUG");
+#else
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_pool_t *root, *pools[20], *pool;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_unmanaged_ex(&root, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < 20; i++) {
+        rv = apr_pool_create(&pools[i], root);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        apr_pool_tag(pools[i], "destroyed");
+        /* Nodes other than the pool's own are not kept */
+        ABTS_PTR_NOTNULL(tc, apr_palloc(pools[i], 20000));
+    }
+    for (i = 0; i < 20; i++)
+        apr_pool_destroy(pools[i]);
+
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 16, (int)stats.pool_cache_count);
+
+    /* The last pool kept is the first one reused, cleanly */
+    rv = apr_pool_create(&pool, root);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_EQUAL(tc, pools[15], pool);
+    ABTS_PTR_EQUAL(tc, root, apr_pool_parent_get(pool));
+    ABTS_PTR_EQUAL(tc, NULL, apr_pool_tag(pool, NULL));
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 15, (int)stats.pool_cache_count);
+
+    /* A full trim gives them back */
+    ABTS_ASSERT(tc, "trimmed", apr_allocator_trim(allocator) > 0);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.pool_cache_count);
+    apr_pool_destroy(pool);
+
+    /* They count against max_free like the free lists */
+    apr_allocator_max_free_set(allocator, 1);
+    for (i = 0; i < 2; i++) {
+        rv = apr_pool_create(&pools[i], root);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < 2; i++)
+        apr_pool_destroy(pools[i]);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.pool_cache_count);
+
+    apr_pool_destroy(root);
+    apr_allocator_destroy(allocator);
+
+#if APR_HAS_THREADS
+    /* The thread caches are used instead */
+    rv = apr_allocator_create_ex(&allocator, APR_ALLOCATOR_THREAD_CACHE);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_unmanaged_ex(&root, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create(&pool, root);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_pool_destroy(pool);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.pool_cache_count);
+    apr_pool_destroy(root);
+    apr_allocator_destroy(allocator);
+#endif
+#endif
+}
+
+static void test_allocator_fit(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_memnode_t *node[5], *got, *many[FIT_NODES];
+    apr_size_t sizes[] = { 3000000, 200000, 1000000, 500000, 20000 };
+    apr_size_t want, best;
+    apr_status_t rv;
+    int i, j, k, ok;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < 5; i++) {
+        node[i] = apr_allocator_alloc(allocator, sizes[i]);
+        ABTS_PTR_NOTNULL(tc, node[i]);
+    }
+    for (i = 0; i < 5; i++) {
+        apr_allocator_free(allocator, node[i]);
+    }
+
+    /* The smallest big enough oversized node */
+    got = apr_allocator_alloc(allocator, 400000);
+    ABTS_PTR_EQUAL(tc, node[3], got);
+    got = apr_allocator_alloc(allocator, 400000);
+    ABTS_PTR_EQUAL(tc, node[2], got);
+    got = apr_allocator_alloc(allocator, 150000);
+    ABTS_PTR_EQUAL(tc, node[1], got);
+
+    /* Up to twice the size from the indexed lists */
+    got = apr_allocator_alloc(allocator, 12000);
+    ABTS_PTR_EQUAL(tc, node[4], got);
+
+    apr_allocator_destroy(allocator);
+
+    /* Many oversized nodes, with sizes in common */
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < FIT_NODES; i++) {
+        many[i] = apr_allocator_alloc(allocator,
+                                      90000 + (i * 7919 % 40) * 10000);
+        ABTS_PTR_NOTNULL(tc, many[i]);
+    }
+    for (i = 0; i < FIT_NODES; i++) {
+        apr_allocator_free(allocator, many[i]);
+    }
+    for (i = 0, ok = 1; i < FIT_NODES; i++) {
+        want = 80000 + (i * 104729 % 45) * 9000;
+        for (j = 0, k = -1, best = 0; j < FIT_NODES; j++) {
+            apr_size_t size;
+
+            size = many[j]->endp - (char *)many[j];
+            if (size >= want + APR_MEMNODE_T_SIZE && (k < 0 || size < best)) {
+                k = j;
+                best = size;
+            }
+        }
+        got = apr_allocator_alloc(allocator, want);
+        ABTS_PTR_NOTNULL(tc, got);
+        if (k >= 0)
+            ok &= ((apr_size_t)(got->endp - (char *)got) == best);
+        apr_allocator_free(allocator, got);
+    }
+    ABTS_TRUE(tc, ok);
+    apr_allocator_destroy(allocator);
+}
+
+static void test_allocator_trim(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_memnode_t *node[10];
+    apr_size_t size, big;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < 10; i++) {
+        node[i] = apr_allocator_alloc(allocator, 5000);
+    }
+    size = node[0]->endp - (char *)node[0];
+    for (i = 0; i < 10; i++) {
+        apr_allocator_free(allocator, node[i]);
+    }
+    node[0] = apr_allocator_alloc(allocator, 300000);
+    big = node[0]->endp - (char *)node[0];
+    apr_allocator_free(allocator, node[0]);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_SIZE_EQUAL(tc, 10 * size + big, stats.free_bytes);
+
+    /* Nothing is old enough yet */
+    rv = apr_allocator_decay_set(allocator, apr_time_from_msec(50), 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, 0, apr_allocator_trim(allocator));
+
+    /* Use three nodes meanwhile, they are kept */
+    for (i = 0; i < 3; i++) {
+        node[i] = apr_allocator_alloc(allocator, 5000);
+    }
+    for (i = 0; i < 3; i++) {
+        apr_allocator_free(allocator, node[i]);
+    }
+    apr_sleep(apr_time_from_msec(60));
+    ABTS_SIZE_EQUAL(tc, 7 * size + big, apr_allocator_trim(allocator));
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_SIZE_EQUAL(tc, 3 * size, stats.free_bytes);
+    ABTS_SIZE_EQUAL(tc, 0, stats.sink_count);
+
+    /* Without decay, everything goes */
+    rv = apr_allocator_decay_set(allocator, 0, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, 3 * size, apr_allocator_trim(allocator));
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_SIZE_EQUAL(tc, 0, stats.free_bytes);
+
+#if APR_HAS_THREADS
+    {
+        apr_pool_t *pool;
+        apr_thread_mutex_t *mutex;
+
+        rv = apr_allocator_decay_set(allocator, apr_time_from_msec(10),
+                                     APR_ALLOCATOR_DECAY_THREAD);
+        ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+        rv = apr_pool_create(&pool, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        apr_allocator_mutex_set(allocator, mutex);
+
+        rv = apr_allocator_decay_set(allocator, apr_time_from_msec(10),
+                                     APR_ALLOCATOR_DECAY_THREAD);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+        for (i = 0; i < 10; i++) {
+            node[i] = apr_allocator_alloc(allocator, 5000);
+        }
+        for (i = 0; i < 10; i++) {
+            apr_allocator_free(allocator, node[i]);
+        }
+        for (i = 0; i < 100; i++) {
+            apr_sleep(apr_time_from_msec(10));
+            apr_allocator_stats_get(allocator, &stats);
+            if (stats.free_bytes == 0)
+                break;
+        }
+        ABTS_SIZE_EQUAL(tc, 0, stats.free_bytes);
+
+        /* Destroying the allocator stops the thread */
+        apr_allocator_destroy(allocator);
+        apr_pool_destroy(pool);
+
+        /* So does destroying its owner pool, before the cleanups destroy
+         * the mutex
+         */
+        rv = apr_allocator_create(&allocator);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_pool_create_ex(&pool, NULL, NULL, allocator);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        apr_allocator_owner_set(allocator, pool);
+        rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        apr_allocator_mutex_set(allocator, mutex);
+
+        rv = apr_allocator_decay_set(allocator, apr_time_from_msec(1),
+                                     APR_ALLOCATOR_DECAY_THREAD);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+        for (i = 0; i < 10; i++) {
+            apr_pool_t *subpool;
+
+            rv = apr_pool_create(&subpool, pool);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_PTR_NOTNULL(tc, apr_palloc(subpool, 5000));
+            apr_pool_destroy(subpool);
+            apr_sleep(apr_time_from_msec(1));
+        }
+        apr_pool_destroy(pool);
+        return;
+    }
+#endif
+
+    apr_allocator_destroy(allocator);
+}
+
+static int rewound;
+
+static apr_status_t rewind_cleanup(void *data)
+{
+    rewound++;
+    return APR_SUCCESS;
+}
+
+static void test_mark_rewind(abts_case *tc, void *data)
+{
+    apr_pool_t *pool, *subpool;
+    apr_pool_mark_t outer, inner;
+    apr_pool_stats_t before, after;
+    char *keep[3], *mem;
+    apr_status_t rv;
+    int i, n;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* Spread the pool over a few nodes first */
+    keep[0] = apr_pstrdup(pool, "small");
+    keep[1] = memset(apr_palloc(pool, 20000), 'a', 20000);
+    keep[2] = memset(apr_palloc(pool, 9000), 'b', 9000);
+    apr_pool_cleanup_register(pool, NULL, rewind_cleanup,
+                              apr_pool_cleanup_null);
+    rv = apr_pool_create(&subpool, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_pool_cleanup_register(subpool, NULL, rewind_cleanup,
+                              apr_pool_cleanup_null);
+
+    /* A free cleanup entry, reused after the mark */
+    apr_pool_cleanup_register(pool, keep, rewind_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_cleanup_kill(pool, keep, rewind_cleanup);
+    apr_pool_stats_get(pool, &before);
+
+    rewound = 0;
+    apr_pool_mark(pool, &outer);
+    for (n = 0; n < 3; n++) {
+        for (i = 0; i < 10; i++) {
+            mem = apr_palloc(pool, 1000 * i + 100);
+            ABTS_PTR_NOTNULL(tc, mem);
+            memset(mem, 'x', 1000 * i + 100);
+        }
+        apr_pool_cleanup_register(pool, NULL, rewind_cleanup,
+                                  apr_pool_cleanup_null);
+
+        apr_pool_mark(pool, &inner);
+        mem = apr_palloc(pool, 100000);
+        ABTS_PTR_NOTNULL(tc, mem);
+        memset(mem, 'y', 100000);
+        apr_pool_cleanup_register(pool, NULL, rewind_cleanup,
+                                  apr_pool_cleanup_null);
+        apr_pool_rewind(pool, &inner);
+        ABTS_INT_EQUAL(tc, 3 * n + 1, rewound);
+
+        /* Subpools created after the mark go with it */
+        rv = apr_pool_create(&subpool, pool);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        apr_pool_cleanup_register(subpool, NULL, rewind_cleanup,
+                                  apr_pool_cleanup_null);
+
+        apr_pool_rewind(pool, &outer);
+        ABTS_INT_EQUAL(tc, 3 * n + 3, rewound);
+
+        apr_pool_stats_get(pool, &after);
+        ABTS_INT_EQUAL(tc, (int)before.used_bytes, (int)after.used_bytes);
+        ABTS_INT_EQUAL(tc, (int)before.node_count, (int)after.node_count);
+    }
+
+    ABTS_STR_EQUAL(tc, "small", keep[0]);
+    ABTS_INT_EQUAL(tc, 'a', keep[1][19999]);
+    ABTS_INT_EQUAL(tc, 'b', keep[2][8999]);
+
+    /* The free entry is still there */
+    apr_pool_cleanup_register(pool, NULL, rewind_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_stats_get(pool, &after);
+    ABTS_INT_EQUAL(tc, (int)before.used_bytes, (int)after.used_bytes);
+
+    /* Killing a cleanup registered before the mark doesn't move it */
+    apr_pool_cleanup_register(pool, keep + 1, rewind_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_mark(pool, &outer);
+    apr_pool_cleanup_register(pool, NULL, rewind_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_cleanup_kill(pool, keep + 1, rewind_cleanup);
+    apr_pool_rewind(pool, &outer);
+    ABTS_INT_EQUAL(tc, 10, rewound);
+
+    apr_pool_destroy(pool);
+    ABTS_INT_EQUAL(tc, 13, rewound);
+}
+
+static void test_pool_stats(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_pool_stats_t stats;
+    apr_size_t node_bytes;
+    apr_status_t rv;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    ABTS_PTR_NOTNULL(tc, apr_palloc(pool, 100000));
+    ABTS_PTR_NOTNULL(tc, apr_palloc(pool, 100));
+    apr_pool_stats_get(pool, &stats);
+    ABTS_ASSERT(tc, "node count", stats.node_count >= 1);
+    ABTS_ASSERT(tc, "used bytes", stats.used_bytes >= 100100);
+    ABTS_ASSERT(tc, "node bytes", stats.node_bytes >= stats.used_bytes);
+    ABTS_ASSERT(tc, "node bytes max", stats.node_bytes_max == stats.node_bytes);
+    ABTS_INT_EQUAL(tc, 0, stats.clear_count);
+    node_bytes = stats.node_bytes;
+
+    apr_pool_clear(pool);
+    apr_pool_stats_get(pool, &stats);
+    ABTS_ASSERT(tc, "node bytes after clear", stats.node_bytes < node_bytes);
+    ABTS_ASSERT(tc, "node bytes max after clear",
+                stats.node_bytes_max == node_bytes);
+    ABTS_INT_EQUAL(tc, 1, stats.clear_count);
+
+    /* The mark is raised as nodes are taken, not on clear */
+    ABTS_PTR_NOTNULL(tc, apr_palloc(pool, 200000));
+    ABTS_PTR_NOTNULL(tc, apr_psprintf(pool, "%0*d", 150000, 0));
+    apr_pool_stats_get(pool, &stats);
+    ABTS_ASSERT(tc, "node bytes max raised", stats.node_bytes_max > node_bytes);
+    ABTS_ASSERT(tc, "node bytes max tracked",
+                stats.node_bytes_max == stats.node_bytes);
+
+    apr_pool_destroy(pool);
+}
+
+static int profile_find(void *baton, const apr_pool_profile_site_t *site)
+{
+    apr_pool_profile_site_t *found = baton;
+
+    if (site->tag && strcmp(site->tag, "profiled") == 0) {
+        found->samples += site->samples;
+        found->alloc_bytes += site->alloc_bytes;
+        found->node_bytes += site->node_bytes;
+        if (site->file_line)
+            found->file_line = site->file_line;
+    }
+    return 0;
+}
+
+static const char profile_file_line[] = "testpools.c:profiled";
+
+static void test_pool_profile(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_pool_profile_site_t found;
+    apr_file_t *file;
+    apr_off_t offset = 0;
+    char buf[8192];
+    apr_size_t len = sizeof(buf) - 1;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_pool_profile_start(1);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Pool profiling with APR_POOL_DEBUG");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_pool_profile_reset();
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_pool_tag(pool, "profiled");
+
+    /* Every allocation is sampled at rate 1, but for a 1 in 2^32 draw */
+    for (i = 0; i < 100; i++)
+        ABTS_PTR_NOTNULL(tc, apr_palloc(pool, 1000));
+    apr_pool_profile_stop();
+    ABTS_PTR_NOTNULL(tc, apr_palloc(pool, 1000));
+
+    memset(&found, 0, sizeof(found));
+    apr_pool_profile_walk(profile_find, &found);
+    ABTS_ASSERT(tc, "samples", found.samples >= 99);
+    ABTS_ASSERT(tc, "alloc bytes", found.alloc_bytes >= 99 * 1000
+                                   && found.alloc_bytes <= 100 * 1000);
+    ABTS_ASSERT(tc, "node bytes", found.node_bytes >= 99 * 1000
+                                  - 8192);
+    ABTS_PTR_EQUAL(tc, NULL, found.file_line);
+
+    /* What APR_POOL_PROFILE makes of apr_psprintf() and apr_palloc() */
+    apr_pool_profile_start(1);
+    for (i = 0; i < 10; i++) {
+        ABTS_PTR_NOTNULL(tc, apr_psprintf_debug(pool, profile_file_line,
+                                                "%d", i));
+        ABTS_PTR_NOTNULL(tc, apr_palloc_debug(pool, 10, profile_file_line));
+    }
+    apr_pool_profile_stop();
+    memset(&found, 0, sizeof(found));
+    apr_pool_profile_walk(profile_find, &found);
+    ABTS_STR_EQUAL(tc, profile_file_line, found.file_line);
+
+    rv = apr_file_mktemp(&file, apr_pstrdup(p, "data/profileXXXXXX"), 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_profile_dump(file, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_file_seek(file, APR_SET, &offset);
+    apr_file_read(file, buf, &len);
+    buf[len] = '\0';
+    apr_file_close(file);
+    ABTS_PTR_NOTNULL(tc, strstr(buf, "Per tag:"));
+    ABTS_PTR_NOTNULL(tc, strstr(buf, "Per site:"));
+    ABTS_PTR_NOTNULL(tc, strstr(buf, "Pool tree:"));
+    ABTS_PTR_NOTNULL(tc, strstr(buf, "profiled"));
+    ABTS_PTR_NOTNULL(tc, strstr(buf, profile_file_line));
+
+    apr_pool_profile_reset();
+    memset(&found, 0, sizeof(found));
+    apr_pool_profile_walk(profile_find, &found);
+    ABTS_ASSERT(tc, "samples after reset", found.samples == 0);
+
+    apr_pool_destroy(pool);
+}
+
+static void test_pool_arena(abts_case *tc, void *data)
+{
+    apr_pool_t *pool, *arena;
+    apr_table_t *conf, *frozen;
+    apr_pool_stats_t stats;
+    const char *val;
+    char *first, *last;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    conf = apr_table_make(pool, 1);
+    for (i = 0; i < 200; i++) {
+        apr_table_setn(conf, apr_psprintf(pool, "key%d", i),
+                       apr_psprintf(pool, "value%d", i));
+    }
+    apr_pool_stats_get(pool, &stats);
+
+    rv = apr_pool_create_arena(&arena, p, stats.used_bytes);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_freeze(pool, 0);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Pool arenas with APR_POOL_DEBUG");
+        apr_pool_destroy(arena);
+        apr_pool_destroy(pool);
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    first = apr_palloc(arena, 1);
+    frozen = apr_table_clone(arena, conf);
+    last = apr_palloc(arena, 1);
+    apr_pool_destroy(pool);
+
+    rv = apr_pool_freeze(arena, APR_POOL_FREEZE_READONLY);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Read-only pool arenas");
+        apr_pool_destroy(arena);
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* The clone is packed in the arena, which is page aligned */
+    ABTS_ASSERT(tc, "arena alignment", ((apr_uintptr_t)first & 4095) == 0);
+    ABTS_ASSERT(tc, "arena packing", last > first
+                && (apr_size_t)(last - first) <= stats.used_bytes);
+    val = apr_table_get(frozen, "key123");
+    ABTS_STR_EQUAL(tc, "value123", val);
+    ABTS_ASSERT(tc, "value in arena", val > first && val < last);
+
+    /* Allocations still work, from elsewhere */
+    val = apr_pstrdup(arena, "after");
+    ABTS_ASSERT(tc, "allocation after freeze", val < first || val > last);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_pool_freeze(arena, 0));
+
+    /* Clearing gives the arena back, writable */
+    apr_pool_clear(arena);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_pool_freeze(arena, 0));
+    ABTS_PTR_NOTNULL(tc, apr_pcalloc(arena, 100000));
+
+    apr_pool_destroy(arena);
+}
+
+static void test_pool_arena_cleanups(abts_case *tc, void *data)
+{
+    apr_pool_t *arena;
+    apr_pool_cleanup_t c;
+    apr_status_t rv;
+    int ran = 0, killed = 0, i;
+
+    for (i = 0; i < 2; i++) {
+        rv = apr_pool_create_arena(&arena, p, 8192);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        apr_pool_cleanup_register(arena, &ran, count_cleanup,
+                                  apr_pool_cleanup_null);
+        apr_pool_cleanup_register_ex(&c, arena, &killed, count_cleanup,
+                                     apr_pool_cleanup_null);
+        ABTS_PTR_NOTNULL(tc, apr_pstrdup(arena, "frozen"));
+
+        rv = apr_pool_freeze(arena, APR_POOL_FREEZE_READONLY);
+        if (rv == APR_ENOTIMPL) {
+            ABTS_NOT_IMPL(tc, "Read-only pool arenas");
+            apr_pool_destroy(arena);
+            return;
+        }
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+        /* None of these write to the arena */
+        apr_pool_cleanup_kill_ex(arena, &c);
+        apr_pool_cleanup_register(arena, &ran, count_cleanup,
+                                  apr_pool_cleanup_null);
+        apr_pool_pre_cleanup_register(arena, &ran, count_cleanup);
+
+        if (i == 0) {
+            apr_pool_clear(arena);
+            ABTS_INT_EQUAL(tc, 3, ran);
+        }
+        apr_pool_destroy(arena);
+    }
+    ABTS_INT_EQUAL(tc, 6, ran);
+    ABTS_INT_EQUAL(tc, 0, killed);
+}
+
+#if APR_HAS_THREADS
+#define CACHE_THREADS 4
+#define CACHE_LOOPS   500
+
+static void * APR_THREAD_FUNC thread_cache_worker(apr_thread_t *thd,
+                                                  void *data)
+{
+    apr_pool_t *parent = data, *sub;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t size;
+    char *mem;
+    int i, j;
+
+    for (i = 0; i < CACHE_LOOPS && rv == APR_SUCCESS; i++) {
+        if ((rv = apr_pool_create(&sub, parent)) != APR_SUCCESS)
+            break;
+
+        /* Spread the allocations over a few node sizes */
+        for (j = 1; j <= 8; j++) {
+            size = (apr_size_t)((i + j) % 5 + 1) * 4096;
+            mem = apr_palloc(sub, size);
+            memset(mem, j, size);
+            if (mem[0] != j || mem[size - 1] != j)
+                rv = APR_EGENERAL;
+        }
+
+        apr_pool_destroy(sub);
+    }
+
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void test_thread_cache(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_thread_t *threads[CACHE_THREADS];
+    apr_pool_t *pool;
+    apr_status_t rv, retval;
+    int i;
+
+    rv = apr_allocator_create_ex(&allocator, APR_ALLOCATOR_THREAD_CACHE);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_ex(&pool, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, pool);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_mutex_set(allocator, mutex);
+
+    for (i = 0; i < CACHE_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, thread_cache_worker,
+                               pool, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < CACHE_THREADS; i++) {
+        rv = apr_thread_join(&retval, threads[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+
+    apr_pool_destroy(pool);
+}
+
+#define CONCURRENT_THREADS 4
+#define CONCURRENT_ALLOCS  2000
+
+typedef struct {
+    apr_pool_t *pool;
+    int id;
+    char *strs[CONCURRENT_ALLOCS];
+    apr_uint64_t *counters[CONCURRENT_ALLOCS / 100];
+} concurrent_data_t;
+
+static void * APR_THREAD_FUNC concurrent_worker(apr_thread_t *thd,
+                                                void *data)
+{
+    concurrent_data_t *d = data;
+    char *mem;
+    int i;
+
+    for (i = 0; i < CONCURRENT_ALLOCS; i++) {
+        if (i % 100 == 0) {
+            /* Now and then something bigger than a node, or aligned */
+            mem = apr_palloc(d->pool, 70000);
+            memset(mem, d->id, 70000);
+            d->counters[i / 100] = apr_pcalloc_aligned(d->pool,
+                                                      sizeof(apr_uint64_t),
+                                                      64);
+        }
+        if (i % 2)
+            d->strs[i] = apr_psprintf(d->pool, "%d:%d:%0*d", d->id, i,
+                                      i % 500, 0);
+        else
+            d->strs[i] = apr_pstrcat(d->pool, apr_itoa(d->pool, d->id), ":",
+                                     apr_itoa(d->pool, i), NULL);
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void concurrent_pool_check(abts_case *tc, apr_allocator_t *allocator)
+{
+    apr_pool_t *pool;
+    apr_thread_t *threads[CONCURRENT_THREADS];
+    concurrent_data_t *d[CONCURRENT_THREADS];
+    apr_status_t rv, retval;
+    char *expect;
+    int i, j;
+
+    rv = apr_pool_create_concurrent(&pool, p, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < CONCURRENT_THREADS; i++) {
+        d[i] = apr_pcalloc(p, sizeof(concurrent_data_t));
+        d[i]->pool = pool;
+        d[i]->id = i;
+        rv = apr_thread_create(&threads[i], NULL, concurrent_worker, d[i], p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < CONCURRENT_THREADS; i++) {
+        rv = apr_thread_join(&retval, threads[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    /* No block was handed out twice */
+    for (i = 0; i < CONCURRENT_THREADS; i++) {
+        for (j = 0; j < CONCURRENT_ALLOCS; j++) {
+            if (j % 2)
+                expect = apr_psprintf(p, "%d:%d:%0*d", i, j, j % 500, 0);
+            else
+                expect = apr_psprintf(p, "%d:%d", i, j);
+            ABTS_STR_EQUAL(tc, expect, d[i]->strs[j]);
+        }
+        for (j = 0; j < CONCURRENT_ALLOCS / 100; j++) {
+            ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)d[i]->counters[j]
+                                        & 63));
+            ABTS_INT_EQUAL(tc, 0, (int)*d[i]->counters[j]);
+        }
+    }
+
+    /* Still usable after a clear */
+    apr_pool_clear(pool);
+    ABTS_STR_EQUAL(tc, "abc", apr_pstrdup(pool, "abc"));
+
+    apr_pool_destroy(pool);
+}
+
+static void test_concurrent_pool(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+
+    concurrent_pool_check(tc, NULL);
+
+    /* The refill lock is all that protects an allocator without mutex */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_allocator_create(&allocator));
+    concurrent_pool_check(tc, allocator);
+    apr_allocator_destroy(allocator);
+}
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testpool(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -149,7 +1230,25 @@ abts_suite *testpool(abts_suite *suite)
     abts_run_test(suite, test_notancestor, NULL);
     abts_run_test(suite, alloc_bytes, NULL);
     abts_run_test(suite, calloc_bytes, NULL);
+    abts_run_test(suite, aligned_bytes, NULL);
+    abts_run_test(suite, grow_bytes, NULL);
     abts_run_test(suite, test_cleanups, NULL);
+    abts_run_test(suite, test_cleanup_handles, NULL);
+    abts_run_test(suite, test_huge_pages, NULL);
+    abts_run_test(suite, test_numa, NULL);
+    abts_run_test(suite, test_allocator_stats, NULL);
+    abts_run_test(suite, test_allocator_fit, NULL);
+    abts_run_test(suite, test_pool_cache, NULL);
+    abts_run_test(suite, test_allocator_trim, NULL);
+    abts_run_test(suite, test_pool_stats, NULL);
+    abts_run_test(suite, test_pool_profile, NULL);
+    abts_run_test(suite, test_pool_arena, NULL);
+    abts_run_test(suite, test_pool_arena_cleanups, NULL);
+    abts_run_test(suite, test_mark_rewind, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_thread_cache, NULL);
+    abts_run_test(suite, test_concurrent_pool, NULL);
+#endif
 
     return suite;
 }
@@ -255,6 +255,10 @@ static int compk(void *a, void *b){
     return comp(a, b);
 }
 
+static int rcomp(void *a, void *b){
+    return comp(b, a);
+}
+
 static void skiplist_test(abts_case *tc, void *data) {
     int test_elems = 10;
     int i = 0, j = 0;
@@ -299,6 +303,129 @@ static void skiplist_test(abts_case *tc, void *data) {
     apr_pool_clear(ptmp);
 }
 
+static void skiplist_index(abts_case *tc, void *data)
+{
+    apr_skiplist *list;
+    apr_skiplistnode *iter;
+    int *vals = apr_palloc(ptmp, 100 * sizeof(int));
+    int i, last, *val;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&list, ptmp));
+    apr_skiplist_set_compare(list, comp, compk);
+
+    /* Half of the elements are indexed when the index is added, half
+     * when they are inserted.
+     */
+    for (i = 0; i < 100; ++i) {
+        vals[i] = i;
+        if (i == 50) {
+            apr_skiplist_add_index(list, rcomp, rcomp);
+        }
+        apr_skiplist_insert(list, &vals[i]);
+    }
+
+    /* The index is in reverse order */
+    val = apr_skiplist_find_compare(list, &vals[42], &iter, rcomp);
+    ABTS_PTR_EQUAL(tc, &vals[42], val);
+    ABTS_PTR_EQUAL(tc, &vals[41], apr_skiplist_next(list, &iter));
+    ABTS_PTR_EQUAL(tc, &vals[42], apr_skiplist_previous(list, &iter));
+    ABTS_PTR_EQUAL(tc, &vals[43], apr_skiplist_previous(list, &iter));
+
+    /* Removals through either comparison remove from both */
+    ABTS_TRUE(tc, apr_skiplist_remove_compare(list, &vals[10], NULL, rcomp));
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_find(list, &vals[10], NULL));
+    ABTS_PTR_EQUAL(tc, NULL,
+                   apr_skiplist_find_compare(list, &vals[10], NULL, rcomp));
+    ABTS_TRUE(tc, apr_skiplist_remove(list, &vals[60], NULL));
+    ABTS_PTR_EQUAL(tc, NULL,
+                   apr_skiplist_find_compare(list, &vals[60], NULL, rcomp));
+    ABTS_PTR_EQUAL(tc, &vals[0], apr_skiplist_pop(list, NULL));
+    ABTS_PTR_EQUAL(tc, NULL,
+                   apr_skiplist_find_compare(list, &vals[0], NULL, rcomp));
+    ABTS_TRUE(tc, 97 == skiplist_get_size(tc, list));
+
+    /* The index still holds the others, in order */
+    val = apr_skiplist_find_compare(list, &vals[99], &iter, rcomp);
+    for (i = 0, last = 100; val; val = apr_skiplist_next(list, &iter)) {
+        ABTS_TRUE(tc, *val < last);
+        last = *val;
+        ++i;
+    }
+    ABTS_INT_EQUAL(tc, 97, i);
+
+    apr_skiplist_destroy(list, NULL);
+    ABTS_TRUE(tc, 0 == skiplist_get_size(tc, list));
+    apr_pool_clear(ptmp);
+}
+
+#define NUM_MANY 5000
+static void skiplist_many_pool(abts_case *tc, apr_pool_t *pool)
+{
+    apr_skiplist *list;
+    apr_skiplistnode *iter;
+    int *vals = malloc(NUM_MANY * sizeof(int));
+    int i, n, last, ok, *val;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&list, pool));
+    apr_skiplist_set_compare(list, comp, compk);
+
+    for (i = 0; i < NUM_MANY; ++i) {
+        vals[i] = i;
+    }
+    /* In scattered order */
+    for (i = 0; i < NUM_MANY; ++i) {
+        apr_skiplist_insert(list, &vals[(i * 7919) % NUM_MANY]);
+    }
+    ABTS_TRUE(tc, NUM_MANY == skiplist_get_size(tc, list));
+
+    /* Remove one in three, whatever their height */
+    for (i = 0, ok = 1; i < NUM_MANY; i += 3) {
+        ok &= apr_skiplist_remove(list, &vals[i], NULL) != 0;
+    }
+    ABTS_TRUE(tc, ok);
+    n = NUM_MANY - (NUM_MANY + 2) / 3;
+    ABTS_TRUE(tc, n == skiplist_get_size(tc, list));
+    for (i = 0, ok = 1; i < NUM_MANY; ++i) {
+        val = apr_skiplist_find(list, &vals[i], NULL);
+        ok &= (i % 3) ? (val == &vals[i]) : (val == NULL);
+    }
+    ABTS_TRUE(tc, ok);
+
+    /* Backward from the last one */
+    val = apr_skiplist_find(list, &vals[NUM_MANY - 1], &iter);
+    for (i = 0, ok = 1, last = NUM_MANY; val;
+         val = apr_skiplist_previous(list, &iter)) {
+        ok &= (*val < last);
+        last = *val;
+        ++i;
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_INT_EQUAL(tc, n, i);
+
+    /* Reinsert the removed ones, then pop all in order */
+    for (i = 0; i < NUM_MANY; i += 3) {
+        apr_skiplist_insert(list, &vals[i]);
+    }
+    for (i = 0, ok = 1; (val = apr_skiplist_pop(list, NULL)) != NULL; ++i) {
+        ok &= (val == &vals[i]);
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_INT_EQUAL(tc, NUM_MANY, i);
+    ABTS_INT_EQUAL(tc, 0, apr_skiplist_height(list));
+
+    apr_skiplist_destroy(list, NULL);
+    free(vals);
+}
+
+static void skiplist_many(abts_case *tc, void *data)
+{
+    skiplist_many_pool(tc, ptmp);
+    apr_pool_clear(ptmp);
+
+    /* malloc()ed */
+    skiplist_many_pool(tc, NULL);
+}
+
 
 abts_suite *testskiplist(abts_suite *suite)
 {
@@ -317,6 +444,8 @@ abts_suite *testskiplist(abts_suite *suite)
     abts_run_test(suite, skiplist_random_loop, NULL);
 
     abts_run_test(suite, skiplist_test, NULL);
+    abts_run_test(suite, skiplist_index, NULL);
+    abts_run_test(suite, skiplist_many, NULL);
 
     apr_pool_destroy(ptmp);
 
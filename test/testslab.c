@@ -0,0 +1,203 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_slab.h"
+#include "apr_thread_proc.h"
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+static void slab_sizes(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_slab_t *slab;
+    apr_slab_stats_t stats;
+    static const struct {
+        apr_size_t size, expected;
+    } sizes[] = {
+        { 1, sizeof(void *) }, { 12, 16 }, { 24, 32 }, { 33, 64 },
+        { 64, 64 }, { 65, 128 }, { 200, 256 }, { 5000, 5056 }
+    };
+    int i;
+
+    apr_pool_create(&pool, p);
+
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_slab_create(&slab, 0, 0, pool));
+    ABTS_PTR_EQUAL(tc, NULL, slab);
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        char *obj;
+
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_slab_create(&slab, sizes[i].size, 0, pool));
+        apr_slab_stats_get(slab, &stats);
+        ABTS_SIZE_EQUAL(tc, sizes[i].expected, stats.object_size);
+
+        obj = apr_slab_alloc(slab);
+        ABTS_PTR_NOTNULL(tc, obj);
+        memset(obj, 'x', sizes[i].size);
+        if (stats.object_size >= 64) {
+            ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)obj % 64));
+        }
+        else {
+            ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)obj
+                                        % stats.object_size));
+        }
+    }
+
+    apr_pool_destroy(pool);
+}
+
+static void slab_reuse(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_slab_t *slab;
+    apr_slab_stats_t stats;
+    void *objs[1000];
+    char *obj;
+    int i;
+
+    apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_slab_create(&slab, 48, 0, pool));
+
+    for (i = 0; i < 1000; i++) {
+        objs[i] = apr_slab_alloc(slab);
+        ABTS_PTR_NOTNULL(tc, objs[i]);
+        memset(objs[i], i & 0xff, 48);
+    }
+    for (i = 1; i < 1000; i++) {
+        ABTS_ASSERT(tc, "objects overlap",
+                    (char *)objs[i] + 64 <= (char *)objs[i - 1]
+                    || (char *)objs[i - 1] + 64 <= (char *)objs[i]);
+    }
+
+    apr_slab_stats_get(slab, &stats);
+    ABTS_SIZE_EQUAL(tc, 1000, stats.object_count);
+    ABTS_SIZE_EQUAL(tc, 0, stats.free_count);
+    ABTS_ASSERT(tc, "no node", stats.node_count > 0);
+    ABTS_ASSERT(tc, "nodes too small",
+                stats.node_bytes >= stats.object_count * stats.object_size);
+
+    apr_slab_free(slab, objs[10]);
+    apr_slab_free(slab, objs[20]);
+    apr_slab_stats_get(slab, &stats);
+    ABTS_SIZE_EQUAL(tc, 2, stats.free_count);
+
+    /* Last freed, first reused */
+    ABTS_PTR_EQUAL(tc, objs[20], apr_slab_alloc(slab));
+    obj = apr_slab_calloc(slab);
+    ABTS_PTR_EQUAL(tc, objs[10], obj);
+    for (i = 0; i < 64; i++) {
+        ABTS_INT_EQUAL(tc, 0, obj[i]);
+    }
+
+    apr_slab_stats_get(slab, &stats);
+    ABTS_SIZE_EQUAL(tc, 1000, stats.object_count);
+    ABTS_SIZE_EQUAL(tc, 0, stats.free_count);
+    ABTS_INT_EQUAL(tc, 1002, (int)stats.alloc_calls);
+    ABTS_INT_EQUAL(tc, 2, (int)stats.free_calls);
+
+    /* Destroying the slab early must not upset the pool's destruction */
+    apr_slab_destroy(slab);
+    apr_pool_destroy(pool);
+}
+
+#if APR_HAS_THREADS
+
+#define SLAB_THREADS    4
+#define SLAB_LOOPS      10000
+#define SLAB_HELD       100
+
+static void * APR_THREAD_FUNC slab_thread(apr_thread_t *thd, void *data)
+{
+    apr_slab_t *slab = data;
+    apr_uint32_t *held[SLAB_HELD];
+    apr_uint32_t tag = (apr_uint32_t)(apr_uintptr_t)&held;
+    int i, n, failed = 0;
+
+    for (i = 0; i < SLAB_LOOPS; i++) {
+        for (n = 0; n < 1 + i % SLAB_HELD; n++) {
+            held[n] = apr_slab_alloc(slab);
+            *held[n] = tag + n;
+        }
+        while (n--) {
+            if (*held[n] != tag + n)
+                failed = 1;
+            apr_slab_free(slab, held[n]);
+        }
+    }
+
+    apr_thread_exit(thd, failed ? APR_EGENERAL : APR_SUCCESS);
+    return NULL;
+}
+
+static void slab_threads(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_slab_t *slab;
+    apr_slab_stats_t stats;
+    apr_thread_t *threads[SLAB_THREADS];
+    apr_status_t rv;
+    int i;
+
+    apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_slab_create(&slab, 32, APR_SLAB_THREADS, pool));
+
+    for (i = 0; i < SLAB_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, slab_thread, slab, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < SLAB_THREADS; i++) {
+        apr_thread_join(&rv, threads[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    /* Every object was freed, wherever it ended up */
+    apr_slab_stats_get(slab, &stats);
+    ABTS_SIZE_EQUAL(tc, stats.object_count, stats.free_count);
+    ABTS_ASSERT(tc, "too many objects",
+                stats.object_count <= SLAB_THREADS * (SLAB_HELD + 32));
+    ABTS_ASSERT(tc, "alloc/free calls mismatch",
+                stats.alloc_calls == stats.free_calls);
+
+    /* Nothing is left in the thread caches */
+    apr_slab_destroy(slab);
+    apr_slab_stats_get(slab, &stats);
+    ABTS_SIZE_EQUAL(tc, 0, stats.free_count);
+    ABTS_SIZE_EQUAL(tc, 0, stats.node_count);
+
+    apr_pool_destroy(pool);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testslab(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, slab_sizes, NULL);
+    abts_run_test(suite, slab_reuse, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, slab_threads, NULL);
+#endif
+
+    return suite;
+}
@@ -20,6 +20,7 @@
 #include "apr_general.h"
 #include "apr_pools.h"
 #include "apr_tables.h"
+#include "apr_strings.h"
 #if APR_HAVE_STDIO_H
 #include <stdio.h>
 #endif
@@ -42,6 +43,236 @@ static void array_clear(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, 0, a1->nelts);
 }
 
+static void array_reserve(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_array_header_t *a;
+    char *elts;
+    int i, ok;
+
+    apr_pool_create(&pool, p);
+    a = apr_array_make(pool, 4, sizeof(int));
+    for (i = 0; i < 4; i++) {
+        APR_ARRAY_PUSH(a, int) = i;
+    }
+
+    /* The last allocation of the pool, grown in place */
+    elts = a->elts;
+    APR_ARRAY_PUSH(a, int) = 4;
+#if !APR_POOL_DEBUG
+    ABTS_PTR_EQUAL(tc, elts, a->elts);
+#endif
+    ABTS_INT_EQUAL(tc, 8, a->nalloc);
+
+    apr_array_reserve(a, 1000);
+    ABTS_TRUE(tc, a->nalloc >= 1000);
+    ABTS_INT_EQUAL(tc, 5, a->nelts);
+    elts = a->elts;
+    for (i = 5, ok = 1; i < 1000; i++) {
+        ok &= (APR_ARRAY_IDX(a, i, int) == 0);
+        APR_ARRAY_PUSH(a, int) = i;
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_PTR_EQUAL(tc, elts, a->elts);
+    for (i = 0, ok = 1; i < 1000; i++) {
+        ok &= (APR_ARRAY_IDX(a, i, int) == i);
+    }
+    ABTS_TRUE(tc, ok);
+
+    /* Not the last allocation any more, moved */
+    apr_palloc(pool, 1);
+    apr_array_reserve(a, 2000);
+    ABTS_TRUE(tc, a->elts != elts);
+    for (i = 0, ok = 1; i < 1000; i++) {
+        ok &= (APR_ARRAY_IDX(a, i, int) == i);
+    }
+    ABTS_TRUE(tc, ok);
+
+    apr_pool_destroy(pool);
+}
+
+static void array_copy_hdr_push(abts_case *tc, void *data)
+{
+    apr_array_header_t *a, *b;
+
+    a = apr_array_make(p, 2, sizeof(int));
+    APR_ARRAY_PUSH(a, int) = 1;
+    APR_ARRAY_PUSH(a, int) = 2;
+
+    /* Pushing to the copy does not touch the original's elements */
+    b = apr_array_copy_hdr(p, a);
+    APR_ARRAY_PUSH(b, int) = 3;
+    APR_ARRAY_IDX(b, 0, int) = 10;
+    ABTS_INT_EQUAL(tc, 1, APR_ARRAY_IDX(a, 0, int));
+    ABTS_INT_EQUAL(tc, 2, a->nelts);
+    ABTS_INT_EQUAL(tc, 3, b->nelts);
+}
+
+static int int_cmp(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int str_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+typedef struct {
+    char name[12];
+    apr_int32_t weight;
+    int order;
+} sort_elt_t;
+
+static int elt_cmp(const void *a, const void *b)
+{
+    return int_cmp(&((const sort_elt_t *)a)->weight,
+                   &((const sort_elt_t *)b)->weight);
+}
+
+#define SORT_N 10000
+
+static void array_sort(abts_case *tc, void *data)
+{
+    apr_array_header_t *a;
+    const char *words[] = { "pear", "apple", "fig", "kiwi", "date", "lime" };
+    int i, n, ok;
+
+    a = apr_array_make(p, 8, sizeof(const char *));
+    apr_array_sort(a, str_cmp);
+    for (i = 0; i < 6; i++) {
+        APR_ARRAY_PUSH(a, const char *) = words[i];
+    }
+    apr_array_sort(a, str_cmp);
+    ABTS_STR_EQUAL(tc, "apple", APR_ARRAY_IDX(a, 0, const char *));
+    ABTS_STR_EQUAL(tc, "date", APR_ARRAY_IDX(a, 1, const char *));
+    ABTS_STR_EQUAL(tc, "pear", APR_ARRAY_IDX(a, 5, const char *));
+
+    /* Random, sorted, reversed, few distinct values, and an odd size */
+    srand(24);
+    for (n = 0; n < 4; n++) {
+        a = apr_array_make(p, SORT_N, sizeof(int));
+        for (i = 0; i < SORT_N; i++) {
+            int v = (n == 0) ? rand()
+                  : (n == 1) ? i
+                  : (n == 2) ? SORT_N - i
+                  : rand() % 3;
+            APR_ARRAY_PUSH(a, int) = v;
+        }
+        apr_array_sort(a, int_cmp);
+        for (i = 1, ok = 1; i < SORT_N; i++) {
+            ok &= (APR_ARRAY_IDX(a, i - 1, int) <= APR_ARRAY_IDX(a, i, int));
+        }
+        ABTS_TRUE(tc, ok);
+    }
+
+    a = apr_array_make(p, SORT_N, sizeof(sort_elt_t));
+    for (i = 0; i < SORT_N; i++) {
+        sort_elt_t *e = apr_array_push(a);
+        e->weight = rand() - RAND_MAX / 2;
+        apr_snprintf(e->name, sizeof(e->name), "%d", e->weight);
+    }
+    apr_array_sort(a, elt_cmp);
+    for (i = 0, ok = 1; i < SORT_N; i++) {
+        sort_elt_t *e = &APR_ARRAY_IDX(a, i, sort_elt_t);
+        ok &= (atoi(e->name) == e->weight);
+        if (i > 0) {
+            ok &= (e[-1].weight <= e->weight);
+        }
+    }
+    ABTS_TRUE(tc, ok);
+}
+
+static void array_sort_key(abts_case *tc, void *data)
+{
+    apr_array_header_t *a;
+    int i, n, ok;
+
+    a = apr_array_make(p, 1, sizeof(sort_elt_t));
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_array_sort_key(a, 0, 3, 0));
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_array_sort_key(a, sizeof(sort_elt_t) - 2, 4, 0));
+
+    /* Small ones are sorted by insertion, large ones by radix */
+    for (n = 10; n <= SORT_N; n *= 10) {
+        a = apr_array_make(p, n, sizeof(sort_elt_t));
+        for (i = 0; i < n; i++) {
+            sort_elt_t *e = apr_array_push(a);
+            e->weight = (rand() % 1000) - 500;
+            e->order = i;
+        }
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_array_sort_key(a, APR_OFFSETOF(sort_elt_t, weight),
+                                          sizeof(apr_int32_t), 1));
+        for (i = 1, ok = 1; i < n; i++) {
+            sort_elt_t *e = &APR_ARRAY_IDX(a, i, sort_elt_t);
+
+            /* Stable */
+            ok &= (e[-1].weight < e->weight
+                   || (e[-1].weight == e->weight && e[-1].order < e->order));
+        }
+        ABTS_TRUE(tc, ok);
+    }
+
+    a = apr_array_make(p, SORT_N, sizeof(apr_uint64_t));
+    for (i = 0; i < SORT_N; i++) {
+        APR_ARRAY_PUSH(a, apr_uint64_t) =
+            (apr_uint64_t)rand() << 40 | (apr_uint64_t)i;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_array_sort_key(a, 0, sizeof(apr_uint64_t), 0));
+    for (i = 1, ok = 1; i < SORT_N; i++) {
+        ok &= (APR_ARRAY_IDX(a, i - 1, apr_uint64_t)
+               < APR_ARRAY_IDX(a, i, apr_uint64_t));
+    }
+    ABTS_TRUE(tc, ok);
+}
+
+static void array_bsearch_unique(abts_case *tc, void *data)
+{
+    apr_array_header_t *a;
+    int i, key, index, ok;
+
+    a = apr_array_make(p, 1, sizeof(int));
+    key = 1;
+    ABTS_PTR_EQUAL(tc, NULL, apr_array_bsearch(a, &key, int_cmp, &index));
+    ABTS_INT_EQUAL(tc, 0, index);
+
+    /* Each even value from 0 to 198 twice */
+    for (i = 0; i < 200; i++) {
+        APR_ARRAY_PUSH(a, int) = (i * 37 % 100) * 2;
+    }
+    apr_array_sort_unique(a, int_cmp);
+    ABTS_INT_EQUAL(tc, 100, a->nelts);
+    for (i = 0, ok = 1; i < 100; i++) {
+        ok &= (APR_ARRAY_IDX(a, i, int) == 2 * i);
+    }
+    ABTS_TRUE(tc, ok);
+
+    for (key = -1, ok = 1; key < 200; key++) {
+        int *v = apr_array_bsearch(a, &key, int_cmp, &index);
+
+        if (key % 2 == 0) {
+            ok &= (v && *v == key && index == key / 2);
+        }
+        else {
+            ok &= (!v && index == (key + 1) / 2);
+        }
+    }
+    ABTS_TRUE(tc, ok);
+
+    /* The first of the equal ones */
+    apr_array_clear(a);
+    for (i = 0; i < 10; i++) {
+        APR_ARRAY_PUSH(a, int) = i / 4;
+    }
+    key = 1;
+    ABTS_PTR_EQUAL(tc, &APR_ARRAY_IDX(a, 4, int),
+                   apr_array_bsearch(a, &key, int_cmp, NULL));
+}
+
 static void table_make(abts_case *tc, void *data)
 {
     t1 = apr_table_make(p, 5);
@@ -199,11 +430,129 @@ static void table_overlap2(abts_case *tc, void *data)
 
 }
 
+static void table_large(abts_case *tc, void *data)
+{
+    apr_pool_t *subp;
+    apr_table_t *t, *c;
+    const apr_array_header_t *arr;
+    apr_table_entry_t *elts;
+    char key[32];
+    int i;
+
+    apr_pool_create(&subp, p);
+    t = apr_table_make(subp, 1);
+
+    /* All the keys share their first characters, as would many headers */
+    for (i = 0; i < 300; i++) {
+        apr_snprintf(key, sizeof(key), "X-Header-%d", i);
+        apr_table_add(t, key, key);
+    }
+    ABTS_INT_EQUAL(tc, 300, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "X-Header-0", apr_table_get(t, "x-header-0"));
+    ABTS_STR_EQUAL(tc, "X-Header-299", apr_table_get(t, "X-HEADER-299"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header-300"));
+
+    /* Duplicates are found first to last */
+    apr_table_add(t, "x-header-42", "again");
+    ABTS_STR_EQUAL(tc, "X-Header-42", apr_table_get(t, "X-Header-42"));
+    ABTS_STR_EQUAL(tc, "X-Header-42,again",
+                   apr_table_getm(subp, t, "X-Header-42"));
+    apr_table_set(t, "X-Header-42", "set");
+    ABTS_INT_EQUAL(tc, 300, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "set", apr_table_get(t, "x-header-42"));
+    apr_table_set(t, "X-Header-43", "set too");
+    ABTS_STR_EQUAL(tc, "set too", apr_table_get(t, "x-header-43"));
+    apr_table_merge(t, "X-Header-44", "merged");
+    ABTS_STR_EQUAL(tc, "X-Header-44, merged", apr_table_get(t, "X-Header-44"));
+
+    /* Removals keep the order of the others, and their lookups */
+    for (i = 0; i < 300; i += 2) {
+        apr_snprintf(key, sizeof(key), "X-Header-%d", i);
+        apr_table_unset(t, key);
+    }
+    arr = apr_table_elts(t);
+    elts = (apr_table_entry_t *)arr->elts;
+    ABTS_INT_EQUAL(tc, 150, arr->nelts);
+    for (i = 0; i < arr->nelts; i++) {
+        apr_snprintf(key, sizeof(key), "X-Header-%d", 2 * i + 1);
+        ABTS_STR_EQUAL(tc, key, elts[i].key);
+        ABTS_PTR_EQUAL(tc, elts[i].val, apr_table_get(t, key));
+    }
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header-42"));
+
+    c = apr_table_copy(subp, t);
+    ABTS_STR_EQUAL(tc, "set too", apr_table_get(c, "X-Header-43"));
+    c = apr_table_clone(subp, t);
+    ABTS_STR_EQUAL(tc, "X-Header-299", apr_table_get(c, "X-Header-299"));
+
+    apr_table_clear(t);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header-43"));
+    apr_table_setn(t, "X-Header-43", "back");
+    ABTS_STR_EQUAL(tc, "back", apr_table_get(t, "X-Header-43"));
+
+    apr_pool_destroy(subp);
+}
+
+static void table_compress_large(abts_case *tc, void *data)
+{
+    apr_pool_t *subp;
+    apr_table_t *t1, *t2;
+    const apr_array_header_t *arr;
+    apr_table_entry_t *elts;
+    char key[32];
+    int i;
+
+    apr_pool_create(&subp, p);
+    t1 = apr_table_make(subp, 1);
+    t2 = apr_table_make(subp, 1);
+
+    /* Large enough to be compressed with a hash rather than by sorting */
+    for (i = 0; i < 40; i++) {
+        apr_table_addn(t1, apr_psprintf(subp, "X-%d", i),
+                       apr_psprintf(subp, "a%d", i));
+        if (i % 3 == 0) {
+            apr_table_addn(t2, apr_psprintf(subp, "x-%d", i),
+                           apr_psprintf(subp, "b%d", i));
+        }
+    }
+    apr_table_addn(t2, "X-new", "c");
+    apr_table_addn(t2, "X-3", "c3");
+
+    apr_table_overlap(t1, t2, APR_OVERLAP_TABLES_MERGE);
+    arr = apr_table_elts(t1);
+    elts = (apr_table_entry_t *)arr->elts;
+    ABTS_INT_EQUAL(tc, 41, arr->nelts);
+    for (i = 0; i < 40; i++) {
+        apr_snprintf(key, sizeof(key), "X-%d", i);
+        ABTS_STR_EQUAL(tc, key, elts[i].key);
+    }
+    ABTS_STR_EQUAL(tc, "X-new", elts[40].key);
+    ABTS_STR_EQUAL(tc, "a0, b0", apr_table_get(t1, "X-0"));
+    ABTS_STR_EQUAL(tc, "a1", apr_table_get(t1, "X-1"));
+    ABTS_STR_EQUAL(tc, "a3, b3, c3", apr_table_get(t1, "X-3"));
+
+    apr_table_addn(t1, "X-1", "d1");
+    apr_table_addn(t1, "x-1", "e1");
+    apr_table_compress(t1, APR_OVERLAP_TABLES_SET);
+    ABTS_INT_EQUAL(tc, 41, apr_table_elts(t1)->nelts);
+    ABTS_STR_EQUAL(tc, "e1", apr_table_get(t1, "X-1"));
+    elts = (apr_table_entry_t *)apr_table_elts(t1)->elts;
+    ABTS_STR_EQUAL(tc, "X-1", elts[1].key);
+    ABTS_STR_EQUAL(tc, "X-new", elts[40].key);
+
+    apr_pool_destroy(subp);
+}
+
 abts_suite *testtable(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
 
     abts_run_test(suite, array_clear, NULL);
+    abts_run_test(suite, array_reserve, NULL);
+    abts_run_test(suite, array_copy_hdr_push, NULL);
+    abts_run_test(suite, array_sort, NULL);
+    abts_run_test(suite, array_sort_key, NULL);
+    abts_run_test(suite, array_bsearch_unique, NULL);
     abts_run_test(suite, table_make, NULL);
     abts_run_test(suite, table_get, NULL);
     abts_run_test(suite, table_getm, NULL);
@@ -215,6 +564,8 @@ abts_suite *testtable(abts_suite *suite)
     abts_run_test(suite, table_unset, NULL);
     abts_run_test(suite, table_overlap, NULL);
     abts_run_test(suite, table_overlap2, NULL);
+    abts_run_test(suite, table_large, NULL);
+    abts_run_test(suite, table_compress_large, NULL);
 
     return suite;
 }
@@ -0,0 +1,157 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Times apr_table_compress() and apr_table_overlap() on tables of various
+ * sizes, with and without duplicate keys.  apr_table_compress() switches
+ * from sorting the entries to hashing them at TABLE_COMPRESS_HASH_MIN
+ * entries (see tables/apr_tables.c): build APR with that macro set to 2,
+ * then to a huge value, to compare both methods at every size.
+ */
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_tables.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_ROUNDS 20000
+#define MAX_NELTS 1024
+#define BATCH 64
+
+static const int sizes[] = { 2, 4, 8, 12, 16, 24, 32, 64, 128, 256, 1024 };
+
+static long rounds = DEFAULT_ROUNDS;
+static const char *keys[MAX_NELTS];
+
+/* Fill t with n entries, one in dups of which repeats an earlier key */
+static void fill(apr_table_t *t, int n, int dups)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (dups && i && (i % dups) == 0) {
+            apr_table_addn(t, keys[i / 2], "dup");
+        }
+        else {
+            apr_table_addn(t, keys[i], "value");
+        }
+    }
+}
+
+/* Average time in nanoseconds of a call, timing batches of calls on
+ * tables filled beforehand
+ */
+static double run(apr_pool_t *pool, int n, int dups, int overlap)
+{
+    apr_table_t *a[BATCH], *b[BATCH];
+    apr_interval_time_t spent = 0;
+    long r;
+    int i;
+
+    for (r = 0; r < rounds; r += BATCH) {
+        apr_time_t start;
+
+        apr_pool_clear(pool);
+        for (i = 0; i < BATCH; i++) {
+            a[i] = apr_table_make(pool, n);
+            if (overlap) {
+                b[i] = apr_table_make(pool, n);
+                fill(a[i], n / 2, dups);
+                fill(b[i], n - n / 2, dups);
+            }
+            else {
+                fill(a[i], n, dups);
+            }
+        }
+
+        start = apr_time_now();
+        for (i = 0; i < BATCH; i++) {
+            if (overlap) {
+                apr_table_overlap(a[i], b[i], APR_OVERLAP_TABLES_MERGE);
+            }
+            else {
+                apr_table_compress(a[i], APR_OVERLAP_TABLES_MERGE);
+            }
+        }
+        spent += apr_time_now() - start;
+    }
+
+    return (double)spent * 1000.0 / (r ? r : 1);
+}
+
+static void bench(apr_pool_t *pool, const char *name, int overlap)
+{
+    unsigned int i;
+
+    printf("%s (ns per call, %ld rounds)\n", name, rounds);
+    printf("    %8s %12s %12s\n", "entries", "unique", "1/4 dups");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int n = sizes[i];
+        double unique = run(pool, n, 0, overlap);
+        double dups = run(pool, n, 4, overlap);
+
+        printf("    %8d %12.0f %12.0f\n", n, unique, dups);
+    }
+    printf("\n");
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool, *scratch;
+    apr_getopt_t *opt;
+    apr_status_t rv;
+    char optchar;
+    const char *optarg;
+    int i;
+
+    printf("APR Table Performance Test\n==========================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS
+        || apr_pool_create(&scratch, pool) != APR_SUCCESS) {
+        exit(-1);
+    }
+
+    if (apr_getopt_init(&opt, pool, argc, argv) != APR_SUCCESS) {
+        exit(-1);
+    }
+    while ((rv = apr_getopt(opt, "r:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'r') {
+            rounds = atol(optarg);
+        }
+    }
+    if ((rv != APR_SUCCESS && rv != APR_EOF) || rounds <= 0) {
+        fprintf(stderr, "Usage: %s [-r rounds]\n", argv[0]);
+        exit(-1);
+    }
+
+    /* Header like keys, sharing their first characters */
+    for (i = 0; i < MAX_NELTS; i++) {
+        keys[i] = apr_psprintf(pool, "X-Header-%d", i);
+    }
+
+    bench(scratch, "apr_table_compress()", 0);
+    bench(scratch, "apr_table_overlap()", 1);
+
+    apr_pool_destroy(pool);
+    return 0;
+}
@@ -0,0 +1,428 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_atomic.h"
+#include "apr_pools.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+#include "apr_timer_wheel.h"
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#define NUM_TIMERS 1000
+#define TICK apr_time_from_msec(1)
+
+typedef struct {
+    apr_timer_t *timer;
+    apr_time_t fired;           /* When expired, 0 if not */
+    int order;                  /* Of the callback, from 1 */
+    apr_interval_time_t period; /* To set the timer again, if not 0 */
+    apr_timer_t *cancel;        /* To cancel, if not NULL */
+} baton_t;
+
+/* The time of the current apr_timer_wheel_expire() call */
+static apr_time_t expire_now;
+static int expire_order;
+
+static void callback(apr_timer_t *timer, void *data)
+{
+    baton_t *b = data;
+
+    b->fired = expire_now;
+    b->order = ++expire_order;
+    if (b->cancel) {
+        apr_timer_cancel(b->cancel);
+    }
+    if (b->period) {
+        apr_timer_set(timer, apr_timer_expiry(timer) + b->period);
+    }
+}
+
+static unsigned int expire_at(apr_timer_wheel_t *tw, apr_time_t now)
+{
+    expire_now = now;
+    return apr_timer_wheel_expire(tw, now);
+}
+
+static baton_t *make_timer(apr_timer_wheel_t *tw, apr_pool_t *pool)
+{
+    baton_t *b = apr_pcalloc(pool, sizeof(*b));
+
+    apr_timer_create(&b->timer, tw, callback, b, pool);
+    return b;
+}
+
+static void timer_basic(abts_case *tc, void *data)
+{
+    apr_timer_wheel_t *tw;
+    baton_t *a, *b;
+    apr_time_t now;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_timer_wheel_create(&tw, 0, 0, p));
+    ABTS_PTR_EQUAL(tc, p, apr_timer_wheel_pool_get(tw));
+    now = apr_time_now();
+    expire_order = 0;
+
+    a = make_timer(tw, p);
+    b = make_timer(tw, p);
+    ABTS_INT_EQUAL(tc, 0, apr_timer_is_pending(a->timer));
+    ABTS_INT_EQUAL(tc, 0, apr_timer_cancel(a->timer));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_timer_wheel_count(tw));
+    ABTS_TRUE(tc, apr_timer_wheel_timeout(tw, now, -1) < 0);
+    ABTS_INT_EQUAL(tc, 1000, (int)apr_timer_wheel_timeout(tw, now, 1000));
+
+    apr_timer_set(a->timer, now + 10 * TICK);
+    apr_timer_set(b->timer, now + 20 * TICK);
+    ABTS_INT_EQUAL(tc, 1, apr_timer_is_pending(a->timer));
+    ABTS_TRUE(tc, apr_timer_expiry(a->timer) == now + 10 * TICK);
+    ABTS_INT_EQUAL(tc, 2, (int)apr_timer_wheel_count(tw));
+
+    /* Never early, at most a tick late */
+    ABTS_INT_EQUAL(tc, 0, expire_at(tw, now + 10 * TICK - 1));
+    ABTS_INT_EQUAL(tc, 1, expire_at(tw, now + 11 * TICK));
+    ABTS_TRUE(tc, a->fired == now + 11 * TICK);
+    ABTS_INT_EQUAL(tc, 0, apr_timer_is_pending(a->timer));
+    ABTS_INT_EQUAL(tc, 1, (int)apr_timer_wheel_count(tw));
+
+    /* Reschedule, later then sooner */
+    apr_timer_set(b->timer, now + 500 * TICK);
+    ABTS_INT_EQUAL(tc, 0, expire_at(tw, now + 100 * TICK));
+    apr_timer_set(b->timer, now + 200 * TICK);
+    ABTS_INT_EQUAL(tc, 1, (int)apr_timer_wheel_count(tw));
+    ABTS_INT_EQUAL(tc, 0, expire_at(tw, now + 199 * TICK));
+    ABTS_INT_EQUAL(tc, 1, expire_at(tw, now + 201 * TICK));
+    ABTS_TRUE(tc, b->fired == now + 201 * TICK);
+
+    /* Cancelled */
+    apr_timer_set(a->timer, now + 300 * TICK);
+    ABTS_INT_EQUAL(tc, 1, apr_timer_cancel(a->timer));
+    ABTS_INT_EQUAL(tc, 0, apr_timer_is_pending(a->timer));
+    ABTS_INT_EQUAL(tc, 0, expire_at(tw, now + 400 * TICK));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_timer_wheel_count(tw));
+
+    /* Set in the past, due at once */
+    apr_timer_set(a->timer, now);
+    ABTS_INT_EQUAL(tc, 1, expire_at(tw, now + 401 * TICK));
+    ABTS_INT_EQUAL(tc, 3, a->order);
+}
+
+static void timer_order(abts_case *tc, void *data)
+{
+    apr_timer_wheel_t *tw;
+    baton_t **timers = apr_palloc(p, NUM_TIMERS * sizeof(baton_t *));
+    int *deltas = apr_palloc(p, NUM_TIMERS * sizeof(int));
+    apr_time_t now, last, half;
+    int i, n, ok;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_timer_wheel_create(&tw, TICK, 0, p));
+    now = apr_time_now();
+    expire_order = 0;
+
+    /* Distinct ticks, some on each level, set in random order */
+    srand(23);
+    for (i = 0; i < NUM_TIMERS; i++) {
+        deltas[i] = (i + 1) * 1009;
+    }
+    for (i = NUM_TIMERS - 1; i > 0; i--) {
+        int j = rand() % (i + 1), d = deltas[i];
+        deltas[i] = deltas[j];
+        deltas[j] = d;
+    }
+    for (i = 0; i < NUM_TIMERS; i++) {
+        timers[i] = make_timer(tw, p);
+        apr_timer_set(timers[i]->timer, now + deltas[i] * TICK);
+    }
+
+    /* Half in small steps, checking none is early or more than a tick
+     * late; then the rest at once, which are run in order.
+     */
+    half = now + (NUM_TIMERS / 2) * 1009 * TICK;
+    for (last = now; ; last += 97 * TICK) {
+        expire_at(tw, last);
+        if (last > half + TICK) {
+            break;
+        }
+    }
+    ABTS_INT_EQUAL(tc, NUM_TIMERS / 2, expire_order);
+    for (i = 0, ok = 1; i < NUM_TIMERS; i++) {
+        apr_time_t when = apr_timer_expiry(timers[i]->timer);
+
+        if (timers[i]->fired) {
+            ok &= (timers[i]->fired >= when)
+                  && (timers[i]->fired < when + 98 * TICK);
+        }
+        else {
+            ok &= (when > last);
+        }
+    }
+    ABTS_TRUE(tc, ok);
+
+    n = expire_at(tw, now + (NUM_TIMERS + 1) * 1009 * TICK);
+    ABTS_INT_EQUAL(tc, NUM_TIMERS / 2, n);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_timer_wheel_count(tw));
+    for (i = 0, ok = 1; i < NUM_TIMERS; i++) {
+        ok &= (timers[i]->order == deltas[i] / 1009);
+    }
+    ABTS_TRUE(tc, ok);
+}
+
+/* Wait as told by apr_timer_wheel_timeout() until the timer fires */
+static void wait_for(abts_case *tc, apr_timer_wheel_t *tw, baton_t *b,
+                     apr_time_t now, apr_interval_time_t tick)
+{
+    apr_time_t when = apr_timer_expiry(b->timer);
+    int wakeups = 0;
+
+    b->fired = 0;
+    while (!b->fired && wakeups < 100) {
+        apr_interval_time_t timeout = apr_timer_wheel_timeout(tw, now, -1);
+
+        ABTS_TRUE(tc, timeout >= 0);
+        ABTS_TRUE(tc, now + timeout <= when + tick);
+        now += timeout;
+        expire_at(tw, now);
+        wakeups++;
+    }
+    ABTS_TRUE(tc, b->fired >= when);
+    ABTS_TRUE(tc, b->fired <= when + tick);
+    ABTS_TRUE(tc, wakeups < 100);
+}
+
+static void timer_far(abts_case *tc, void *data)
+{
+    apr_timer_wheel_t *tw;
+    apr_interval_time_t tick = apr_time_from_sec(1);
+    baton_t *a, *b;
+    apr_time_t now;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_timer_wheel_create(&tw, tick, 0, p));
+    now = apr_time_now();
+
+    a = make_timer(tw, p);
+    b = make_timer(tw, p);
+
+    /* Cascaded from each level */
+    apr_timer_set(a->timer, now + apr_time_from_sec(300));
+    wait_for(tc, tw, a, now, tick);
+    now = a->fired;
+    apr_timer_set(a->timer, now + apr_time_from_sec(20000));
+    wait_for(tc, tw, a, now, tick);
+    now = a->fired;
+    apr_timer_set(a->timer, now + apr_time_from_sec(3000000));
+    wait_for(tc, tw, a, now, tick);
+    now = a->fired;
+    apr_timer_set(a->timer, now + apr_time_from_sec(100000000));
+    wait_for(tc, tw, a, now, tick);
+    now = a->fired;
+
+    /* Further than the wheel */
+    apr_timer_set(a->timer, now + apr_time_from_sec(APR_INT64_C(10000000000)));
+    apr_timer_set(b->timer, now + apr_time_from_sec(APR_INT64_C(5000000000)));
+    now += apr_time_from_sec(APR_INT64_C(4999999999));
+    ABTS_INT_EQUAL(tc, 0, expire_at(tw, now));
+    ABTS_INT_EQUAL(tc, 2, (int)apr_timer_wheel_count(tw));
+    wait_for(tc, tw, a, now, tick);
+    ABTS_TRUE(tc, b->fired >= apr_timer_expiry(b->timer));
+    ABTS_TRUE(tc, b->fired <= apr_timer_expiry(b->timer) + tick);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_timer_wheel_count(tw));
+}
+
+static void timer_callbacks(abts_case *tc, void *data)
+{
+    apr_timer_wheel_t *tw;
+    baton_t *periodic, *a, *b;
+    apr_time_t now, t;
+    int n;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_timer_wheel_create(&tw, TICK, 0, p));
+    now = apr_time_now();
+    expire_order = 0;
+
+    /* Set again by its callback */
+    periodic = make_timer(tw, p);
+    periodic->period = 50 * TICK;
+    apr_timer_set(periodic->timer, now + 50 * TICK);
+    for (t = now, n = 0; t <= now + 995 * TICK; t += 10 * TICK) {
+        n += expire_at(tw, t);
+    }
+    ABTS_INT_EQUAL(tc, 19, n);
+    ABTS_INT_EQUAL(tc, 1, apr_timer_is_pending(periodic->timer));
+    apr_timer_cancel(periodic->timer);
+
+    /* Cancelling a timer expired in the same tick, not run yet */
+    a = make_timer(tw, p);
+    b = make_timer(tw, p);
+    apr_timer_set(a->timer, t + 10 * TICK);
+    apr_timer_set(b->timer, t + 10 * TICK);
+    a->cancel = b->timer;
+    b->cancel = a->timer;
+    ABTS_INT_EQUAL(tc, 1, expire_at(tw, t + 20 * TICK));
+    ABTS_TRUE(tc, !a->fired != !b->fired);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_timer_wheel_count(tw));
+}
+
+static void timer_timeout(abts_case *tc, void *data)
+{
+    apr_timer_wheel_t *tw;
+    baton_t *a;
+    apr_time_t now;
+    apr_interval_time_t timeout;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_timer_wheel_create(&tw, TICK, 0, p));
+    now = apr_time_now();
+    a = make_timer(tw, p);
+
+    apr_timer_set(a->timer, now + 100 * TICK);
+    timeout = apr_timer_wheel_timeout(tw, now, -1);
+    ABTS_TRUE(tc, timeout > 99 * TICK && timeout <= 101 * TICK);
+    ABTS_TRUE(tc, apr_timer_wheel_timeout(tw, now, 10 * TICK) == 10 * TICK);
+    ABTS_TRUE(tc, apr_timer_wheel_timeout(tw, now + 200 * TICK, -1) == 0);
+
+    /* A lower bound, close enough */
+    apr_timer_set(a->timer, now + 1000 * TICK);
+    timeout = apr_timer_wheel_timeout(tw, now, -1);
+    ABTS_TRUE(tc, timeout > 0 && timeout <= 1001 * TICK);
+    wait_for(tc, tw, a, now, TICK);
+}
+
+static void timer_pool_cleanup(abts_case *tc, void *data)
+{
+    apr_timer_wheel_t *tw;
+    apr_pool_t *sub;
+    baton_t *a;
+    apr_time_t now;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_timer_wheel_create(&tw, TICK, 0, p));
+    now = apr_time_now();
+
+    apr_pool_create(&sub, p);
+    a = make_timer(tw, sub);
+    apr_timer_set(a->timer, now + 10 * TICK);
+    ABTS_INT_EQUAL(tc, 1, (int)apr_timer_wheel_count(tw));
+    apr_pool_destroy(sub);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_timer_wheel_count(tw));
+    ABTS_INT_EQUAL(tc, 0, expire_at(tw, now + 20 * TICK));
+}
+
+#if APR_HAS_THREADS
+
+#define NUM_THREADS 4
+#define NUM_ROUNDS 10000
+
+typedef struct {
+    baton_t **timers;
+} thread_baton_t;
+
+static apr_uint32_t fired;
+
+static void count_callback(apr_timer_t *timer, void *data)
+{
+    apr_atomic_inc32(&fired);
+}
+
+static void *APR_THREAD_FUNC thread_func(apr_thread_t *thd, void *data)
+{
+    thread_baton_t *tb = data;
+    apr_time_t now = apr_time_now();
+    unsigned int seed = (unsigned int)(apr_uintptr_t)tb;
+    int i;
+
+    for (i = 0; i < NUM_ROUNDS; i++) {
+        apr_timer_t *timer;
+
+        seed = seed * 1103515245 + 12345;
+        timer = tb->timers[(seed >> 16) % NUM_TIMERS]->timer;
+        if ((seed >> 8) % 4) {
+            apr_timer_set(timer, now + ((seed >> 4) % 2000) * TICK);
+        }
+        else {
+            apr_timer_cancel(timer);
+        }
+    }
+    return NULL;
+}
+
+static void timer_threads(abts_case *tc, void *data)
+{
+    apr_timer_wheel_t *tw;
+    apr_thread_t *threads[NUM_THREADS];
+    thread_baton_t tbs[NUM_THREADS];
+    apr_time_t now;
+    apr_size_t count;
+    int i, j, n;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_timer_wheel_create(&tw, TICK,
+                                          APR_TIMER_WHEEL_THREADSAFE, p));
+    now = apr_time_now();
+    fired = 0;
+
+    /* Each thread its own timers, all expired here meanwhile */
+    for (i = 0; i < NUM_THREADS; i++) {
+        tbs[i].timers = apr_palloc(p, NUM_TIMERS * sizeof(baton_t *));
+        for (j = 0; j < NUM_TIMERS; j++) {
+            tbs[i].timers[j] = apr_pcalloc(p, sizeof(baton_t));
+            apr_timer_create(&tbs[i].timers[j]->timer, tw, count_callback,
+                             NULL, p);
+        }
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_thread_create(&threads[i], NULL, thread_func,
+                                         &tbs[i], p));
+    }
+    for (n = 0; n < 100; n++) {
+        apr_timer_wheel_expire(tw, now + n * 10 * TICK);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_status_t retval;
+        apr_thread_join(&retval, threads[i]);
+    }
+
+    count = apr_timer_wheel_count(tw);
+    for (i = 0, n = 0; i < NUM_THREADS; i++) {
+        for (j = 0; j < NUM_TIMERS; j++) {
+            n += apr_timer_is_pending(tbs[i].timers[j]->timer);
+        }
+    }
+    ABTS_INT_EQUAL(tc, n, (int)count);
+
+    fired = 0;
+    apr_timer_wheel_expire(tw, now + 3000 * TICK);
+    ABTS_INT_EQUAL(tc, n, (int)fired);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_timer_wheel_count(tw));
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testtimerwheel(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, timer_basic, NULL);
+    abts_run_test(suite, timer_order, NULL);
+    abts_run_test(suite, timer_far, NULL);
+    abts_run_test(suite, timer_callbacks, NULL);
+    abts_run_test(suite, timer_timeout, NULL);
+    abts_run_test(suite, timer_pool_cleanup, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, timer_threads, NULL);
+#endif
+
+    return suite;
+}
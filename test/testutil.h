@@ -131,5 +131,11 @@ abts_suite *testrmm(abts_suite *suite);
 abts_suite *testdbm(abts_suite *suite);
 abts_suite *testlfsabi(abts_suite *suite);
 abts_suite *testskiplist(abts_suite *suite);
+abts_suite *testslab(abts_suite *suite);
+abts_suite *testohash(abts_suite *suite);
+abts_suite *testchash(abts_suite *suite);
+abts_suite *testbtree(abts_suite *suite);
+abts_suite *testtimerwheel(abts_suite *suite);
+abts_suite *testbloom(abts_suite *suite);
 
 #endif /* APR_TEST_INCLUDES */
@@ -21,6 +21,7 @@
 #include "apr_ring.h"
 #include "apr_thread_cond.h"
 #include "apr_portable.h"
+#include "apr_slab.h"
 
 #if APR_HAS_THREADS
 
@@ -74,7 +75,7 @@ struct apr_thread_pool
     apr_thread_mutex_t *lock;
     apr_thread_cond_t *cond;
     volatile int terminated;
-    struct apr_thread_pool_tasks *recycled_tasks;
+    apr_slab_t *task_slab;
     struct apr_thread_list *recycled_thds;
     apr_thread_pool_task_t *task_idx[TASK_PRIORITY_SEGS];
 };
@@ -109,11 +110,12 @@ static apr_status_t thread_pool_construct(apr_thread_pool_t * me,
         goto CATCH_ENOMEM;
     }
     APR_RING_INIT(me->scheduled_tasks, apr_thread_pool_task, link);
-    me->recycled_tasks = apr_palloc(me->pool, sizeof(*me->recycled_tasks));
-    if (!me->recycled_tasks) {
+    /* Tasks are allocated and freed with the lock held */
+    rv = apr_slab_create(&me->task_slab, sizeof(apr_thread_pool_task_t), 0,
+                         me->pool);
+    if (APR_SUCCESS != rv) {
         goto CATCH_ENOMEM;
     }
-    APR_RING_INIT(me->recycled_tasks, apr_thread_pool_task, link);
     me->busy_thds = apr_palloc(me->pool, sizeof(*me->busy_thds));
     if (!me->busy_thds) {
         goto CATCH_ENOMEM;
@@ -267,8 +269,7 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
             task->func(t, task->param);
             apr_thread_mutex_lock(me->lock);
             apr_pool_owner_set(me->pool, 0);
-            APR_RING_INSERT_TAIL(me->recycled_tasks, task,
-                                 apr_thread_pool_task, link);
+            apr_slab_free(me->task_slab, task);
             elt->current_owner = NULL;
             if (TH_STOP == elt->state) {
                 break;
@@ -410,15 +411,9 @@ static apr_thread_pool_task_t *task_new(apr_thread_pool_t * me,
 {
     apr_thread_pool_task_t *t;
 
-    if (APR_RING_EMPTY(me->recycled_tasks, apr_thread_pool_task, link)) {
-        t = apr_pcalloc(me->pool, sizeof(*t));
-        if (NULL == t) {
-            return NULL;
-        }
-    }
-    else {
-        t = APR_RING_FIRST(me->recycled_tasks);
-        APR_RING_REMOVE(t, link);
+    t = apr_slab_alloc(me->task_slab);
+    if (NULL == t) {
+        return NULL;
     }
 
     APR_RING_ELEM_INIT(t, link);
@@ -628,6 +623,7 @@ static apr_status_t remove_scheduled_tasks(apr_thread_pool_t *me,
         if (t_loc->owner == owner) {
             --me->scheduled_task_cnt;
             APR_RING_REMOVE(t_loc, link);
+            apr_slab_free(me->task_slab, t_loc);
         }
         t_loc = next;
     }
@@ -656,6 +652,7 @@ static apr_status_t remove_tasks(apr_thread_pool_t *me, void *owner)
                 }
             }
             APR_RING_REMOVE(t_loc, link);
+            apr_slab_free(me->task_slab, t_loc);
         }
         t_loc = next;
     }
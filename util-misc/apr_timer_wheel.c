@@ -0,0 +1,514 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_ring.h"
+#include "apr_thread_mutex.h"
+
+#include "apr_timer_wheel.h"
+
+/*
+ * The wheel has LEVELS levels of slots, each slot a ring of timers.  The
+ * 256 slots of level 0 are one tick each, the 64 slots of level 1 are 256
+ * ticks each, those of level 2 are 64 times longer, and so on.  A timer
+ * due in fewer than 256 ticks from the current one is in the slot of
+ * level 0 of its tick, otherwise in the slot of the lowest level spanning
+ * its tick (as the current one, modulo the level's range).
+ *
+ * Each time the current tick crosses the boundary of a slot of level 1
+ * (every 256 ticks), the timers of that slot are moved down to the slots
+ * of level 0 (cascaded), and so on for the higher levels.  Then the timers
+ * of the slot of level 0 of the tick are expired.  Each timer is thus
+ * moved at most LEVELS - 1 times, and usually not at all when it is
+ * rescheduled before it gets close to expiry.
+ *
+ * A bitmap per level tells which slots are not empty, so that the empty
+ * ones are skipped when expiring, and the next tick when something will
+ * happen is found in a few bit operations.
+ */
+
+#define LEVELS          5
+#define LEVEL0_BITS     8
+#define LEVEL0_SIZE     (1 << LEVEL0_BITS)
+#define LEVEL0_MASK     (LEVEL0_SIZE - 1)
+#define LEVEL_BITS      6
+#define LEVEL_SIZE      (1 << LEVEL_BITS)
+#define LEVEL_MASK      (LEVEL_SIZE - 1)
+
+/* The shift of the ticks of a slot of level l > 0 */
+#define LEVEL_SHIFT(l)  (LEVEL0_BITS + ((l) - 1) * LEVEL_BITS)
+
+/* The furthest a timer can be on the wheel */
+#define MAX_DELTA       ((APR_UINT64_C(1) << LEVEL_SHIFT(LEVELS)) - 1)
+
+#define DEFAULT_TICK    1000    /* one millisecond */
+
+#define EXPIRING        LEVELS  /* The level of the expired timers */
+
+APR_RING_HEAD(timer_ring_t, apr_timer_t);
+typedef struct timer_ring_t timer_ring_t;
+
+struct apr_timer_t {
+    APR_RING_ENTRY(apr_timer_t) link;
+    apr_timer_wheel_t *tw;
+    apr_timer_callback_t *callback;
+    void *baton;
+    apr_time_t when;
+    apr_uint64_t expires;       /* The tick */
+    unsigned int level;
+    unsigned int slot;
+    int pending;
+};
+
+struct apr_timer_wheel_t {
+    apr_pool_t *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    apr_time_t base;            /* The time of tick 0 */
+    apr_interval_time_t tick;
+    apr_uint64_t now;           /* The next tick to expire */
+    apr_size_t count;           /* On the wheel */
+    apr_size_t nexpired;        /* Expired, callback not run yet */
+    apr_uint64_t bits0[LEVEL0_SIZE / 64];
+    apr_uint64_t bits[LEVELS];  /* bits[0] unused */
+    timer_ring_t level0[LEVEL0_SIZE];
+    timer_ring_t levels[LEVELS][LEVEL_SIZE]; /* levels[0] unused */
+    timer_ring_t expired;
+    timer_ring_t cascading;     /* Empty but while cascade() runs */
+};
+
+#if APR_HAS_THREADS
+#define WHEEL_LOCK(tw) \
+    if ((tw)->mutex) apr_thread_mutex_lock((tw)->mutex)
+#define WHEEL_UNLOCK(tw) \
+    if ((tw)->mutex) apr_thread_mutex_unlock((tw)->mutex)
+#else
+#define WHEEL_LOCK(tw)
+#define WHEEL_UNLOCK(tw)
+#endif
+
+/* Lowest bit set in a (non-zero) bitmap */
+static APR_INLINE unsigned int bit_lowest(apr_uint64_t bits)
+{
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+    return (unsigned int)__builtin_ctzll(bits);
+#else
+    unsigned int n = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* The first slot of level 0 at or after from not empty, or LEVEL0_SIZE */
+static unsigned int level0_next(const apr_timer_wheel_t *tw, unsigned int from)
+{
+    unsigned int i = from / 64;
+    apr_uint64_t bits;
+
+    if (from >= LEVEL0_SIZE) {
+        return LEVEL0_SIZE;
+    }
+    bits = tw->bits0[i] & (~APR_UINT64_C(0) << (from % 64));
+
+    for (;;) {
+        if (bits) {
+            return i * 64 + bit_lowest(bits);
+        }
+        if (++i == LEVEL0_SIZE / 64) {
+            return LEVEL0_SIZE;
+        }
+        bits = tw->bits0[i];
+    }
+}
+
+static void timer_link(apr_timer_wheel_t *tw, apr_timer_t *t)
+{
+    apr_uint64_t expires = t->expires, delta;
+    timer_ring_t *ring;
+    unsigned int l;
+
+    if (expires < tw->now) {
+        expires = tw->now;
+    }
+    delta = expires - tw->now;
+
+    if (delta < LEVEL0_SIZE) {
+        t->level = 0;
+        t->slot = (unsigned int)(expires & LEVEL0_MASK);
+        tw->bits0[t->slot / 64] |= APR_UINT64_C(1) << (t->slot % 64);
+        ring = &tw->level0[t->slot];
+    }
+    else {
+        if (delta > MAX_DELTA) {
+            /* Too far, this slot will bring it back here */
+            expires = tw->now + MAX_DELTA;
+            delta = MAX_DELTA;
+        }
+        for (l = 1; delta >> LEVEL_SHIFT(l + 1); l++)
+            ;
+        t->level = l;
+        t->slot = (unsigned int)(expires >> LEVEL_SHIFT(l)) & LEVEL_MASK;
+        tw->bits[l] |= APR_UINT64_C(1) << t->slot;
+        ring = &tw->levels[l][t->slot];
+    }
+
+    APR_RING_INSERT_TAIL(ring, t, apr_timer_t, link);
+}
+
+static void timer_unlink(apr_timer_wheel_t *tw, apr_timer_t *t)
+{
+    APR_RING_REMOVE(t, link);
+
+    if (t->level == 0) {
+        if (APR_RING_EMPTY(&tw->level0[t->slot], apr_timer_t, link)) {
+            tw->bits0[t->slot / 64] &= ~(APR_UINT64_C(1) << (t->slot % 64));
+        }
+    }
+    else if (t->level < LEVELS) {
+        if (APR_RING_EMPTY(&tw->levels[t->level][t->slot], apr_timer_t,
+                           link)) {
+            tw->bits[t->level] &= ~(APR_UINT64_C(1) << t->slot);
+        }
+    }
+}
+
+/* Move the timers of the slot of level l of the current tick down */
+static void cascade(apr_timer_wheel_t *tw, unsigned int l)
+{
+    unsigned int slot = (unsigned int)(tw->now >> LEVEL_SHIFT(l)) & LEVEL_MASK;
+    timer_ring_t *ring = &tw->levels[l][slot];
+    timer_ring_t *moving = &tw->cascading;
+
+    if (!(tw->bits[l] & (APR_UINT64_C(1) << slot))) {
+        return;
+    }
+    tw->bits[l] &= ~(APR_UINT64_C(1) << slot);
+
+    APR_RING_CONCAT(moving, ring, apr_timer_t, link);
+    while (!APR_RING_EMPTY(moving, apr_timer_t, link)) {
+        apr_timer_t *t = APR_RING_FIRST(moving);
+
+        APR_RING_REMOVE(t, link);
+        timer_link(tw, t);
+    }
+}
+
+/* Take a pending timer off the wheel, or the expired ones */
+static void timer_remove(apr_timer_wheel_t *tw, apr_timer_t *t)
+{
+    timer_unlink(tw, t);
+    if (t->level == EXPIRING) {
+        tw->nexpired--;
+    }
+    else {
+        tw->count--;
+    }
+    t->pending = 0;
+}
+
+static apr_uint64_t time_to_tick(const apr_timer_wheel_t *tw, apr_time_t when,
+                                 int round_up)
+{
+    apr_time_t elapsed = when - tw->base;
+
+    if (elapsed <= 0) {
+        return 0;
+    }
+    if (round_up) {
+        elapsed += tw->tick - 1;
+    }
+    return (apr_uint64_t)(elapsed / tw->tick);
+}
+
+/* Move the timers expired up to the given tick to tw->expired */
+static void advance(apr_timer_wheel_t *tw, apr_uint64_t last)
+{
+    while (tw->now <= last) {
+        unsigned int slot = (unsigned int)(tw->now & LEVEL0_MASK);
+        apr_uint64_t next;
+        unsigned int l;
+
+        if (!tw->count) {
+            tw->now = last + 1;
+            break;
+        }
+
+        if (slot == 0) {
+            for (l = 1; l < LEVELS; l++) {
+                cascade(tw, l);
+                if ((tw->now >> LEVEL_SHIFT(l)) & LEVEL_MASK) {
+                    break;
+                }
+            }
+        }
+
+        if (tw->bits0[slot / 64] & (APR_UINT64_C(1) << (slot % 64))) {
+            timer_ring_t *ring = &tw->level0[slot];
+            apr_timer_t *t;
+
+            for (t = APR_RING_FIRST(ring); t != APR_RING_SENTINEL(ring,
+                                                                 apr_timer_t,
+                                                                 link);
+                 t = APR_RING_NEXT(t, link)) {
+                t->level = EXPIRING;
+                tw->count--;
+                tw->nexpired++;
+            }
+            APR_RING_CONCAT(&tw->expired, ring, apr_timer_t, link);
+            tw->bits0[slot / 64] &= ~(APR_UINT64_C(1) << (slot % 64));
+        }
+
+        /* Skip to the next slot not empty, or the next cascade */
+        slot = level0_next(tw, slot + 1);
+        next = (tw->now & ~(apr_uint64_t)LEVEL0_MASK) + slot;
+        tw->now = (next <= last) ? next : last + 1;
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_timer_wheel_create(apr_timer_wheel_t **ptw,
+                                                 apr_interval_time_t tick,
+                                                 apr_uint32_t flags,
+                                                 apr_pool_t *pool)
+{
+    apr_timer_wheel_t *tw;
+    unsigned int i, l;
+
+    *ptw = NULL;
+
+#if !APR_HAS_THREADS
+    if (flags & APR_TIMER_WHEEL_THREADSAFE) {
+        return APR_ENOTIMPL;
+    }
+#endif
+
+    tw = apr_pcalloc(pool, sizeof(*tw));
+    tw->pool = pool;
+    tw->tick = (tick > 0) ? tick : DEFAULT_TICK;
+    tw->base = apr_time_now();
+
+#if APR_HAS_THREADS
+    if (flags & APR_TIMER_WHEEL_THREADSAFE) {
+        apr_status_t rv = apr_thread_mutex_create(&tw->mutex,
+                                                  APR_THREAD_MUTEX_DEFAULT,
+                                                  pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+#endif
+
+    for (i = 0; i < LEVEL0_SIZE; i++) {
+        APR_RING_INIT(&tw->level0[i], apr_timer_t, link);
+    }
+    for (l = 1; l < LEVELS; l++) {
+        for (i = 0; i < LEVEL_SIZE; i++) {
+            APR_RING_INIT(&tw->levels[l][i], apr_timer_t, link);
+        }
+    }
+    APR_RING_INIT(&tw->expired, apr_timer_t, link);
+    APR_RING_INIT(&tw->cascading, apr_timer_t, link);
+
+    *ptw = tw;
+    return APR_SUCCESS;
+}
+
+static apr_status_t timer_cleanup(void *data)
+{
+    apr_timer_cancel(data);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_timer_create(apr_timer_t **timer,
+                                           apr_timer_wheel_t *tw,
+                                           apr_timer_callback_t *callback,
+                                           void *baton, apr_pool_t *pool)
+{
+    apr_timer_t *t = apr_pcalloc(pool, sizeof(*t));
+
+    APR_RING_ELEM_INIT(t, link);
+    t->tw = tw;
+    t->callback = callback;
+    t->baton = baton;
+
+    /* Don't leave it on the wheel */
+    apr_pool_cleanup_register(pool, t, timer_cleanup,
+                              apr_pool_cleanup_null);
+
+    *timer = t;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_timer_set(apr_timer_t *t, apr_time_t when)
+{
+    apr_timer_wheel_t *tw = t->tw;
+
+    WHEEL_LOCK(tw);
+    if (t->pending) {
+        timer_remove(tw, t);
+    }
+    t->when = when;
+    t->expires = time_to_tick(tw, when, 1);
+    t->pending = 1;
+    timer_link(tw, t);
+    tw->count++;
+    WHEEL_UNLOCK(tw);
+}
+
+APR_DECLARE(int) apr_timer_cancel(apr_timer_t *t)
+{
+    apr_timer_wheel_t *tw = t->tw;
+    int pending;
+
+    WHEEL_LOCK(tw);
+    pending = t->pending;
+    if (pending) {
+        timer_remove(tw, t);
+    }
+    WHEEL_UNLOCK(tw);
+
+    return pending;
+}
+
+APR_DECLARE(int) apr_timer_is_pending(apr_timer_t *t)
+{
+    apr_timer_wheel_t *tw = t->tw;
+    int pending;
+
+    WHEEL_LOCK(tw);
+    pending = t->pending;
+    WHEEL_UNLOCK(tw);
+
+    return pending;
+}
+
+APR_DECLARE(apr_time_t) apr_timer_expiry(apr_timer_t *t)
+{
+    return t->when;
+}
+
+APR_DECLARE(unsigned int) apr_timer_wheel_expire(apr_timer_wheel_t *tw,
+                                                 apr_time_t now)
+{
+    unsigned int n = 0;
+
+    WHEEL_LOCK(tw);
+    if (now >= tw->base) {
+        advance(tw, time_to_tick(tw, now, 0));
+    }
+
+    /* One at a time, since the callbacks may set or cancel the others */
+    while (!APR_RING_EMPTY(&tw->expired, apr_timer_t, link)) {
+        apr_timer_t *t = APR_RING_FIRST(&tw->expired);
+
+        APR_RING_REMOVE(t, link);
+        t->pending = 0;
+        tw->nexpired--;
+        WHEEL_UNLOCK(tw);
+
+        t->callback(t, t->baton);
+        n++;
+
+        WHEEL_LOCK(tw);
+    }
+    WHEEL_UNLOCK(tw);
+
+    return n;
+}
+
+APR_DECLARE(apr_interval_time_t) apr_timer_wheel_timeout(
+                                        apr_timer_wheel_t *tw,
+                                        apr_time_t now,
+                                        apr_interval_time_t max)
+{
+    apr_uint64_t next, cur;
+    apr_time_t deadline;
+    unsigned int slot, l;
+
+    WHEEL_LOCK(tw);
+    if (tw->nexpired) {
+        WHEEL_UNLOCK(tw);
+        return 0;
+    }
+    if (!tw->count) {
+        WHEEL_UNLOCK(tw);
+        return max;
+    }
+
+    /* Due in this round of level 0, that's exact */
+    slot = level0_next(tw, (unsigned int)(tw->now & LEVEL0_MASK));
+    if (slot < LEVEL0_SIZE) {
+        next = (tw->now & ~(apr_uint64_t)LEVEL0_MASK) + slot;
+    }
+    else {
+        /* Otherwise due in the next round of level 0, or cascaded at
+         * the start of a slot of some level, whichever comes first.
+         */
+        next = (tw->now | LEVEL0_MASK) + 1;
+        slot = level0_next(tw, 0);
+        if (slot < LEVEL0_SIZE) {
+            next += slot;
+        }
+        else {
+            next = ~(apr_uint64_t)0;
+        }
+        for (l = 1; l < LEVELS; l++) {
+            if (tw->bits[l]) {
+                unsigned int shift = LEVEL_SHIFT(l), from, d;
+                apr_uint64_t rotated, candidate;
+
+                /* The slots after the current one, circularly */
+                cur = tw->now >> shift;
+                from = (unsigned int)(cur + 1) & LEVEL_MASK;
+                rotated = (tw->bits[l] >> from)
+                          | (from ? tw->bits[l] << (LEVEL_SIZE - from) : 0);
+                d = bit_lowest(rotated) + 1;
+                candidate = (cur + d) << shift;
+                if (candidate < next) {
+                    next = candidate;
+                }
+            }
+        }
+    }
+    deadline = tw->base + (apr_time_t)next * tw->tick;
+    WHEEL_UNLOCK(tw);
+
+    if (deadline <= now) {
+        return 0;
+    }
+    if (max >= 0 && deadline - now > max) {
+        return max;
+    }
+    return deadline - now;
+}
+
+APR_DECLARE(apr_size_t) apr_timer_wheel_count(apr_timer_wheel_t *tw)
+{
+    apr_size_t count;
+
+    WHEEL_LOCK(tw);
+    count = tw->count + tw->nexpired;
+    WHEEL_UNLOCK(tw);
+
+    return count;
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(timer_wheel)